@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# parse the synthetic dump (sample.txt) from a pipe in one thread, mapped in several threads, and split into pages, the records have to match
+
+set -e
+
+READER=$(pwd)/reader
+SAMPLE=$(pwd)/sample.txt
+TMP=$(mktemp -d)
+
+trap 'rm -rf "${TMP}"' EXIT
+
+mkdir "${TMP}/pipe" "${TMP}/mmap" "${TMP}/pages" "${TMP}/pages/dump"
+
+(cd "${TMP}/pipe" && "${READER}" -h 100000 -t 1 < "${SAMPLE}")
+(cd "${TMP}/mmap" && "${READER}" -h 100000 -t 4 "${SAMPLE}")
+(cd "${TMP}/pages" && split -l 500 "${SAMPLE}" dump/page- && "${READER}" -h 100000 dump/page-*)
+
+cmp "${TMP}/pipe/factored.bits" "${TMP}/mmap/factored.bits"
+cmp "${TMP}/pipe/lltested.bits" "${TMP}/mmap/lltested.bits"
+cmp "${TMP}/pipe/status.bin" "${TMP}/mmap/status.bin"
+
+for f in factored.bits lltested.bits status.bin; do
+	cmp "${TMP}/pipe/${f}" "${TMP}/pages/${f}"
+done
+
+echo "OK"
@@ -3,13 +3,29 @@
 START=2
 STOP=268435456
 STEP=1000
+DUMP=${DUMP:-dump}
+# the pages downloaded less than MAX_AGE minutes ago are kept, 0 downloads all of them again
+MAX_AGE=${MAX_AGE:-0}
+# OFFLINE=1 only imports the dump as it is
+OFFLINE=${OFFLINE:-0}
 
 set -e
 
-for ((i=$START;i<=$STOP-$STEP;i+=$STEP)); do
-	EXP_LO=$i
-	EXP_HI=$(($i+$STEP))
-	echo "Iteration ${EXP_LO} ${EXP_HI}..."
-	URL="http://www.mersenne.org/report_exponent/?exp_lo=${EXP_LO}&exp_hi=${EXP_HI}&text=1"
-	wget "${URL}" -q -O - | hxnormalize -ex -i0 | hxselect -c 'div#text_output' | ./reader
-done
+mkdir -p "${DUMP}"
+
+# download the pages again, the status changes between the runs
+if [ "${OFFLINE}" = 0 ]; then
+	for ((i=$START;i<=$STOP-$STEP;i+=$STEP)); do
+		EXP_LO=$i
+		EXP_HI=$(($i+$STEP))
+		PAGE="${DUMP}/${EXP_LO}.txt"
+		[ -s "${PAGE}" ] && [ -n "$(find "${PAGE}" -mmin -"${MAX_AGE}")" ] && continue
+		echo "Iteration ${EXP_LO} ${EXP_HI}..."
+		URL="http://www.mersenne.org/report_exponent/?exp_lo=${EXP_LO}&exp_hi=${EXP_HI}&text=1"
+		wget "${URL}" -q -O - | hxnormalize -ex -i0 | hxselect -c 'div#text_output' > "${PAGE}.tmp"
+		mv "${PAGE}.tmp" "${PAGE}"
+	done
+fi
+
+# import the whole dump, the records are only updated in place
+find "${DUMP}" -name '*.txt' -print0 | xargs -0 ./reader
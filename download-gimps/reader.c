@@ -7,149 +7,435 @@
 #include <string.h>
 #include <strings.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <libmp.h>
+#include <record.h>
+#include <status.h>
+
+// the whole input, mapped or read into memory
+struct input {
+	const char *path;
+	char *data;
+	size_t size;
+	int mapped;
+};
+
+struct stats {
+	size_t records;
+	size_t prime;
+	size_t factored;
+	size_t unfactored;
+	size_t pm1;
+	size_t ll;
+	size_t errors;
+	// changes of the records and of the status
+	size_t new_factored;
+	size_t new_lltested;
+	size_t new_tf;
+	size_t new_pm1;
+};
+
+// a part of the input starting at a record boundary
+struct job {
+	const char *path; // of the input
+	const char *base; // beginning of the input
+	const char *begin, *end;
+	struct mp_record *factored_record;
+	struct mp_record *lltested_record;
+	struct mp_status *status;
+	int exponent_limit;
+	struct stats stats;
+	pthread_t thread;
+};
 
 static
-void set_bit(char *ptr, int i)
+int is_space(char c)
 {
-	ptr[i/8] |= 1 << i%8;
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
 }
 
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
+// the next whitespace-delimited token, 0 at the end
+static
+int next_token(const char **ptr, const char *end, const char **token, size_t *len)
 {
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
+	const char *p = *ptr;
+
+	while( p < end && is_space(*p) )
+		p++;
+
+	if( p == end )
 	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
-		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
-		}
+		*ptr = p;
+		return 0;
+	}
 
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
+	*token = p;
+
+	while( p < end && !is_space(*p) )
+		p++;
 
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+	*len = (size_t)(p - *token);
+	*ptr = p;
 
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+	return 1;
+}
+
+static
+int match(const char *token, size_t len, const char *word)
+{
+	return strlen(word) == len && 0 == memcmp(token, word, len);
+}
+
+static
+int parse_int(const char *token, size_t len, int64_t *x)
+{
+	int64_t r = 0;
+
+	if( 0 == len || len > 18 )
+		return 0;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		if( token[i] < '0' || token[i] > '9' )
+			return 0;
+
+		r = 10 * r + (token[i] - '0');
 	}
-	else
+
+	*x = r;
+
+	return 1;
+}
+
+// "B1=4356913107423,B2=348553048593840", B2 may be missing
+static
+int parse_bounds(const char *token, size_t len, int64_t *B1, int64_t *B2)
+{
+	const char *comma = memchr(token, ',', len);
+	size_t len1 = comma ? (size_t)(comma - token) : len;
+
+	*B2 = 0;
+
+	if( len1 < 3 || memcmp(token, "B1=", 3) || !parse_int(token + 3, len1 - 3, B1) )
+		return 0;
+
+	if( comma )
 	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
+		size_t len2 = len - len1 - 1;
 
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
+		if( len2 < 3 || memcmp(comma + 1, "B2=", 3) || !parse_int(comma + 4, len2 - 3, B2) )
+			return 0;
+	}
+
+	return 1;
+}
+
+static
+int is_status(const char *token, size_t len)
+{
+	return match(token, len, "Prime") || match(token, len, "Factored") || match(token, len, "Unfactored")
+		|| match(token, len, "PM1") || match(token, len, "LL");
+}
+
+// the beginning of the first record (or header) at or after ptr, end if there is none
+static
+const char *record_start(const char *ptr, const char *begin, const char *end)
+{
+	// do not start in the middle of a token
+	while( ptr > begin && ptr < end && !is_space(ptr[-1]) )
+		ptr++;
+
+	const char *prev = NULL;
+	size_t prev_len = 0;
+	const char *token;
+	size_t len;
+	int64_t x;
+
+	while( next_token(&ptr, end, &token, &len) )
+	{
+		if( match(token, len, "Exponent") )
+			return token;
+
+		// the exponent followed by its status
+		if( prev && is_status(token, len) && parse_int(prev, prev_len, &x) )
+			return prev;
+
+		prev = token;
+		prev_len = len;
+	}
+
+	return end;
+}
+
+// parse the records in [begin; end), the only output are the bits and the statistics
+void *parse_job(void *arg)
+{
+	struct job *job = arg;
+	struct stats *stats = &job->stats;
+	const char *ptr = job->begin;
+	const char *end = job->end;
+	const char *token;
+	size_t len;
+
+	while( next_token(&ptr, end, &token, &len) )
+	{
+		int64_t exp;
+		const char *record = token;
+
+		// "# ..." up to the end of the line, a comment of the local files
+		if( '#' == *token )
 		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
+			const char *eol = memchr(ptr, '\n', (size_t)(end - ptr));
+
+			ptr = eol ? eol : end;
+			continue;
 		}
 
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
+		if( match(token, len, "Exponent") )
 		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
+			// "Exponent Status Data"
+			if( next_token(&ptr, end, &token, &len) && match(token, len, "Status")
+			 && next_token(&ptr, end, &token, &len) && match(token, len, "Data") )
+				continue;
 		}
-		if( *p_exponent_limit > detected_exponent_limit )
+		else if( parse_int(token, len, &exp) && next_token(&ptr, end, &token, &len) )
 		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
+			int valid = exp < job->exponent_limit;
+
+			if( match(token, len, "Prime") )
+			{
+				stats->records++;
+				stats->prime++;
+				continue;
+			}
+
+			if( match(token, len, "Factored") && next_token(&ptr, end, &token, &len) )
+			{
+				// only the changed bits are written
+				if( valid && !mp_record_get_bit(job->factored_record, (int)exp) && !mp_record_set_bit(job->factored_record, (int)exp) )
+					stats->new_factored++;
+				stats->records++;
+				stats->factored++;
+				continue;
+			}
+
+			// "2^63"
+			if( match(token, len, "Unfactored") && next_token(&ptr, end, &token, &len) )
+			{
+				int64_t bits;
+				if( valid && len > 2 && 0 == memcmp(token, "2^", 2) && parse_int(token + 2, len - 2, &bits) )
+					stats->new_tf += (size_t)mp_status_set_tf(job->status, (int)exp, (int)bits);
+				stats->records++;
+				stats->unfactored++;
+				continue;
+			}
+
+			// "B1=4356913107423,B2=348553048593840"
+			if( match(token, len, "PM1") && next_token(&ptr, end, &token, &len) )
+			{
+				int64_t B1, B2;
+				if( valid && parse_bounds(token, len, &B1, &B2) )
+					stats->new_pm1 += (size_t)mp_status_set_pm1(job->status, (int)exp, (uint64_t)B1, (uint64_t)B2);
+				stats->records++;
+				stats->pm1++;
+				continue;
+			}
+
+			// "Verified (Factored);2011-10-03;name;12ACD05A4339E0__", the date and the name may be empty
+			if( match(token, len, "LL") )
+			{
+				const char *state_end = memchr(ptr, ';', (size_t)(end - ptr));
+				const char *date_end = state_end ? memchr(state_end + 1, ';', (size_t)(end - state_end - 1)) : NULL;
+				const char *name_end = date_end ? memchr(date_end + 1, ';', (size_t)(end - date_end - 1)) : NULL;
+
+				ptr = name_end ? name_end + 1 : end;
+
+				// the residue
+				if( name_end && ptr < end && !is_space(*ptr) && next_token(&ptr, end, &token, &len) )
+				{
+					if( valid && !mp_record_get_bit(job->lltested_record, (int)exp) && !mp_record_set_bit(job->lltested_record, (int)exp) )
+						stats->new_lltested++;
+					stats->records++;
+					stats->ll++;
+					continue;
+				}
+			}
 		}
 
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
+		// skip to the next record
+		if( stats->errors++ < 10 )
 		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
+			message(WARN "Unable to parse the record at offset %zu of '%s' :(\n", (size_t)(record - job->base), job->path ? job->path : "stdin");
+		}
+
+		ptr = record_start(ptr, job->begin, end);
+	}
+
+	return NULL;
+}
+
+static
+int input_open(struct input *input, const char *path)
+{
+	input->path = path;
+	input->data = NULL;
+	input->size = 0;
+	input->mapped = 0;
+
+	int fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+	struct stat st;
+
+	if( -1 == fd || -1 == fstat(fd, &st) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to open the input '%s' :( Error: %s\n", path ? path : "stdin", strerror(errsv));
+		if( -1 != fd )
+			close(fd);
+		return -1;
+	}
+
+	// regular files are mapped
+	if( S_ISREG(st.st_mode) && st.st_size > 0 )
+	{
+		void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if( MAP_FAILED != addr )
+		{
+			input->data = addr;
+			input->size = (size_t)st.st_size;
+			input->mapped = 1;
+
+			if( path )
+				close(fd);
+
+			return 0;
 		}
+	}
+
+	// pipes are read in large chunks
+	size_t capacity = 0;
+
+	for(;;)
+	{
+		if( input->size == capacity )
+		{
+			capacity = capacity ? 2 * capacity : (size_t)16 << 20;
+
+			char *data = realloc(input->data, capacity);
+
+			if( NULL == data )
+			{
+				message(ERR "Unable to allocate memory :( %zu bytes requested.\n", capacity);
+				free(input->data);
+				input->data = NULL;
+				if( path )
+					close(fd);
+				return -1;
+			}
+
+			input->data = data;
+		}
+
+		ssize_t r = read(fd, input->data + input->size, capacity - input->size);
 
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+		if( r < 0 && EINTR == errno )
+			continue;
 
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
+		if( r < 0 )
 		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
+			int errsv = errno;
+			message(ERR "Unable to read the input :( Error: %s\n", strerror(errsv));
+			free(input->data);
+			input->data = NULL;
+			if( path )
+				close(fd);
+			return -1;
 		}
 
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+		if( 0 == r )
+			break;
 
-		fclose(record_file);
+		input->size += (size_t)r;
 	}
 
-	return record;
+	if( path )
+		close(fd);
+
+	return 0;
 }
 
-// save the record
-void record_save(char *record, int exponent_limit, const char *record_path)
+static
+void input_close(struct input *input)
 {
-	message("Saving the record to '%s'...\n", record_path);
+	if( input->mapped )
+		munmap(input->data, input->size);
+	else
+		free(input->data);
 
-	// remove backup copy
-	char backup_path[4096];
-	sprintf(backup_path, "%s.bak", record_path);
-	unlink(backup_path);
+	input->data = NULL;
+}
+
+static
+void stats_add(struct stats *total, const struct stats *stats)
+{
+	total->records += stats->records;
+	total->prime += stats->prime;
+	total->factored += stats->factored;
+	total->unfactored += stats->unfactored;
+	total->pm1 += stats->pm1;
+	total->ll += stats->ll;
+	total->errors += stats->errors;
+	total->new_factored += stats->new_factored;
+	total->new_lltested += stats->new_lltested;
+	total->new_tf += stats->new_tf;
+	total->new_pm1 += stats->new_pm1;
+}
 
-	// rename a previous record
-	rename(record_path, backup_path);
+// split the input at record boundaries and parse the parts in parallel, the jobs are set up from the config
+void parse(const struct input *input, struct job *jobs, int threads, const struct job *config, struct stats *stats)
+{
+	const char *begin = input->data;
+	const char *end = input->data + input->size;
 
-	// create new record
-	FILE *record_file = fopen(record_path, "w");
-	if( NULL == record_file )
+	// small inputs are not worth the threads
+	if( (size_t)threads > input->size / (1 << 16) + 1 )
 	{
-		int errsv = errno;
-		message(ERR "Unable to save the record :( Error: %s\n", strerror(errsv));
-		return;
+		threads = (int)(input->size / (1 << 16) + 1);
 	}
 
-	// loop over the record
-	if( (size_t)(exponent_limit+7)/8 != fwrite(record, (size_t)1, (size_t)(exponent_limit+7)/8, record_file) )
+	for(int t = 0; t < threads; t++)
 	{
-		message(ERR "Unable to write into the record :( The file is incomplete!\n");
+		struct job *job = &jobs[t];
+
+		*job = *config;
+		job->path = input->path;
+		job->base = begin;
+		job->begin = t ? jobs[t-1].end : begin;
+		job->end = t + 1 < threads ? record_start(begin + input->size / (size_t)threads * (size_t)(t + 1), begin, end) : end;
+		if( job->end < job->begin )
+			job->end = job->begin;
+		memset(&job->stats, 0, sizeof(job->stats));
+
+		if( pthread_create(&job->thread, NULL, parse_job, job) )
+		{
+			message(ERR "Unable to start a thread :(\n");
+			exit(0);
+		}
 	}
 
-	fclose(record_file);
+	for(int t = 0; t < threads; t++)
+	{
+		pthread_join(jobs[t].thread, NULL);
 
-	message("The record was saved successfully.\n");
+		stats_add(stats, &jobs[t].stats);
+	}
 }
 
-enum state_t {
-	ST_START, // at the beginning, expecting "Exponent" => ST_START_EXPONENT
-	ST_START_EXPONENT, // after "Exponent", expecting "Status" => ST_START_STATUS
-	ST_START_STATUS, // after "Status", expecting "Data" => ST_READY
-	ST_READY, // expecting "%li" exponent, => ST_EXPONENT
-	ST_EXPONENT, // got exponent, expecting eighter "Prime" (=> ST_READY) or "Factored" (=> ST_FACTORED) or "Unfactored" (=> ST_UNFACTORED) or "PM1" (=> ST_PM1) or "LL" (=> ST_LL) or "Exponent" (=> ST_START_EXPONENT)
-	ST_FACTORED,
-	ST_UNFACTORED,
-	ST_PM1,
-	ST_LL,
-	ST_ERROR,
-	ST_EOF
-};
-
-// reader [OPTIONS] < stdin
+// reader [OPTIONS] [FILE...]
 int main(int argc, char *argv[])
 {
 	message("%s: Sieve of Mersenne exponents, mersenne.org parser\n", argv[0]);
@@ -157,10 +443,11 @@ int main(int argc, char *argv[])
 	int exponent_limit = -1;
 	const char *factored_path = "factored.bits";
 	const char *lltested_path = "lltested.bits";
-	FILE *input = stdin;
+	const char *status_path = "status.bin";
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
 
 	// parse command-line options
-	for(int opt; (opt = getopt(argc, argv, "h:")) != -1;)
+	for(int opt; (opt = getopt(argc, argv, "h:t:s:")) != -1;)
 	{
 		switch(opt)
 		{
@@ -173,195 +460,104 @@ int main(int argc, char *argv[])
 					exponent_limit = -1;
 				}
 				break;
+			// -s FILE : status of the trial factoring and P-1 per prime exponent
+			case 's':
+				status_path = optarg;
+				break;
+			// -t THREADS : number of threads
+			case 't':
+				threads = atoi(optarg);
+				break;
 			default :
 				message(WARN "Unknown option :( Read the source code!\n");
 		}
 	}
 
-	// argument after options
-	if(optind < argc)
+	if( threads < 1 )
 	{
-		message(WARN "Too much options :( Read the source code!\n");
+		threads = 1;
 	}
 
+
 	// load the records
-	char *factored_record = record_load(&exponent_limit, factored_path);
-	char *lltested_record = record_load(&exponent_limit, lltested_path);
+	struct mp_record factored_record, lltested_record;
+	if( mp_record_open(&factored_record, factored_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		exit(0);
+	}
+	if( mp_record_open(&lltested_record, lltested_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		exit(0);
+	}
 
-	enum state_t state = ST_START;
-	int run = 1;
+	// create prime table
+	uint8_t *primes = load_prime_table(exponent_limit);
+	if( NULL == primes )
+	{
+		primes = gen_prime_table(exponent_limit);
+		save_prime_table(primes, exponent_limit);
+	}
 
-	while(run)
+	struct mp_status status;
+	if( mp_status_open(&status, status_path, exponent_limit, primes, MP_STATUS_RDWR) )
 	{
-		char buff[4096];
-		int ret;
-		int64_t exp;
+		exit(0);
+	}
+
+	struct job *jobs = malloc((size_t)threads * sizeof(struct job));
+	if( NULL == jobs )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		exit(0);
+	}
+
+	struct job config;
+	config.factored_record = &factored_record;
+	config.lltested_record = &lltested_record;
+	config.status = &status;
+	config.exponent_limit = exponent_limit;
 
-		switch(state)
+	struct stats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	size_t files = 0, bytes = 0;
+
+	// the arguments after options are the inputs, stdin if there are none
+	do {
+		// reader [OPTIONS] [FILE...]
+		const char *input_path = optind < argc && strcmp(argv[optind], "-") ? argv[optind] : NULL;
+
+		struct input input;
+		if( input_open(&input, input_path) )
 		{
-#			define NEXT_STATE(next_state) { /*printf("\tNEXT: %s\n", #next_state);*/ state = (next_state); break; }
-			// ----------------------------------------------------
-			case ST_START:
-				ret = fscanf(input, "%s", buff);
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 0 == ret )
-					NEXT_STATE(ST_ERROR);
-				if( 0 == strcmp(buff, "Exponent") )
-					NEXT_STATE(ST_START_EXPONENT);
-				NEXT_STATE(ST_ERROR);
-			// ----------------------------------------------------
-			case ST_START_EXPONENT:
-				ret = fscanf(input, "%s", buff);
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 0 == ret )
-					NEXT_STATE(ST_ERROR);
-				if( 0 == strcmp(buff, "Status") )
-					NEXT_STATE(ST_START_STATUS);
-				NEXT_STATE(ST_ERROR);
-			// ----------------------------------------------------
-			case ST_START_STATUS:
-				ret = fscanf(input, "%s", buff);
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 0 == ret )
-					NEXT_STATE(ST_ERROR);
-				if( 0 == strcmp(buff, "Data") )
-					NEXT_STATE(ST_READY);
-				NEXT_STATE(ST_ERROR);
-			// ----------------------------------------------------
-			case ST_READY:
-				ret = fscanf(input, "%" SCNd64, &exp);
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 0 == ret )
-					NEXT_STATE(ST_ERROR);
-				printf("EXPONENT: %" PRId64 "\n", exp);
-				NEXT_STATE(ST_EXPONENT);
-			// ----------------------------------------------------
-			case ST_EXPONENT:
-				ret = fscanf(input, "%s", buff);
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 0 == ret )
-					NEXT_STATE(ST_ERROR);
-				if( 0 == strcmp(buff, "Prime") )
-				{
-					printf("PRIME\n");
-					NEXT_STATE(ST_READY);
-				}
-				if( 0 == strcmp(buff, "Factored") )
-				{
-					printf("FACTORED\n");
-					NEXT_STATE(ST_FACTORED);
-				}
-				if( 0 == strcmp(buff, "Unfactored") )
-				{
-					printf("UNFACTORED\n");
-					NEXT_STATE(ST_UNFACTORED);
-				}
-				if( 0 == strcmp(buff, "PM1") )
-				{
-					printf("PM1\n");
-					NEXT_STATE(ST_PM1);
-				}
-				if( 0 == strcmp(buff, "LL") )
-				{
-					printf("LL\n");
-					NEXT_STATE(ST_LL);
-				}
-				if( 0 == strcmp(buff, "Exponent") )
-				{
-					printf("RESTART\n");
-					NEXT_STATE(ST_START_EXPONENT);
-				}
-				printf("UNHANDLED %s\n", buff);
-				NEXT_STATE(ST_ERROR);
-			// ----------------------------------------------------
-			case ST_FACTORED:
-				ret = fscanf(input, "%s", buff);
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 0 == ret )
-					NEXT_STATE(ST_ERROR);
-				// TODO: mark as composite in FACTOR table
-				set_bit(factored_record, (int)exp);
-				NEXT_STATE(ST_READY);
-			// ----------------------------------------------------
-			case ST_LL:
-				ret = fscanf(input, " %[^;]", buff); // read "Verified", "Verified (Factored)", "Unverified"
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 1 != ret )
-					NEXT_STATE(ST_ERROR);
-				printf("\t\tSTATE: '%s'\n", buff);
-				*buff = 0;
-				ret = fscanf(input, ";%[^;]", buff); // read date "2011-10-03" or fails due to empty string
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 1 == ret )
-					printf("\t\tDATE: '%s'\n", buff);
-				else
-					printf("\t\tDATE: (empty)\n");
-				*buff = 0;
-				ret = fscanf(input, ";%[^;]", buff); // read name or fails due to empty string
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 1 == ret )
-					printf("\t\tNAME: '%s'\n", buff);
-				else
-					printf("\t\tNAME: (empty)\n");
-				ret = fscanf(input, ";%s", buff); // read residue "12ACD05A4339E0__"
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 1 != ret )
-					NEXT_STATE(ST_ERROR);
-				printf("\t\tRESIDUE: '%s'\n", buff);
-				// TODO: mark as composite in LL table
-				set_bit(lltested_record, (int)exp);
-				NEXT_STATE(ST_READY);
-			// ----------------------------------------------------
-			case ST_UNFACTORED:
-				ret = fscanf(input, " %s", buff); // read "2^63"
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 1 != ret )
-					NEXT_STATE(ST_ERROR);
-				NEXT_STATE(ST_READY);
-			// ----------------------------------------------------
-			case ST_PM1:
-				ret = fscanf(input, " %s", buff); // read "B1=4356913107423,B2=348553048593840"
-				if( EOF == ret )
-					NEXT_STATE(ST_EOF);
-				if( 1 != ret )
-					NEXT_STATE(ST_ERROR);
-				NEXT_STATE(ST_READY);
-			// ----------------------------------------------------
-			case ST_EOF:
-				printf("EOF\n");
-				run = 0;
-				NEXT_STATE(ST_ERROR);
-			// ----------------------------------------------------
-			case ST_ERROR:
-				printf("ERROR\n");
-				run = 0;
-				NEXT_STATE(ST_ERROR);
-			// ----------------------------------------------------
-			default:
-				assert( !"implemented" );
-#			undef NEXT_STATE
+			exit(0);
 		}
-	}
 
-	printf("DONE\n");
+		parse(&input, jobs, threads, &config, &stats);
+
+		files++;
+		bytes += input.size;
+
+		input_close(&input);
+	} while( ++optind < argc );
+
+	message("%zu records parsed (%zu Prime, %zu Factored, %zu Unfactored, %zu PM1, %zu LL), %zu errors, %zu bytes in %zu files.\n",
+		stats.records, stats.prime, stats.factored, stats.unfactored, stats.pm1, stats.ll, stats.errors, bytes, files);
+	message("Changes: %zu newly factored, %zu newly LL-tested, %zu trial factoring depths and %zu P-1 bounds raised.\n",
+		stats.new_factored, stats.new_lltested, stats.new_tf, stats.new_pm1);
+
+	free(jobs);
 
 	// save the records
-	record_save(lltested_record, exponent_limit, lltested_path);
-	record_save(factored_record, exponent_limit, factored_path);
+	mp_status_sync(&status);
+	mp_status_close(&status);
+	free(primes);
+
+	mp_record_sync(&lltested_record);
+	mp_record_sync(&factored_record);
 
-	free(lltested_record);
-	free(factored_record);
+	mp_record_close(&lltested_record);
+	mp_record_close(&factored_record);
 
 	message("The program has finished successfully.\n");
 
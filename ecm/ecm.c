@@ -0,0 +1,1052 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <libmp.h>
+#include <record.h>
+#include <journal.h>
+#include <checkpoint.h>
+#include <list.h>
+#include <mersenne.h>
+
+int g_term = 0;
+int g_info = 0;
+
+void sighandler_int(int signum)
+{
+	(void)signum;
+	exit(0);
+}
+
+void sighandler_alrm(int signum)
+{
+	(void)signum;
+	g_term = 1;
+}
+
+void sighandler_term(int signum)
+{
+	(void)signum;
+	g_term = 1;
+
+	// set the signal handler again
+	signal(SIGTERM, sighandler_term);
+}
+
+void sighandler_usr1(int signum)
+{
+	(void)signum;
+	g_info = 1;
+
+	// set the signal handler again
+	signal(SIGUSR1, sighandler_usr1);
+}
+
+// the modulus of the stage 2 giant steps
+#define D 2310
+
+// ladder steps between the checks of the flags
+#define POLL 1024
+
+/**
+ * ECM on M(p) with the Montgomery curves B y^2 = x^3 + A x^2 + x in the
+ * projective x-only coordinates (X : Z). The curve of sigma is the one of
+ * Suyama (its order is divisible by 12): u = sigma^2 - 5, v = 4 sigma, the
+ * point is (u^3 : v^3) and (A + 2) / 4 = (v - u)^3 (3u + v) / (16 u^3 v).
+ * The fraction is never inverted, the doubling is scaled by its denominator
+ * instead. Stage 1 runs the Montgomery ladder over the bits of the scalar of
+ * all the prime powers up to B1 (computed once from the prime table), a
+ * factor q shows up as Z == 0 (mod q). Stage 2 takes the baby steps j Q for
+ * j coprime to D and the giant steps m D Q, and multiplies the cross
+ * products X_m Z_j - X_j Z_m, which vanish mod q if m D == +-j in the group,
+ * with the primes m D - j and m D + j in (B1; B2] paired into a single
+ * product as in pm1. The curves of an exponent are run in parallel, a thread
+ * per curve at a time, each thread has its own context.
+ */
+struct ecm {
+	uint32_t p;
+	uint64_t B1;
+	uint64_t B2;
+	const uint8_t *primes;
+	const uint64_t *k; // the stage 1 scalar
+	size_t k_bits;
+	uint64_t sigma0;
+	uint64_t curves; // per exponent
+	uint64_t next; // the next curve handed out
+	uint64_t *busy; // the curve of each thread in progress, UINT64_MAX if none
+	struct mp_record *record;
+	struct mp_journal *journal;
+	pthread_mutex_t mutex; // of the curves handed out, of the record and of the journal
+	int stop; // the curves of the exponent
+	int quit; // the info thread
+	int found;
+};
+
+struct point {
+	uint64_t *X;
+	uint64_t *Z;
+};
+
+struct curve {
+	struct mp_mersenne ctx;
+	uint64_t *n; // (A + 2) / 4 = n / d
+	uint64_t *d;
+	uint64_t *t[6]; // temporaries
+};
+
+static
+int is_composite(const uint8_t *primes, uint64_t n)
+{
+	return primes[n/8] & 1 << n%8;
+}
+
+static
+int point_alloc(const struct mp_mersenne *ctx, struct point *P)
+{
+	P->X = mp_mersenne_alloc(ctx);
+	P->Z = mp_mersenne_alloc(ctx);
+
+	return P->X && P->Z ? 0 : -1;
+}
+
+static
+void point_free(struct point *P)
+{
+	free(P->X);
+	free(P->Z);
+}
+
+static
+void point_copy(const struct mp_mersenne *ctx, struct point *R, const struct point *P)
+{
+	mp_mersenne_copy(ctx, R->X, P->X);
+	mp_mersenne_copy(ctx, R->Z, P->Z);
+}
+
+// R = 2P, R may alias P
+static
+void xdbl(struct curve *c, struct point *R, const struct point *P)
+{
+	struct mp_mersenne *ctx = &c->ctx;
+	uint64_t *s = c->t[0], *m = c->t[1], *t = c->t[2];
+
+	mp_mersenne_add(ctx, s, P->X, P->Z);
+	mp_mersenne_sqr(ctx, s, s); // (X + Z)^2
+	mp_mersenne_sub(ctx, m, P->X, P->Z);
+	mp_mersenne_sqr(ctx, m, m); // (X - Z)^2
+	mp_mersenne_sub(ctx, t, s, m); // 4 X Z
+
+	mp_mersenne_mul(ctx, m, m, c->d);
+	mp_mersenne_mul(ctx, R->X, s, m); // d (X + Z)^2 (X - Z)^2
+	mp_mersenne_mul(ctx, s, t, c->n);
+	mp_mersenne_add(ctx, s, s, m);
+	mp_mersenne_mul(ctx, R->Z, t, s); // 4 X Z (d (X - Z)^2 + n 4 X Z)
+}
+
+// R = P + Q, the difference P - Q is M, R may alias P or Q (not M)
+static
+void xadd(struct curve *c, struct point *R, const struct point *P, const struct point *Q, const struct point *M)
+{
+	struct mp_mersenne *ctx = &c->ctx;
+	uint64_t *a = c->t[3], *b = c->t[4], *e = c->t[5];
+
+	mp_mersenne_sub(ctx, a, P->X, P->Z);
+	mp_mersenne_add(ctx, e, Q->X, Q->Z);
+	mp_mersenne_mul(ctx, a, a, e); // (XP - ZP)(XQ + ZQ)
+	mp_mersenne_add(ctx, b, P->X, P->Z);
+	mp_mersenne_sub(ctx, e, Q->X, Q->Z);
+	mp_mersenne_mul(ctx, b, b, e); // (XP + ZP)(XQ - ZQ)
+
+	mp_mersenne_add(ctx, e, a, b);
+	mp_mersenne_sub(ctx, b, a, b);
+	mp_mersenne_sqr(ctx, e, e);
+	mp_mersenne_sqr(ctx, b, b);
+	mp_mersenne_mul(ctx, R->X, e, M->Z);
+	mp_mersenne_mul(ctx, R->Z, b, M->X);
+}
+
+// R = k P by the Montgomery ladder, k has bits bits, k > 0, R must not alias P
+static
+int ladder(struct curve *c, struct point *R, const struct point *P, const uint64_t *k, size_t bits, const int *stop)
+{
+	struct point S;
+
+	if( point_alloc(&c->ctx, &S) )
+	{
+		point_free(&S);
+		return -1;
+	}
+
+	// R = P, S = 2P, S - R = P
+	point_copy(&c->ctx, R, P);
+	xdbl(c, &S, P);
+
+	for(size_t i = bits - 1; i-- > 0;)
+	{
+		if( k[i / 64] >> (i % 64) & 1 )
+		{
+			xadd(c, R, R, &S, P);
+			xdbl(c, &S, &S);
+		}
+		else
+		{
+			xadd(c, &S, R, &S, P);
+			xdbl(c, R, R);
+		}
+
+		if( stop && 0 == i % POLL && __atomic_load_n(stop, __ATOMIC_RELAXED) )
+		{
+			point_free(&S);
+			return -1;
+		}
+	}
+
+	point_free(&S);
+
+	return 0;
+}
+
+static
+int ladder64(struct curve *c, struct point *R, const struct point *P, uint64_t k)
+{
+	return ladder(c, R, P, &k, (size_t)(64 - __builtin_clzll(k)), NULL);
+}
+
+// the point and the curve of Suyama's sigma
+static
+void suyama(struct curve *c, struct point *P, uint64_t sigma)
+{
+	struct mp_mersenne *ctx = &c->ctx;
+	uint64_t *u = c->t[0], *v = c->t[1], *u3 = c->t[2], *e = c->t[3];
+
+	mp_mersenne_set_ui(ctx, u, sigma * sigma - 5);
+	mp_mersenne_set_ui(ctx, v, 4 * sigma);
+
+	mp_mersenne_sqr(ctx, u3, u);
+	mp_mersenne_mul(ctx, u3, u3, u);
+	mp_mersenne_copy(ctx, P->X, u3); // u^3
+	mp_mersenne_sqr(ctx, P->Z, v);
+	mp_mersenne_mul(ctx, P->Z, P->Z, v); // v^3
+
+	// n = (v - u)^3 (3u + v)
+	mp_mersenne_sub(ctx, e, v, u);
+	mp_mersenne_sqr(ctx, c->n, e);
+	mp_mersenne_mul(ctx, c->n, c->n, e);
+	mp_mersenne_mul_ui(ctx, e, u, 3);
+	mp_mersenne_add(ctx, e, e, v);
+	mp_mersenne_mul(ctx, c->n, c->n, e);
+
+	// d = 16 u^3 v
+	mp_mersenne_mul(ctx, c->d, u3, v);
+	mp_mersenne_mul_ui(ctx, c->d, c->d, 16);
+}
+
+// 1 if g is neither 1 nor M(p)
+static
+int proper(const struct mp_mersenne *ctx, const uint64_t *g)
+{
+	int one = 1, all = 1;
+
+	for(size_t i = 0; i < ctx->words; i++)
+	{
+		uint64_t top = i == ctx->words - 1 && ctx->p % 64 ? (UINT64_C(1) << ctx->p % 64) - 1 : UINT64_MAX;
+
+		one = one && g[i] == (i == 0);
+		all = all && g[i] == top;
+	}
+
+	return !one && !all;
+}
+
+// the decimal digits of a factor up to 128 bits, the hexadecimal ones above
+static
+char *factor_to_str(char *buf, size_t size, const uint64_t *g, size_t words)
+{
+	size_t top = words;
+
+	while( top > 1 && 0 == g[top - 1] )
+		top--;
+
+	if( top <= 2 )
+	{
+		char tmp[40];
+
+		snprintf(buf, size, "%s", mp_uint128_to_str(tmp, (uint128_t)(top > 1 ? g[1] : 0) << 64 | g[0]));
+
+		return buf;
+	}
+
+	size_t pos = (size_t)snprintf(buf, size, "0x%" PRIx64, g[top - 1]);
+
+	for(size_t i = top - 1; i-- > 0 && pos < size;)
+		pos += (size_t)snprintf(buf + pos, size - pos, "%016" PRIx64, g[i]);
+
+	return buf;
+}
+
+static
+void report(struct ecm *ecm, const struct mp_mersenne *ctx, const uint64_t *g, uint64_t sigma, int stage)
+{
+	char buf[4096];
+
+	pthread_mutex_lock(&ecm->mutex);
+
+	message(INFO "success, %s | M(%" PRIu32 ") in the stage %i of the curve sigma = %" PRIu64 "\n", factor_to_str(buf, sizeof(buf), g, ctx->words), ecm->p, stage, sigma);
+
+	if( !ecm->found )
+	{
+		mp_record_set_bit(ecm->record, (int)ecm->p);
+
+		// the journal holds the factors up to 128 bits
+		size_t top = ctx->words;
+
+		while( top > 2 && 0 == g[top - 1] )
+			top--;
+
+		if( top <= 2 )
+			mp_journal_add(ecm->journal, (int)ecm->p, (uint128_t)(top > 1 ? g[1] : 0) << 64 | g[0]);
+	}
+
+	ecm->found = 1;
+	ecm->stop = 1;
+
+	pthread_mutex_unlock(&ecm->mutex);
+}
+
+// returns 1 if a factor is in g, 0 if none, -1 on failure or interruption
+static
+int stage2(struct ecm *ecm, struct curve *c, const struct point *Q, uint64_t *g)
+{
+	struct mp_mersenne *ctx = &c->ctx;
+	struct point baby[D/4];
+	uint32_t js[D/4];
+	size_t count = 0;
+	struct point cur, prev, Q2, G, Gprev, DQ;
+	uint64_t *acc = mp_mersenne_alloc(ctx), *u = mp_mersenne_alloc(ctx), *w = mp_mersenne_alloc(ctx);
+	int ret = -1;
+
+	memset(&cur, 0, sizeof(cur));
+	memset(&prev, 0, sizeof(prev));
+	memset(&Q2, 0, sizeof(Q2));
+	memset(&G, 0, sizeof(G));
+	memset(&Gprev, 0, sizeof(Gprev));
+	memset(&DQ, 0, sizeof(DQ));
+
+	if( !acc || !u || !w || point_alloc(ctx, &cur) || point_alloc(ctx, &prev) || point_alloc(ctx, &Q2) || point_alloc(ctx, &G) || point_alloc(ctx, &Gprev) || point_alloc(ctx, &DQ) )
+		goto end;
+
+	// the odd j Q, (j + 2) Q = j Q + 2 Q with the difference (j - 2) Q
+	xdbl(c, &Q2, Q);
+	point_copy(ctx, &cur, Q);
+
+	for(uint32_t j = 1; j < D/2; j += 2)
+	{
+		if( j % 3 && j % 5 && j % 7 && j % 11 )
+		{
+			if( point_alloc(ctx, &baby[count]) )
+			{
+				point_free(&baby[count]);
+				goto end;
+			}
+
+			point_copy(ctx, &baby[count], &cur);
+			js[count++] = j;
+		}
+
+		if( 1 == j )
+		{
+			point_copy(ctx, &prev, &cur);
+			xadd(c, &cur, &cur, &Q2, Q);
+		}
+		else
+		{
+			xadd(c, &G, &cur, &Q2, &prev);
+			point_copy(ctx, &prev, &cur);
+			point_copy(ctx, &cur, &G);
+		}
+	}
+
+	// the giant steps from m0 D Q, (m + 1) D Q = m D Q + D Q with the difference (m - 1) D Q
+	uint64_t m0 = ecm->B1 / D;
+
+	if( ladder64(c, &DQ, Q, D) || ladder64(c, &Gprev, Q, m0 * D) || ladder64(c, &G, Q, (m0 + 1) * D) )
+		goto end;
+
+	mp_mersenne_set_ui(ctx, acc, 1);
+
+	for(uint64_t m = m0; m * D < ecm->B2 + D/2; m++)
+	{
+		// Gprev = m D Q, G = (m + 1) D Q
+		for(size_t i = 0; i < count; i++)
+		{
+			uint64_t a = m * D - js[i], b = m * D + js[i];
+			int use_a = a > ecm->B1 && a <= ecm->B2 && !is_composite(ecm->primes, a);
+			int use_b = b > ecm->B1 && b <= ecm->B2 && !is_composite(ecm->primes, b);
+
+			if( use_a || use_b )
+			{
+				mp_mersenne_mul(ctx, u, Gprev.X, baby[i].Z);
+				mp_mersenne_mul(ctx, w, baby[i].X, Gprev.Z);
+				mp_mersenne_sub(ctx, u, u, w);
+				mp_mersenne_mul(ctx, acc, acc, u);
+			}
+		}
+
+		xadd(c, &cur, &G, &DQ, &Gprev);
+		point_copy(ctx, &Gprev, &G);
+		point_copy(ctx, &G, &cur);
+
+		if( __atomic_load_n(&ecm->stop, __ATOMIC_RELAXED) )
+			goto end;
+	}
+
+	if( mp_mersenne_gcd(ctx, g, acc) )
+		goto end;
+
+	ret = proper(ctx, g);
+
+end:
+	for(size_t i = 0; i < count; i++)
+		point_free(&baby[i]);
+
+	point_free(&cur);
+	point_free(&prev);
+	point_free(&Q2);
+	point_free(&G);
+	point_free(&Gprev);
+	point_free(&DQ);
+
+	free(acc);
+	free(u);
+	free(w);
+
+	return ret;
+}
+
+// returns 0 if the curve has been finished, -1 on failure or interruption
+static
+int curve_run(struct ecm *ecm, struct curve *c, uint64_t sigma)
+{
+	struct mp_mersenne *ctx = &c->ctx;
+	struct point P, Q;
+	uint64_t *g = mp_mersenne_alloc(ctx);
+	int ret = -1;
+
+	memset(&P, 0, sizeof(P));
+	memset(&Q, 0, sizeof(Q));
+
+	if( NULL == g || point_alloc(ctx, &P) || point_alloc(ctx, &Q) )
+		goto end;
+
+	suyama(c, &P, sigma);
+
+	// stage 1
+	if( ladder(c, &Q, &P, ecm->k, ecm->k_bits, &ecm->stop) )
+		goto end;
+
+	if( mp_mersenne_gcd(ctx, g, Q.Z) )
+		goto end;
+
+	if( proper(ctx, g) )
+	{
+		report(ecm, ctx, g, sigma, 1);
+		ret = 0;
+		goto end;
+	}
+
+	// stage 2
+	if( ecm->B2 > ecm->B1 )
+	{
+		int found = stage2(ecm, c, &Q, g);
+
+		if( found < 0 )
+			goto end;
+
+		if( found )
+			report(ecm, ctx, g, sigma, 2);
+	}
+
+	ret = 0;
+
+end:
+	point_free(&P);
+	point_free(&Q);
+
+	free(g);
+
+	return ret;
+}
+
+struct ecmthread {
+	struct ecm *ecm;
+	pthread_t thread;
+	int index;
+};
+
+static
+void *ecmthread_main(void *arg)
+{
+	struct ecmthread *th = arg;
+	struct ecm *ecm = th->ecm;
+	struct curve c;
+
+	if( mp_mersenne_init(&c.ctx, ecm->p) )
+	{
+		__atomic_store_n(&ecm->stop, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	c.n = mp_mersenne_alloc(&c.ctx);
+	c.d = mp_mersenne_alloc(&c.ctx);
+
+	int failed = !c.n || !c.d;
+
+	for(int i = 0; i < 6; i++)
+	{
+		c.t[i] = mp_mersenne_alloc(&c.ctx);
+		failed = failed || !c.t[i];
+	}
+
+	while( !failed )
+	{
+		pthread_mutex_lock(&ecm->mutex);
+		uint64_t curve = ecm->next < ecm->curves && !ecm->stop ? ecm->next++ : UINT64_MAX;
+		ecm->busy[th->index] = curve;
+		pthread_mutex_unlock(&ecm->mutex);
+
+		if( UINT64_MAX == curve || curve_run(ecm, &c, ecm->sigma0 + curve) )
+			break;
+
+		pthread_mutex_lock(&ecm->mutex);
+		ecm->busy[th->index] = UINT64_MAX;
+		pthread_mutex_unlock(&ecm->mutex);
+	}
+
+	if( failed )
+		__atomic_store_n(&ecm->stop, 1, __ATOMIC_RELAXED);
+
+	free(c.n);
+	free(c.d);
+
+	for(int i = 0; i < 6; i++)
+		free(c.t[i]);
+
+	mp_mersenne_free(&c.ctx);
+
+	return NULL;
+}
+
+// the lowest curve not finished, the mutex is held
+static
+uint64_t ecm_state(const struct ecm *ecm, int threads)
+{
+	uint64_t state = ecm->next;
+
+	for(int t = 0; t < threads; t++)
+	{
+		if( ecm->busy[t] < state )
+			state = ecm->busy[t];
+	}
+
+	return state;
+}
+
+// the scalar of stage 1, the prime powers up to B1, returns the number of words
+static
+size_t scalar(uint64_t B1, const uint8_t *primes, uint64_t **k)
+{
+	// log2(lcm(1..B1)) < 1.04 B1 / ln(2)
+	size_t capacity = (size_t)(B1 * 3 / 2 / 64) + 4;
+	size_t len = 1;
+	uint64_t m = 1;
+
+	*k = malloc(capacity * sizeof(uint64_t));
+
+	if( NULL == *k )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return 0;
+	}
+
+	(*k)[0] = 1;
+
+	for(uint64_t q = 2; q <= B1 + 1; q++)
+	{
+		// flush the last product
+		int last = q == B1 + 1;
+		uint64_t qe = 1;
+
+		if( !last )
+		{
+			if( is_composite(primes, q) )
+				continue;
+
+			for(qe = q; qe <= B1 / q; qe *= q)
+				;
+		}
+
+		if( m > UINT64_MAX / qe || last )
+		{
+			uint64_t carry = 0;
+
+			for(size_t i = 0; i < len; i++)
+			{
+				uint128_t t = (uint128_t)(*k)[i] * m + carry;
+
+				(*k)[i] = (uint64_t)t;
+				carry = (uint64_t)(t >> 64);
+			}
+
+			if( carry )
+				(*k)[len++] = carry;
+
+			m = 1;
+		}
+
+		m *= qe;
+	}
+
+	return len;
+}
+
+// returns the curves finished
+static
+uint64_t ecm_exponent(struct ecm *ecm, int threads)
+{
+	struct ecmthread *ths = malloc((size_t)threads * sizeof(struct ecmthread));
+	int started = 0;
+
+	ecm->busy = malloc((size_t)threads * sizeof(uint64_t));
+
+	if( NULL == ths || NULL == ecm->busy )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		free(ths);
+		free(ecm->busy);
+		return ecm->next;
+	}
+
+	message(INFO "ECM of M(%" PRIu32 "), curves %" PRIu64 " to %" PRIu64 "...\n", ecm->p, ecm->next, ecm->curves);
+
+	for(int t = 0; t < threads; t++)
+	{
+		ths[t].ecm = ecm;
+		ths[t].index = t;
+		ecm->busy[t] = UINT64_MAX;
+
+		if( pthread_create(&ths[t].thread, NULL, ecmthread_main, &ths[t]) )
+		{
+			message(ERR "Unable to start a thread :(\n");
+			__atomic_store_n(&ecm->stop, 1, __ATOMIC_RELAXED);
+			break;
+		}
+
+		started++;
+	}
+
+	for(int t = 0; t < started; t++)
+	{
+		pthread_join(ths[t].thread, NULL);
+	}
+
+	uint64_t state = ecm_state(ecm, threads);
+
+	free(ths);
+	free(ecm->busy);
+
+	return state;
+}
+
+// the position in the list, the curves done on that exponent, and the parameters of the run
+struct state {
+	size_t i;
+	uint32_t p;
+	uint64_t curves;
+	uint64_t total; // curves per exponent
+	uint64_t B1;
+	uint64_t B2;
+	uint64_t sigma0;
+};
+
+void state_save(const struct state *state)
+{
+	char buf[256];
+	int len = snprintf(buf, sizeof(buf), "%zu %" PRIu32 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+		state->i, state->p, state->curves, state->total, state->B1, state->B2, state->sigma0);
+
+	mp_write_file_atomic("ecm.state", buf, (size_t)len);
+}
+
+void state_load(struct state *state)
+{
+	static const struct state empty;
+	FILE *state_file = fopen("ecm.state", "r");
+
+	*state = empty;
+
+	if( NULL == state_file )
+		return;
+
+	if( fscanf(state_file, "%zu %" SCNu32 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+		&state->i, &state->p, &state->curves, &state->total, &state->B1, &state->B2, &state->sigma0) != 7 )
+	{
+		message(ERR "Unable to read the state :( Starting over.\n");
+		*state = empty;
+	}
+
+	fclose(state_file);
+}
+
+void *info_main(void *arg)
+{
+	struct ecm *ecm = arg;
+
+	while( !__atomic_load_n(&ecm->quit, __ATOMIC_RELAXED) )
+	{
+		struct timespec ts = { 0, 100000000 };
+
+		nanosleep(&ts, NULL);
+
+		if( g_term )
+		{
+			// exit the program
+			__atomic_store_n(&ecm->stop, 1, __ATOMIC_RELAXED);
+		}
+
+		if( g_info )
+		{
+			pthread_mutex_lock(&ecm->mutex);
+			if( ecm->p )
+				message("M(%" PRIu32 "), %" PRIu64 " of %" PRIu64 " curves handed out.\n", ecm->p, ecm->next, ecm->curves);
+			pthread_mutex_unlock(&ecm->mutex);
+
+			g_info = 0;
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	message("%s: Mersenne number factorization, ECM\n", argv[0]);
+
+	int exponent_limit = 256*1024*1024; // 2^8 * 2^10 * 2^10
+	const char *record_path = "record.bits";
+	const char *list_path = NULL; // a single exponent
+	uint32_t p = 0;
+	int64_t B1 = 50000;
+	int64_t B2 = -1; // 100 B1
+	int64_t curves = 16;
+	uint64_t sigma0 = 6;
+	unsigned int timeout = 0; // no limit
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	// parse command-line options
+	for(int opt; (opt = getopt(argc, argv, "h:r:L:b:B:n:S:t:j:")) != -1;)
+	{
+		switch(opt)
+		{
+			// -h EXP : highest exponent in the prime table (and the record)
+			case 'h':
+				exponent_limit = atoi(optarg);
+				if( exponent_limit < 2 )
+				{
+					message(WARN "Invalid exponent, keeping the default one!\n");
+					exponent_limit = 256*1024*1024;
+				}
+				break;
+			// -r FILE : record of the eliminated exponents
+			case 'r':
+				record_path = optarg;
+				break;
+			// -L FILE : the exponents of the list (text, one per line, or see tools/decode)
+			case 'L':
+				list_path = optarg;
+				break;
+			// -b B1 : the bound of the stage 1 (at least D = 2310)
+			case 'b':
+				B1 = atoll(optarg);
+				break;
+			// -B B2 : the bound of the stage 2 (below the exponent limit), B1 skips the stage 2
+			case 'B':
+				B2 = atoll(optarg);
+				break;
+			// -n CURVES : the curves per exponent
+			case 'n':
+				curves = atoll(optarg);
+				break;
+			// -S SIGMA : the first curve, the curve c of an exponent is sigma + c
+			case 'S':
+				sigma0 = (uint64_t)atoll(optarg);
+				break;
+			// -t SECS : terminate after given time limit (in seconds)
+			case 't':
+				timeout = (unsigned int)atoi(optarg);
+				break;
+			// -j THREADS : number of threads
+			case 'j':
+				threads = atoi(optarg);
+				if( threads < 1 )
+				{
+					message(WARN "Invalid number of threads, using one!\n");
+					threads = 1;
+				}
+				break;
+			default :
+				message(WARN "Unknown option :( Read the source code!\n");
+		}
+	}
+	// argument after options
+	if(optind < argc)
+	{
+		// ecm [OPTIONS] [EXPONENT]
+		p = (uint32_t)atol(argv[optind++]);
+
+		if(optind < argc)
+		{
+			message(WARN "Too much options :( Read the source code!\n");
+		}
+	}
+
+	if( B1 < D || B1 >= exponent_limit )
+	{
+		message(ERR "invalid B1 = %" PRId64 "!\n", B1);
+		return 1;
+	}
+
+	// sigma^2 - 5 fits
+	if( sigma0 < 6 || sigma0 + (uint64_t)curves > UINT32_MAX || curves < 1 )
+	{
+		message(ERR "invalid curves!\n");
+		return 1;
+	}
+
+	if( B2 < 0 )
+	{
+		B2 = 100 * B1;
+	}
+
+	if( B2 >= exponent_limit )
+	{
+		B2 = exponent_limit - 1;
+		message(WARN "B2 is limited by the prime table, using %" PRId64 "!\n", B2);
+	}
+
+	// create prime table
+	uint8_t *primes = load_prime_table(exponent_limit);
+	if( NULL == primes )
+	{
+		primes = gen_prime_table(exponent_limit);
+		save_prime_table(primes, exponent_limit);
+	}
+
+	uint32_t *exponents;
+	size_t count = 1;
+
+	if( list_path )
+	{
+		exponents = mp_list_load(list_path, &count);
+	}
+	else
+	{
+		exponents = malloc(sizeof(uint32_t));
+
+		if( exponents )
+			exponents[0] = p;
+	}
+
+	if( NULL == exponents )
+	{
+		return 1;
+	}
+
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		return 1;
+	}
+
+	struct mp_journal journal;
+	if( mp_journal_open_record(&journal, record_path) )
+	{
+		return 1;
+	}
+
+	struct ecm ecm;
+
+	ecm.B1 = (uint64_t)B1;
+	ecm.B2 = (uint64_t)B2;
+	ecm.primes = primes;
+	ecm.k = NULL;
+	ecm.sigma0 = sigma0;
+	ecm.curves = (uint64_t)curves;
+	ecm.record = &record;
+	ecm.journal = &journal;
+	ecm.stop = 0;
+	ecm.quit = 0;
+	ecm.p = 0;
+	ecm.next = 0;
+
+	uint64_t *k;
+	size_t len = scalar(ecm.B1, primes, &k);
+
+	if( 0 == len )
+	{
+		return 1;
+	}
+
+	ecm.k = k;
+	ecm.k_bits = len * 64 - (size_t)__builtin_clzll(k[len - 1]);
+
+	message("stage 1, B1 = %" PRIu64 ", %zu bits of the scalar, stage 2, B2 = %" PRIu64 "\n", ecm.B1, ecm.k_bits, ecm.B2);
+
+	struct state resume;
+
+	state_load(&resume);
+
+	// the list has changed, or the exponents done had fewer curves or other bounds
+	if( resume.i >= count || exponents[resume.i] != resume.p || resume.total < ecm.curves
+	 || resume.B1 != ecm.B1 || resume.B2 != ecm.B2 || resume.sigma0 != ecm.sigma0 )
+	{
+		if( resume.p )
+			message(WARN "The state does not match the list or the parameters, starting over.\n");
+
+		resume.i = 0;
+		resume.p = 0;
+		resume.curves = 0;
+	}
+	else
+	{
+		message("Resuming M(%" PRIu32 ") from the curve %" PRIu64 "...\n", resume.p, resume.curves);
+	}
+
+	pthread_mutex_init(&ecm.mutex, NULL);
+
+	signal(SIGINT,  sighandler_int); // exit immediately
+	signal(SIGALRM, sighandler_alrm); // stop, exit
+	signal(SIGTERM, sighandler_term); // stop, exit
+	signal(SIGUSR1, sighandler_usr1); // print the progress
+
+	// set the alarm
+	if( timeout )
+	{
+		message("Setting an alarm to be delivered in %u seconds...\n", timeout);
+		alarm(timeout);
+	}
+
+	// the signals are polled by a thread of its own, the workers run per exponent
+	int interrupted = 0;
+	pthread_t info;
+
+	if( pthread_create(&info, NULL, info_main, &ecm) )
+	{
+		message(ERR "Unable to start a thread :(\n");
+		return 1;
+	}
+
+	size_t done = 0, eliminated = 0, skipped = 0;
+
+	// the exponents before the one resumed are done
+	skipped += resume.i;
+
+	for(size_t i = resume.i; i < count && !interrupted; i++)
+	{
+		uint32_t n = exponents[i];
+		struct state state = { i, n, 0, ecm.curves, ecm.B1, ecm.B2, ecm.sigma0 };
+
+		if( n < 3 || n >= (uint32_t)exponent_limit || is_composite(primes, n) )
+		{
+			message(WARN "%" PRIu32 " is not a prime exponent below the limit, skipping!\n", n);
+			skipped++;
+			continue;
+		}
+
+		// eliminated
+		if( mp_record_get_bit(&record, (int)n) )
+		{
+			skipped++;
+			continue;
+		}
+
+		// the curves are done
+		if( i == resume.i && n == resume.p && resume.curves >= ecm.curves )
+		{
+			skipped++;
+			continue;
+		}
+
+		pthread_mutex_lock(&ecm.mutex);
+		ecm.p = n;
+		ecm.next = i == resume.i && n == resume.p ? resume.curves : 0;
+		ecm.found = 0;
+		pthread_mutex_unlock(&ecm.mutex);
+
+		state.curves = ecm_exponent(&ecm, threads);
+
+		if( ecm.found )
+		{
+			eliminated++;
+		}
+		else if( state.curves < ecm.curves )
+		{
+			// interrupted, or failed
+			state_save(&state);
+			interrupted = 1;
+			break;
+		}
+
+		pthread_mutex_lock(&ecm.mutex);
+		ecm.stop = 0;
+		pthread_mutex_unlock(&ecm.mutex);
+
+		done++;
+
+		mp_journal_flush(&journal);
+		state.curves = ecm.curves;
+		state_save(&state);
+
+		if( g_term )
+		{
+			interrupted = i + 1 < count;
+			break;
+		}
+	}
+
+	__atomic_store_n(&ecm.quit, 1, __ATOMIC_RELAXED);
+	pthread_join(info, NULL);
+
+	// the list is finished, the next run starts over
+	if( !interrupted )
+		unlink("ecm.state");
+
+	message("%zu of %zu exponents done, %zu eliminated, %zu skipped.\n", done, count, eliminated, skipped);
+
+	pthread_mutex_destroy(&ecm.mutex);
+
+	mp_journal_sync(&journal);
+	mp_journal_close(&journal);
+
+	mp_record_sync(&record);
+	mp_record_close(&record);
+
+	free(k);
+	free(exponents);
+	free(primes);
+
+	if( interrupted )
+	{
+		message("The program has been interrupted.\n");
+
+		return 2;
+	}
+
+	message("The program has finished successfully.\n");
+
+	return 0;
+}
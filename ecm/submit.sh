@@ -0,0 +1,19 @@
+#!/bin/bash
+#
+#$ -N ecm
+#$ -o factor/ecm/logs/$JOB_NAME.$JOB_ID.out
+#$ -e factor/ecm/logs/$JOB_NAME.$JOB_ID.err
+
+# log a node name
+uname -n
+
+# change working directory to store the record to the right place
+cd $HOME/factor/ecm/
+
+# limit job to one hour, the curves done are kept in the state
+./ecm -t 3600 "$@"
+
+# submit again while the list is not done
+if [ $? -eq 2 ]; then
+	qsub -q all.q@@stable -l ram_free=512M $HOME/factor/ecm/submit.sh "$@"
+fi
@@ -1,64 +1,1637 @@
 #include <libmp.h>
+#include <status.h>
+#include <mont.h>
+#include <checkpoint.h>
+#include <record.h>
+#include <journal.h>
+#include <list.h>
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
 
 #define INT128_H64L64(x) INT128_H64(x), INT128_L64(x)
 
+int g_term = 0;
+int g_info = 0;
+int g_save = 0;
+
+void sighandler_int(int signum)
+{
+	(void)signum;
+	exit(0);
+}
+
+void sighandler_alrm(int signum)
+{
+	(void)signum;
+	g_term = 1;
+}
+
+void sighandler_term(int signum)
+{
+	(void)signum;
+	g_term = 1;
+
+	// set the signal handler again
+	signal(SIGTERM, sighandler_term);
+}
+
+void sighandler_usr1(int signum)
+{
+	(void)signum;
+	g_info = 1;
+
+	// set the signal handler again
+	signal(SIGUSR1, sighandler_usr1);
+}
+
+void sighandler_usr2(int signum)
+{
+	(void)signum;
+	g_save = 1;
+
+	// set the signal handler again
+	signal(SIGUSR2, sighandler_usr2);
+}
+
+// factors q = 2kp + 1 are split into the classes k == c (mod CLASSES)
+#define CLASSES 4620
+// bits of a sieve segment, a bit per k of a class
+#define SEGMENT (1 << 18)
+// moduli per call of the powering
+#define BATCH 1024
+// the most work units per class
+#define SLICES 16
+
+#define PROGRESS_MAGIC "MPTFPRG1"
+
+/**
+ * Trial factoring of M(p) by q = 2kp + 1 in [2^from; 2^to). The classes of
+ * q == 3, 5 (mod 8) or divisible by 3, 5, 7 or 11 are dropped (960 of 4620
+ * classes remain), the k of a class are sieved by the primes below a bound,
+ * and the survivors are powered in batches.
+ *
+ * The k = c + CLASSES*j of a class are split into slices of j, these are the
+ * work units, the first slices of all the classes go first. The threads take
+ * the units from their own queues and steal the upper half of the longest
+ * queue once theirs is empty. A unit is done from its beginning, the number
+ * of j done per unit is the progress saved.
+ */
+struct tf {
+	uint64_t p;
+	struct mp_plan plan; // of 2^p, shared by all the factors
+	int from;
+	int to;
+	uint128_t k_min;
+	uint128_t k_max;
+	uint32_t *primes; // sieve primes, 13 and above
+	uint32_t *roots; // r | 2kp + 1 if k == root (mod r)
+	uint32_t *invs; // 1/CLASSES (mod r)
+	size_t count;
+	uint16_t classes[CLASSES]; // the kept classes
+	int class_count;
+	int slices;
+	size_t units;
+	uint64_t *begin; // the first j of a unit
+	uint64_t *end;
+	uint64_t *done; // j done from the beginning
+	int all; // report all the factors
+	int stop;
+	int running; // threads
+	pthread_mutex_t mutex;
+	uint128_t factor; // the smallest factor found, or 0
+	uint64_t candidates;
+	uint64_t tested;
+};
+
+// the units [head; tail) of a thread
+struct tf_queue {
+	pthread_mutex_t mutex;
+	size_t head;
+	size_t tail;
+};
+
+struct tf_thread {
+	struct tf *tf;
+	struct tf_queue *queues;
+	int threads;
+	int id;
+	pthread_t thread;
+	uint32_t *offsets; // the next j of the unit to be marked, per prime
+	uint64_t bits[SEGMENT/64];
+	size_t batch;
+	uint128_t q[BATCH];
+	uint128_t r[BATCH];
+	uint64_t q64[BATCH];
+	uint64_t r64[BATCH];
+};
+
+struct progress_header {
+	char magic[8];
+	uint64_t p;
+	int32_t from;
+	int32_t to;
+	uint32_t units;
+	uint32_t slices;
+	uint64_t factor[2]; // low and high half
+};
+
+// a^e (mod r)
+static
+uint32_t uint32_pow_mod(uint32_t a, uint32_t e, uint32_t r)
+{
+	uint64_t x = 1, b = a % r;
+
+	for(; e; e >>= 1)
+	{
+		if( e & 1 )
+			x = x * b % r;
+		b = b * b % r;
+	}
+
+	return (uint32_t)x;
+}
+
+static
+int is_composite(const uint8_t *primes, uint32_t n)
+{
+	return primes[n/8] & 1 << n%8;
+}
+
+// the first and the last j of the class c, returns 0 if the class is empty
+static
+int tf_class_range(const struct tf *tf, uint32_t c, uint128_t *j_first, uint128_t *j_last)
+{
+	if( tf->k_max < c )
+		return 0;
+
+	*j_first = tf->k_min <= c ? 0 : (tf->k_min - c + CLASSES - 1) / CLASSES;
+	*j_last = (tf->k_max - c) / CLASSES;
+
+	return *j_first <= *j_last;
+}
+
+static
+int tf_init(struct tf *tf, uint64_t p, int from, int to, uint32_t bound, const uint8_t *primes)
+{
+	tf->p = p;
+	tf->from = from;
+	tf->to = to;
+	tf->all = 0;
+	tf->stop = 0;
+	tf->factor = 0;
+	tf->candidates = 0;
+	tf->tested = 0;
+
+	mp_plan_init(&tf->plan, p);
+
+	pthread_mutex_init(&tf->mutex, NULL);
+
+	// 2kp + 1 >= 2^from, 2kp + 1 < 2^to
+	tf->k_min = ((UINT128_1 << from) - 1 + 2*p - 1) / (2*p);
+	tf->k_max = ((UINT128_1 << to) - 2) / (2*p);
+
+	if( tf->k_min < 1 )
+		tf->k_min = 1;
+
+	if( tf->k_max / CLASSES >= (UINT128_1 << 63) )
+	{
+		message(ERR "The range is too wide!\n");
+		return -1;
+	}
+
+	tf->class_count = 0;
+
+	for(uint32_t c = 0; c < CLASSES; c++)
+	{
+		// q (mod 8) depends on k (mod 4)
+		uint64_t q8 = (2 * (p % 8) * (c % 4) + 1) % 8;
+		uint64_t q1155 = (2 * (p % 1155) * c + 1) % 1155;
+
+		if( (q8 == 1 || q8 == 7) && q1155 % 3 && q1155 % 5 && q1155 % 7 && q1155 % 11 )
+			tf->classes[tf->class_count++] = (uint16_t)c;
+	}
+
+	// a slice of at least a segment
+	uint128_t length = (tf->k_max - tf->k_min) / CLASSES + 1;
+
+	tf->slices = length / SEGMENT >= SLICES ? SLICES : (int)(length / SEGMENT) + 1;
+	tf->units = (size_t)tf->class_count * (size_t)tf->slices;
+
+	size_t max = bound / 2 + 1;
+
+	tf->primes = malloc(max * sizeof(uint32_t));
+	tf->roots = malloc(max * sizeof(uint32_t));
+	tf->invs = malloc(max * sizeof(uint32_t));
+	tf->begin = malloc(tf->units * sizeof(uint64_t));
+	tf->end = malloc(tf->units * sizeof(uint64_t));
+	tf->done = calloc(tf->units, sizeof(uint64_t));
+	tf->count = 0;
+
+	if( NULL == tf->primes || NULL == tf->roots || NULL == tf->invs || NULL == tf->begin || NULL == tf->end || NULL == tf->done )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	for(uint32_t r = 13; r < bound; r += 2)
+	{
+		// q == 1 (mod p)
+		if( is_composite(primes, r) || r == p )
+			continue;
+
+		// 2kp == -1 (mod r)
+		uint32_t inv2p = uint32_pow_mod((uint32_t)(2 * p % r), r - 2, r);
+
+		tf->primes[tf->count] = r;
+		tf->roots[tf->count] = r - inv2p;
+		tf->invs[tf->count] = uint32_pow_mod(CLASSES % r, r - 2, r);
+		tf->count++;
+	}
+
+	for(int i = 0; i < tf->class_count; i++)
+	{
+		uint128_t j_first = 0, j_last = 0;
+		uint128_t total = 0;
+
+		if( tf_class_range(tf, tf->classes[i], &j_first, &j_last) )
+			total = j_last + 1 - j_first;
+
+		for(int s = 0; s < tf->slices; s++)
+		{
+			size_t u = (size_t)s * (size_t)tf->class_count + (size_t)i;
+
+			tf->begin[u] = (uint64_t)(j_first + total * (uint128_t)s / (uint128_t)tf->slices);
+			tf->end[u] = (uint64_t)(j_first + total * (uint128_t)(s + 1) / (uint128_t)tf->slices);
+		}
+	}
+
+	return 0;
+}
+
+static
+void tf_free(struct tf *tf)
+{
+	free(tf->primes);
+	free(tf->roots);
+	free(tf->invs);
+	free(tf->begin);
+	free(tf->end);
+	free(tf->done);
+
+	pthread_mutex_destroy(&tf->mutex);
+}
+
+// load the progress of the same search, 1 if it was loaded
+static
+int tf_load(struct tf *tf, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+
+	if( NULL == file )
+		return 0;
+
+	struct progress_header header;
+	size_t len = sizeof(header) + tf->units * sizeof(uint64_t);
+	uint8_t *buf = malloc(len + sizeof(uint32_t));
+	uint32_t crc;
+	int ret = 0;
+
+	if( NULL != buf && len + sizeof(crc) == fread(buf, 1, len + sizeof(crc), file) && EOF == fgetc(file) )
+	{
+		memcpy(&header, buf, sizeof(header));
+		memcpy(&crc, buf + len, sizeof(crc));
+
+		if( memcmp(header.magic, PROGRESS_MAGIC, sizeof(header.magic)) || crc != mp_crc32(0, buf, len) )
+		{
+			message(WARN "The progress '%s' is damaged, starting over!\n", path);
+		}
+		else if( header.p != tf->p || header.from != tf->from || header.to != tf->to || header.units != tf->units || header.slices != (uint32_t)tf->slices )
+		{
+			message(WARN "The progress '%s' is of another search, starting over!\n", path);
+		}
+		else
+		{
+			memcpy(tf->done, buf + sizeof(header), tf->units * sizeof(uint64_t));
+
+			tf->factor = (uint128_t)header.factor[1] << 64 | header.factor[0];
+
+			ret = 1;
+		}
+	}
+	else
+	{
+		message(WARN "The progress '%s' is of another search, starting over!\n", path);
+	}
+
+	free(buf);
+	fclose(file);
+
+	return ret;
+}
+
+// replace the progress file atomically
+static
+int tf_save(struct tf *tf, const char *path)
+{
+	struct progress_header header;
+	size_t len = sizeof(header) + tf->units * sizeof(uint64_t);
+	uint8_t *buf = malloc(len + sizeof(uint32_t));
+
+	if( NULL == buf )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRESS_MAGIC, sizeof(header.magic));
+	header.p = tf->p;
+	header.from = tf->from;
+	header.to = tf->to;
+	header.units = (uint32_t)tf->units;
+	header.slices = (uint32_t)tf->slices;
+
+	pthread_mutex_lock(&tf->mutex);
+	header.factor[0] = (uint64_t)tf->factor;
+	header.factor[1] = (uint64_t)(tf->factor >> 64);
+	pthread_mutex_unlock(&tf->mutex);
+
+	memcpy(buf, &header, sizeof(header));
+
+	for(size_t u = 0; u < tf->units; u++)
+	{
+		uint64_t done = __atomic_load_n(&tf->done[u], __ATOMIC_ACQUIRE);
+
+		memcpy(buf + sizeof(header) + u * sizeof(uint64_t), &done, sizeof(done));
+	}
+
+	uint32_t crc = mp_crc32(0, buf, len);
+
+	memcpy(buf + len, &crc, sizeof(crc));
+
+	int ret = mp_write_file_atomic(path, buf, len + sizeof(crc));
+
+	free(buf);
+
+	return ret;
+}
+
+// power the batch, remember the factors
+static
+void tf_flush(struct tf_thread *th)
+{
+	struct tf *tf = th->tf;
+
+	if( tf->to <= 63 )
+	{
+		mp_plan_pow2_mod64(&tf->plan, th->batch, th->q64, th->r64);
+
+		for(size_t i = 0; i < th->batch; i++)
+			th->q[i] = th->q64[i], th->r[i] = th->r64[i];
+	}
+	else
+	{
+		mp_plan_pow2_mod128(&tf->plan, th->batch, th->q, th->r);
+	}
+
+	for(size_t i = 0; i < th->batch; i++)
+	{
+		if( 1 == th->r[i] )
+		{
+			char buf[40];
+
+			message(INFO "success, %s | M(%" PRIu64 ")\n", mp_uint128_to_str(buf, th->q[i]), tf->p);
+
+			pthread_mutex_lock(&tf->mutex);
+
+			if( 0 == tf->factor || th->q[i] < tf->factor )
+				tf->factor = th->q[i];
+
+			if( !tf->all )
+				__atomic_store_n(&tf->stop, 1, __ATOMIC_RELAXED);
+
+			pthread_mutex_unlock(&tf->mutex);
+		}
+	}
+
+	__atomic_fetch_add(&tf->tested, th->batch, __ATOMIC_RELAXED);
+
+	th->batch = 0;
+}
+
+// continue the unit u, returns 0 if it was interrupted
+static
+int tf_unit(struct tf_thread *th, size_t u)
+{
+	struct tf *tf = th->tf;
+	uint32_t c = tf->classes[u % (size_t)tf->class_count];
+	uint64_t j_start = tf->begin[u] + tf->done[u];
+	uint64_t j_end = tf->end[u];
+
+	if( j_start >= j_end )
+		return 1;
+
+	// the first j of the unit marked by each prime
+	for(size_t n = 0; n < tf->count; n++)
+	{
+		uint32_t r = tf->primes[n];
+		uint64_t j0 = (uint64_t)(tf->roots[n] + r - c % r) * tf->invs[n] % r;
+		uint32_t offset = (uint32_t)((j0 + r - j_start % r) % r);
+
+		// keep the prime itself
+		if( 2 * tf->p * (c + CLASSES * ((uint128_t)j_start + offset)) + 1 == r )
+			offset += r;
+
+		th->offsets[n] = offset;
+	}
+
+	for(uint64_t j_base = j_start; j_base < j_end; j_base += SEGMENT)
+	{
+		uint32_t len = j_end - j_base < SEGMENT ? (uint32_t)(j_end - j_base) : SEGMENT;
+
+		memset(th->bits, 0, (len + 63) / 64 * sizeof(uint64_t));
+
+		for(size_t n = 0; n < tf->count; n++)
+		{
+			uint32_t r = tf->primes[n];
+			uint32_t i = th->offsets[n];
+
+			for(; i < len; i += r)
+				th->bits[i/64] |= UINT64_C(1) << i%64;
+
+			th->offsets[n] = i - len;
+		}
+
+		// the survivors
+		for(uint32_t w = 0; w < (len + 63) / 64; w++)
+		{
+			uint64_t x = ~th->bits[w];
+
+			if( w == len / 64 )
+				x &= (UINT64_C(1) << len%64) - 1;
+
+			for(; x; x &= x - 1)
+			{
+				uint128_t k = c + CLASSES * ((uint128_t)j_base + w * 64 + (uint32_t)__builtin_ctzll(x));
+				uint128_t q = 2 * tf->p * k + 1;
+
+				th->q[th->batch] = q;
+				th->q64[th->batch] = (uint64_t)q;
+
+				if( ++th->batch == BATCH )
+					tf_flush(th);
+			}
+		}
+
+		// the segment is done
+		tf_flush(th);
+
+		__atomic_fetch_add(&tf->candidates, len, __ATOMIC_RELAXED);
+		__atomic_store_n(&tf->done[u], j_base + len - tf->begin[u], __ATOMIC_RELEASE);
+
+		if( __atomic_load_n(&tf->stop, __ATOMIC_RELAXED) )
+			return 0;
+	}
+
+	return 1;
+}
+
+// the next unit of the thread, stolen if needed, or -1
+static
+int64_t tf_next(struct tf_thread *th)
+{
+	struct tf_queue *own = &th->queues[th->id];
+
+	pthread_mutex_lock(&own->mutex);
+
+	if( own->head < own->tail )
+	{
+		size_t u = own->head++;
+
+		pthread_mutex_unlock(&own->mutex);
+
+		return (int64_t)u;
+	}
+
+	pthread_mutex_unlock(&own->mutex);
+
+	// steal the upper half of the longest queue
+	for(;;)
+	{
+		int victim = -1;
+		size_t longest = 0;
+
+		for(int t = 0; t < th->threads; t++)
+		{
+			struct tf_queue *queue = &th->queues[t];
+
+			pthread_mutex_lock(&queue->mutex);
+
+			if( queue->tail - queue->head > longest )
+			{
+				longest = queue->tail - queue->head;
+				victim = t;
+			}
+
+			pthread_mutex_unlock(&queue->mutex);
+		}
+
+		if( -1 == victim )
+			return -1;
+
+		struct tf_queue *queue = &th->queues[victim];
+		size_t head, tail;
+
+		pthread_mutex_lock(&queue->mutex);
+
+		tail = queue->tail;
+		head = queue->head + (queue->tail - queue->head) / 2;
+
+		if( head < tail )
+			queue->tail = head;
+
+		pthread_mutex_unlock(&queue->mutex);
+
+		// someone was faster
+		if( head >= tail )
+			continue;
+
+		pthread_mutex_lock(&own->mutex);
+		own->head = head + 1;
+		own->tail = tail;
+		pthread_mutex_unlock(&own->mutex);
+
+		return (int64_t)head;
+	}
+}
+
+static
+void *tf_thread(void *arg)
+{
+	struct tf_thread *th = arg;
+	struct tf *tf = th->tf;
+
+	for(int64_t u; !__atomic_load_n(&tf->stop, __ATOMIC_RELAXED) && (u = tf_next(th)) >= 0;)
+	{
+		if( !tf_unit(th, (size_t)u) )
+			break;
+	}
+
+	__atomic_fetch_sub(&tf->running, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+// 1 if all the units are done
+static
+int tf_finished(const struct tf *tf)
+{
+	for(size_t u = 0; u < tf->units; u++)
+	{
+		if( tf->begin[u] + tf->done[u] < tf->end[u] )
+			return 0;
+	}
+
+	return 1;
+}
+
+// the share of the candidates done, and the bound below which all of them are done
+static
+void tf_dump(const struct tf *tf, double secs)
+{
+	uint128_t total = 0, done = 0;
+	uint128_t below = UINT128_MAX;
+
+	for(size_t u = 0; u < tf->units; u++)
+	{
+		uint64_t d = __atomic_load_n(&tf->done[u], __ATOMIC_ACQUIRE);
+
+		total += tf->end[u] - tf->begin[u];
+		done += d;
+
+		if( tf->begin[u] + d < tf->end[u] )
+		{
+			uint128_t k = tf->classes[u % (size_t)tf->class_count] + CLASSES * ((uint128_t)tf->begin[u] + d);
+
+			if( k < below )
+				below = k;
+		}
+	}
+
+	uint128_t limit = below == UINT128_MAX ? UINT128_1 << tf->to : 2 * tf->p * below + 1;
+	uint64_t candidates = __atomic_load_n(&tf->candidates, __ATOMIC_RELAXED);
+	char buf[40];
+
+	message("%.1f seconds elapsed, %" PRIu64 " candidates sieved, %" PRIu64 " powered (%.0f candidates per sec).\n",
+		secs, candidates, __atomic_load_n(&tf->tested, __ATOMIC_RELAXED), secs > 0 ? (double)candidates / secs : 0.);
+	message("%.2f %% of the range done, all the factors below %s are tried.\n",
+		total ? 100. * (double)done / (double)total : 100., mp_uint128_to_str(buf, limit));
+}
+
+static
+double elapsed(const struct timespec *tp0)
+{
+	struct timespec tp1;
+
+	clock_gettime(CLOCK_REALTIME, &tp1);
+
+	return (double)(tp1.tv_sec - tp0->tv_sec) + (double)(tp1.tv_nsec - tp0->tv_nsec) * 1e-9;
+}
+
+// returns the smallest factor found, or 0
+static
+uint128_t tf_run(struct tf *tf, int threads, const char *progress_path, int interval)
+{
+	if( tf_load(tf, progress_path) )
+	{
+		message("The progress was restored from '%s'.\n", progress_path);
+
+		if( tf->factor && !tf->all )
+		{
+			char buf[40];
+
+			message(INFO "success, %s | M(%" PRIu64 ") is already known\n", mp_uint128_to_str(buf, tf->factor), tf->p);
+
+			return tf->factor;
+		}
+	}
+
+	message(INFO "%i classes in %zu units, %zu sieve primes, %i threads\n", tf->class_count, tf->units, tf->count, threads);
+
+	struct tf_queue *queues = malloc((size_t)threads * sizeof(struct tf_queue));
+	struct tf_thread *ths = malloc((size_t)threads * sizeof(struct tf_thread));
+
+	if( NULL == queues || NULL == ths )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return 0;
+	}
+
+	struct timespec tp0;
+
+	clock_gettime(CLOCK_REALTIME, &tp0);
+
+	int started = 0;
+
+	tf->running = threads;
+
+	for(int t = 0; t < threads; t++)
+	{
+		pthread_mutex_init(&queues[t].mutex, NULL);
+		queues[t].head = tf->units * (size_t)t / (size_t)threads;
+		queues[t].tail = tf->units * (size_t)(t + 1) / (size_t)threads;
+
+		ths[t].tf = tf;
+		ths[t].queues = queues;
+		ths[t].threads = threads;
+		ths[t].id = t;
+		ths[t].batch = 0;
+		ths[t].offsets = malloc((tf->count ? tf->count : 1) * sizeof(uint32_t));
+	}
+
+	for(int t = 0; t < threads; t++)
+	{
+		if( NULL == ths[t].offsets || pthread_create(&ths[t].thread, NULL, tf_thread, &ths[t]) )
+		{
+			message(ERR "Unable to start a thread :(\n");
+			__atomic_store_n(&tf->stop, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_sub(&tf->running, threads - t, __ATOMIC_RELEASE);
+			break;
+		}
+
+		started++;
+	}
+
+	time_t last = time(NULL);
+
+	while( __atomic_load_n(&tf->running, __ATOMIC_ACQUIRE) > 0 )
+	{
+		struct timespec ts = { 0, 100000000 };
+
+		nanosleep(&ts, NULL);
+
+		if( g_term )
+		{
+			__atomic_store_n(&tf->stop, 1, __ATOMIC_RELAXED);
+		}
+
+		if( g_info )
+		{
+			tf_dump(tf, elapsed(&tp0));
+
+			g_info = 0;
+		}
+
+		if( g_save || (interval > 0 && time(NULL) - last >= interval) )
+		{
+			tf_save(tf, progress_path);
+
+			last = time(NULL);
+			g_save = 0;
+		}
+	}
+
+	for(int t = 0; t < started; t++)
+	{
+		pthread_join(ths[t].thread, NULL);
+	}
+
+	tf_save(tf, progress_path);
+
+	tf_dump(tf, elapsed(&tp0));
+
+	for(int t = 0; t < threads; t++)
+	{
+		free(ths[t].offsets);
+		pthread_mutex_destroy(&queues[t].mutex);
+	}
+
+	free(queues);
+	free(ths);
+
+	return tf->factor;
+}
+
+// exponents interleaved by a thread in the batch mode
+#define GROUP 64
+
+/**
+ * Trial factoring of a list of exponents up to a common bit level. A thread
+ * takes a group of exponents at once: the roots -1/(2n) (mod r) of the whole
+ * group cost a single inversion per sieve prime (the product of the group is
+ * inverted and the inverses are peeled off), the k of each exponent are
+ * sieved without the classes (the small work units would not pay for their
+ * setup), and the survivors of all the exponents share the batches of the
+ * powering, a lane per exponent. The factors go to the record and the
+ * journal, the exponents done without a factor raise their depth in the
+ * status, so that a rerun skips them.
+ */
+struct batch {
+	const uint32_t *exponents;
+	size_t count;
+	int from; // unless the status knows better
+	int to;
+	struct mp_record *record;
+	struct mp_journal *journal;
+	struct mp_status *status; // NULL if there is none
+	pthread_mutex_t mutex; // of the journal
+	uint32_t *primes; // sieve primes, 3 and above
+	size_t prime_count;
+	size_t next; // the next group
+	int stop;
+	int running;
+	uint64_t candidates;
+	uint64_t tested;
+	uint64_t done; // exponents
+	uint64_t eliminated;
+	uint64_t skipped;
+};
+
+struct batch_thread {
+	struct batch *batch;
+	pthread_t thread;
+	size_t size; // exponents in the group
+	uint32_t n[GROUP];
+	int found[GROUP];
+	uint32_t *roots; // [prime][exponent], UINT32_MAX if r | 2n
+	uint32_t *offsets; // the next k of the exponent to be marked, per prime
+	uint32_t products[GROUP];
+	uint64_t bits[SEGMENT/64];
+	size_t len;
+	int lane[BATCH]; // exponent of the lane in the group
+	uint128_t q[BATCH];
+	uint128_t e[BATCH];
+	uint128_t r[BATCH];
+	uint64_t q64[BATCH];
+	uint64_t e64[BATCH];
+	uint64_t r64[BATCH];
+};
+
+// the roots of all the exponents of the group, an inversion per prime
+static
+void batch_roots(struct batch_thread *th)
+{
+	struct batch *batch = th->batch;
+
+	for(size_t n = 0; n < batch->prime_count; n++)
+	{
+		uint32_t r = batch->primes[n];
+		uint32_t *roots = th->roots + n * GROUP;
+		uint64_t product = 1;
+
+		// the prefix products of 2n (mod r), r | 2n is left out
+		for(size_t g = 0; g < th->size; g++)
+		{
+			uint64_t a = 2 * (uint64_t)th->n[g] % r;
+
+			if( a )
+				product = product * a % r;
+
+			th->products[g] = (uint32_t)product;
+		}
+
+		uint64_t inv = uint32_pow_mod((uint32_t)product, r - 2, r);
+
+		for(size_t g = th->size; g-- > 0;)
+		{
+			uint64_t a = 2 * (uint64_t)th->n[g] % r;
+
+			if( 0 == a )
+			{
+				roots[g] = UINT32_MAX;
+				continue;
+			}
+
+			// 1/(2n) = 1/(a_0 ... a_g) * (a_0 ... a_{g-1})
+			uint64_t inv_a = g ? inv * th->products[g-1] % r : inv;
+
+			inv = inv * a % r;
+
+			// 2kn == -1 (mod r)
+			roots[g] = (uint32_t)(inv_a ? r - inv_a : 0);
+		}
+	}
+}
+
+// power the batch, eliminate the exponents
+static
+void batch_flush(struct batch_thread *th)
+{
+	struct batch *batch = th->batch;
+
+	if( batch->to <= 63 )
+	{
+		mp_uint64_pow2_mod_batch(th->len, th->q64, th->e64, th->r64);
+
+		for(size_t i = 0; i < th->len; i++)
+			th->q[i] = th->q64[i], th->r[i] = th->r64[i];
+	}
+	else
+	{
+		mp_uint128_pow2_mod_batch(th->len, th->q, th->e, th->r);
+	}
+
+	for(size_t i = 0; i < th->len; i++)
+	{
+		int g = th->lane[i];
+
+		if( 1 == th->r[i] && !th->found[g] )
+		{
+			char buf[40];
+
+			th->found[g] = 1;
+
+			message(INFO "success, %s | M(%" PRIu32 ")\n", mp_uint128_to_str(buf, th->q[i]), th->n[g]);
+
+			if( 0 == mp_record_set_bit(batch->record, (int)th->n[g]) )
+				__atomic_fetch_add(&batch->eliminated, 1, __ATOMIC_RELAXED);
+
+			pthread_mutex_lock(&batch->mutex);
+			mp_journal_add(batch->journal, (int)th->n[g], th->q[i]);
+			pthread_mutex_unlock(&batch->mutex);
+		}
+	}
+
+	__atomic_fetch_add(&batch->tested, th->len, __ATOMIC_RELAXED);
+
+	th->len = 0;
+}
+
+// the k of the exponent g, returns 0 if it was interrupted
+static
+int batch_exponent(struct batch_thread *th, int g, int from)
+{
+	struct batch *batch = th->batch;
+	uint64_t n = th->n[g];
+
+	// 2kn + 1 >= 2^from, 2kn + 1 < 2^to
+	uint128_t k_min = ((UINT128_1 << from) - 1 + 2*n - 1) / (2*n);
+	uint128_t k_max = ((UINT128_1 << batch->to) - 2) / (2*n);
+
+	if( k_min < 1 )
+		k_min = 1;
+
+	if( k_min > k_max )
+		return 1;
+
+	// q == +-1 (mod 8) as a pattern of k (mod 4), a segment starts at k_min (mod 4)
+	uint64_t pattern = 0;
+
+	for(int i = 0; i < 64; i++)
+	{
+		uint64_t q8 = (2 * (n % 8) * ((uint64_t)(k_min + (uint128_t)i) % 4) + 1) % 8;
+
+		if( q8 == 1 || q8 == 7 )
+			pattern |= UINT64_C(1) << i;
+	}
+
+	const uint32_t *roots = th->roots;
+
+	for(size_t m = 0; m < batch->prime_count; m++)
+	{
+		uint32_t r = batch->primes[m];
+		uint32_t root = roots[m * GROUP + (size_t)g];
+
+		if( UINT32_MAX == root )
+		{
+			th->offsets[m] = UINT32_MAX;
+			continue;
+		}
+
+		uint32_t offset = (uint32_t)((root + r - (uint32_t)(k_min % r)) % r);
+
+		// keep the prime itself
+		if( 2 * n * (k_min + offset) + 1 == r )
+			offset += r;
+
+		th->offsets[m] = offset;
+	}
+
+	for(uint128_t k_base = k_min; k_base <= k_max; k_base += SEGMENT)
+	{
+		uint32_t len = k_max - k_base + 1 < SEGMENT ? (uint32_t)(k_max - k_base + 1) : SEGMENT;
+
+		memset(th->bits, 0, (len + 63) / 64 * sizeof(uint64_t));
+
+		for(size_t m = 0; m < batch->prime_count; m++)
+		{
+			uint32_t r = batch->primes[m];
+			uint32_t i = th->offsets[m];
+
+			if( UINT32_MAX == i )
+				continue;
+
+			for(; i < len; i += r)
+				th->bits[i/64] |= UINT64_C(1) << i%64;
+
+			th->offsets[m] = i - len;
+		}
+
+		// the survivors
+		for(uint32_t w = 0; w < (len + 63) / 64; w++)
+		{
+			uint64_t x = ~th->bits[w] & pattern;
+
+			if( w == len / 64 )
+				x &= (UINT64_C(1) << len%64) - 1;
+
+			for(; x; x &= x - 1)
+			{
+				uint128_t q = 2 * n * (k_base + w * 64 + (uint32_t)__builtin_ctzll(x)) + 1;
+
+				th->lane[th->len] = g;
+				th->q[th->len] = q;
+				th->e[th->len] = n;
+				th->q64[th->len] = (uint64_t)q;
+				th->e64[th->len] = n;
+
+				if( ++th->len == BATCH )
+					batch_flush(th);
+			}
+		}
+
+		__atomic_fetch_add(&batch->candidates, len, __ATOMIC_RELAXED);
+
+		if( th->found[g] )
+			return 1;
+
+		if( __atomic_load_n(&batch->stop, __ATOMIC_RELAXED) )
+			return 0;
+	}
+
+	return 1;
+}
+
+static
+void *batch_thread(void *arg)
+{
+	struct batch_thread *th = arg;
+	struct batch *batch = th->batch;
+
+	while( !__atomic_load_n(&batch->stop, __ATOMIC_RELAXED) )
+	{
+		size_t first = __atomic_fetch_add(&batch->next, GROUP, __ATOMIC_RELAXED);
+		int from[GROUP];
+
+		if( first >= batch->count )
+			break;
+
+		th->size = 0;
+
+		for(size_t i = first; i < first + GROUP && i < batch->count; i++)
+		{
+			uint32_t n = batch->exponents[i];
+			int depth = batch->status ? mp_status_get_tf(batch->status, (int)n) : 0;
+
+			// eliminated, or deep enough
+			if( mp_record_get_bit(batch->record, (int)n) || depth >= batch->to )
+			{
+				__atomic_fetch_add(&batch->skipped, 1, __ATOMIC_RELAXED);
+				continue;
+			}
+
+			from[th->size] = depth > 0 ? depth : batch->from;
+			th->found[th->size] = 0;
+			th->n[th->size++] = n;
+		}
+
+		batch_roots(th);
+
+		size_t g = 0;
+
+		for(; g < th->size; g++)
+		{
+			if( !batch_exponent(th, (int)g, from[g]) )
+				break;
+		}
+
+		// the factors of the survivors in the batch
+		batch_flush(th);
+
+		// the exponents done without a factor
+		for(size_t i = 0; i < g; i++)
+		{
+			if( !th->found[i] && batch->status )
+				mp_status_set_tf(batch->status, (int)th->n[i], batch->to);
+		}
+
+		__atomic_fetch_add(&batch->done, g, __ATOMIC_RELAXED);
+	}
+
+	__atomic_fetch_sub(&batch->running, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static
+void batch_dump(const struct batch *batch, double secs)
+{
+	uint64_t candidates = __atomic_load_n(&batch->candidates, __ATOMIC_RELAXED);
+
+	message("%.1f seconds elapsed, %" PRIu64 " candidates sieved, %" PRIu64 " powered (%.0f candidates per sec).\n",
+		secs, candidates, __atomic_load_n(&batch->tested, __ATOMIC_RELAXED), secs > 0 ? (double)candidates / secs : 0.);
+	message("%" PRIu64 " of %zu exponents done, %" PRIu64 " eliminated, %" PRIu64 " skipped.\n",
+		__atomic_load_n(&batch->done, __ATOMIC_RELAXED), batch->count,
+		__atomic_load_n(&batch->eliminated, __ATOMIC_RELAXED), __atomic_load_n(&batch->skipped, __ATOMIC_RELAXED));
+}
+
+// trial factor all the exponents of the list up to 2^to, returns the exit code
+static
+int batch_run(const char *list_path, const char *record_path, const char *status_path, int from, int to, uint32_t bound, int threads, const uint8_t *primes, int exponent_limit)
+{
+	struct batch batch;
+	size_t count;
+
+	uint32_t *exponents = mp_list_load(list_path, &count);
+
+	if( NULL == exponents )
+		return 1;
+
+	// only the prime exponents the record can hold
+	size_t kept = 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		uint32_t n = exponents[i];
+
+		if( n > 2 && n < (uint32_t)exponent_limit && !is_composite(primes, n) )
+			exponents[kept++] = n;
+	}
+
+	message(INFO "%zu prime exponents of %zu in the list\n", kept, count);
+
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		free(exponents);
+		return 1;
+	}
+
+	struct mp_journal journal;
+	if( mp_journal_open_record(&journal, record_path) )
+	{
+		mp_record_close(&record);
+		free(exponents);
+		return 1;
+	}
+
+	struct mp_status status;
+	int has_status = 0 == mp_status_open(&status, status_path, exponent_limit, primes, MP_STATUS_RDWR);
+
+	batch.exponents = exponents;
+	batch.count = kept;
+	batch.from = from;
+	batch.to = to;
+	batch.record = &record;
+	batch.journal = &journal;
+	batch.status = has_status ? &status : NULL;
+	batch.next = 0;
+	batch.stop = 0;
+	batch.candidates = 0;
+	batch.tested = 0;
+	batch.done = 0;
+	batch.eliminated = 0;
+	batch.skipped = 0;
+	batch.prime_count = 0;
+	batch.primes = malloc((bound / 2 + 1) * sizeof(uint32_t));
+
+	pthread_mutex_init(&batch.mutex, NULL);
+
+	for(uint32_t r = 3; NULL != batch.primes && r < bound; r += 2)
+	{
+		if( !is_composite(primes, r) )
+			batch.primes[batch.prime_count++] = r;
+	}
+
+	struct batch_thread *ths = malloc((size_t)threads * sizeof(struct batch_thread));
+
+	if( NULL == batch.primes || NULL == ths )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return 1;
+	}
+
+	message(INFO "trial factoring up to 2^%i, %zu sieve primes, %i threads\n", to, batch.prime_count, threads);
+
+	struct timespec tp0;
+
+	clock_gettime(CLOCK_REALTIME, &tp0);
+
+	int started = 0;
+
+	batch.running = threads;
+
+	for(int t = 0; t < threads; t++)
+	{
+		ths[t].batch = &batch;
+		ths[t].len = 0;
+		ths[t].roots = malloc(batch.prime_count * GROUP * sizeof(uint32_t) + 1);
+		ths[t].offsets = malloc(batch.prime_count * sizeof(uint32_t) + 1);
+
+		if( NULL == ths[t].roots || NULL == ths[t].offsets || pthread_create(&ths[t].thread, NULL, batch_thread, &ths[t]) )
+		{
+			message(ERR "Unable to start a thread :(\n");
+			__atomic_store_n(&batch.stop, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_sub(&batch.running, threads - t, __ATOMIC_RELEASE);
+			free(ths[t].roots);
+			free(ths[t].offsets);
+			break;
+		}
+
+		started++;
+	}
+
+	while( __atomic_load_n(&batch.running, __ATOMIC_ACQUIRE) > 0 )
+	{
+		struct timespec ts = { 0, 100000000 };
+
+		nanosleep(&ts, NULL);
+
+		if( g_term )
+		{
+			__atomic_store_n(&batch.stop, 1, __ATOMIC_RELAXED);
+		}
+
+		if( g_info )
+		{
+			batch_dump(&batch, elapsed(&tp0));
+
+			g_info = 0;
+		}
+	}
+
+	for(int t = 0; t < started; t++)
+	{
+		pthread_join(ths[t].thread, NULL);
+
+		free(ths[t].roots);
+		free(ths[t].offsets);
+	}
+
+	batch_dump(&batch, elapsed(&tp0));
+
+	mp_journal_sync(&journal);
+	mp_journal_close(&journal);
+
+	if( has_status )
+	{
+		mp_status_sync(&status);
+		mp_status_close(&status);
+	}
+
+	mp_record_sync(&record);
+	mp_record_close(&record);
+
+	pthread_mutex_destroy(&batch.mutex);
+
+	int finished = batch.done + batch.skipped == batch.count;
+
+	free(batch.primes);
+	free(ths);
+	free(exponents);
+
+	return finished ? 0 : 2;
+}
+
+/**
+ * The k of the order search in increasing order: the products of at most
+ * factors primes of the table (with repetition). Each k = m * P[i] with P[i]
+ * its largest prime has a single parent, m * P[i-1] if that is still sorted,
+ * otherwise m, so every k is reached once and each pop pushes at most two
+ * children (m * P[i+1] and k * P[i]). The heap holds the frontier only.
+ * The enumeration starts at k_min: the heap is seeded with the k >= k_min
+ * whose parent is below k_min, the prefixes below k_min are walked once.
+ */
+struct smooth_item {
+	uint128_t k;
+	uint32_t i; // the index of the largest prime
+	uint32_t c; // the number of primes
+};
+
+struct smooth {
+	const uint32_t *primes;
+	size_t count;
+	uint32_t factors;
+	uint128_t k_min;
+	uint128_t k_max;
+	struct smooth_item *heap;
+	size_t len;
+	size_t capacity;
+};
+
 static
-int int128_clz(int128_t x)
+int smooth_push(struct smooth *s, uint128_t k, uint32_t i, uint32_t c)
 {
-	// high part
-	if( x>>64 )
+	if( s->len == s->capacity )
 	{
-		return __builtin_clzl((int64_t)(x>>64));
+		size_t capacity = 2 * s->capacity + 1024;
+		struct smooth_item *heap = realloc(s->heap, capacity * sizeof(struct smooth_item));
+
+		if( NULL == heap )
+		{
+			message(ERR "Unable to allocate memory :(\n");
+			return -1;
+		}
+
+		s->heap = heap;
+		s->capacity = capacity;
 	}
-	else
-	// low part
+
+	size_t j = s->len++;
+
+	for(; j > 0 && s->heap[(j-1)/2].k > k; j = (j-1)/2)
+		s->heap[j] = s->heap[(j-1)/2];
+
+	s->heap[j] = (struct smooth_item){ k, i, c };
+
+	return 0;
+}
+
+// the first index from i on with P[j] >= x
+static
+size_t smooth_lower_bound(const struct smooth *s, size_t i, uint128_t x)
+{
+	size_t j = s->count;
+
+	while( i < j )
 	{
-		return 64 + __builtin_clzl((int64_t)(x));
+		size_t h = i + (j - i) / 2;
+
+		if( s->primes[h] < x )
+			i = h + 1;
+		else
+			j = h;
 	}
+
+	return i;
 }
 
-int main(int argc, char *argv[])
+// the prefix m < k_min of c primes, P[i] the largest one: seed its first k >= k_min, walk the longer prefixes below k_min
+static
+int smooth_seed(struct smooth *s, uint128_t m, size_t i, uint32_t c)
 {
-	(void)argc;
-	message("%s: Mersenne number factorization, 128-bit factors\n", argv[0]);
+	if( c >= s->factors )
+		return 0;
 
-	// Find a factor of M(p), p : PRIME
-	int128_t p = 74551753;
+	size_t j = smooth_lower_bound(s, i, (s->k_min + m - 1) / m);
 
-	message(INFO "factoring %" PRId64 ":%" PRId64 "... :)\n", INT128_H64L64(p));
+	if( j < s->count && m * s->primes[j] <= s->k_max )
+	{
+		if( smooth_push(s, m * s->primes[j], (uint32_t)j, c + 1) )
+			return -1;
+	}
 
-	// check p : PRIME
-	if( !mp_int128_is_prime_wheel30(p) )
+	// m * P[t] < k_min for t < j, its own k >= m * P[t]^2
+	for(size_t t = i; t < j && m * s->primes[t] <= s->k_max / s->primes[t]; t++)
 	{
-		message(ERR "%" PRId64 ":%" PRId64 " not a prime!\n", INT128_H64L64(p));
-		return 1;
+		if( smooth_seed(s, m * s->primes[t], t, c + 1) )
+			return -1;
+	}
+
+	return 0;
+}
+
+static
+int smooth_init(struct smooth *s, const uint32_t *primes, size_t count, uint32_t factors, uint128_t k_min, uint128_t k_max)
+{
+	s->primes = primes;
+	s->count = count;
+	s->factors = factors;
+	s->k_min = k_min;
+	s->k_max = k_max;
+	s->heap = NULL;
+	s->len = 0;
+	s->capacity = 0;
+
+	if( k_min <= 1 )
+		return smooth_push(s, 1, 0, 0);
+
+	return smooth_seed(s, 1, 0, 0);
+}
+
+static
+void smooth_free(struct smooth *s)
+{
+	free(s->heap);
+}
+
+// the next k, 0 at the end or on failure
+static
+uint128_t smooth_next(struct smooth *s)
+{
+	if( 0 == s->len )
+		return 0;
+
+	struct smooth_item top = s->heap[0];
+	struct smooth_item last = s->heap[--s->len];
+	size_t j = 0;
+
+	for(size_t child; (child = 2*j + 1) < s->len; j = child)
+	{
+		if( child + 1 < s->len && s->heap[child + 1].k < s->heap[child].k )
+			child++;
+
+		if( last.k <= s->heap[child].k )
+			break;
+
+		s->heap[j] = s->heap[child];
 	}
 
-	message(INFO "order-0 factoring...\n");
+	if( s->len )
+		s->heap[j] = last;
 
-	// if ( p * 2 ) + 1 > MAX
-	if( p > (INT128_MAX - 1) / 2 )
+	if( 0 == top.c )
 	{
-		message(ERR "overflow!\n");
-		return 1;
+		if( s->factors && s->count && s->primes[0] <= s->k_max && smooth_push(s, s->primes[0], 0, 1) )
+			return 0;
+
+		return top.k;
 	}
 
+	uint32_t i = top.i;
+
+	// m * P[i+1]
+	if( i + 1 < s->count && top.k / s->primes[i] <= s->k_max / s->primes[i+1] )
 	{
-		int128_t q = ( p * 2 ) + 1;
+		if( smooth_push(s, top.k / s->primes[i] * s->primes[i+1], i + 1, top.c) )
+			return 0;
+	}
 
-		if( mp_int128_dpow2_pl_log(q, p) == 1 )
-		{
-			message(INFO "success, %" PRId64 ":%" PRId64 " | M(%" PRId64 ":%" PRId64 ")\n", INT128_H64L64(q), INT128_H64L64(p));
+	// k * P[i]
+	if( top.c < s->factors && top.k <= s->k_max / s->primes[i] )
+	{
+		if( smooth_push(s, top.k * s->primes[i], i, top.c + 1) )
 			return 0;
+	}
+
+	return top.k;
+}
+
+// the smallest factor q = 2kp + 1 in [2^from; 2^to), k : SMOOTH, returns the factor, 0 if none, -1 on failure
+static
+int128_t order_search(uint64_t p, int from, int to, uint32_t smoothness, int factors, const uint8_t *primes)
+{
+	// 2kp + 1 >= 2^from, 2kp + 1 < 2^to
+	uint128_t k_min = ((UINT128_1 << from) - 1 + 2*p - 1) / (2*p);
+	uint128_t k_max = ((UINT128_1 << to) - 2) / (2*p);
+
+	size_t count = 0;
+	uint32_t *table = malloc(((size_t)smoothness / 2 + 2) * sizeof(uint32_t));
+
+	if( NULL == table )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	for(uint32_t a = 2; a <= smoothness; a++)
+	{
+		if( !is_composite(primes, a) )
+			table[count++] = a;
+	}
+
+	message(INFO "searching k with at most %i prime factors below %" PRIu32 " (%zu primes)...\n", factors, smoothness, count);
+
+	struct smooth s;
+	struct mp_plan plan;
+	uint128_t q[BATCH], r[BATCH];
+	uint64_t q64[BATCH], r64[BATCH];
+	uint64_t yielded = 0, tested = 0;
+	int128_t factor = 0;
+
+	mp_plan_init(&plan, p);
+
+	if( smooth_init(&s, table, count, (uint32_t)factors, k_min, k_max) )
+	{
+		smooth_free(&s);
+		free(table);
+		return -1;
+	}
+
+	for(int end = 0; !end && !factor && !g_term;)
+	{
+		size_t len = 0;
+
+		while( len < BATCH )
+		{
+			uint128_t k = smooth_next(&s);
+
+			if( 0 == k )
+			{
+				end = 1;
+				break;
+			}
+
+			yielded++;
+
+			uint128_t c = 2 * k * p + 1;
+
+			// q == +-1 (mod 8)
+			if( (c & 7) == 1 || (c & 7) == 7 )
+				q[len++] = c;
+		}
+
+		if( to <= 63 )
+		{
+			for(size_t i = 0; i < len; i++)
+				q64[i] = (uint64_t)q[i];
+
+			mp_plan_pow2_mod64(&plan, len, q64, r64);
+
+			for(size_t i = 0; i < len; i++)
+				r[i] = r64[i];
 		}
+		else
+		{
+			mp_plan_pow2_mod128(&plan, len, q, r);
+		}
+
+		tested += len;
+
+		// the batch is ascending
+		for(size_t i = 0; i < len && !factor; i++)
+		{
+			if( 1 == r[i] )
+				factor = (int128_t)q[i];
+		}
+
+		if( g_info )
+		{
+			char buf[40];
+
+			message("%" PRIu64 " k enumerated, %" PRIu64 " candidates powered, heap of %zu, at k = %s\n", yielded, tested, s.len, mp_uint128_to_str(buf, len ? (q[len-1] - 1) / (2*p) : k_min));
+
+			g_info = 0;
+		}
+
+		// the enumeration failed
+		if( end && s.len )
+			factor = -1;
 	}
 
+	message(INFO "%" PRIu64 " k enumerated, %" PRIu64 " candidates powered\n", yielded, tested);
+
+	smooth_free(&s);
+	free(table);
+
+	return factor;
+}
+
+int main(int argc, char *argv[])
+{
+	message("%s: Mersenne number factorization, 128-bit factors\n", argv[0]);
+
+	// Find a factor of M(p), p : PRIME
+	int128_t p = 74551753;
+
 	int exponent_limit = 256*1024*1024; // 2^8 * 2^10 * 2^10
-	int log2_exponent_limit = 8*(int)sizeof(int128_t) - int128_clz(exponent_limit-1); // 8 + 10 + 10
-	int prefactored_bitlevel = 75;
+	const char *status_path = "status.bin";
+	int prefactored_bitlevel = 75; // unless the status knows better
+	int bitlevel = -1; // one bit level above the prefactored one
+	int sieve_bound = 1 << 17;
+	int all = 0;
+	int order = 0;
+	int smoothness = -1; // the prime table
+	int factors = 2;
+	unsigned int timeout = 0; // no limit
+	int interval = 60; // checkpoint every minute
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	const char *progress_path = "factor.state";
+	const char *list_path = NULL; // a single exponent
+	const char *record_path = "record.bits";
+
+	// parse command-line options
+	for(int opt; (opt = getopt(argc, argv, "h:s:b:e:l:aoS:f:t:c:j:p:L:r:")) != -1;)
+	{
+		switch(opt)
+		{
+			// -h EXP : highest exponent in the prime table
+			case 'h':
+				exponent_limit = atoi(optarg);
+				if( exponent_limit < 2 )
+				{
+					message(WARN "Invalid exponent, keeping the default one!\n");
+					exponent_limit = 256*1024*1024;
+				}
+				break;
+			// -s FILE : status of the trial factoring per prime exponent (see download-gimps/reader)
+			case 's':
+				status_path = optarg;
+				break;
+			// -b BITS : factors below 2^BITS are known to be tried, if the status does not tell
+			case 'b':
+				prefactored_bitlevel = atoi(optarg);
+				break;
+			// -e BITS : try the factors below 2^BITS (at most 127)
+			case 'e':
+				bitlevel = atoi(optarg);
+				break;
+			// -l BOUND : sieve the candidates by the primes below BOUND
+			case 'l':
+				sieve_bound = atoi(optarg);
+				break;
+			// -a : report all the factors in the range, do not stop at the first one
+			case 'a':
+				all = 1;
+				break;
+			// -o : search the factors 2kp + 1 of k : SMOOTH in increasing order instead of all k
+			case 'o':
+				order = 1;
+				break;
+			// -S BOUND : the prime factors of k in the order search are at most BOUND
+			case 'S':
+				smoothness = atoi(optarg);
+				break;
+			// -f COUNT : k in the order search has at most COUNT prime factors
+			case 'f':
+				factors = atoi(optarg);
+				break;
+			// -t SECS : terminate the trial factoring after given time limit (in seconds)
+			case 't':
+				timeout = (unsigned int)atoi(optarg);
+				break;
+			// -c SECS : checkpoint interval (in seconds), 0 disables the autosave
+			case 'c':
+				interval = atoi(optarg);
+				break;
+			// -j THREADS : number of threads
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			// -p FILE : progress of the trial factoring per work unit
+			case 'p':
+				progress_path = optarg;
+				break;
+			// -L FILE : trial factor the exponents of the list (text, one per line, or see tools/decode) up to 2^BITS of -e
+			case 'L':
+				list_path = optarg;
+				break;
+			// -r FILE : record of the eliminated exponents in the batch mode
+			case 'r':
+				record_path = optarg;
+				break;
+			default :
+				message(WARN "Unknown option :( Read the source code!\n");
+		}
+	}
+	// argument after options
+	if(optind < argc)
+	{
+		// factor-128 [OPTIONS] [EXPONENT]
+		p = (int128_t)atol(argv[optind++]);
+
+		if(optind < argc)
+		{
+			message(WARN "Too much options :( Read the source code!\n");
+		}
+	}
 
 	// create prime table
 	uint8_t *primes = load_prime_table(exponent_limit);
@@ -68,88 +1641,200 @@ int main(int argc, char *argv[])
 		save_prime_table(primes, exponent_limit);
 	}
 
-	message(INFO "order-1 factoring...\n");
+	if( list_path )
+	{
+		if( bitlevel < 1 || bitlevel > 127 || prefactored_bitlevel >= bitlevel )
+		{
+			message(ERR "invalid range of the bit levels, 2^%i to 2^%i!\n", prefactored_bitlevel, bitlevel);
+			return 1;
+		}
+
+		if( sieve_bound < 13 || sieve_bound > exponent_limit )
+		{
+			sieve_bound = exponent_limit < 1 << 17 ? exponent_limit : 1 << 17;
+			message(WARN "Invalid sieve bound, using %i!\n", sieve_bound);
+		}
+
+		if( threads < 1 )
+		{
+			threads = 1;
+		}
+
+		signal(SIGINT,  sighandler_int); // exit immediately
+		signal(SIGALRM, sighandler_alrm); // stop the threads, exit
+		signal(SIGTERM, sighandler_term); // stop the threads, exit
+		signal(SIGUSR1, sighandler_usr1); // print the throughput
+
+		// set the alarm
+		if( timeout )
+		{
+			message("Setting an alarm to be delivered in %u seconds...\n", timeout);
+			alarm(timeout);
+		}
+
+		int ret = batch_run(list_path, record_path, status_path, prefactored_bitlevel < 0 ? 0 : prefactored_bitlevel, bitlevel, (uint32_t)sieve_bound, threads, primes, exponent_limit);
+
+		free(primes);
+
+		message(2 == ret ? "The program has been interrupted.\n" : "The program has finished.\n");
+
+		return ret;
+	}
+
+	message(INFO "factoring %" PRId64 ":%" PRId64 "... :)\n", INT128_H64L64(p));
 
-	if( p > (INT128_MAX - 1) / 2 )
+	// check p : PRIME
+	if( !mp_int128_is_prime_wheel30(p) )
 	{
-		message(ERR "p * 2 overflows!\n");
+		message(ERR "%" PRId64 ":%" PRId64 " not a prime!\n", INT128_H64L64(p));
 		return 1;
 	}
 
-	if( ( 8*(int)sizeof(int128_t) - int128_clz(p * 2) ) + log2_exponent_limit < prefactored_bitlevel )
+
+	// the trial factoring depth imported from GIMPS
+	struct mp_status status;
+	if( p < (int128_t)exponent_limit && 0 == mp_status_open(&status, status_path, exponent_limit, primes, MP_STATUS_RDONLY) )
 	{
-		message(WARN "skipping the order-1 factoring due to prefactored limit\n");
+		int tf = mp_status_get_tf(&status, (int)p);
+
+		if( tf > 0 )
+		{
+			message(INFO "the trial factoring of M(%" PRId64 ":%" PRId64 ") is known up to 2^%i\n", INT128_H64L64(p), tf);
+			prefactored_bitlevel = tf;
+		}
+
+		mp_status_close(&status);
 	}
 	else
 	{
-		// for each prime 'a'
-		for(int128_t a = 2; a; a = mp_int128_next_prime_cached(a, primes, exponent_limit))
+		message(WARN "no status of the exponent, assuming the trial factoring up to 2^%i\n", prefactored_bitlevel);
+	}
+
+	if( prefactored_bitlevel < 0 )
+	{
+		prefactored_bitlevel = 0;
+	}
+
+	int128_t factor;
+
+	signal(SIGINT,  sighandler_int); // exit immediately
+	signal(SIGALRM, sighandler_alrm); // save the progress, exit
+	signal(SIGTERM, sighandler_term); // save the progress, exit
+	signal(SIGUSR1, sighandler_usr1); // print the throughput
+	signal(SIGUSR2, sighandler_usr2); // save the progress
+
+	// set the alarm
+	if( timeout )
+	{
+		message("Setting an alarm to be delivered in %u seconds...\n", timeout);
+		alarm(timeout);
+	}
+
+	if( order )
+	{
+		// the whole range, the smoothness bounds the search
+		if( bitlevel < 0 )
 		{
-			// if ( p * a * 2 ) + 1 > MAX
-			if( p > (INT128_MAX - 1) / 2 / a )
-			{
-				message(ERR "( p * a * 2 ) + 1 overflows!\n");
-				return 1;
-			}
+			bitlevel = 127;
+		}
+
+		if( bitlevel > 127 || prefactored_bitlevel >= bitlevel || p > (int128_t)INT64_MAX / 2 )
+		{
+			message(ERR "invalid range of the bit levels, 2^%i to 2^%i!\n", prefactored_bitlevel, bitlevel);
+			return 1;
+		}
+
+		if( smoothness < 2 || smoothness >= exponent_limit )
+		{
+			smoothness = exponent_limit - 1;
+		}
 
-			int128_t q = ( p * a * 2 ) + 1;
+		message(INFO "order search from 2^%i to 2^%i...\n", prefactored_bitlevel, bitlevel);
 
-			if( mp_int128_dpow2_pl_log(q, p) == 1 )
-			{
-				message(INFO "success, %" PRId64 ":%" PRId64 " | M(%" PRId64 ":%" PRId64 ")\n", INT128_H64L64(q), INT128_H64L64(p));
-				return 0;
-			}
+		factor = order_search((uint64_t)p, prefactored_bitlevel, bitlevel, (uint32_t)smoothness, factors < 0 ? 0 : factors, primes);
+
+		if( factor > 0 )
+		{
+			message(INFO "success, %" PRId64 ":%" PRId64 " | M(%" PRId64 ":%" PRId64 ")\n", INT128_H64L64(factor), INT128_H64L64(p));
 		}
-	}
 
-	message(INFO "order-2 factoring...\n");
+		if( 0 == factor && g_term )
+		{
+			free(primes);
+
+			message("The program has been interrupted.\n");
 
-	// for each prime 'a'
-	for(int128_t a = 2; a; a = mp_int128_next_prime_cached(a, primes, exponent_limit))
+			return 2;
+		}
+	}
+	else
 	{
-		message(DBG "progress: %" PRId64 ":%" PRId64 "/%" PRId64 ":%" PRId64 "\n", INT128_H64L64(a), INT128_H64L64((int128_t)exponent_limit));
+		if( bitlevel < 0 )
+		{
+			bitlevel = prefactored_bitlevel + 1;
+		}
 
-		// q0 = p * a * 2
-		if( a > (INT128_MAX - 1) / 2 / p )
+		if( bitlevel > 127 || prefactored_bitlevel >= bitlevel || p > (int128_t)INT64_MAX / 2 )
 		{
-			message(ERR "p * a * 2 overflows!\n");
+			message(ERR "invalid range of the bit levels, 2^%i to 2^%i!\n", prefactored_bitlevel, bitlevel);
 			return 1;
 		}
 
-		int128_t q0 = p * a * 2;
+		if( sieve_bound < 13 || sieve_bound > exponent_limit )
+		{
+			sieve_bound = exponent_limit < 1 << 17 ? exponent_limit : 1 << 17;
+			message(WARN "Invalid sieve bound, using %i!\n", sieve_bound);
+		}
+
+		message(INFO "trial factoring from 2^%i to 2^%i...\n", prefactored_bitlevel, bitlevel);
+
+		struct tf tf;
 
-		if( ( 8*(int)sizeof(int128_t) - int128_clz(q0) ) + log2_exponent_limit < prefactored_bitlevel )
+		if( tf_init(&tf, (uint64_t)p, prefactored_bitlevel, bitlevel, (uint32_t)sieve_bound, primes) )
 		{
-			message(WARN "skipping internal loop in the order-2 factoring due to prefactored limit\n");
+			return 1;
 		}
-		else
+
+		tf.all = all;
+
+		if( threads < 1 )
 		{
-			// for each prime 'b'
-			for(int128_t b = 2; b; b = mp_int128_next_prime_cached(b, primes, exponent_limit))
-			{
-				// if ( p * a * b * 2 ) + 1 > MAX
-				if( b > (INT128_MAX - 1) / q0 )
-				{
-					message(ERR "( p * a * b * 2 ) + 1 overflows!\n");
-					return 1;
-				}
+			threads = 1;
+		}
 
-				int128_t q = ( b * q0 ) + 1;
+		factor = (int128_t)tf_run(&tf, threads, progress_path, interval);
 
-				if( mp_int128_dpow2_pl_log(q, p) == 1 )
-				{
-					message(INFO "success, %" PRId64 ":%" PRId64 " | M(%" PRId64 ":%" PRId64 ")\n", INT128_H64L64(q), INT128_H64L64(p));
-					return 0;
-				}
-			}
+		int finished = tf_finished(&tf);
+
+		tf_free(&tf);
+
+		// the progress is saved, see submit.sh
+		if( 0 == factor && !finished )
+		{
+			free(primes);
+
+			message("The program has been interrupted.\n");
+
+			return 2;
 		}
 	}
 
-	// ...
-	message(INFO "no factor found\n");
+	if( factor < 0 )
+	{
+		return 1;
+	}
 
 	free(primes);
 
+	if( factor > 0 )
+	{
+		message("The program has finished.\n");
+
+		return 0;
+	}
+
+	message(INFO "no factor found\n");
+
 	message("The program has finished successfully.\n");
 
 	return -1;
@@ -0,0 +1,19 @@
+#!/bin/bash
+#
+#$ -N factor-128
+#$ -o factor/factor-128/logs/$JOB_NAME.$JOB_ID.out
+#$ -e factor/factor-128/logs/$JOB_NAME.$JOB_ID.err
+
+# log a node name
+uname -n
+
+# change working directory to store the progress to the right place
+cd $HOME/factor/factor-128/
+
+# limit job to one hour, the progress is saved on the alarm
+./factor-128 -t 3600 "$@"
+
+# submit again while the range is not done
+if [ $? -eq 2 ]; then
+	qsub -q all.q@@stable -l ram_free=512M $HOME/factor/factor-128/submit.sh "$@"
+fi
@@ -0,0 +1,289 @@
+#include "bitmap.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+#	include <immintrin.h>
+#endif
+
+// the word w of a bitmap of the given size in bytes, zeros beyond, NULL reads as zeros
+static
+uint64_t load(const uint8_t *p, size_t w, size_t bytes)
+{
+	uint64_t x = 0;
+
+	if( NULL == p )
+		return 0;
+
+	size_t offset = w * 8;
+	size_t len = bytes - offset < 8 ? bytes - offset : 8;
+
+	memcpy(&x, p + offset, len);
+
+	return x;
+}
+
+// (a or ~a) & ~b & ~mask
+static
+uint64_t op(const uint8_t *a, uint64_t inv, const uint8_t *b, const uint8_t *mask, size_t w, size_t bytes)
+{
+	return (load(a, w, bytes) ^ inv) & ~load(b, w, bytes) & ~load(mask, w, bytes);
+}
+
+// bits [begin; end) of the word w
+static
+uint64_t range(size_t w, size_t begin, size_t end)
+{
+	size_t lo = w * 64;
+	uint64_t x = UINT64_MAX;
+
+	if( begin > lo )
+		x &= UINT64_MAX << (begin - lo);
+
+	if( end < lo + 64 )
+		x &= ~(UINT64_MAX << (end - lo));
+
+	return x;
+}
+
+#if defined(__AVX512BW__)
+static
+__m512i popcount512(__m512i v)
+{
+#	if defined(__AVX512VPOPCNTDQ__)
+	return _mm512_popcnt_epi64(v);
+#	else
+	// nibble lookup, the bytes are summed by SAD
+	const __m512i lookup = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+	const __m512i low = _mm512_set1_epi8(0x0f);
+
+	__m512i lo = _mm512_and_si512(v, low);
+	__m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low);
+	__m512i cnt = _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo), _mm512_shuffle_epi8(lookup, hi));
+
+	return _mm512_sad_epu8(cnt, _mm512_setzero_si512());
+#	endif
+}
+#elif defined(__AVX2__)
+static
+__m256i popcount256(__m256i v)
+{
+	const __m256i lookup = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+
+	__m256i lo = _mm256_and_si256(v, low);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+	__m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+
+	return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+#endif
+
+// popcount of the whole words [w; w+words) of (a or ~a) & ~b & ~mask
+static
+size_t popcount_words(const uint8_t *a, uint64_t inv, const uint8_t *b, const uint8_t *mask, size_t w, size_t words)
+{
+	size_t count = 0;
+	size_t i = w * 8;
+	size_t end = (w + words) * 8;
+
+#if defined(__AVX512BW__)
+	__m512i acc = _mm512_setzero_si512();
+	__m512i vinv = _mm512_set1_epi64((long long)inv);
+
+	for(; i + 64 <= end; i += 64)
+	{
+		__m512i x = _mm512_xor_si512(_mm512_loadu_si512(a + i), vinv);
+
+		if( b )
+			x = _mm512_andnot_si512(_mm512_loadu_si512(b + i), x);
+		if( mask )
+			x = _mm512_andnot_si512(_mm512_loadu_si512(mask + i), x);
+
+		acc = _mm512_add_epi64(acc, popcount512(x));
+	}
+
+	count += (size_t)_mm512_reduce_add_epi64(acc);
+#elif defined(__AVX2__)
+	__m256i acc = _mm256_setzero_si256();
+	__m256i vinv = _mm256_set1_epi64x((long long)inv);
+
+	for(; i + 32 <= end; i += 32)
+	{
+		__m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)), vinv);
+
+		if( b )
+			x = _mm256_andnot_si256(_mm256_loadu_si256((const __m256i *)(b + i)), x);
+		if( mask )
+			x = _mm256_andnot_si256(_mm256_loadu_si256((const __m256i *)(mask + i)), x);
+
+		acc = _mm256_add_epi64(acc, popcount256(x));
+	}
+
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	count += (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#endif
+
+	for(; i < end; i += 8)
+	{
+		count += (size_t)__builtin_popcountll(op(a, inv, b, mask, i / 8, end));
+	}
+
+	return count;
+}
+
+static
+size_t popcount_op(const uint8_t *a, uint64_t inv, const uint8_t *b, const uint8_t *mask, size_t begin, size_t end)
+{
+	if( begin >= end )
+		return 0;
+
+	size_t bytes = (end + 7) / 8;
+	size_t w0 = begin / 64;
+	size_t w1 = (end - 1) / 64;
+
+	if( w0 == w1 )
+		return (size_t)__builtin_popcountll(op(a, inv, b, mask, w0, bytes) & range(w0, begin, end));
+
+	size_t count = 0;
+
+	count += (size_t)__builtin_popcountll(op(a, inv, b, mask, w0, bytes) & range(w0, begin, end));
+	count += (size_t)__builtin_popcountll(op(a, inv, b, mask, w1, bytes) & range(w1, begin, end));
+
+	// the words in between are whole
+	count += popcount_words(a, inv, b, mask, w0 + 1, w1 - w0 - 1);
+
+	return count;
+}
+
+size_t mp_bitmap_popcount(const uint8_t *a, size_t begin, size_t end)
+{
+	return popcount_op(a, 0, NULL, NULL, begin, end);
+}
+
+size_t mp_bitmap_popcount_andn(const uint8_t *a, const uint8_t *b, const uint8_t *mask, size_t begin, size_t end)
+{
+	return popcount_op(a, 0, b, mask, begin, end);
+}
+
+size_t mp_bitmap_popcount_nor(const uint8_t *a, const uint8_t *mask, size_t begin, size_t end)
+{
+	return popcount_op(a, UINT64_MAX, NULL, mask, begin, end);
+}
+
+// write up to max indices of set bits from *pos on, *pos is left at the next unreported one
+static
+size_t extract_op(const uint8_t *a, uint64_t inv, const uint8_t *b, const uint8_t *mask, size_t *pos, size_t end, uint32_t *out, size_t max)
+{
+	size_t bytes = (end + 7) / 8;
+	size_t count = 0;
+	size_t i = *pos;
+
+	while( i < end )
+	{
+		size_t w = i / 64;
+		uint64_t x = op(a, inv, b, mask, w, bytes) & range(w, i, end);
+
+		for(; x; x &= x - 1)
+		{
+			if( count == max )
+			{
+				*pos = w * 64 + (size_t)__builtin_ctzll(x);
+				return count;
+			}
+
+			out[count++] = (uint32_t)(w * 64 + (size_t)__builtin_ctzll(x));
+		}
+
+		i = (w + 1) * 64;
+	}
+
+	*pos = end;
+
+	return count;
+}
+
+size_t mp_bitmap_extract_andn(const uint8_t *a, const uint8_t *b, const uint8_t *mask, size_t *pos, size_t end, uint32_t *out, size_t max)
+{
+	return extract_op(a, 0, b, mask, pos, end, out, max);
+}
+
+size_t mp_bitmap_extract_nor(const uint8_t *a, const uint8_t *mask, size_t *pos, size_t end, uint32_t *out, size_t max)
+{
+	return extract_op(a, UINT64_MAX, NULL, mask, pos, end, out, max);
+}
+
+// the highest set bit of a & ~b & ~mask in [begin; end), or end if there is none
+size_t mp_bitmap_last_andn(const uint8_t *a, const uint8_t *b, const uint8_t *mask, size_t begin, size_t end)
+{
+	if( begin >= end )
+		return end;
+
+	size_t bytes = (end + 7) / 8;
+
+	for(size_t w = (end - 1) / 64 + 1; w-- > begin / 64;)
+	{
+		uint64_t x = op(a, 0, b, mask, w, bytes) & range(w, begin, end);
+
+		if( x )
+			return w * 64 + 63 - (size_t)__builtin_clzll(x);
+	}
+
+	return end;
+}
+
+// dst |= src
+void mp_bitmap_or(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t i = 0;
+
+#if defined(__AVX512BW__)
+	for(; i + 64 <= size; i += 64)
+		_mm512_storeu_si512(dst + i, _mm512_or_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+#elif defined(__AVX2__)
+	for(; i + 32 <= size; i += 32)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(dst + i)), _mm256_loadu_si256((const __m256i *)(src + i))));
+#endif
+
+	for(; i < size; i++)
+		dst[i] |= src[i];
+}
+
+// dst ^= src
+void mp_bitmap_xor(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t i = 0;
+
+#if defined(__AVX512BW__)
+	for(; i + 64 <= size; i += 64)
+		_mm512_storeu_si512(dst + i, _mm512_xor_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+#elif defined(__AVX2__)
+	for(; i + 32 <= size; i += 32)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(dst + i)), _mm256_loadu_si256((const __m256i *)(src + i))));
+#endif
+
+	for(; i < size; i++)
+		dst[i] ^= src[i];
+}
+
+// dst &= ~src
+void mp_bitmap_andn(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t i = 0;
+
+#if defined(__AVX512BW__)
+	for(; i + 64 <= size; i += 64)
+		_mm512_storeu_si512(dst + i, _mm512_andnot_si512(_mm512_loadu_si512(src + i), _mm512_loadu_si512(dst + i)));
+#elif defined(__AVX2__)
+	for(; i + 32 <= size; i += 32)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_andnot_si256(_mm256_loadu_si256((const __m256i *)(src + i)), _mm256_loadu_si256((const __m256i *)(dst + i))));
+#endif
+
+	for(; i < size; i++)
+		dst[i] &= (uint8_t)~src[i];
+}
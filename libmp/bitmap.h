@@ -0,0 +1,40 @@
+/** @file bitmap.h
+ * Vectorized kernels over bitmaps (records and prime tables)
+ */
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @defgroup bitmap bitmap
+ * @{
+ */
+
+/**
+ * The bit i is the bit i%8 of the byte i/8. The ranges [begin; end) are in
+ * bits, the arrays have to hold at least (end+7)/8 bytes. The b and mask
+ * arguments may be NULL, which stands for a bitmap of zeros. With the prime
+ * table as the mask (composites are set), the kernels only look at prime
+ * exponents.
+ */
+
+void mp_bitmap_or(uint8_t *dst, const uint8_t *src, size_t size);
+void mp_bitmap_xor(uint8_t *dst, const uint8_t *src, size_t size);
+void mp_bitmap_andn(uint8_t *dst, const uint8_t *src, size_t size);
+
+size_t mp_bitmap_popcount(const uint8_t *a, size_t begin, size_t end);
+
+// a & ~b & ~mask
+size_t mp_bitmap_popcount_andn(const uint8_t *a, const uint8_t *b, const uint8_t *mask, size_t begin, size_t end);
+// ~a & ~mask
+size_t mp_bitmap_popcount_nor(const uint8_t *a, const uint8_t *mask, size_t begin, size_t end);
+
+size_t mp_bitmap_extract_andn(const uint8_t *a, const uint8_t *b, const uint8_t *mask, size_t *pos, size_t end, uint32_t *out, size_t max);
+size_t mp_bitmap_extract_nor(const uint8_t *a, const uint8_t *mask, size_t *pos, size_t end, uint32_t *out, size_t max);
+
+size_t mp_bitmap_last_andn(const uint8_t *a, const uint8_t *b, const uint8_t *mask, size_t begin, size_t end);
+
+/** @} */
+
+#endif
@@ -0,0 +1,565 @@
+#include "checkpoint.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define WAL_MAGIC "MPWAL01\n"
+
+struct wal_header {
+	char magic[8];
+	int64_t state;
+	uint64_t size; // record size in bytes
+	uint32_t chunk; // MP_RECORD_CHUNK
+	uint32_t count; // number of chunks that follow
+};
+
+// make a rename or unlink in the directory of the path durable
+static
+int fsync_dir(const char *path)
+{
+	char dir[4096];
+	const char *slash = strrchr(path, '/');
+
+	if( NULL == slash )
+	{
+		strcpy(dir, ".");
+	}
+	else
+	{
+		size_t len = slash == path ? 1 : (size_t)(slash - path);
+
+		if( len >= sizeof(dir) )
+			return -1;
+
+		memcpy(dir, path, len);
+		dir[len] = 0;
+	}
+
+	int fd = open(dir, O_RDONLY);
+
+	if( -1 == fd )
+		return -1;
+
+	int ret = fsync(fd);
+
+	close(fd);
+
+	return ret;
+}
+
+// write the file aside, fsync it and rename it over the original one
+int mp_write_file_atomic(const char *path, const void *buf, size_t len)
+{
+	char tmp_path[4096+4];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	int fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+
+	if( -1 == fd )
+	{
+		int errsv = errno;
+		message(ERR "Unable to create '%s' :( Error: %s\n", tmp_path, strerror(errsv));
+		return -1;
+	}
+
+	const uint8_t *ptr = buf;
+
+	while( len > 0 )
+	{
+		ssize_t ret = write(fd, ptr, len);
+
+		if( -1 == ret && EINTR == errno )
+			continue;
+
+		if( -1 == ret )
+		{
+			int errsv = errno;
+			message(ERR "Unable to write into '%s' :( Error: %s\n", tmp_path, strerror(errsv));
+			close(fd);
+			unlink(tmp_path);
+			return -1;
+		}
+
+		ptr += ret;
+		len -= (size_t)ret;
+	}
+
+	if( -1 == fsync(fd) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to flush '%s' :( Error: %s\n", tmp_path, strerror(errsv));
+		close(fd);
+		unlink(tmp_path);
+		return -1;
+	}
+
+	close(fd);
+
+	if( -1 == rename(tmp_path, path) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to rename '%s' :( Error: %s\n", tmp_path, strerror(errsv));
+		unlink(tmp_path);
+		return -1;
+	}
+
+	fsync_dir(path);
+
+	return 0;
+}
+
+static
+size_t chunk_len(size_t size, size_t c)
+{
+	size_t offset = c * MP_RECORD_CHUNK;
+
+	return size - offset < MP_RECORD_CHUNK ? size - offset : MP_RECORD_CHUNK;
+}
+
+// move the dirty chunks of the record into the pending set
+static
+int collect(struct mp_checkpoint *cp)
+{
+	struct mp_record *record = cp->record;
+
+	size_t bytes = (record->chunks+7)/8;
+
+	uint8_t *pending = realloc(cp->pending, bytes);
+
+	if( NULL == pending )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", bytes);
+		return -1;
+	}
+
+	if( bytes > (cp->pending_chunks+7)/8 )
+		memset(pending + (cp->pending_chunks+7)/8, 0, bytes - (cp->pending_chunks+7)/8);
+
+	cp->pending = pending;
+	cp->pending_chunks = record->chunks;
+
+	for(size_t i = 0; i < bytes; i++)
+	{
+		pending[i] |= __atomic_exchange_n(&record->dirty[i], (uint8_t)0, __ATOMIC_RELAXED);
+	}
+
+	return 0;
+}
+
+static
+size_t pending_count(const struct mp_checkpoint *cp)
+{
+	size_t count = 0;
+
+	for(size_t i = 0; i < (cp->pending_chunks+7)/8; i++)
+	{
+		count += (size_t)__builtin_popcount(cp->pending[i]);
+	}
+
+	return count;
+}
+
+static
+double elapsed(const struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return (double)(t1.tv_sec - t0->tv_sec) + (double)(t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+int mp_checkpoint_init(struct mp_checkpoint *cp, struct mp_record *record, const char *state_path, int interval)
+{
+	cp->record = record;
+	cp->state_path = state_path;
+	cp->pending = NULL;
+	cp->pending_chunks = 0;
+	cp->interval = interval;
+	cp->last = time(NULL);
+	cp->journal = NULL;
+	cp->delta = NULL;
+	cp->snapshot.buf = NULL;
+
+	if( (size_t)snprintf(cp->wal_path, sizeof(cp->wal_path), "%s.wal", record->path) >= sizeof(cp->wal_path) )
+	{
+		message(ERR "The record path is too long!\n");
+		return -1;
+	}
+
+	if( MP_RECORD_RDWR != record->mode )
+	{
+		message(ERR "Unable to checkpoint the read-only record '%s'!\n", record->path);
+		return -1;
+	}
+
+	return collect(cp);
+}
+
+void mp_checkpoint_free(struct mp_checkpoint *cp)
+{
+	free(cp->pending);
+	free(cp->snapshot.buf);
+
+	cp->pending = NULL;
+	cp->pending_chunks = 0;
+	cp->snapshot.buf = NULL;
+}
+
+int mp_checkpoint_due(const struct mp_checkpoint *cp)
+{
+	return cp->interval > 0 && time(NULL) - cp->last >= cp->interval;
+}
+
+// copy the changed chunks and the state, this is the only part that stalls the caller
+int mp_checkpoint_prepare(struct mp_checkpoint *cp, int64_t state, struct mp_snapshot *snapshot)
+{
+	struct timespec t0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if( collect(cp) )
+		return -1;
+
+	snapshot->journal_entries = 0;
+	snapshot->journal_bytes = 0;
+
+	// the eliminations reach the file now, the fsync is left to mp_checkpoint_write
+	if( cp->journal )
+	{
+		uint32_t entries = cp->journal->count;
+		size_t bytes = cp->journal->len;
+
+		if( mp_journal_flush(cp->journal) )
+			return -1;
+
+		if( entries )
+		{
+			snapshot->journal_entries = entries;
+			snapshot->journal_bytes = bytes;
+		}
+	}
+
+	if( cp->delta )
+		mp_delta_mark(cp->delta, cp->pending, cp->pending_chunks);
+
+	struct mp_record *record = cp->record;
+
+	size_t count = pending_count(cp);
+
+	snapshot->cp = cp;
+	snapshot->state = state;
+	snapshot->count = count;
+	snapshot->fold = count >= MP_CHECKPOINT_WAL_CHUNKS;
+	snapshot->len = 0;
+
+	cp->last = time(NULL);
+
+	if( snapshot->fold )
+	{
+		// the msync in mp_checkpoint_write covers all of them
+		memset(cp->pending, 0, (cp->pending_chunks+7)/8);
+
+		snapshot->stall = elapsed(&t0);
+
+		return 0;
+	}
+
+	size_t len = sizeof(struct wal_header) + count * (sizeof(uint32_t) + MP_RECORD_CHUNK) + sizeof(uint32_t);
+
+	uint8_t *buf = realloc(snapshot->buf, len);
+
+	if( NULL == buf )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", len);
+		return -1;
+	}
+
+	snapshot->buf = buf;
+	snapshot->len = len;
+
+	struct wal_header header;
+
+	memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+	header.state = state;
+	header.size = (uint64_t)record->size;
+	header.chunk = MP_RECORD_CHUNK;
+	header.count = (uint32_t)count;
+
+	uint8_t *ptr = buf;
+
+	memcpy(ptr, &header, sizeof(header));
+	ptr += sizeof(header);
+
+	for(size_t c = 0; c < cp->pending_chunks; c++)
+	{
+		if( cp->pending[c/8] & 1 << c%8 )
+		{
+			uint32_t index = (uint32_t)c;
+
+			memcpy(ptr, &index, sizeof(index));
+			ptr += sizeof(index);
+
+			size_t clen = chunk_len(record->size, c);
+
+			memcpy(ptr, record->bits + c * MP_RECORD_CHUNK, clen);
+			memset(ptr + clen, 0, MP_RECORD_CHUNK - clen);
+			ptr += MP_RECORD_CHUNK;
+		}
+	}
+
+	uint32_t crc = mp_crc32(0, buf, (size_t)(ptr - buf));
+
+	memcpy(ptr, &crc, sizeof(crc));
+
+	snapshot->stall = elapsed(&t0);
+
+	return 0;
+}
+
+// msync the record, replace the state file and drop the write-ahead file
+static
+int fold_write(struct mp_checkpoint *cp, int64_t state)
+{
+	if( mp_record_sync(cp->record) )
+		return -1;
+
+	if( cp->state_path )
+	{
+		char buf[32];
+		int len = sprintf(buf, "%" PRId64, state);
+
+		if( mp_write_file_atomic(cp->state_path, buf, (size_t)len) )
+		{
+			message(ERR "Unable to save the state :(\n");
+			return -1;
+		}
+
+		message("The state (%" PRId64 ") was saved successfully.\n", state);
+	}
+
+	// the record and the state are durable now
+	if( 0 == unlink(cp->wal_path) )
+		fsync_dir(cp->wal_path);
+
+	return 0;
+}
+
+// rewrite the delta file, if any
+static
+int delta_write(struct mp_checkpoint *cp)
+{
+	if( NULL == cp->delta )
+		return 0;
+
+	if( mp_delta_write(cp->delta) )
+		return -1;
+
+	message("Delta of %zu exponents (%zu bytes) written to '%s'.\n", cp->delta->count, cp->delta->len, cp->delta->path);
+
+	return 0;
+}
+
+// persist the snapshot, safe to run in the background
+int mp_checkpoint_write(struct mp_snapshot *snapshot)
+{
+	struct mp_checkpoint *cp = snapshot->cp;
+
+	struct timespec t0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	// the certificates have to be durable before the bits they prove
+	if( cp->journal && -1 == fsync(cp->journal->fd) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to flush the journal '%s' :( Error: %s\n", cp->journal->path, strerror(errsv));
+		return -1;
+	}
+
+	if( snapshot->journal_entries )
+	{
+		message("%" PRIu32 " eliminations (%zu bytes) appended to the journal '%s'.\n", snapshot->journal_entries, snapshot->journal_bytes, cp->journal->path);
+	}
+
+	if( snapshot->fold )
+	{
+		if( fold_write(cp, snapshot->state) )
+		{
+			// the pending set was dropped, so the whole record has to be written again
+			mp_record_set_dirty(cp->record, (size_t)0, cp->record->size);
+			return -1;
+		}
+
+		message("Checkpoint of the state (%" PRId64 ") folded into the record, %zu chunks (%zu bytes) flushed (%.3f ms stalled, %.3f ms in total).\n",
+			snapshot->state, snapshot->count, snapshot->count * MP_RECORD_CHUNK, snapshot->stall * 1e3, (snapshot->stall + elapsed(&t0)) * 1e3);
+
+		return delta_write(cp);
+	}
+
+	if( mp_write_file_atomic(cp->wal_path, snapshot->buf, snapshot->len) )
+		return -1;
+
+	message("Checkpoint of the state (%" PRId64 ") committed, %zu chunks (%zu bytes) written to '%s' (%.3f ms stalled, %.3f ms in total).\n",
+		snapshot->state, snapshot->count, snapshot->len, cp->wal_path, snapshot->stall * 1e3, (snapshot->stall + elapsed(&t0)) * 1e3);
+
+	return delta_write(cp);
+}
+
+// write the changed chunks and the state into the write-ahead file
+int mp_checkpoint_commit(struct mp_checkpoint *cp, int64_t state)
+{
+	if( mp_checkpoint_prepare(cp, state, &cp->snapshot) )
+		return -1;
+
+	return mp_checkpoint_write(&cp->snapshot);
+}
+
+static
+void write_job(void *arg)
+{
+	mp_checkpoint_write(arg);
+}
+
+// take a snapshot and persist it in the background, returns -1 if the worker is busy
+int mp_checkpoint_commit_async(struct mp_checkpoint *cp, struct mp_worker *worker, int64_t state)
+{
+	if( mp_worker_busy(worker) )
+		return -1;
+
+	if( mp_checkpoint_prepare(cp, state, &cp->snapshot) )
+		return -1;
+
+	return mp_worker_submit(worker, write_job, &cp->snapshot);
+}
+
+// synchronous fold, e.g. at exit
+int mp_checkpoint_fold(struct mp_checkpoint *cp, int64_t state)
+{
+	if( collect(cp) )
+		return -1;
+
+	if( cp->delta )
+		mp_delta_mark(cp->delta, cp->pending, cp->pending_chunks);
+
+	memset(cp->pending, 0, (cp->pending_chunks+7)/8);
+
+	cp->last = time(NULL);
+
+	if( cp->journal && mp_journal_sync(cp->journal) )
+		return -1;
+
+	if( fold_write(cp, state) )
+		return -1;
+
+	return delta_write(cp);
+}
+
+// replay the write-ahead file left by an interrupted run
+int mp_checkpoint_recover(struct mp_checkpoint *cp)
+{
+	FILE *file = fopen(cp->wal_path, "rb");
+
+	if( NULL == file )
+		return 0;
+
+	fseek(file, 0L, SEEK_END);
+	long flen = ftell(file);
+	rewind(file);
+
+	size_t len = flen > 0 ? (size_t)flen : 0;
+
+	uint8_t *buf = malloc(len ? len : 1);
+
+	if( NULL == buf )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", len);
+		fclose(file);
+		return -1;
+	}
+
+	if( len != fread(buf, (size_t)1, len, file) )
+	{
+		len = 0;
+	}
+
+	fclose(file);
+
+	struct wal_header header;
+	uint32_t crc;
+
+	int valid = len >= sizeof(header) + sizeof(crc);
+
+	if( valid )
+	{
+		memcpy(&header, buf, sizeof(header));
+		memcpy(&crc, buf + len - sizeof(crc), sizeof(crc));
+
+		valid = 0 == memcmp(header.magic, WAL_MAGIC, sizeof(header.magic))
+			&& MP_RECORD_CHUNK == header.chunk
+			&& len == sizeof(header) + (size_t)header.count * (sizeof(uint32_t) + MP_RECORD_CHUNK) + sizeof(crc)
+			&& crc == mp_crc32(0, buf, len - sizeof(crc));
+	}
+
+	if( !valid )
+	{
+		message(WARN "Discarding the incomplete write-ahead file '%s'.\n", cp->wal_path);
+		unlink(cp->wal_path);
+		free(buf);
+		return 0;
+	}
+
+	struct mp_record *record = cp->record;
+
+	message("Replaying %" PRIu32 " chunks of the write-ahead file '%s' (state %" PRId64 ")...\n", header.count, cp->wal_path, header.state);
+
+	if( header.size != (uint64_t)record->size )
+	{
+		message(WARN "The write-ahead file was written for a record of %" PRIu64 " bytes, the record has %zu bytes!\n", header.size, record->size);
+	}
+
+	const uint8_t *ptr = buf + sizeof(header);
+
+	for(uint32_t i = 0; i < header.count; i++)
+	{
+		uint32_t index;
+
+		memcpy(&index, ptr, sizeof(index));
+		ptr += sizeof(index);
+
+		size_t offset = (size_t)index * MP_RECORD_CHUNK;
+
+		// bits are only ever set, so OR-ing an older or newer chunk is safe
+		for(size_t j = 0; j < MP_RECORD_CHUNK && offset + j < record->size; j++)
+		{
+			// the shared mapping may have written the bits already, so the whole chunk goes into the delta
+			if( record->fresh )
+				record->fresh[offset + j] |= ptr[j];
+
+			record->bits[offset + j] |= ptr[j];
+		}
+
+		if( offset < record->size )
+			mp_record_set_dirty(record, offset, MP_RECORD_CHUNK);
+
+		ptr += MP_RECORD_CHUNK;
+	}
+
+	free(buf);
+
+	if( mp_checkpoint_fold(cp, header.state) )
+		return -1;
+
+	message("The write-ahead file was replayed successfully.\n");
+
+	return 1;
+}
@@ -0,0 +1,78 @@
+/** @file checkpoint.h
+ * Crash-safe incremental checkpoints of a record and a sieve state
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "record.h"
+#include "worker.h"
+#include "journal.h"
+#include "delta.h"
+
+/** @defgroup checkpoint checkpoint
+ * @{
+ */
+
+// fold the write-ahead file into the record once it holds this many chunks
+#define MP_CHECKPOINT_WAL_CHUNKS 256
+
+struct mp_checkpoint;
+
+/**
+ * A copy of the changed chunks taken by the sieve thread, so that the slow part
+ * of a checkpoint (write, fsync, msync) can run in the background.
+ */
+struct mp_snapshot {
+	struct mp_checkpoint *cp;
+	int64_t state;
+	int fold; // fold instead of writing the write-ahead file
+	uint8_t *buf; // content of the write-ahead file
+	size_t len;
+	size_t count; // number of chunks
+	uint32_t journal_entries; // entries flushed into the journal
+	size_t journal_bytes;
+	double stall; // seconds spent by the caller taking the snapshot
+};
+
+/**
+ * A checkpoint copies the chunks of the record changed since the last fold
+ * together with the state into the write-ahead file (record path + ".wal"),
+ * which is written aside, fsync'ed and renamed over the previous one. Once it
+ * grows too large, the write-ahead file is folded: the record is msync'ed, the
+ * state file is replaced atomically and the write-ahead file is removed. A
+ * valid write-ahead file found at startup is replayed into the record.
+ */
+struct mp_checkpoint {
+	struct mp_record *record;
+	const char *state_path; // NULL if there is no state
+	char wal_path[4096];
+	uint8_t *pending; // chunks changed since the last fold
+	size_t pending_chunks;
+	int interval; // autosave interval in seconds, 0 to disable
+	time_t last;
+	struct mp_journal *journal; // optional, made durable before the checkpoint
+	struct mp_delta *delta; // optional, rewritten after each checkpoint
+	struct mp_snapshot snapshot; // used by mp_checkpoint_commit_async
+};
+
+int mp_checkpoint_init(struct mp_checkpoint *cp, struct mp_record *record, const char *state_path, int interval);
+void mp_checkpoint_free(struct mp_checkpoint *cp);
+
+int mp_checkpoint_recover(struct mp_checkpoint *cp);
+
+int mp_checkpoint_due(const struct mp_checkpoint *cp);
+int mp_checkpoint_commit(struct mp_checkpoint *cp, int64_t state);
+int mp_checkpoint_commit_async(struct mp_checkpoint *cp, struct mp_worker *worker, int64_t state);
+int mp_checkpoint_fold(struct mp_checkpoint *cp, int64_t state);
+
+int mp_checkpoint_prepare(struct mp_checkpoint *cp, int64_t state, struct mp_snapshot *snapshot);
+int mp_checkpoint_write(struct mp_snapshot *snapshot);
+
+int mp_write_file_atomic(const char *path, const void *buf, size_t len);
+
+/** @} */
+
+#endif
@@ -0,0 +1,437 @@
+#include "delta.h"
+#include "checkpoint.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define DELTA_MAGIC "MPDELTA1"
+
+struct delta_header {
+	char magic[8];
+	uint32_t base_crc; // CRC-32 of the base record
+	uint32_t reserved;
+	uint64_t base_size; // size of the base record in bytes
+	uint64_t count; // number of exponents
+};
+
+static
+size_t put_varint(uint8_t *ptr, uint32_t x)
+{
+	size_t len = 0;
+
+	while( x >= 0x80 )
+	{
+		ptr[len++] = (uint8_t)(x | 0x80);
+		x >>= 7;
+	}
+
+	ptr[len++] = (uint8_t)x;
+
+	return len;
+}
+
+// returns the number of bytes consumed, or 0 on malformed input
+static
+size_t get_varint(const uint8_t *ptr, const uint8_t *end, uint32_t *x)
+{
+	uint32_t r = 0;
+
+	for(size_t len = 0; ptr + len < end && len < 5; len++)
+	{
+		r |= (uint32_t)(ptr[len] & 0x7f) << (7*len);
+
+		if( !(ptr[len] & 0x80) )
+		{
+			*x = r;
+			return len + 1;
+		}
+	}
+
+	return 0;
+}
+
+// load the exponents of an existing delta, they are written again with the new ones
+static
+int delta_load(struct mp_delta *delta)
+{
+	struct mp_delta_reader reader;
+
+	if( mp_delta_reader_open(&reader, delta->path) )
+		return -1;
+
+	struct mp_record *record = delta->record;
+	size_t capacity = 0;
+	int n;
+
+	for(int ret; (ret = mp_delta_next(&reader, &n)) != 0;)
+	{
+		if( ret < 0 )
+		{
+			mp_delta_reader_close(&reader);
+			return -1;
+		}
+
+		if( n < record->exponent_limit )
+		{
+			size_t c = (size_t)n/8/MP_RECORD_CHUNK;
+
+			record->fresh[n/8] |= (uint8_t)( 1 << n%8 );
+			delta->changed[c/8] |= (uint8_t)( 1 << c%8 );
+			continue;
+		}
+
+		// the record maps only a part of the file, keep them aside
+		if( delta->above_count == capacity )
+		{
+			capacity = 2 * capacity + 64;
+
+			uint32_t *above = realloc(delta->above, capacity * sizeof(uint32_t));
+
+			if( NULL == above )
+			{
+				message(ERR "Unable to allocate memory :( %zu bytes requested.\n", capacity * sizeof(uint32_t));
+				mp_delta_reader_close(&reader);
+				return -1;
+			}
+
+			delta->above = above;
+		}
+
+		delta->above[delta->above_count++] = (uint32_t)n;
+	}
+
+	delta->base_crc = reader.base_crc;
+	delta->base_size = (size_t)reader.base_size;
+
+	message("Appending to the delta '%s' of %" PRIu64 " exponents.\n", delta->path, reader.count);
+
+	mp_delta_reader_close(&reader);
+
+	return 0;
+}
+
+// continue the existing delta, or start a new one against the record as it is
+int mp_delta_init(struct mp_delta *delta, struct mp_record *record)
+{
+	delta->record = record;
+	delta->chunks = (record->size + MP_RECORD_CHUNK - 1) / MP_RECORD_CHUNK;
+	delta->changed = NULL;
+	delta->above = NULL;
+	delta->above_count = 0;
+	delta->buf = NULL;
+	delta->capacity = 0;
+	delta->len = 0;
+	delta->count = 0;
+
+	if( (size_t)snprintf(delta->path, sizeof(delta->path), "%s.delta", record->path) >= sizeof(delta->path) )
+	{
+		message(ERR "The record path is too long!\n");
+		return -1;
+	}
+
+	delta->changed = calloc((delta->chunks+7)/8 ? (delta->chunks+7)/8 : 1, (size_t)1);
+
+	if( NULL == delta->changed )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (delta->chunks+7)/8);
+		return -1;
+	}
+
+	if( mp_record_track(record) )
+		return -1;
+
+	// a damaged delta is left for the user, its eliminations are not lost silently
+	if( 0 == access(delta->path, F_OK) )
+		return delta_load(delta);
+
+	delta->base_size = record->size;
+	delta->base_crc = mp_crc32(0, record->bits, record->size);
+
+	message("Starting a new delta '%s'.\n", delta->path);
+
+	return 0;
+}
+
+void mp_delta_free(struct mp_delta *delta)
+{
+	free(delta->changed);
+	free(delta->above);
+	free(delta->buf);
+
+	delta->changed = NULL;
+	delta->above = NULL;
+	delta->buf = NULL;
+}
+
+// grow the bitmap of the changed chunks to count chunks
+static
+int changed_reserve(struct mp_delta *delta, size_t count)
+{
+	size_t bytes = (count+7)/8;
+
+	if( count <= delta->chunks )
+		return 0;
+
+	uint8_t *changed = realloc(delta->changed, bytes);
+
+	if( NULL == changed )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", bytes);
+		return -1;
+	}
+
+	memset(changed + (delta->chunks+7)/8, 0, bytes - (delta->chunks+7)/8);
+
+	delta->changed = changed;
+	delta->chunks = count;
+
+	return 0;
+}
+
+// add the chunks (a bitmap of count chunks) to the changed ones
+void mp_delta_mark(struct mp_delta *delta, const uint8_t *chunks, size_t count)
+{
+	size_t bytes = (count+7)/8;
+
+	if( changed_reserve(delta, count) )
+		return;
+
+	for(size_t i = 0; i < bytes; i++)
+	{
+		delta->changed[i] |= chunks[i];
+	}
+}
+
+static
+int reserve(struct mp_delta *delta, size_t len)
+{
+	if( len <= delta->capacity )
+		return 0;
+
+	size_t new_capacity = 2 * len + 4096;
+
+	uint8_t *buf = realloc(delta->buf, new_capacity);
+
+	if( NULL == buf )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", new_capacity);
+		return -1;
+	}
+
+	delta->buf = buf;
+	delta->capacity = new_capacity;
+
+	return 0;
+}
+
+// encode the bits set since the base and replace the delta file
+int mp_delta_write(struct mp_delta *delta)
+{
+	const struct mp_record *record = delta->record;
+
+	size_t len = sizeof(struct delta_header);
+	size_t count = 0;
+	uint32_t last = 0;
+
+	if( reserve(delta, len + 4096) )
+		return -1;
+
+	// the record has grown over some of them
+	while( delta->above_count > 0 && delta->above[0] < (uint32_t)record->exponent_limit )
+	{
+		uint32_t n = delta->above[0];
+		size_t c = (size_t)n/8/MP_RECORD_CHUNK;
+
+		if( changed_reserve(delta, record->chunks) )
+			return -1;
+
+		__atomic_fetch_or(&record->fresh[n/8], (uint8_t)( 1 << n%8 ), __ATOMIC_RELAXED);
+		delta->changed[c/8] |= (uint8_t)( 1 << c%8 );
+
+		memmove(delta->above, delta->above + 1, --delta->above_count * sizeof(uint32_t));
+	}
+
+	for(size_t c = 0; c < delta->chunks; c++)
+	{
+		if( !(delta->changed[c/8] & 1 << c%8) )
+			continue;
+
+		size_t begin = c * MP_RECORD_CHUNK;
+		size_t end = begin + MP_RECORD_CHUNK < record->size ? begin + MP_RECORD_CHUNK : record->size;
+
+		for(size_t i = begin; i < end; i++)
+		{
+			unsigned fresh = __atomic_load_n(&record->fresh[i], __ATOMIC_RELAXED);
+
+			for(; fresh; fresh &= fresh - 1)
+			{
+				uint32_t n = (uint32_t)(i * 8) + (uint32_t)__builtin_ctz(fresh);
+
+				// 5 bytes of the varint, 4 bytes of the checksum
+				if( reserve(delta, len + 9) )
+					return -1;
+
+				len += put_varint(delta->buf + len, n - last);
+				last = n;
+				count++;
+			}
+		}
+	}
+
+	// all of them above the ones of the record
+	for(size_t i = 0; i < delta->above_count; i++)
+	{
+		if( reserve(delta, len + 9) )
+			return -1;
+
+		len += put_varint(delta->buf + len, delta->above[i] - last);
+		last = delta->above[i];
+		count++;
+	}
+
+	struct delta_header header;
+
+	memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+	header.base_crc = delta->base_crc;
+	header.reserved = 0;
+	header.base_size = (uint64_t)delta->base_size;
+	header.count = (uint64_t)count;
+
+	memcpy(delta->buf, &header, sizeof(header));
+
+	uint32_t crc = mp_crc32(0, delta->buf, len);
+
+	memcpy(delta->buf + len, &crc, sizeof(crc));
+	len += sizeof(crc);
+
+	delta->len = len;
+	delta->count = count;
+
+	return mp_write_file_atomic(delta->path, delta->buf, len);
+}
+
+// 1 if the file starts with the delta magic
+int mp_delta_probe(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+
+	if( NULL == file )
+		return 0;
+
+	char magic[8];
+
+	int ret = sizeof(magic) == fread(magic, 1, sizeof(magic), file) && 0 == memcmp(magic, DELTA_MAGIC, sizeof(magic));
+
+	fclose(file);
+
+	return ret;
+}
+
+int mp_delta_reader_open(struct mp_delta_reader *reader, const char *path)
+{
+	reader->path = path;
+	reader->map = NULL;
+	reader->last = 0;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if( -1 == fd || -1 == fstat(fd, &st) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to open the delta '%s' :( Error: %s\n", path, strerror(errsv));
+		if( -1 != fd )
+			close(fd);
+		return -1;
+	}
+
+	reader->size = (size_t)st.st_size;
+
+	struct delta_header header;
+	uint32_t crc;
+
+	if( reader->size < sizeof(header) + sizeof(crc) )
+	{
+		message(ERR "The delta '%s' is truncated!\n", path);
+		close(fd);
+		return -1;
+	}
+
+	void *addr = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if( MAP_FAILED == addr )
+	{
+		int errsv = errno;
+		message(ERR "Unable to map the delta '%s' :( Error: %s\n", path, strerror(errsv));
+		return -1;
+	}
+
+	reader->map = addr;
+
+	memcpy(&header, reader->map, sizeof(header));
+	memcpy(&crc, reader->map + reader->size - sizeof(crc), sizeof(crc));
+
+	if( memcmp(header.magic, DELTA_MAGIC, sizeof(header.magic)) || crc != mp_crc32(0, reader->map, reader->size - sizeof(crc)) )
+	{
+		message(ERR "The delta '%s' is damaged!\n", path);
+		mp_delta_reader_close(reader);
+		return -1;
+	}
+
+	reader->base_crc = header.base_crc;
+	reader->base_size = header.base_size;
+	reader->count = header.count;
+	reader->left = header.count;
+	reader->ptr = reader->map + sizeof(header);
+	reader->end = reader->map + reader->size - sizeof(crc);
+
+	madvise(addr, reader->size, MADV_SEQUENTIAL);
+
+	return 0;
+}
+
+void mp_delta_reader_close(struct mp_delta_reader *reader)
+{
+	if( reader->map )
+		munmap((void *)reader->map, reader->size);
+
+	reader->map = NULL;
+}
+
+// returns 1 for an exponent, 0 at the end, -1 on malformed input
+int mp_delta_next(struct mp_delta_reader *reader, int *n)
+{
+	if( 0 == reader->left )
+		return 0;
+
+	uint32_t d;
+	size_t len = get_varint(reader->ptr, reader->end, &d);
+
+	if( 0 == len )
+	{
+		message(WARN "The delta '%s' is malformed!\n", reader->path);
+		reader->left = 0;
+		return -1;
+	}
+
+	reader->ptr += len;
+	reader->left--;
+	reader->last += (int)d;
+
+	*n = reader->last;
+
+	return 1;
+}
@@ -0,0 +1,70 @@
+/** @file delta.h
+ * Sparse lists of exponents eliminated since a base snapshot of a record
+ */
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "record.h"
+
+/** @defgroup delta delta
+ * @{
+ */
+
+/**
+ * The delta file (record path + ".delta") holds a header (magic, CRC-32 and
+ * size of the base record, number of exponents), the sorted exponents whose
+ * bits were set since the base as varints of their differences, and a CRC-32
+ * of all that. Each checkpoint rewrites it atomically. A run appends to the
+ * delta left by the previous one and keeps its base, the bits are collected
+ * by the record (mp_record_track). Once the delta is shipped, it is removed
+ * (or renamed), and the next run starts a new one against the record as it is.
+ */
+struct mp_delta {
+	struct mp_record *record;
+	char path[4096];
+	size_t base_size;
+	uint32_t base_crc; // CRC-32 of the record when the delta was started
+	uint8_t *changed; // chunks changed since the base
+	size_t chunks;
+	uint32_t *above; // exponents of the delta above the exponent limit of the record
+	size_t above_count;
+	uint8_t *buf; // encoded delta
+	size_t capacity;
+	size_t len;
+	size_t count; // exponents in the encoded delta
+};
+
+int mp_delta_init(struct mp_delta *delta, struct mp_record *record);
+void mp_delta_free(struct mp_delta *delta);
+
+void mp_delta_mark(struct mp_delta *delta, const uint8_t *chunks, size_t count);
+int mp_delta_write(struct mp_delta *delta);
+
+/**
+ * Sequential reader over a read-only mapping of a delta file.
+ */
+struct mp_delta_reader {
+	const char *path;
+	const uint8_t *map;
+	size_t size;
+	const uint8_t *ptr;
+	const uint8_t *end;
+	uint64_t left; // exponents left
+	int last;
+	uint32_t base_crc;
+	uint64_t base_size;
+	uint64_t count;
+};
+
+int mp_delta_probe(const char *path);
+
+int mp_delta_reader_open(struct mp_delta_reader *reader, const char *path);
+void mp_delta_reader_close(struct mp_delta_reader *reader);
+
+int mp_delta_next(struct mp_delta_reader *reader, int *n);
+
+/** @} */
+
+#endif
@@ -0,0 +1,423 @@
+#include "factor.h"
+#include "mont.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+static
+int ctz128(uint128_t x)
+{
+	uint64_t lo = (uint64_t)x;
+
+	return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((uint64_t)(x >> 64));
+}
+
+static
+int clz128(uint128_t x)
+{
+	uint64_t hi = (uint64_t)(x >> 64);
+
+	return hi ? __builtin_clzll(hi) : 64 + __builtin_clzll((uint64_t)x);
+}
+
+// binary gcd
+static
+uint128_t gcd128(uint128_t a, uint128_t b)
+{
+	if( 0 == a )
+		return b;
+	if( 0 == b )
+		return a;
+
+	int s = ctz128(a | b);
+
+	a >>= ctz128(a);
+
+	do {
+		b >>= ctz128(b);
+
+		if( a > b )
+		{
+			uint128_t t = a;
+			a = b;
+			b = t;
+		}
+
+		b -= a;
+	} while( b );
+
+	return a << s;
+}
+
+// n mod f by 64-bit divisions, f < 2^32
+static
+uint32_t mod_small(uint128_t n, uint32_t f)
+{
+	uint64_t hi = (uint64_t)(n >> 64), lo = (uint64_t)n;
+	uint64_t r = hi % f;
+
+	r = (r << 32 | lo >> 32) % f;
+	r = (r << 32 | (lo & UINT32_MAX)) % f;
+
+	return (uint32_t)r;
+}
+
+// the next trial divisor: 2, 3, 5, 7, 11, 13, 17, 19, 23, 25, ...
+static
+uint32_t next_trial(uint32_t f)
+{
+	if( f < 5 )
+		return f < 2 ? 2 : 2 * f - 1;
+
+	// 6i+1, 6i+5
+	return f % 6 == 1 ? f + 4 : f + 2;
+}
+
+// Newton from above
+static
+uint128_t isqrt128(uint128_t n)
+{
+	if( n < 2 )
+		return n;
+
+	uint128_t x = (uint128_t)1 << ((129 - clz128(n)) / 2);
+
+	for(;;)
+	{
+		uint128_t y = (x + n / x) / 2;
+
+		if( y >= x )
+			return x;
+
+		x = y;
+	}
+}
+
+static
+uint128_t add_mod(uint128_t a, uint128_t b, uint128_t q)
+{
+	uint128_t s = a + b;
+
+	return s >= q ? s - q : s;
+}
+
+static
+uint128_t sub_mod(uint128_t a, uint128_t b, uint128_t q)
+{
+	return a >= b ? a - b : a + (q - b);
+}
+
+// a/2 (mod q), q < 2^127 is odd
+static
+uint128_t half_mod(uint128_t a, uint128_t q)
+{
+	return a & 1 ? (a + q) >> 1 : a >> 1;
+}
+
+// a signed small number in the Montgomery form
+static
+uint128_t to_mont(const struct mp_mont128 *ctx, int64_t a)
+{
+	uint128_t m = mp_mont128_to(ctx, (uint128_t)(a < 0 ? -a : a));
+
+	return a < 0 && m ? ctx->q - m : m;
+}
+
+// the strong probable prime test to the base 2
+static
+int sprp2(const struct mp_mont128 *ctx)
+{
+	uint128_t n = ctx->q;
+	int s = ctz128(n - 1);
+	uint128_t d = (n - 1) >> s;
+	uint128_t minus_one = n - ctx->one;
+	uint128_t x = ctx->one;
+
+	for(int b = 127 - clz128(d); b >= 0; b--)
+	{
+		x = mp_mont128_mul(ctx, x, x);
+
+		if( d >> b & 1 )
+			x = add_mod(x, x, n);
+	}
+
+	if( x == ctx->one || x == minus_one )
+		return 1;
+
+	for(int r = 1; r < s; r++)
+	{
+		x = mp_mont128_mul(ctx, x, x);
+
+		if( x == minus_one )
+			return 1;
+	}
+
+	return 0;
+}
+
+// the Jacobi symbol (a/n), n is odd
+static
+int jacobi(uint128_t a, uint128_t n)
+{
+	int j = 1;
+
+	a %= n;
+
+	while( a )
+	{
+		while( 0 == (a & 1) )
+		{
+			a >>= 1;
+
+			if( 3 == (n & 7) || 5 == (n & 7) )
+				j = -j;
+		}
+
+		uint128_t t = a;
+		a = n;
+		n = t;
+
+		if( 3 == (a & 3) && 3 == (n & 3) )
+			j = -j;
+
+		a %= n;
+	}
+
+	return 1 == n ? j : 0;
+}
+
+// the strong Lucas probable prime test, P = 1 and Q = (1 - D)/4 with D the first of 5, -7, 9, -11, ... such that (D/n) = -1
+static
+int lucas(const struct mp_mont128 *ctx)
+{
+	uint128_t n = ctx->q;
+	int64_t D = 5;
+
+	// there would be no such D
+	uint128_t r = isqrt128(n);
+	if( r * r == n )
+		return 0;
+
+	for(;;)
+	{
+		uint128_t a = D < 0 ? n - (uint128_t)(-D) % n : (uint128_t)D % n;
+		int j = jacobi(a, n);
+
+		if( -1 == j )
+			break;
+
+		// a factor of n, n is above the trial bound
+		if( 0 == j )
+			return 0;
+
+		D = D < 0 ? -D + 2 : -D - 2;
+	}
+
+	uint128_t Dm = to_mont(ctx, D);
+	uint128_t Qm = to_mont(ctx, (1 - D) / 4);
+
+	// n + 1 = d 2^s
+	int s = ctz128(n + 1);
+	uint128_t d = (n + 1) >> s;
+
+	// U_1 = 1, V_1 = P = 1, Q^1
+	uint128_t U = ctx->one, V = ctx->one, Qk = Qm;
+
+	for(int b = 126 - clz128(d); b >= 0; b--)
+	{
+		// U_2k = U_k V_k, V_2k = V_k^2 - 2 Q^k
+		U = mp_mont128_mul(ctx, U, V);
+		V = sub_mod(mp_mont128_mul(ctx, V, V), add_mod(Qk, Qk, n), n);
+		Qk = mp_mont128_mul(ctx, Qk, Qk);
+
+		if( d >> b & 1 )
+		{
+			// U_k+1 = (P U_k + V_k)/2, V_k+1 = (D U_k + P V_k)/2
+			uint128_t U1 = half_mod(add_mod(U, V, n), n);
+			uint128_t V1 = half_mod(add_mod(mp_mont128_mul(ctx, Dm, U), V, n), n);
+
+			U = U1;
+			V = V1;
+			Qk = mp_mont128_mul(ctx, Qk, Qm);
+		}
+	}
+
+	if( 0 == U || 0 == V )
+		return 1;
+
+	for(int i = 1; i < s; i++)
+	{
+		V = sub_mod(mp_mont128_mul(ctx, V, V), add_mod(Qk, Qk, n), n);
+		Qk = mp_mont128_mul(ctx, Qk, Qk);
+
+		if( 0 == V )
+			return 1;
+	}
+
+	return 0;
+}
+
+int mp_uint128_is_prime(uint128_t n)
+{
+	assert( n >> 127 == 0 );
+
+	for(uint32_t f = 2; f < MP_FACTOR_TRIAL; f = next_trial(f))
+	{
+		if( n == f )
+			return 1;
+
+		if( 0 == mod_small(n, f) )
+			return 0;
+	}
+
+	if( n < (uint128_t)MP_FACTOR_TRIAL * MP_FACTOR_TRIAL )
+		return n > 1;
+
+	struct mp_mont128 ctx;
+
+	mp_mont128_init(&ctx, n);
+
+	return sprp2(&ctx) && lucas(&ctx);
+}
+
+uint128_t mp_uint128_rho(uint128_t n, uint64_t budget)
+{
+	assert( n >> 127 == 0 );
+	assert( n & 1 );
+
+	struct mp_mont128 ctx;
+	uint64_t iterations = 0;
+
+	mp_mont128_init(&ctx, n);
+
+	// x -> x^2 + c, the next c if the cycle closes without a factor
+	for(uint128_t c = 1; c < n; c++)
+	{
+		uint128_t x = 0, y = 2, ys = 2, q = ctx.one, g = 1;
+
+		for(uint64_t r = 1; 1 == g; r *= 2)
+		{
+			x = y;
+
+			for(uint64_t i = 0; i < r; i++)
+				y = add_mod(mp_mont128_mul(&ctx, y, y), c, n);
+
+			iterations += r;
+
+			// the differences are multiplied together, a gcd per batch
+			for(uint64_t k = 0; k < r && 1 == g; k += MP_FACTOR_BATCH)
+			{
+				uint64_t len = r - k < MP_FACTOR_BATCH ? r - k : MP_FACTOR_BATCH;
+
+				ys = y;
+
+				for(uint64_t i = 0; i < len; i++)
+				{
+					y = add_mod(mp_mont128_mul(&ctx, y, y), c, n);
+					q = mp_mont128_mul(&ctx, q, x > y ? x - y : y - x);
+				}
+
+				g = gcd128(q, n);
+
+				iterations += len;
+
+				if( budget && iterations > budget )
+					return 0;
+			}
+		}
+
+		// the batch has multiplied all the factors in, step it once again
+		if( g == n )
+		{
+			do {
+				ys = add_mod(mp_mont128_mul(&ctx, ys, ys), c, n);
+				g = gcd128(x > ys ? x - ys : ys - x, n);
+			} while( 1 == g );
+		}
+
+		if( g != n )
+			return g;
+	}
+
+	return 0;
+}
+
+int mp_uint128_factor(uint128_t n, uint128_t *factors, int *exponents, uint128_t *cofactor, uint64_t budget)
+{
+	assert( n > 0 );
+	assert( n >> 127 == 0 );
+
+	// the prime factors with repetitions
+	uint128_t primes[128];
+	size_t count = 0;
+	uint128_t stack[128];
+	size_t top = 0;
+
+	*cofactor = 1;
+
+	for(uint32_t f = 2; f < MP_FACTOR_TRIAL && (uint128_t)f * f <= n; f = next_trial(f))
+	{
+		while( 0 == mod_small(n, f) )
+		{
+			primes[count++] = f;
+			n /= f;
+		}
+	}
+
+	if( n > 1 )
+		stack[top++] = n;
+
+	while( top > 0 )
+	{
+		uint128_t c = stack[--top];
+
+		// no factor below the trial bound is left
+		if( c < (uint128_t)MP_FACTOR_TRIAL * MP_FACTOR_TRIAL || mp_uint128_is_prime(c) )
+		{
+			primes[count++] = c;
+			continue;
+		}
+
+		uint128_t d = mp_uint128_rho(c, budget);
+
+		if( 0 == d )
+		{
+			*cofactor *= c;
+			continue;
+		}
+
+		stack[top++] = d;
+		stack[top++] = c / d;
+	}
+
+	// insertion sort, few factors
+	for(size_t i = 1; i < count; i++)
+	{
+		uint128_t p = primes[i];
+		size_t j = i;
+
+		for(; j > 0 && primes[j - 1] > p; j--)
+			primes[j] = primes[j - 1];
+
+		primes[j] = p;
+	}
+
+	int distinct = 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if( distinct > 0 && factors[distinct - 1] == primes[i] )
+		{
+			exponents[distinct - 1]++;
+			continue;
+		}
+
+		factors[distinct] = primes[i];
+		exponents[distinct] = 1;
+		distinct++;
+	}
+
+	return distinct;
+}
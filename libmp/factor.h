@@ -0,0 +1,46 @@
+/** @file factor.h
+ * Factorization of 128-bit numbers: trial division, BPSW and Pollard-Brent rho
+ */
+#ifndef FACTOR_H
+#define FACTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "libmp.h"
+
+/** @defgroup factor factor
+ * @{
+ */
+
+// trial division below this bound
+#define MP_FACTOR_TRIAL 1024
+
+// the rho iterations between the gcds
+#define MP_FACTOR_BATCH 128
+
+// the distinct prime factors of a number below 2^127
+#define MP_FACTOR_MAX 128
+
+/**
+ * The small factors are divided out first, then the cofactors are split by
+ * the Brent variant of the Pollard rho (x -> x^2 + c in the Montgomery form
+ * of mont.h, MP_FACTOR_BATCH differences multiplied together per gcd) until
+ * all of them pass the Baillie-PSW test (the strong test to the base 2 and
+ * the strong Lucas test with the parameters of Selfridge, there is no known
+ * counterexample). The rho iterations can be limited: the cofactors left
+ * unsplit are multiplied into *cofactor, a prime factor below about the
+ * square of the budget is found nevertheless almost surely.
+ */
+
+// Baillie-PSW, n < 2^127
+int mp_uint128_is_prime(uint128_t n);
+
+// a proper factor of the odd composite n < 2^127, 0 if the budget of iterations is spent (0 for no limit)
+uint128_t mp_uint128_rho(uint128_t n, uint64_t budget);
+
+// the distinct primes in ascending order with the exponents, returns their count, n < 2^127
+int mp_uint128_factor(uint128_t n, uint128_t *factors, int *exponents, uint128_t *cofactor, uint64_t budget);
+
+/** @} */
+
+#endif
@@ -0,0 +1,428 @@
+#include "journal.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define JOURNAL_MAGIC "MPJ1"
+
+struct block_header {
+	char magic[4];
+	uint32_t count; // number of entries
+	uint32_t len; // payload bytes
+	uint32_t crc; // CRC-32 of the payload
+};
+
+// the longest entry: 5 bytes of the exponent and 19 bytes of k
+#define ENTRY_MAX 24
+
+static
+size_t put_varint(uint8_t *ptr, uint128_t x)
+{
+	size_t len = 0;
+
+	while( x >= 0x80 )
+	{
+		ptr[len++] = (uint8_t)(x | 0x80);
+		x >>= 7;
+	}
+
+	ptr[len++] = (uint8_t)x;
+
+	return len;
+}
+
+// returns the number of bytes consumed, or 0 on malformed input
+static
+size_t get_varint(const uint8_t *ptr, const uint8_t *end, uint128_t *x)
+{
+	uint128_t r = 0;
+
+	for(size_t len = 0; ptr + len < end && len < 19; len++)
+	{
+		r |= (uint128_t)(ptr[len] & 0x7f) << (7*len);
+
+		if( !(ptr[len] & 0x80) )
+		{
+			*x = r;
+			return len + 1;
+		}
+	}
+
+	return 0;
+}
+
+static
+size_t encode(uint8_t *ptr, int *last_n, int n, uint128_t q)
+{
+	int64_t d = (int64_t)n - (int64_t)*last_n;
+	uint64_t zigzag = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+
+	// q = 2kn+1
+	uint128_t k = (q - 1) / (2 * (uint128_t)(unsigned)n);
+
+	*last_n = n;
+
+	size_t len = put_varint(ptr, zigzag);
+
+	return len + put_varint(ptr + len, k);
+}
+
+static
+size_t decode(const uint8_t *ptr, const uint8_t *end, int *last_n, int *n, uint128_t *q)
+{
+	uint128_t zigzag, k;
+
+	size_t len = get_varint(ptr, end, &zigzag);
+
+	if( 0 == len )
+		return 0;
+
+	size_t len2 = get_varint(ptr + len, end, &k);
+
+	if( 0 == len2 )
+		return 0;
+
+	int64_t d = (int64_t)((uint64_t)(zigzag >> 1) ^ -(uint64_t)(zigzag & 1));
+
+	*n = (int)(*last_n + d);
+	*q = 2 * k * (uint128_t)(unsigned)*n + 1;
+
+	*last_n = *n;
+
+	return len + len2;
+}
+
+// size of the valid prefix (whole blocks with a correct checksum)
+static
+size_t valid_prefix(const uint8_t *map, size_t size)
+{
+	size_t pos = 0;
+
+	while( size - pos >= sizeof(struct block_header) )
+	{
+		struct block_header header;
+
+		memcpy(&header, map + pos, sizeof(header));
+
+		if( memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic))
+			|| header.len > size - pos - sizeof(header)
+			|| header.crc != mp_crc32(0, map + pos + sizeof(header), header.len) )
+			break;
+
+		pos += sizeof(header) + header.len;
+	}
+
+	return pos;
+}
+
+// map the whole file read-only, an empty file gives NULL
+static
+int map_file(int fd, const char *path, const uint8_t **map, size_t *size)
+{
+	struct stat st;
+
+	if( -1 == fstat(fd, &st) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to stat the journal '%s' :( Error: %s\n", path, strerror(errsv));
+		return -1;
+	}
+
+	*size = (size_t)st.st_size;
+	*map = NULL;
+
+	if( 0 == *size )
+		return 0;
+
+	void *addr = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if( MAP_FAILED == addr )
+	{
+		int errsv = errno;
+		message(ERR "Unable to map the journal '%s' :( Error: %s\n", path, strerror(errsv));
+		return -1;
+	}
+
+	*map = addr;
+
+	return 0;
+}
+
+// open (or create) the journal for appending
+int mp_journal_open(struct mp_journal *journal, const char *path)
+{
+	if( (size_t)snprintf(journal->path, sizeof(journal->path), "%s", path) >= sizeof(journal->path) )
+	{
+		message(ERR "The journal path is too long!\n");
+		return -1;
+	}
+
+	journal->len = 0;
+	journal->count = 0;
+	journal->last_n = 0;
+	journal->entries = 0;
+	journal->bytes = 0;
+	journal->size = 0;
+	journal->buf = malloc(MP_JOURNAL_BUFFER + sizeof(struct block_header) + ENTRY_MAX);
+
+	if( NULL == journal->buf )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	journal->fd = open(path, O_RDWR|O_CREAT|O_APPEND, 0644);
+
+	if( -1 == journal->fd )
+	{
+		int errsv = errno;
+		message(ERR "Unable to open the journal '%s' :( Error: %s\n", path, strerror(errsv));
+		free(journal->buf);
+		return -1;
+	}
+
+	const uint8_t *map;
+	size_t size;
+
+	if( map_file(journal->fd, path, &map, &size) )
+	{
+		mp_journal_close(journal);
+		return -1;
+	}
+
+	size_t valid = map ? valid_prefix(map, size) : 0;
+
+	if( map )
+		munmap((void *)map, size);
+
+	// appending after a torn block would hide all the following blocks
+	if( valid != size )
+	{
+		message(WARN "Cutting off %zu bytes of an incomplete block at the end of the journal '%s'.\n", size - valid, path);
+
+		if( -1 == ftruncate(journal->fd, (off_t)valid) )
+		{
+			int errsv = errno;
+			message(ERR "Unable to truncate the journal '%s' :( Error: %s\n", path, strerror(errsv));
+			mp_journal_close(journal);
+			return -1;
+		}
+	}
+
+	journal->size = valid;
+
+	// leave a room for the header
+	journal->len = sizeof(struct block_header);
+
+	return 0;
+}
+
+// open (or create) the journal next to the record
+int mp_journal_open_record(struct mp_journal *journal, const char *record_path)
+{
+	char path[4096];
+
+	if( (size_t)snprintf(path, sizeof(path), "%s.journal", record_path) >= sizeof(path) )
+	{
+		message(ERR "The record path is too long!\n");
+		return -1;
+	}
+
+	return mp_journal_open(journal, path);
+}
+
+void mp_journal_close(struct mp_journal *journal)
+{
+	if( -1 != journal->fd )
+	{
+		mp_journal_sync(journal);
+		close(journal->fd);
+	}
+
+	free(journal->buf);
+
+	journal->fd = -1;
+	journal->buf = NULL;
+}
+
+int mp_journal_add(struct mp_journal *journal, int n, uint128_t q)
+{
+	// the buffer is full and the previous flush failed
+	if( journal->len >= MP_JOURNAL_BUFFER + sizeof(struct block_header) && mp_journal_flush(journal) )
+		return -1;
+
+	journal->len += encode(journal->buf + journal->len, &journal->last_n, n, q);
+	journal->count++;
+
+	if( journal->len >= MP_JOURNAL_BUFFER + sizeof(struct block_header) )
+		return mp_journal_flush(journal);
+
+	return 0;
+}
+
+int mp_journal_add64(struct mp_journal *journal, int n, uint64_t q) { return mp_journal_add(journal, n, (uint128_t)q); }
+
+int mp_journal_add128(struct mp_journal *journal, int n, uint128_t q) { return mp_journal_add(journal, n, q); }
+
+// write the buffered entries as one block
+int mp_journal_flush(struct mp_journal *journal)
+{
+	if( 0 == journal->count )
+		return 0;
+
+	struct block_header header;
+
+	memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+	header.count = journal->count;
+	header.len = (uint32_t)(journal->len - sizeof(header));
+	header.crc = mp_crc32(0, journal->buf + sizeof(header), header.len);
+
+	memcpy(journal->buf, &header, sizeof(header));
+
+	const uint8_t *ptr = journal->buf;
+	size_t len = journal->len;
+
+	while( len > 0 )
+	{
+		ssize_t ret = write(journal->fd, ptr, len);
+
+		if( -1 == ret && EINTR == errno )
+			continue;
+
+		if( -1 == ret )
+		{
+			int errsv = errno;
+			message(ERR "Unable to write into the journal '%s' :( Error: %s\n", journal->path, strerror(errsv));
+			// drop a partial block and keep the entries, the next flush retries
+			if( -1 == ftruncate(journal->fd, (off_t)journal->size) )
+				message(WARN "Unable to truncate the journal '%s'!\n", journal->path);
+			return -1;
+		}
+
+		ptr += ret;
+		len -= (size_t)ret;
+	}
+
+	journal->entries += journal->count;
+	journal->bytes += journal->len;
+	journal->size += journal->len;
+
+	journal->len = sizeof(header);
+	journal->count = 0;
+	journal->last_n = 0;
+
+	return 0;
+}
+
+// flush and make the journal durable
+int mp_journal_sync(struct mp_journal *journal)
+{
+	if( mp_journal_flush(journal) )
+		return -1;
+
+	if( -1 == fsync(journal->fd) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to flush the journal '%s' :( Error: %s\n", journal->path, strerror(errsv));
+		return -1;
+	}
+
+	return 0;
+}
+
+int mp_journal_reader_open(struct mp_journal_reader *reader, const char *path)
+{
+	reader->path = path;
+	reader->pos = 0;
+	reader->ptr = NULL;
+	reader->end = NULL;
+	reader->left = 0;
+	reader->last_n = 0;
+
+	int fd = open(path, O_RDONLY);
+
+	if( -1 == fd )
+	{
+		int errsv = errno;
+		message(ERR "Unable to open the journal '%s' :( Error: %s\n", path, strerror(errsv));
+		return -1;
+	}
+
+	int ret = map_file(fd, path, &reader->map, &reader->size);
+
+	close(fd);
+
+	if( 0 == ret && reader->map )
+		madvise((void *)reader->map, reader->size, MADV_SEQUENTIAL);
+
+	return ret;
+}
+
+void mp_journal_reader_close(struct mp_journal_reader *reader)
+{
+	if( reader->map )
+		munmap((void *)reader->map, reader->size);
+
+	reader->map = NULL;
+}
+
+static
+int damaged(struct mp_journal_reader *reader)
+{
+	message(WARN "The journal '%s' is damaged at the offset %zu!\n", reader->path, reader->pos);
+
+	reader->left = 0;
+	reader->pos = reader->size;
+
+	return -1;
+}
+
+// returns 1 for an entry, 0 at the end, -1 on a damaged block
+int mp_journal_next(struct mp_journal_reader *reader, int *n, uint128_t *q)
+{
+	while( 0 == reader->left )
+	{
+		if( reader->pos == reader->size )
+			return 0;
+
+		struct block_header header;
+
+		if( reader->size - reader->pos < sizeof(header) )
+			return damaged(reader);
+
+		memcpy(&header, reader->map + reader->pos, sizeof(header));
+
+		const uint8_t *payload = reader->map + reader->pos + sizeof(header);
+
+		if( memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic))
+			|| header.len > reader->size - reader->pos - sizeof(header)
+			|| header.crc != mp_crc32(0, payload, header.len) )
+			return damaged(reader);
+
+		reader->ptr = payload;
+		reader->end = payload + header.len;
+		reader->left = header.count;
+		reader->last_n = 0;
+		reader->pos += sizeof(header) + header.len;
+	}
+
+	size_t len = decode(reader->ptr, reader->end, &reader->last_n, n, q);
+
+	if( 0 == len )
+		return damaged(reader);
+
+	reader->ptr += len;
+	reader->left--;
+
+	return 1;
+}
@@ -0,0 +1,71 @@
+/** @file journal.h
+ * Append-only journal of eliminations (exponent and factor)
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "libmp.h"
+
+/** @defgroup journal journal
+ * @{
+ */
+
+// flush the buffer into the file once it grows over this many bytes
+#define MP_JOURNAL_BUFFER (64*1024)
+
+/**
+ * The journal is a sequence of blocks, one block per flush. A block has a
+ * header (magic, number of entries, payload length, CRC-32 of the payload)
+ * followed by the entries. An entry is the zigzag varint of the exponent
+ * difference to the previous entry of the block followed by the varint of k,
+ * where the factor is q = 2kn+1. A torn block at the end of the file is cut
+ * off when the journal is opened. The journal of a record is kept next to it
+ * (record path + ".journal").
+ */
+struct mp_journal {
+	char path[4096];
+	int fd;
+	uint8_t *buf;
+	size_t len;
+	uint32_t count; // entries in the buffer
+	int last_n; // previous exponent in the buffer
+	uint64_t entries; // entries written since open
+	uint64_t bytes; // bytes written since open
+	size_t size; // file size
+};
+
+int mp_journal_open(struct mp_journal *journal, const char *path);
+int mp_journal_open_record(struct mp_journal *journal, const char *record_path);
+void mp_journal_close(struct mp_journal *journal);
+
+int mp_journal_add(struct mp_journal *journal, int n, uint128_t q);
+int mp_journal_add64(struct mp_journal *journal, int n, uint64_t q);
+int mp_journal_add128(struct mp_journal *journal, int n, uint128_t q);
+
+int mp_journal_flush(struct mp_journal *journal);
+int mp_journal_sync(struct mp_journal *journal);
+
+/**
+ * Sequential reader over a read-only mapping of the journal.
+ */
+struct mp_journal_reader {
+	const char *path;
+	const uint8_t *map;
+	size_t size;
+	size_t pos; // next block
+	const uint8_t *ptr; // next entry of the current block
+	const uint8_t *end;
+	uint32_t left; // entries left in the current block
+	int last_n;
+};
+
+int mp_journal_reader_open(struct mp_journal_reader *reader, const char *path);
+void mp_journal_reader_close(struct mp_journal_reader *reader);
+
+int mp_journal_next(struct mp_journal_reader *reader, int *n, uint128_t *q);
+
+/** @} */
+
+#endif
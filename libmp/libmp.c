@@ -1,5 +1,7 @@
 #include "libmp.h"
 #include "hsort.h"
+#include "mont.h"
+#include "factor.h"
 
 #include <stdint.h>
 #include <assert.h>
@@ -2110,11 +2112,15 @@ int64_t mp_int64_element2_order(int64_t p) { return int64_element2_order(p); }
 static
 int64_t int64_element2_order_prtable(int64_t p, const uint8_t *primes, int exponent_limit)
 {
+	// the order of 2 is not prime
+	if( p < 3 )
+		return 0;
+
 	int64_t n = p - 1;
 
-	// 4 KiB table
-	int64_t powers[64];
-	int64_dpow2_pl_log_cached_init(p, powers, n);
+	// 2^(2^i) (mod p), shared by all the powers below
+	struct mp_mont64_squares squares;
+	mp_mont64_squares_init(&squares, (uint64_t)p, 64 - __builtin_clzll((uint64_t)n));
 
 	int64_t f = 1;
 
@@ -2126,15 +2132,38 @@ int64_t int64_element2_order_prtable(int64_t p, const uint8_t *primes, int expon
 		if( 0 == f )
 			return 0;
 
+		// the cofactor is prime, the order is either n or not a prime
+		if( n > 1 && f > n / f )
+		{
+			if( n >= exponent_limit )
+				return 0;
+
+			uint64_t r;
+			struct mp_plan plan;
+
+			mp_plan_init(&plan, (uint128_t)n);
+			mp_plan_pow2_mod64_dual(&squares, 1, &plan, &r);
+
+			return r == 1 ? n : 0;
+		}
+
 		if( n > 1 && 0 == n % f )
 		{
 			do {
 				n /= f;
 			} while( 0 == n % f );
 
-			if( int64_dpow2_pl_log_cached(p, powers, f) == 1 )
+			// 2^f and 2^n (mod p) at once
+			struct mp_plan plans[2];
+			uint64_t r[2];
+
+			mp_plan_init(&plans[0], (uint128_t)f);
+			mp_plan_init(&plans[1], (uint128_t)n);
+			mp_plan_pow2_mod64_dual(&squares, 2, plans, r);
+
+			if( r[0] == 1 )
 				return f;
-			if( int64_dpow2_pl_log_cached(p, powers, n) != 1 )
+			if( r[1] != 1 )
 				return 0;
 		}
 	} while(1);
@@ -2260,40 +2289,69 @@ int128_t int128_element2_order(int128_t p)
 {
 	// NOTE: assert( p : PRIME );
 
+	if( p < 3 )
+		return p - 1;
+
 	// group order
-	int128_t n = p - 1;
-	// maximum number of factors
-	int128_t max_factors = int128_floor_log2(n);
+	uint128_t n = (uint128_t)p - 1;
 
-	// +1 due to terminating zero
-	int128_t factors[max_factors+1];
-	int128_t exponents[max_factors+1];
+	uint128_t factors[MP_FACTOR_MAX];
+	int exponents[MP_FACTOR_MAX];
+	uint128_t cofactor;
 
 	// n = p1^e1 * p2^e2 * ... * pk^ek
-	int128_factors_exponents(n, factors, exponents);
+	int count = mp_uint128_factor(n, factors, exponents, &cofactor, 0);
+
+	assert( 1 == cofactor );
 
-	int128_t t = n;
+	uint128_t t = n;
 
 	// for each factor
-	for(int128_t *f = factors, *e = exponents; *f; f++, e++)
+	for(int i = 0; i < count; i++)
 	{
-		int128_t pe = int128_pow_pl_log(*f, *e);
+		for(int e = 0; e < exponents[i]; e++)
+			t /= factors[i];
 
-		t = t/pe;
+		// a1 = 2^t, a1 <- a1^f
+		while( mp_uint128_pow2_mod((uint128_t)p, t) != 1 )
+			t *= factors[i];
+	}
 
-		int128_t a1 = int128_dpow2_pl_log(p, t);
+	return (int128_t)t;
+}
 
-		while( a1 != 1 )
-		{
-			a1 = int128_dpow_pl_log(a1, p, *f);
-			t = t * *f;
-		}
+int128_t mp_int128_element2_order(int128_t p) { return int128_element2_order(p); }
+
+// the order of 2 if it is a prime below L, or 0
+static
+int128_t int128_element2_order_lim(int128_t p, int128_t L)
+{
+	// the order of 2 is not prime
+	if( p < 3 )
+		return 0;
+
+	uint128_t n = (uint128_t)p - 1;
+
+	uint128_t factors[MP_FACTOR_MAX];
+	int exponents[MP_FACTOR_MAX];
+	uint128_t cofactor;
+
+	// the rho finds a factor f after about sqrt(f) iterations, the cofactors left unsplit have no factor below L
+	uint64_t budget = 8 * (uint64_t)int128_floor_sqrt(L) + MP_FACTOR_TRIAL;
+
+	int count = mp_uint128_factor(n, factors, exponents, &cofactor, budget);
+
+	for(int i = 0; i < count && factors[i] < (uint128_t)L; i++)
+	{
+		// the order is f, the only divisor besides 1
+		if( mp_uint128_pow2_mod((uint128_t)p, factors[i]) == 1 )
+			return (int128_t)factors[i];
 	}
 
-	return t;
+	return 0;
 }
 
-int128_t mp_int128_element2_order(int128_t p) { return int128_element2_order(p); }
+int128_t mp_int128_element2_order_lim(int128_t p, int128_t L) { return int128_element2_order_lim(p, L); }
 
 static
 int64_t int64_gcd(int64_t a, int64_t b)
@@ -2812,6 +2870,25 @@ int int128_is_prime_wheel30(int128_t p)
 
 int mp_int128_is_prime_wheel30(int128_t p) { return int128_is_prime_wheel30(p); }
 
+// decimal representation, the buf has to hold at least 40 characters
+char *mp_uint128_to_str(char *buf, uint128_t x)
+{
+	char tmp[40];
+	int len = 0;
+
+	do {
+		tmp[len++] = (char)('0' + (int)(x % 10));
+		x /= 10;
+	} while( x );
+
+	for(int i = 0; i < len; i++)
+		buf[i] = tmp[len-1-i];
+
+	buf[len] = 0;
+
+	return buf;
+}
+
 int message(const char *format, ...)
 {
 	va_list ap;
@@ -2822,6 +2899,9 @@ int message(const char *format, ...)
 
 	buf[strlen(buf)-1] = 0;
 
+	// do not interleave with messages from a background thread
+	flockfile(stdout);
+
 	int n = printf("[%s] ", buf);
 
 	va_start(ap, format);
@@ -2830,9 +2910,60 @@ int message(const char *format, ...)
 
 	fflush(stdout);
 
+	funlockfile(stdout);
+
 	return n;
 }
 
+// the reflected polynomial 0xEDB88320, read-only and shared by all the threads
+static const uint32_t crc32_table[256] = {
+	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
+	0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+	0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+	0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
+	0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
+	0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+	0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+	0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
+	0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
+	0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+	0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+	0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
+	0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
+	0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+	0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+	0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
+	0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
+	0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+	0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+	0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
+	0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
+	0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+// CRC-32 (IEEE 802.3), start with crc = 0
+uint32_t mp_crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *ptr = buf;
+
+	crc = ~crc;
+
+	while( len-- )
+		crc = crc32_table[(crc ^ *ptr++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
 // 0 : composite
 // > 0 : prime
 static
@@ -2845,25 +2976,26 @@ int int_is_prime_cached(int p, const uint8_t *primes)
 
 int mp_int_is_prime_cached(int p, const uint8_t *primes) { return int_is_prime_cached(p, primes); }
 
+// n : factor | M(n), n is prime, or 0
 static
-void int64_test_prtest(uint8_t *record, int64_t factor, int exponent_limit, const uint8_t *primes)
+int int64_exponent_prtest(int64_t factor, int exponent_limit, const uint8_t *primes)
 {
 	// skip M itself
 	if( INT64_0 == (factor & (factor+INT64_1)) )
 	{
-		return;
+		return 0;
 	}
 
 	// check if the factor \equiv \pm 1 in \pmod 8
 	if( (INT64_C(1) != (factor&INT64_C(7))) && (INT64_C(7) != (factor&INT64_C(7))) )
 	{
-		return;
+		return 0;
 	}
 
 	// not a prime factor, skip them
 	if( !int64_is_prime_wheel6(factor) )
 	{
-		return;
+		return 0;
 	}
 
 	// find M(n)
@@ -2871,47 +3003,70 @@ void int64_test_prtest(uint8_t *record, int64_t factor, int exponent_limit, cons
 
 	// check if the exponent is prime
 	if( int_is_prime_cached(n, primes) )
+	{
+		return n;
+	}
+
+	return 0;
+}
+
+int mp_int64_exponent_prtest(int64_t factor, int exponent_limit, const uint8_t *primes) { return int64_exponent_prtest(factor, exponent_limit, primes); }
+
+static
+void int64_test_prtest(uint8_t *record, int64_t factor, int exponent_limit, const uint8_t *primes)
+{
+	int n = int64_exponent_prtest(factor, exponent_limit, primes);
+
+	if( n )
 	{
 		// mark the M(n) as dirty
 		set_bit(record, n);
-
-		message(DBG "M(%i) was eliminated by %" PRId64 "!\n", n, factor);
 	}
 }
 
 void mp_int64_test_prtest(uint8_t *record, int64_t factor, int exponent_limit, const uint8_t *primes) { int64_test_prtest(record, factor, exponent_limit, primes); }
 
+// n : factor | M(n), n is prime, or 0
 static
-void int128_test_prtest(uint8_t *record, int128_t factor, int exponent_limit, const uint8_t *primes)
+int int128_exponent_prtest(int128_t factor, int exponent_limit, const uint8_t *primes)
 {
 	// skip M itself
 	if( INT128_0 == (factor & (factor+INT128_1)) )
 	{
-		return;
+		return 0;
 	}
 
 	// check if the factor \equiv \pm 1 in \pmod 8
 	if( (1 != (factor&7)) && (7 != (factor&7)) )
 	{
-		return;
+		return 0;
 	}
 
 	// not a prime factor, skip them
-	if( !int128_is_prime_wheel6(factor) )
+	if( !mp_uint128_is_prime((uint128_t)factor) )
 	{
-		return;
+		return 0;
 	}
 
-	// find M(n)
-	int n = (int)mp_int128_dlog2_bg_lim(factor, exponent_limit);
+	// find M(n), n is prime
+	int n = (int)int128_element2_order_lim(factor, exponent_limit);
 
-	// check if the exponent is prime
-	if( int_is_prime_cached(n, primes) )
+	assert( 0 == n || int_is_prime_cached(n, primes) );
+
+	return n;
+}
+
+int mp_int128_exponent_prtest(int128_t factor, int exponent_limit, const uint8_t *primes) { return int128_exponent_prtest(factor, exponent_limit, primes); }
+
+static
+void int128_test_prtest(uint8_t *record, int128_t factor, int exponent_limit, const uint8_t *primes)
+{
+	int n = int128_exponent_prtest(factor, exponent_limit, primes);
+
+	if( n )
 	{
 		// mark the M(n) as dirty
 		set_bit(record, n);
-
-		message(DBG "M(%i) was eliminated by %" PRIu64 ":%" PRIu64 "!\n", n, INT128_H64(factor), INT128_L64(factor));
 	}
 }
 
@@ -14,6 +14,8 @@
 
 int message(const char *format, ...);
 
+uint32_t mp_crc32(uint32_t crc, const void *buf, size_t len);
+
 uint8_t *load_prime_table(int exponent_limit);
 uint8_t *gen_prime_table(int exponent_limit);
 void save_prime_table(const uint8_t *primes, int exponent_limit);
@@ -74,6 +76,7 @@ int mp_int64_is_prime_wheel30(int64_t p);
 
 int64_t mp_int64_next_prime_cached(int64_t p, const uint8_t *primes, int exponent_limit);
 
+int mp_int64_exponent_prtest(int64_t factor, int exponent_limit, const uint8_t *primes);
 void mp_int64_test_prtest(uint8_t *record, int64_t factor, int exponent_limit, const uint8_t *primes);
 void mp_int64_test_direct(uint8_t *record, int64_t factor, int exponent_limit, const uint8_t *primes);
 
@@ -135,6 +138,7 @@ int128_t mp_int128_dlog2_mn(int128_t p);
 int128_t mp_int128_dlog2_pl(int128_t p);
 int128_t mp_int128_dlog2_bg(int128_t p);
 int128_t mp_int128_element2_order(int128_t p);
+int128_t mp_int128_element2_order_lim(int128_t p, int128_t L);
 
 int128_t mp_int128_dlog2_mn_lim(int128_t p, int128_t L);
 int128_t mp_int128_dlog2_pl_lim(int128_t p, int128_t L);
@@ -148,8 +152,11 @@ int mp_int128_is_prime(int128_t p);
 int mp_int128_is_prime_wheel6(int128_t p);
 int mp_int128_is_prime_wheel30(int128_t p);
 
+char *mp_uint128_to_str(char *buf, uint128_t x);
+
 int128_t mp_int128_next_prime_cached(int128_t p, const uint8_t *primes, int exponent_limit);
 
+int mp_int128_exponent_prtest(int128_t factor, int exponent_limit, const uint8_t *primes);
 void mp_int128_test_prtest(uint8_t *record, int128_t factor, int exponent_limit, const uint8_t *primes);
 void mp_int128_test_direct(uint8_t *record, int128_t factor, int exponent_limit, const uint8_t *primes);
 
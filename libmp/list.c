@@ -0,0 +1,224 @@
+#include "list.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// differences of the ascending exponents, *last is the exponent before the first one
+size_t mp_list_encode(uint32_t *out, const uint32_t *exponents, size_t count, uint32_t *last)
+{
+	uint32_t prev = *last;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		out[i] = exponents[i] - prev;
+		prev = exponents[i];
+	}
+
+	*last = prev;
+
+	return count;
+}
+
+// (re)write the header at the beginning of the file
+int mp_list_write_header(FILE *file, uint64_t count, uint64_t exponent_limit)
+{
+	struct mp_list_header header;
+
+	memcpy(header.magic, MP_LIST_MAGIC, sizeof(header.magic));
+	header.count = count;
+	header.exponent_limit = exponent_limit;
+
+	if( fseek(file, 0, SEEK_SET) || 1 != fwrite(&header, sizeof(header), 1, file) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to write the list header :( Error: %s\n", strerror(errsv));
+		return -1;
+	}
+
+	return 0;
+}
+
+int mp_list_open(struct mp_list *list, const char *path)
+{
+	list->path = path;
+	list->map = NULL;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if( -1 == fd || -1 == fstat(fd, &st) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to open the list '%s' :( Error: %s\n", path, strerror(errsv));
+		if( -1 != fd )
+			close(fd);
+		return -1;
+	}
+
+	list->size = (size_t)st.st_size;
+
+	struct mp_list_header header;
+
+	if( list->size < sizeof(header) )
+	{
+		message(ERR "The list '%s' is truncated!\n", path);
+		close(fd);
+		return -1;
+	}
+
+	void *addr = mmap(NULL, list->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if( MAP_FAILED == addr )
+	{
+		int errsv = errno;
+		message(ERR "Unable to map the list '%s' :( Error: %s\n", path, strerror(errsv));
+		return -1;
+	}
+
+	list->map = addr;
+
+	memcpy(&header, list->map, sizeof(header));
+
+	if( memcmp(header.magic, MP_LIST_MAGIC, sizeof(header.magic)) || header.count > (list->size - sizeof(header)) / sizeof(uint32_t) )
+	{
+		message(ERR "The list '%s' is damaged!\n", path);
+		mp_list_close(list);
+		return -1;
+	}
+
+	list->count = header.count;
+	list->exponent_limit = header.exponent_limit;
+	list->deltas = (const uint32_t *)(list->map + sizeof(header));
+
+	madvise(addr, list->size, MADV_SEQUENTIAL);
+
+	return 0;
+}
+
+void mp_list_close(struct mp_list *list)
+{
+	if( list->map )
+		munmap((void *)list->map, list->size);
+
+	list->map = NULL;
+}
+
+// up to max exponents from the index *pos on, *last is the exponent before it
+size_t mp_list_decode(const struct mp_list *list, size_t *pos, uint32_t *last, uint32_t *out, size_t max)
+{
+	size_t i = *pos;
+	size_t n = 0;
+	uint32_t prev = *last;
+
+	for(; n < max && i < list->count; n++, i++)
+	{
+		prev += list->deltas[i];
+		out[n] = prev;
+	}
+
+	*pos = i;
+	*last = prev;
+
+	return n;
+}
+
+// 1 if the file starts with the list magic
+int mp_list_probe(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+
+	if( NULL == file )
+		return 0;
+
+	char magic[8];
+
+	int ret = sizeof(magic) == fread(magic, 1, sizeof(magic), file) && 0 == memcmp(magic, MP_LIST_MAGIC, sizeof(magic));
+
+	fclose(file);
+
+	return ret;
+}
+
+// all the exponents of a list file or of a text file (one per line), NULL on failure
+uint32_t *mp_list_load(const char *path, size_t *count)
+{
+	if( mp_list_probe(path) )
+	{
+		struct mp_list list;
+
+		if( mp_list_open(&list, path) )
+			return NULL;
+
+		uint32_t *exponents = malloc((list.count ? list.count : 1) * sizeof(uint32_t));
+		size_t pos = 0;
+		uint32_t last = 0;
+
+		if( NULL == exponents )
+		{
+			message(ERR "Unable to allocate memory :(\n");
+			mp_list_close(&list);
+			return NULL;
+		}
+
+		*count = mp_list_decode(&list, &pos, &last, exponents, list.count);
+
+		mp_list_close(&list);
+
+		return exponents;
+	}
+
+	FILE *file = fopen(path, "r");
+
+	if( NULL == file )
+	{
+		message(ERR "Unable to open the list '%s' :(\n", path);
+		return NULL;
+	}
+
+	size_t capacity = 1 << 16;
+	uint32_t *exponents = malloc(capacity * sizeof(uint32_t));
+
+	*count = 0;
+
+	for(uint32_t n; NULL != exponents && 1 == fscanf(file, "%" SCNu32, &n);)
+	{
+		if( *count == capacity )
+		{
+			uint32_t *more = realloc(exponents, 2 * capacity * sizeof(uint32_t));
+
+			if( NULL == more )
+			{
+				free(exponents);
+				exponents = NULL;
+				break;
+			}
+
+			exponents = more;
+			capacity *= 2;
+		}
+
+		exponents[(*count)++] = n;
+	}
+
+	if( NULL == exponents )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+	}
+
+	fclose(file);
+
+	return exponents;
+}
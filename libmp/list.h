@@ -0,0 +1,54 @@
+/** @file list.h
+ * Binary lists of exponents
+ */
+#ifndef LIST_H
+#define LIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** @defgroup list list
+ * @{
+ */
+
+#define MP_LIST_MAGIC "MPLIST01"
+
+/**
+ * The list file holds the header and count differences of the ascending
+ * exponents (the first one is taken from zero) as native uint32_t, so the
+ * file can be mapped and walked in place.
+ */
+struct mp_list_header {
+	char magic[8];
+	uint64_t count; // number of exponents
+	uint64_t exponent_limit; // of the record the list comes from
+};
+
+size_t mp_list_encode(uint32_t *out, const uint32_t *exponents, size_t count, uint32_t *last);
+int mp_list_write_header(FILE *file, uint64_t count, uint64_t exponent_limit);
+
+/**
+ * Read-only mapping of a list file.
+ */
+struct mp_list {
+	const char *path;
+	const uint8_t *map;
+	size_t size;
+	const uint32_t *deltas;
+	uint64_t count;
+	uint64_t exponent_limit;
+};
+
+int mp_list_open(struct mp_list *list, const char *path);
+void mp_list_close(struct mp_list *list);
+
+size_t mp_list_decode(const struct mp_list *list, size_t *pos, uint32_t *last, uint32_t *out, size_t max);
+
+int mp_list_probe(const char *path);
+
+uint32_t *mp_list_load(const char *path, size_t *count);
+
+/** @} */
+
+#endif
@@ -0,0 +1,818 @@
+#include "mersenne.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// the prime 2^64 - 2^32 + 1, its multiplicative group has a generator 7
+#define NTT_P UINT64_C(0xffffffff00000001)
+#define NTT_EPSILON UINT64_C(0xffffffff)
+#define NTT_G 7
+
+// branchless, the residues are random and the branches would be mispredicted
+static
+uint64_t ntt_add(uint64_t a, uint64_t b)
+{
+	uint64_t s = a + b;
+
+	// 2^64 == 2^32 - 1 (mod P)
+	s += NTT_EPSILON & -(uint64_t)(s < a);
+	s -= NTT_P & -(uint64_t)(s >= NTT_P);
+
+	return s;
+}
+
+static
+uint64_t ntt_sub(uint64_t a, uint64_t b)
+{
+	uint64_t d = a - b;
+
+	// + P == - 2^32 + 1 (mod 2^64)
+	d -= NTT_EPSILON & -(uint64_t)(a < b);
+
+	return d;
+}
+
+// 2^64 == 2^32 - 1, 2^96 == -1 (mod P)
+static
+uint64_t ntt_mul(uint64_t a, uint64_t b)
+{
+	uint128_t x = (uint128_t)a * b;
+	uint64_t lo = (uint64_t)x;
+	uint64_t hi = (uint64_t)(x >> 64);
+	uint64_t hi_hi = hi >> 32;
+	uint64_t hi_lo = hi & NTT_EPSILON;
+
+	uint64_t t0 = lo - hi_hi;
+
+	t0 -= NTT_EPSILON & -(uint64_t)(lo < hi_hi);
+
+	uint64_t t1 = hi_lo * NTT_EPSILON;
+	uint64_t s = t0 + t1;
+
+	s += NTT_EPSILON & -(uint64_t)(s < t0);
+	s -= NTT_P & -(uint64_t)(s >= NTT_P);
+
+	return s;
+}
+
+static
+uint64_t ntt_pow(uint64_t a, uint64_t e)
+{
+	uint64_t r = 1;
+
+	for(; e; e >>= 1)
+	{
+		if( e & 1 )
+			r = ntt_mul(r, a);
+
+		a = ntt_mul(a, a);
+	}
+
+	return r;
+}
+
+// decimation in frequency, the output is in the bit-reversed order
+static
+void ntt_forward(const struct mp_mersenne *ctx, uint64_t *a)
+{
+	for(size_t h = ctx->len / 2; h >= 1; h /= 2)
+	{
+		for(size_t s = 0; s < ctx->len; s += 2*h)
+		{
+			for(size_t j = 0; j < h; j++)
+			{
+				uint64_t u = a[s + j];
+				uint64_t v = a[s + j + h];
+
+				a[s + j] = ntt_add(u, v);
+				a[s + j + h] = ntt_mul(ntt_sub(u, v), ctx->roots[h + j]);
+			}
+		}
+	}
+}
+
+// decimation in time from the bit-reversed order, not scaled
+static
+void ntt_inverse(const struct mp_mersenne *ctx, uint64_t *a)
+{
+	for(size_t h = 1; h < ctx->len; h *= 2)
+	{
+		for(size_t s = 0; s < ctx->len; s += 2*h)
+		{
+			for(size_t j = 0; j < h; j++)
+			{
+				uint64_t u = a[s + j];
+				uint64_t v = ntt_mul(a[s + j + h], ctx->iroots[h + j]);
+
+				a[s + j] = ntt_add(u, v);
+				a[s + j + h] = ntt_sub(u, v);
+			}
+		}
+	}
+}
+
+// the position of the digit i, ceil(p i / len)
+static
+size_t digit_pos(const struct mp_mersenne *ctx, size_t i)
+{
+	return (size_t)(((uint64_t)ctx->p * i + ctx->len - 1) >> ctx->log_len);
+}
+
+int mp_mersenne_init(struct mp_mersenne *ctx, uint32_t p)
+{
+	assert( p >= 2 );
+
+	ctx->p = p;
+	ctx->words = (p + 63) / 64;
+
+	// len products of the digits of ceil(p / len) bits below P > 2^63
+	for(ctx->log_len = 1; 2 * ((p + (UINT32_C(1) << ctx->log_len) - 1) >> ctx->log_len) + ctx->log_len > 63; ctx->log_len++)
+		;
+
+	ctx->len = (size_t)1 << ctx->log_len;
+
+	// the roots of unity of the order 192 len, 2 is one of the order 192
+	assert( ctx->log_len <= 26 );
+
+	// a is also the scratch of the Karatsuba multiplication
+	size_t alloc = ctx->len < 4 * ctx->words + 64 ? 4 * ctx->words + 64 : ctx->len;
+
+	ctx->roots = malloc(ctx->len * sizeof(uint64_t));
+	ctx->iroots = malloc(ctx->len * sizeof(uint64_t));
+	ctx->weights = malloc(ctx->len * sizeof(uint64_t));
+	ctx->iweights = malloc(ctx->len * sizeof(uint64_t));
+	ctx->a = malloc(alloc * sizeof(uint64_t));
+	ctx->b = malloc(alloc * sizeof(uint64_t));
+	ctx->t = malloc((2 * ctx->words + 1) * sizeof(uint64_t));
+
+	if( !ctx->roots || !ctx->iroots || !ctx->weights || !ctx->iweights || !ctx->a || !ctx->b || !ctx->t )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		mp_mersenne_free(ctx);
+		return -1;
+	}
+
+	for(size_t h = 1; h < ctx->len; h *= 2)
+	{
+		// a primitive root of unity of the order 2h
+		uint64_t w = ntt_pow(NTT_G, (NTT_P - 1) / (2 * h));
+		uint64_t iw = ntt_pow(w, NTT_P - 2);
+
+		ctx->roots[h] = 1;
+		ctx->iroots[h] = 1;
+
+		for(size_t j = 1; j < h; j++)
+		{
+			ctx->roots[h + j] = ntt_mul(ctx->roots[h + j - 1], w);
+			ctx->iroots[h + j] = ntt_mul(ctx->iroots[h + j - 1], iw);
+		}
+	}
+
+	// the root r of 2 of the degree len, r^len is a root of unity of the order 192
+	uint64_t omega = ntt_pow(NTT_G, (NTT_P - 1) / (192 * (uint64_t)ctx->len));
+	uint64_t omega_len = ntt_pow(omega, ctx->len);
+	uint64_t root = 1, power = 1;
+
+	for(int j = 0; power != 2; j++)
+	{
+		assert( j < 192 );
+
+		root = ntt_mul(root, omega);
+		power = ntt_mul(power, omega_len);
+	}
+
+	// the digit i is weighted by r^(len ceil(p i / len) - p i), the inverse is scaled by 1/len
+	uint64_t inv_root = ntt_pow(root, NTT_P - 2);
+	uint64_t inv_len = ntt_pow(ctx->len, NTT_P - 2);
+
+	for(size_t i = 0; i < ctx->len; i++)
+	{
+		uint64_t e = ((uint64_t)digit_pos(ctx, i) << ctx->log_len) - (uint64_t)p * i;
+
+		ctx->weights[i] = ntt_pow(root, e);
+		ctx->iweights[i] = ntt_mul(ntt_pow(inv_root, e), inv_len);
+	}
+
+	return 0;
+}
+
+void mp_mersenne_free(struct mp_mersenne *ctx)
+{
+	free(ctx->roots);
+	free(ctx->iroots);
+	free(ctx->weights);
+	free(ctx->iweights);
+	free(ctx->a);
+	free(ctx->b);
+	free(ctx->t);
+
+	ctx->roots = NULL;
+	ctx->iroots = NULL;
+	ctx->weights = NULL;
+	ctx->iweights = NULL;
+	ctx->a = NULL;
+	ctx->b = NULL;
+	ctx->t = NULL;
+}
+
+// a zero residue
+uint64_t *mp_mersenne_alloc(const struct mp_mersenne *ctx)
+{
+	uint64_t *r = calloc(ctx->words, sizeof(uint64_t));
+
+	if( NULL == r )
+		message(ERR "Unable to allocate memory :(\n");
+
+	return r;
+}
+
+// the mask of the top word
+static
+uint64_t top_mask(const struct mp_mersenne *ctx)
+{
+	return ctx->p % 64 ? (UINT64_C(1) << ctx->p % 64) - 1 : UINT64_MAX;
+}
+
+// 64 bits of t (tw words) from the bit pos on, zeros beyond
+static
+uint64_t bits_at(const uint64_t *t, size_t tw, size_t pos)
+{
+	size_t w = pos / 64;
+	unsigned s = (unsigned)(pos % 64);
+	uint64_t x = 0;
+
+	if( w < tw )
+		x = t[w] >> s;
+
+	if( s && w + 1 < tw )
+		x |= t[w + 1] << (64 - s);
+
+	return x;
+}
+
+// r = t (mod 2^p - 1), t < 2^(p + 64 words), r may alias t
+static
+void reduce(const struct mp_mersenne *ctx, uint64_t *r, const uint64_t *t, size_t tw)
+{
+	size_t words = ctx->words;
+	uint64_t mask = top_mask(ctx);
+	uint64_t carry = 0;
+
+	// the high words are read before r is written
+	for(size_t i = 0; i < words; i++)
+	{
+		uint64_t lo = i < tw ? t[i] : 0;
+		uint64_t hi = bits_at(t, tw, ctx->p + 64 * i);
+
+		if( i == words - 1 )
+			lo &= mask;
+
+		uint128_t s = (uint128_t)lo + hi + carry;
+
+		r[i] = (uint64_t)s;
+		carry = (uint64_t)(s >> 64);
+	}
+
+	// fold the bits above p back
+	for(;;)
+	{
+		uint64_t over = (r[words - 1] & ~mask) >> (ctx->p % 64) | (ctx->p % 64 ? carry << (64 - ctx->p % 64) : carry);
+
+		if( 0 == over )
+			break;
+
+		r[words - 1] &= mask;
+		carry = 0;
+
+		for(size_t i = 0; i < words && over; i++)
+		{
+			r[i] += over;
+			over = r[i] < over;
+		}
+
+		// out of the top word, p is a multiple of 64
+		carry = over;
+	}
+
+	// 2^p - 1 == 0
+	for(size_t i = 0; i < words; i++)
+	{
+		if( r[i] != (i == words - 1 ? mask : UINT64_MAX) )
+			return;
+	}
+
+	memset(r, 0, words * sizeof(uint64_t));
+}
+
+void mp_mersenne_set_ui(const struct mp_mersenne *ctx, uint64_t *r, uint64_t a)
+{
+	uint64_t t[2] = { a, 0 };
+
+	reduce(ctx, r, t, 2);
+}
+
+void mp_mersenne_copy(const struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x)
+{
+	memcpy(r, x, ctx->words * sizeof(uint64_t));
+}
+
+int mp_mersenne_is_ui(struct mp_mersenne *ctx, const uint64_t *x, uint64_t a)
+{
+	uint64_t *t = ctx->t + ctx->words + 1;
+
+	mp_mersenne_set_ui(ctx, t, a);
+
+	return 0 == memcmp(t, x, ctx->words * sizeof(uint64_t));
+}
+
+void mp_mersenne_add(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *y)
+{
+	uint64_t carry = 0;
+
+	for(size_t i = 0; i < ctx->words; i++)
+	{
+		uint128_t s = (uint128_t)x[i] + y[i] + carry;
+
+		ctx->t[i] = (uint64_t)s;
+		carry = (uint64_t)(s >> 64);
+	}
+
+	ctx->t[ctx->words] = carry;
+
+	reduce(ctx, r, ctx->t, ctx->words + 1);
+}
+
+// x + (2^p - 1 - y)
+void mp_mersenne_sub(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *y)
+{
+	uint64_t mask = top_mask(ctx);
+	uint64_t carry = 0;
+
+	for(size_t i = 0; i < ctx->words; i++)
+	{
+		uint64_t ny = ~y[i] & (i == ctx->words - 1 ? mask : UINT64_MAX);
+		uint128_t s = (uint128_t)x[i] + ny + carry;
+
+		ctx->t[i] = (uint64_t)s;
+		carry = (uint64_t)(s >> 64);
+	}
+
+	ctx->t[ctx->words] = carry;
+
+	reduce(ctx, r, ctx->t, ctx->words + 1);
+}
+
+void mp_mersenne_sub_ui(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, uint64_t a)
+{
+	// the upper half of the product buffer, sub uses the lower one
+	uint64_t *t = ctx->t + ctx->words + 1;
+
+	mp_mersenne_set_ui(ctx, t, a);
+	mp_mersenne_sub(ctx, r, x, t);
+}
+
+void mp_mersenne_mul_ui(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, uint32_t c)
+{
+	uint64_t carry = 0;
+
+	for(size_t i = 0; i < ctx->words; i++)
+	{
+		uint128_t s = (uint128_t)x[i] * c + carry;
+
+		ctx->t[i] = (uint64_t)s;
+		carry = (uint64_t)(s >> 64);
+	}
+
+	ctx->t[ctx->words] = carry;
+
+	reduce(ctx, r, ctx->t, ctx->words + 1);
+}
+
+// the weighted digits of x, the digit i has digit_pos(i + 1) - digit_pos(i) bits
+static
+void split(const struct mp_mersenne *ctx, uint64_t *a, const uint64_t *x)
+{
+	size_t pos = 0;
+
+	for(size_t i = 0; i < ctx->len; i++)
+	{
+		size_t next = digit_pos(ctx, i + 1);
+		uint64_t digit = bits_at(x, ctx->words, pos) & ((UINT64_C(1) << (next - pos)) - 1);
+
+		a[i] = ntt_mul(digit, ctx->weights[i]);
+		pos = next;
+	}
+}
+
+// unweight the cyclic convolution, propagate the carries, reduce
+static
+void join(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *a)
+{
+	size_t tw = ctx->words + 2;
+	uint128_t acc = 0;
+	size_t pos = 0;
+
+	memset(ctx->t, 0, tw * sizeof(uint64_t));
+
+	for(size_t i = 0; i < ctx->len; i++)
+	{
+		size_t next = digit_pos(ctx, i + 1);
+		unsigned bits = (unsigned)(next - pos);
+
+		acc += ntt_mul(a[i], ctx->iweights[i]);
+
+		uint64_t digit = (uint64_t)acc & ((UINT64_C(1) << bits) - 1);
+
+		ctx->t[pos / 64] |= digit << (pos % 64);
+		if( pos % 64 + bits > 64 )
+			ctx->t[pos / 64 + 1] |= digit >> (64 - pos % 64);
+
+		acc >>= bits;
+		pos = next;
+	}
+
+	// the carry out at 2^p
+	size_t w = pos / 64;
+	unsigned sh = (unsigned)(pos % 64);
+	uint64_t lo = (uint64_t)acc, hi = (uint64_t)(acc >> 64);
+
+	ctx->t[w] |= lo << sh;
+	ctx->t[w + 1] |= sh ? lo >> (64 - sh) | hi << sh : hi;
+	if( sh )
+		ctx->t[w + 2] |= hi >> (64 - sh);
+
+	reduce(ctx, r, ctx->t, tw);
+}
+
+// r = a + b (n words), returns the carry
+static
+uint64_t add_n(uint64_t *r, const uint64_t *a, const uint64_t *b, size_t n)
+{
+	uint64_t carry = 0;
+
+	for(size_t i = 0; i < n; i++)
+	{
+		uint128_t s = (uint128_t)a[i] + b[i] + carry;
+
+		r[i] = (uint64_t)s;
+		carry = (uint64_t)(s >> 64);
+	}
+
+	return carry;
+}
+
+// r = a - b (n words), returns the borrow
+static
+uint64_t sub_n(uint64_t *r, const uint64_t *a, const uint64_t *b, size_t n)
+{
+	uint64_t borrow = 0;
+
+	for(size_t i = 0; i < n; i++)
+	{
+		uint128_t d = (uint128_t)a[i] - b[i] - borrow;
+
+		r[i] = (uint64_t)d;
+		borrow = (uint64_t)(d >> 64) & 1;
+	}
+
+	return borrow;
+}
+
+// r = |x - y|, x has n words, y has m <= n words, returns 1 if x < y
+static
+int diff_n(uint64_t *r, const uint64_t *x, size_t n, const uint64_t *y, size_t m)
+{
+	int less = 0;
+
+	for(size_t i = n; i-- > 0;)
+	{
+		uint64_t yi = i < m ? y[i] : 0;
+
+		if( x[i] != yi )
+		{
+			less = x[i] < yi;
+			break;
+		}
+	}
+
+	const uint64_t *a = less ? y : x, *b = less ? x : y;
+	size_t an = less ? m : n, bn = less ? n : m;
+	uint64_t borrow = 0;
+
+	for(size_t i = 0; i < n; i++)
+	{
+		uint128_t d = (uint128_t)(i < an ? a[i] : 0) - (i < bn ? b[i] : 0) - borrow;
+
+		r[i] = (uint64_t)d;
+		borrow = (uint64_t)(d >> 64) & 1;
+	}
+
+	return less;
+}
+
+// r = x y (2n words), the subtractive Karatsuba, s is the scratch of 4n + 64 words
+static
+void karatsuba(uint64_t *r, const uint64_t *x, const uint64_t *y, size_t n, uint64_t *s)
+{
+	if( n < MP_MERSENNE_KARATSUBA_BASE )
+	{
+		memset(r, 0, 2 * n * sizeof(uint64_t));
+
+		for(size_t i = 0; i < n; i++)
+		{
+			uint64_t carry = 0;
+
+			for(size_t j = 0; j < n; j++)
+			{
+				uint128_t t = (uint128_t)x[i] * y[j] + r[i + j] + carry;
+
+				r[i + j] = (uint64_t)t;
+				carry = (uint64_t)(t >> 64);
+			}
+
+			r[i + n] = carry;
+		}
+
+		return;
+	}
+
+	// x = x1 2^(64h) + x0, x1 has l <= h words
+	size_t h = (n + 1) / 2, l = n - h;
+	uint64_t *dx = s, *dy = s + h, *m = s + 2 * h, *t = s + 4 * h;
+
+	int neg = diff_n(dx, x, h, x + h, l) ^ diff_n(dy, y, h, y + h, l);
+
+	karatsuba(r, x, y, h, t);
+	karatsuba(r + 2 * h, x + h, y + h, l, t);
+	karatsuba(m, dx, dy, h, t);
+
+	// x0 y1 + x1 y0 = x0 y0 + x1 y1 - (x0 - x1)(y0 - y1)
+	memset(t, 0, (2 * h + 1) * sizeof(uint64_t));
+	memcpy(t, r + 2 * h, 2 * l * sizeof(uint64_t));
+
+	t[2 * h] = add_n(t, t, r, 2 * h);
+
+	if( neg )
+		t[2 * h] += add_n(t, t, m, 2 * h);
+	else
+		t[2 * h] -= sub_n(t, t, m, 2 * h);
+
+	// the middle term below 2n words
+	size_t tn = 2 * h + 1 < 2 * n - h ? 2 * h + 1 : 2 * n - h;
+	uint64_t carry = add_n(r + h, r + h, t, tn);
+
+	for(size_t i = h + tn; i < 2 * n && carry; i++)
+	{
+		r[i] += carry;
+		carry = r[i] < carry;
+	}
+}
+
+static
+void mul_karatsuba(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *y)
+{
+	size_t tw = 2 * ctx->words;
+
+	karatsuba(ctx->t, x, y, ctx->words, ctx->a);
+
+	reduce(ctx, r, ctx->t, tw);
+}
+
+void mp_mersenne_sqr(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x)
+{
+	if( ctx->words <= MP_MERSENNE_KARATSUBA )
+	{
+		mul_karatsuba(ctx, r, x, x);
+		return;
+	}
+
+	split(ctx, ctx->a, x);
+
+	ntt_forward(ctx, ctx->a);
+
+	for(size_t i = 0; i < ctx->len; i++)
+		ctx->a[i] = ntt_mul(ctx->a[i], ctx->a[i]);
+
+	ntt_inverse(ctx, ctx->a);
+
+	join(ctx, r, ctx->a);
+}
+
+void mp_mersenne_mul(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *y)
+{
+	if( ctx->words <= MP_MERSENNE_KARATSUBA )
+	{
+		mul_karatsuba(ctx, r, x, y);
+		return;
+	}
+
+	split(ctx, ctx->a, x);
+	split(ctx, ctx->b, y);
+
+	ntt_forward(ctx, ctx->a);
+	ntt_forward(ctx, ctx->b);
+
+	for(size_t i = 0; i < ctx->len; i++)
+		ctx->a[i] = ntt_mul(ctx->a[i], ctx->b[i]);
+
+	ntt_inverse(ctx, ctx->a);
+
+	join(ctx, r, ctx->a);
+}
+
+// left-to-right, the transform of x is kept for all the multiplications
+void mp_mersenne_pow(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *e, size_t bits)
+{
+	// the highest set bit
+	while( bits > 0 && !(e[(bits - 1) / 64] >> ((bits - 1) % 64) & 1) )
+		bits--;
+
+	if( 0 == bits )
+	{
+		mp_mersenne_set_ui(ctx, r, 1);
+		return;
+	}
+
+	// x may alias r
+	if( ctx->words <= MP_MERSENNE_KARATSUBA )
+	{
+		uint64_t *y = ctx->b;
+
+		mp_mersenne_copy(ctx, y, x);
+		mp_mersenne_copy(ctx, r, x);
+
+		for(size_t i = bits - 1; i-- > 0;)
+		{
+			mp_mersenne_sqr(ctx, r, r);
+
+			if( e[i / 64] >> (i % 64) & 1 )
+				mp_mersenne_mul(ctx, r, r, y);
+		}
+
+		return;
+	}
+
+	split(ctx, ctx->b, x);
+	ntt_forward(ctx, ctx->b);
+
+	mp_mersenne_copy(ctx, r, x);
+
+	for(size_t i = bits - 1; i-- > 0;)
+	{
+		mp_mersenne_sqr(ctx, r, r);
+
+		if( e[i / 64] >> (i % 64) & 1 )
+		{
+			split(ctx, ctx->a, r);
+
+			ntt_forward(ctx, ctx->a);
+
+			for(size_t j = 0; j < ctx->len; j++)
+				ctx->a[j] = ntt_mul(ctx->a[j], ctx->b[j]);
+
+			ntt_inverse(ctx, ctx->a);
+
+			join(ctx, r, ctx->a);
+		}
+	}
+}
+
+// 62 divsteps on the low bits of f and g, 2^62 (f', g') = (u f + v g, q f + r g)
+static
+int64_t divsteps62(int64_t delta, uint64_t f, uint64_t g, int64_t m[4])
+{
+	int64_t u = 1, v = 0, q = 0, r = 1;
+
+	for(int i = 0; i < 62; i++)
+	{
+		if( delta > 0 && (g & 1) )
+		{
+			uint64_t f1 = g;
+			int64_t u1 = 2 * q, v1 = 2 * r;
+
+			g = (g - f) >> 1;
+			f = f1;
+			q -= u;
+			r -= v;
+			u = u1;
+			v = v1;
+			delta = 1 - delta;
+		}
+		else if( g & 1 )
+		{
+			g = (g + f) >> 1;
+			q += u;
+			r += v;
+			u *= 2;
+			v *= 2;
+			delta++;
+		}
+		else
+		{
+			g >>= 1;
+			u *= 2;
+			v *= 2;
+			delta++;
+		}
+	}
+
+	m[0] = u;
+	m[1] = v;
+	m[2] = q;
+	m[3] = r;
+
+	return delta;
+}
+
+// out = (u x + v y) / 2^62 of the signed numbers of n words (two's complement)
+static
+void combine(uint64_t *out, const uint64_t *x, const uint64_t *y, size_t n, int64_t u, int64_t v)
+{
+	int128_t acc = 0;
+	uint64_t prev = 0;
+
+	for(size_t i = 0; i < n; i++)
+	{
+		// |u| + |v| <= 2^62, the sum fits
+		int128_t xi = i + 1 < n ? (int128_t)x[i] : (int128_t)(int64_t)x[i];
+		int128_t yi = i + 1 < n ? (int128_t)y[i] : (int128_t)(int64_t)y[i];
+
+		acc += (int128_t)u * xi + (int128_t)v * yi;
+
+		uint64_t lo = (uint64_t)acc;
+
+		acc >>= 64;
+
+		if( i > 0 )
+			out[i - 1] = prev >> 62 | lo << 2;
+
+		prev = lo;
+	}
+
+	out[n - 1] = prev >> 62 | (uint64_t)acc << 2;
+}
+
+// the safe gcd of Bernstein and Yang, f = 2^p - 1 is odd
+int mp_mersenne_gcd(const struct mp_mersenne *ctx, uint64_t *g, const uint64_t *x)
+{
+	size_t n = ctx->words + 1;
+	uint64_t *buf = calloc(4 * n, sizeof(uint64_t));
+
+	if( NULL == buf )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	uint64_t *f = buf, *h = buf + n, *f1 = buf + 2*n, *h1 = buf + 3*n;
+	int64_t delta = 1;
+
+	for(size_t i = 0; i < ctx->words; i++)
+		f[i] = i == ctx->words - 1 ? top_mask(ctx) : UINT64_MAX;
+
+	memcpy(h, x, ctx->words * sizeof(uint64_t));
+
+	for(;;)
+	{
+		int zero = 1;
+
+		for(size_t i = 0; i < n && zero; i++)
+			zero = 0 == h[i];
+
+		if( zero )
+			break;
+
+		int64_t m[4];
+
+		delta = divsteps62(delta, f[0], h[0], m);
+
+		combine(f1, f, h, n, m[0], m[1]);
+		combine(h1, f, h, n, m[2], m[3]);
+
+		uint64_t *t;
+		t = f; f = f1; f1 = t;
+		t = h; h = h1; h1 = t;
+	}
+
+	// |f|
+	if( (int64_t)f[n - 1] < 0 )
+	{
+		uint64_t carry = 1;
+
+		for(size_t i = 0; i < n; i++)
+		{
+			f[i] = ~f[i] + carry;
+			carry = carry && 0 == f[i];
+		}
+	}
+
+	memcpy(g, f, ctx->words * sizeof(uint64_t));
+
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+/** @file mersenne.h
+ * Multiprecision arithmetic modulo a Mersenne number 2^p - 1
+ */
+#ifndef MERSENNE_H
+#define MERSENNE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @defgroup mersenne mersenne
+ * @{
+ */
+
+// the residues of at most this many words are multiplied by Karatsuba
+#define MP_MERSENNE_KARATSUBA 512
+
+// the schoolbook multiplication below this many words
+#define MP_MERSENNE_KARATSUBA_BASE 16
+
+/**
+ * A residue is an array of words 64-bit words (little endian), reduced to
+ * [0; 2^p - 1). The products are computed exactly by the irrational-base
+ * discrete weighted transform over the prime 2^64 - 2^32 + 1: x is split into
+ * len digits of ceil(p (i + 1) / len) - ceil(p i / len) bits, the digit i is
+ * weighted by the power of a root of 2 of the degree len (it exists since 2
+ * is a root of unity of the order 192), and the cyclic convolution of the
+ * length len is then the product modulo 2^p - 1 without any zero-padding.
+ * Up to MP_MERSENNE_KARATSUBA words, the products are computed by Karatsuba
+ * instead and folded by the shift-add reduction x = (x mod 2^p) + (x >> p).
+ * The context holds the twiddles and the buffers, so it must not be shared
+ * by threads.
+ */
+struct mp_mersenne {
+	uint32_t p;
+	size_t words; // of a residue
+	size_t len; // of the transform, the number of digits
+	unsigned log_len;
+	uint64_t *roots; // [h + j] = w_{2h}^j
+	uint64_t *iroots;
+	uint64_t *weights; // of the digits
+	uint64_t *iweights; // scaled by 1/len
+	uint64_t *a; // transforms
+	uint64_t *b;
+	uint64_t *t; // product, 2 * words + 1
+};
+
+int mp_mersenne_init(struct mp_mersenne *ctx, uint32_t p);
+void mp_mersenne_free(struct mp_mersenne *ctx);
+
+uint64_t *mp_mersenne_alloc(const struct mp_mersenne *ctx);
+
+void mp_mersenne_set_ui(const struct mp_mersenne *ctx, uint64_t *r, uint64_t a);
+void mp_mersenne_copy(const struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x);
+int mp_mersenne_is_ui(struct mp_mersenne *ctx, const uint64_t *x, uint64_t a);
+
+void mp_mersenne_add(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *y);
+void mp_mersenne_sub(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *y);
+void mp_mersenne_sub_ui(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, uint64_t a);
+void mp_mersenne_mul_ui(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, uint32_t c);
+
+void mp_mersenne_sqr(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x);
+void mp_mersenne_mul(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *y);
+
+// r = x^e, e has bits bits (little endian words)
+void mp_mersenne_pow(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, const uint64_t *e, size_t bits);
+
+// g = gcd(x, 2^p - 1) as an integer (2^p - 1 itself for x = 0)
+int mp_mersenne_gcd(const struct mp_mersenne *ctx, uint64_t *g, const uint64_t *x);
+
+/** @} */
+
+#endif
@@ -0,0 +1,506 @@
+#include "mont.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+// -q^{-1} mod 2^64, q is odd
+static
+uint64_t neg_inv64(uint64_t q)
+{
+	// q*q == 1 (mod 8), each step doubles the number of correct bits
+	uint64_t inv = q;
+
+	for(int i = 0; i < 5; i++)
+	{
+		inv *= UINT64_C(2) - q * inv;
+	}
+
+	return -inv;
+}
+
+static
+void mont64_init(struct mp_mont64 *ctx, uint64_t q)
+{
+	assert( (q & 1) && q < (UINT64_C(1) << 63) );
+
+	ctx->q = q;
+	ctx->qinv = neg_inv64(q);
+	ctx->one = (-q) % q;
+}
+
+void mp_mont64_init(struct mp_mont64 *ctx, uint64_t q) { mont64_init(ctx, q); }
+
+// a*b/R (mod q), a, b < q
+static
+uint64_t mont64_mul(const struct mp_mont64 *ctx, uint64_t a, uint64_t b)
+{
+	uint128_t t = (uint128_t)a * b;
+	uint64_t m = (uint64_t)t * ctx->qinv;
+	uint64_t u = (uint64_t)((t + (uint128_t)m * ctx->q) >> 64);
+
+	return u >= ctx->q ? u - ctx->q : u;
+}
+
+uint64_t mp_mont64_mul(const struct mp_mont64 *ctx, uint64_t a, uint64_t b) { return mont64_mul(ctx, a, b); }
+
+uint64_t mp_mont64_to(const struct mp_mont64 *ctx, uint64_t a)
+{
+	return (uint64_t)(((uint128_t)a << 64) % ctx->q);
+}
+
+uint64_t mp_mont64_from(const struct mp_mont64 *ctx, uint64_t a)
+{
+	return mont64_mul(ctx, a, UINT64_C(1));
+}
+
+static
+void mont128_init(struct mp_mont128 *ctx, uint128_t q)
+{
+	assert( (q & 1) && q < (UINT128_1 << 127) );
+
+	ctx->q = q;
+	ctx->qinv = neg_inv64((uint64_t)q);
+	ctx->one = (-q) % q;
+}
+
+void mp_mont128_init(struct mp_mont128 *ctx, uint128_t q) { mont128_init(ctx, q); }
+
+// a*b/R (mod q), a, b < q, two 64-bit limbs (CIOS)
+static
+uint128_t mont128_mul(const struct mp_mont128 *ctx, uint128_t a, uint128_t b)
+{
+	uint64_t a0 = (uint64_t)a, a1 = (uint64_t)(a >> 64);
+	uint64_t b0 = (uint64_t)b, b1 = (uint64_t)(b >> 64);
+	uint64_t q0 = (uint64_t)ctx->q, q1 = (uint64_t)(ctx->q >> 64);
+	uint64_t t0, t1, t2, m;
+	uint128_t p;
+
+	// t = a*b0
+	p = (uint128_t)a0 * b0;
+	t0 = (uint64_t)p;
+	p = (uint128_t)a1 * b0 + (p >> 64);
+	t1 = (uint64_t)p;
+	t2 = (uint64_t)(p >> 64);
+
+	// t = (t + m*q) / 2^64
+	m = t0 * ctx->qinv;
+	p = (uint128_t)m * q0 + t0;
+	p = (uint128_t)m * q1 + t1 + (p >> 64);
+	t0 = (uint64_t)p;
+	p = (uint128_t)t2 + (p >> 64);
+	t1 = (uint64_t)p;
+	t2 = (uint64_t)(p >> 64);
+
+	// t += a*b1
+	p = (uint128_t)a0 * b1 + t0;
+	t0 = (uint64_t)p;
+	p = (uint128_t)a1 * b1 + t1 + (p >> 64);
+	t1 = (uint64_t)p;
+	t2 += (uint64_t)(p >> 64);
+
+	// t = (t + m*q) / 2^64
+	m = t0 * ctx->qinv;
+	p = (uint128_t)m * q0 + t0;
+	p = (uint128_t)m * q1 + t1 + (p >> 64);
+	t0 = (uint64_t)p;
+	p = (uint128_t)t2 + (p >> 64);
+	t1 = (uint64_t)p;
+
+	// t < 2q < 2^128
+	uint128_t u = (uint128_t)t1 << 64 | t0;
+
+	return u >= ctx->q ? u - ctx->q : u;
+}
+
+uint128_t mp_mont128_mul(const struct mp_mont128 *ctx, uint128_t a, uint128_t b) { return mont128_mul(ctx, a, b); }
+
+uint128_t mp_mont128_to(const struct mp_mont128 *ctx, uint128_t a)
+{
+	// R^2 mod q by doubling
+	uint128_t r2 = ctx->one;
+
+	for(int i = 0; i < 128; i++)
+	{
+		r2 += r2;
+		if( r2 >= ctx->q )
+			r2 -= ctx->q;
+	}
+
+	return mont128_mul(ctx, a % ctx->q, r2);
+}
+
+uint128_t mp_mont128_from(const struct mp_mont128 *ctx, uint128_t a)
+{
+	return mont128_mul(ctx, a, UINT128_1);
+}
+
+// 2^e (mod q), left-to-right, the multiplications by two are additions
+static
+uint64_t uint64_pow2_mod(uint64_t q, uint64_t e)
+{
+	struct mp_mont64 ctx;
+
+	mont64_init(&ctx, q);
+
+	uint64_t x = ctx.one;
+
+	for(int b = 63 - __builtin_clzll(e | 1); b >= 0; b--)
+	{
+		x = mont64_mul(&ctx, x, x);
+
+		if( e >> b & 1 )
+		{
+			x += x;
+			if( x >= q )
+				x -= q;
+		}
+	}
+
+	return mont64_mul(&ctx, x, UINT64_C(1));
+}
+
+uint64_t mp_uint64_pow2_mod(uint64_t q, uint64_t e) { return uint64_pow2_mod(q, e); }
+
+static
+int uint128_bits(uint128_t x)
+{
+	uint64_t h = (uint64_t)(x >> 64);
+
+	if( h )
+		return 128 - __builtin_clzll(h);
+
+	return 64 - __builtin_clzll((uint64_t)x | 1);
+}
+
+static
+uint128_t uint128_pow2_mod(uint128_t q, uint128_t e)
+{
+	struct mp_mont128 ctx;
+
+	mont128_init(&ctx, q);
+
+	uint128_t x = ctx.one;
+
+	for(int b = uint128_bits(e) - 1; b >= 0; b--)
+	{
+		x = mont128_mul(&ctx, x, x);
+
+		if( e >> b & 1 )
+		{
+			x += x;
+			if( x >= q )
+				x -= q;
+		}
+	}
+
+	return mont128_mul(&ctx, x, UINT128_1);
+}
+
+uint128_t mp_uint128_pow2_mod(uint128_t q, uint128_t e) { return uint128_pow2_mod(q, e); }
+
+// r[i] = 2^e[i] (mod q[i]), independent lanes keep the multiplier busy
+static
+void uint64_pow2_mod_batch(size_t count, const uint64_t *q, const uint64_t *e, uint64_t *r)
+{
+	for(size_t i = 0; i < count; i += MP_MONT_LANES)
+	{
+		size_t lanes = count - i < MP_MONT_LANES ? count - i : MP_MONT_LANES;
+
+		struct mp_mont64 ctx[MP_MONT_LANES];
+		uint64_t x[MP_MONT_LANES];
+		uint64_t mask = 1;
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			mont64_init(&ctx[l], q[i+l]);
+			x[l] = ctx[l].one;
+			mask |= e[i+l];
+		}
+
+		// a lane with a shorter exponent squares the one
+		for(int b = 63 - __builtin_clzll(mask); b >= 0; b--)
+		{
+			for(size_t l = 0; l < lanes; l++)
+			{
+				uint64_t y = mont64_mul(&ctx[l], x[l], x[l]);
+				uint64_t z = y + y;
+
+				z = z >= ctx[l].q ? z - ctx[l].q : z;
+				x[l] = e[i+l] >> b & 1 ? z : y;
+			}
+		}
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			r[i+l] = mont64_mul(&ctx[l], x[l], UINT64_C(1));
+		}
+	}
+}
+
+void mp_uint64_pow2_mod_batch(size_t count, const uint64_t *q, const uint64_t *e, uint64_t *r) { uint64_pow2_mod_batch(count, q, e, r); }
+
+static
+void uint128_pow2_mod_batch(size_t count, const uint128_t *q, const uint128_t *e, uint128_t *r)
+{
+	for(size_t i = 0; i < count; i += MP_MONT_LANES)
+	{
+		size_t lanes = count - i < MP_MONT_LANES ? count - i : MP_MONT_LANES;
+
+		struct mp_mont128 ctx[MP_MONT_LANES];
+		uint128_t x[MP_MONT_LANES];
+		uint128_t mask = 1;
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			mont128_init(&ctx[l], q[i+l]);
+			x[l] = ctx[l].one;
+			mask |= e[i+l];
+		}
+
+		for(int b = uint128_bits(mask) - 1; b >= 0; b--)
+		{
+			for(size_t l = 0; l < lanes; l++)
+			{
+				uint128_t y = mont128_mul(&ctx[l], x[l], x[l]);
+				uint128_t z = y + y;
+
+				z = z >= ctx[l].q ? z - ctx[l].q : z;
+				x[l] = e[i+l] >> b & 1 ? z : y;
+			}
+		}
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			r[i+l] = mont128_mul(&ctx[l], x[l], UINT128_1);
+		}
+	}
+}
+
+void mp_uint128_pow2_mod_batch(size_t count, const uint128_t *q, const uint128_t *e, uint128_t *r) { uint128_pow2_mod_batch(count, q, e, r); }
+
+// the window of w top bits pays off when its value in doublings costs less than w squarings
+#define PLAN_COST_SQUARE 6
+#define PLAN_COST_DOUBLE 1
+
+static
+void plan_init(struct mp_plan *plan, uint128_t e)
+{
+	int bits = e ? uint128_bits(e) : 0;
+	int window = 0;
+	int best = 0;
+
+	for(int w = 1; w <= bits && w <= 8; w++)
+	{
+		int start = (int)(e >> (bits - w));
+		int gain = w * PLAN_COST_SQUARE - start * PLAN_COST_DOUBLE;
+
+		if( gain > best )
+		{
+			best = gain;
+			window = w;
+		}
+	}
+
+	plan->e = e;
+	plan->start = window ? (int)(e >> (bits - window)) : 0;
+	plan->steps = bits - window;
+
+	for(int s = 0; s < plan->steps; s++)
+	{
+		plan->ops[s] = (uint8_t)(e >> (plan->steps - 1 - s) & 1);
+	}
+
+	plan->count = 0;
+
+	for(int b = 0; b < bits; b++)
+	{
+		if( e >> b & 1 )
+			plan->set[plan->count++] = (uint8_t)b;
+	}
+}
+
+void mp_plan_init(struct mp_plan *plan, uint128_t e) { plan_init(plan, e); }
+
+// r[i] = 2^e (mod q[i]), the lanes share the plan
+static
+void plan_pow2_mod64(const struct mp_plan *plan, size_t count, const uint64_t *q, uint64_t *r)
+{
+	for(size_t i = 0; i < count; i += MP_MONT_LANES)
+	{
+		size_t lanes = count - i < MP_MONT_LANES ? count - i : MP_MONT_LANES;
+
+		struct mp_mont64 ctx[MP_MONT_LANES];
+		uint64_t x[MP_MONT_LANES];
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			mont64_init(&ctx[l], q[i+l]);
+			x[l] = ctx[l].one;
+
+			// 2^start R (mod q)
+			for(int s = 0; s < plan->start; s++)
+			{
+				uint64_t z = x[l] + x[l];
+
+				x[l] = z >= ctx[l].q ? z - ctx[l].q : z;
+			}
+		}
+
+		for(int s = 0; s < plan->steps; s++)
+		{
+			for(size_t l = 0; l < lanes; l++)
+			{
+				x[l] = mont64_mul(&ctx[l], x[l], x[l]);
+			}
+
+			// the same for all the lanes
+			if( plan->ops[s] )
+			{
+				for(size_t l = 0; l < lanes; l++)
+				{
+					uint64_t z = x[l] + x[l];
+
+					x[l] = z >= ctx[l].q ? z - ctx[l].q : z;
+				}
+			}
+		}
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			r[i+l] = mont64_mul(&ctx[l], x[l], UINT64_C(1));
+		}
+	}
+}
+
+void mp_plan_pow2_mod64(const struct mp_plan *plan, size_t count, const uint64_t *q, uint64_t *r) { plan_pow2_mod64(plan, count, q, r); }
+
+static
+void plan_pow2_mod128(const struct mp_plan *plan, size_t count, const uint128_t *q, uint128_t *r)
+{
+	for(size_t i = 0; i < count; i += MP_MONT_LANES)
+	{
+		size_t lanes = count - i < MP_MONT_LANES ? count - i : MP_MONT_LANES;
+
+		struct mp_mont128 ctx[MP_MONT_LANES];
+		uint128_t x[MP_MONT_LANES];
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			mont128_init(&ctx[l], q[i+l]);
+			x[l] = ctx[l].one;
+
+			for(int s = 0; s < plan->start; s++)
+			{
+				uint128_t z = x[l] + x[l];
+
+				x[l] = z >= ctx[l].q ? z - ctx[l].q : z;
+			}
+		}
+
+		for(int s = 0; s < plan->steps; s++)
+		{
+			for(size_t l = 0; l < lanes; l++)
+			{
+				x[l] = mont128_mul(&ctx[l], x[l], x[l]);
+			}
+
+			if( plan->ops[s] )
+			{
+				for(size_t l = 0; l < lanes; l++)
+				{
+					uint128_t z = x[l] + x[l];
+
+					x[l] = z >= ctx[l].q ? z - ctx[l].q : z;
+				}
+			}
+		}
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			r[i+l] = mont128_mul(&ctx[l], x[l], UINT128_1);
+		}
+	}
+}
+
+void mp_plan_pow2_mod128(const struct mp_plan *plan, size_t count, const uint128_t *q, uint128_t *r) { plan_pow2_mod128(plan, count, q, r); }
+
+static
+void mont64_squares_init(struct mp_mont64_squares *squares, uint64_t q, int count)
+{
+	assert( count <= 64 );
+
+	mont64_init(&squares->ctx, q);
+
+	squares->count = count;
+
+	// 2 R (mod q)
+	uint64_t x = squares->ctx.one + squares->ctx.one;
+
+	x = x >= q ? x - q : x;
+
+	for(int i = 0; i < count; i++)
+	{
+		squares->sq[i] = x;
+		x = mont64_mul(&squares->ctx, x, x);
+	}
+}
+
+void mp_mont64_squares_init(struct mp_mont64_squares *squares, uint64_t q, int count) { mont64_squares_init(squares, q, count); }
+
+// the products of the squares at the set bits, the chains of the plans are independent
+static
+void plan_pow2_mod64_dual(const struct mp_mont64_squares *squares, size_t count, const struct mp_plan *plans, uint64_t *r)
+{
+	const struct mp_mont64 *ctx = &squares->ctx;
+
+	for(size_t i = 0; i < count; i += MP_MONT_LANES)
+	{
+		size_t lanes = count - i < MP_MONT_LANES ? count - i : MP_MONT_LANES;
+
+		uint64_t x[MP_MONT_LANES];
+		int steps = 0;
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			assert( plans[i+l].count == 0 || plans[i+l].set[plans[i+l].count-1] < squares->count );
+
+			x[l] = ctx->one;
+			steps = plans[i+l].count > steps ? plans[i+l].count : steps;
+		}
+
+		for(int s = 0; s < steps; s++)
+		{
+			for(size_t l = 0; l < lanes; l++)
+			{
+				if( s < plans[i+l].count )
+					x[l] = mont64_mul(ctx, x[l], squares->sq[plans[i+l].set[s]]);
+			}
+		}
+
+		for(size_t l = 0; l < lanes; l++)
+		{
+			r[i+l] = mont64_mul(ctx, x[l], UINT64_C(1));
+		}
+	}
+}
+
+void mp_plan_pow2_mod64_dual(const struct mp_mont64_squares *squares, size_t count, const struct mp_plan *plans, uint64_t *r) { plan_pow2_mod64_dual(squares, count, plans, r); }
+
+// r[i] = 2^e (mod q[i]), all the lanes share the exponent
+void mp_uint64_pow2_mod_shared(size_t count, const uint64_t *q, uint64_t e, uint64_t *r)
+{
+	struct mp_plan plan;
+
+	plan_init(&plan, e);
+	plan_pow2_mod64(&plan, count, q, r);
+}
+
+void mp_uint128_pow2_mod_shared(size_t count, const uint128_t *q, uint128_t e, uint128_t *r)
+{
+	struct mp_plan plan;
+
+	plan_init(&plan, e);
+	plan_pow2_mod128(&plan, count, q, r);
+}
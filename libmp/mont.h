@@ -0,0 +1,97 @@
+/** @file mont.h
+ * Montgomery multiplication and batched powers of two modulo many moduli
+ */
+#ifndef MONT_H
+#define MONT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "libmp.h"
+
+/** @defgroup mont mont
+ * @{
+ */
+
+// the number of moduli processed side by side
+#define MP_MONT_LANES 8
+
+/**
+ * Montgomery context of an odd modulus q < 2^63, R = 2^64.
+ */
+struct mp_mont64 {
+	uint64_t q;
+	uint64_t qinv; // -q^{-1} mod 2^64
+	uint64_t one; // R mod q
+};
+
+/**
+ * Montgomery context of an odd modulus q < 2^127, R = 2^128.
+ */
+struct mp_mont128 {
+	uint128_t q;
+	uint64_t qinv; // -q^{-1} mod 2^64
+	uint128_t one; // R mod q
+};
+
+void mp_mont64_init(struct mp_mont64 *ctx, uint64_t q);
+uint64_t mp_mont64_mul(const struct mp_mont64 *ctx, uint64_t a, uint64_t b);
+uint64_t mp_mont64_to(const struct mp_mont64 *ctx, uint64_t a);
+uint64_t mp_mont64_from(const struct mp_mont64 *ctx, uint64_t a);
+
+void mp_mont128_init(struct mp_mont128 *ctx, uint128_t q);
+uint128_t mp_mont128_mul(const struct mp_mont128 *ctx, uint128_t a, uint128_t b);
+uint128_t mp_mont128_to(const struct mp_mont128 *ctx, uint128_t a);
+uint128_t mp_mont128_from(const struct mp_mont128 *ctx, uint128_t a);
+
+uint64_t mp_uint64_pow2_mod(uint64_t q, uint64_t e);
+uint128_t mp_uint128_pow2_mod(uint128_t q, uint128_t e);
+
+void mp_uint64_pow2_mod_batch(size_t count, const uint64_t *q, const uint64_t *e, uint64_t *r);
+void mp_uint128_pow2_mod_batch(size_t count, const uint128_t *q, const uint128_t *e, uint128_t *r);
+
+// the same exponent for all the moduli (trial factoring of a single Mersenne number)
+void mp_uint64_pow2_mod_shared(size_t count, const uint64_t *q, uint64_t e, uint64_t *r);
+void mp_uint128_pow2_mod_shared(size_t count, const uint128_t *q, uint128_t e, uint128_t *r);
+
+// the longest exponent of a plan
+#define MP_PLAN_BITS 128
+
+/**
+ * Powering plan of 2^e, built once per exponent and evaluated against many
+ * moduli. The top window bits of e are taken at once: the ladder starts at
+ * 2^start, which takes a few doublings of R (mod q) instead of the
+ * squarings, and the remaining steps square and double (if ops[] is set)
+ * all the lanes alike. The positions of the set bits serve the dual form: one
+ * modulus, many exponents sharing the table of the squares.
+ */
+struct mp_plan {
+	uint128_t e;
+	int start; // the value of the window
+	int steps;
+	uint8_t ops[MP_PLAN_BITS]; // the doubling after the squaring
+	int count;
+	uint8_t set[MP_PLAN_BITS]; // positions of the set bits of e
+};
+
+void mp_plan_init(struct mp_plan *plan, uint128_t e);
+
+void mp_plan_pow2_mod64(const struct mp_plan *plan, size_t count, const uint64_t *q, uint64_t *r);
+void mp_plan_pow2_mod128(const struct mp_plan *plan, size_t count, const uint128_t *q, uint128_t *r);
+
+/**
+ * 2^(2^i) (mod q) in the Montgomery form, i < 64.
+ */
+struct mp_mont64_squares {
+	struct mp_mont64 ctx;
+	int count;
+	uint64_t sq[64];
+};
+
+void mp_mont64_squares_init(struct mp_mont64_squares *squares, uint64_t q, int count);
+
+// r[i] = 2^e[i] (mod q), e[i] = plans[i].e < 2^squares->count
+void mp_plan_pow2_mod64_dual(const struct mp_mont64_squares *squares, size_t count, const struct mp_plan *plans, uint64_t *r);
+
+/** @} */
+
+#endif
@@ -0,0 +1,101 @@
+#include "prefilter.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+#	include <immintrin.h>
+#endif
+
+// the first odd primes
+void mp_prefilter_init(struct mp_prefilter *pf)
+{
+	pf->count = 0;
+	pf->tested = 0;
+	pf->passed = 0;
+
+	for(uint64_t p = 3; pf->count < MP_PREFILTER_PRIMES; p += 2)
+	{
+		int prime = 1;
+
+		for(uint64_t d = 3; d * d <= p && prime; d += 2)
+			prime = 0 != p % d;
+
+		if( !prime )
+			continue;
+
+		// Newton iteration, each step doubles the correct low bits
+		uint64_t inv = p;
+		for(int i = 0; i < 5; i++)
+			inv *= 2 - p * inv;
+
+		pf->inv[pf->count] = inv;
+		pf->lim[pf->count] = UINT64_MAX / p;
+		pf->max = p;
+		pf->count++;
+	}
+}
+
+static
+int divisible(const struct mp_prefilter *pf, uint64_t n)
+{
+	if( n <= pf->max )
+		return 0;
+
+	for(size_t j = 0; j < pf->count; j++)
+	{
+		if( n * pf->inv[j] <= pf->lim[j] )
+			return 1;
+	}
+
+	return 0;
+}
+
+// copy the candidates without a small prime factor to out (may be the same as in), returns their number
+size_t mp_prefilter_int64(struct mp_prefilter *pf, const int64_t *in, size_t count, int64_t *out)
+{
+	size_t n = 0;
+	size_t i = 0;
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+	const __m512i max = _mm512_set1_epi64((long long)pf->max);
+
+	for(; i + 8 <= count; i += 8)
+	{
+		__m512i v = _mm512_loadu_si512(in + i);
+		__mmask8 alive = _mm512_cmpgt_epu64_mask(v, max);
+		__mmask8 dead = 0;
+
+		for(size_t j = 0; j < pf->count && dead != alive; j++)
+		{
+			__m512i x = _mm512_mullo_epi64(v, _mm512_set1_epi64((long long)pf->inv[j]));
+
+			dead |= _mm512_mask_cmple_epu64_mask(alive, x, _mm512_set1_epi64((long long)pf->lim[j]));
+		}
+
+		__mmask8 keep = (__mmask8)~dead;
+
+		_mm512_mask_compressstoreu_epi64(out + n, keep, v);
+		n += (size_t)__builtin_popcount(keep);
+	}
+#endif
+
+	for(; i < count; i++)
+	{
+		if( !divisible(pf, (uint64_t)in[i]) )
+			out[n++] = in[i];
+	}
+
+	pf->tested += count;
+	pf->passed += n;
+
+	return n;
+}
+
+void mp_prefilter_dump(const struct mp_prefilter *pf)
+{
+	message("%" PRIu64 " candidates drawn, %" PRIu64 " (%.1f %%) without a factor below %" PRIu64 ".\n",
+		pf->tested, pf->passed, pf->tested ? 100. * (double)pf->passed / (double)pf->tested : 0., pf->max + 1);
+}
@@ -0,0 +1,40 @@
+/** @file prefilter.h
+ * Batched divisibility of candidate factors by small primes
+ */
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @defgroup prefilter prefilter
+ * @{
+ */
+
+// the odd primes tried
+#define MP_PREFILTER_PRIMES 256
+
+/**
+ * An odd p divides n iff n * p^{-1} (mod 2^64) <= (2^64-1)/p, so each prime
+ * costs one multiplication and one comparison per candidate, and the
+ * candidates are processed side by side in vector lanes. Candidates up to
+ * the largest prime tried are always passed through.
+ */
+struct mp_prefilter {
+	size_t count;
+	uint64_t inv[MP_PREFILTER_PRIMES]; // p^{-1} (mod 2^64)
+	uint64_t lim[MP_PREFILTER_PRIMES]; // (2^64-1)/p
+	uint64_t max; // the largest prime
+	uint64_t tested;
+	uint64_t passed;
+};
+
+void mp_prefilter_init(struct mp_prefilter *pf);
+
+size_t mp_prefilter_int64(struct mp_prefilter *pf, const int64_t *in, size_t count, int64_t *out);
+
+void mp_prefilter_dump(const struct mp_prefilter *pf);
+
+/** @} */
+
+#endif
@@ -0,0 +1,372 @@
+#include "prune.h"
+#include "mont.h"
+#include "bitmap.h"
+#include "factor.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <assert.h>
+
+int mp_prune_init(struct mp_prune *prune, const struct mp_record *record, const uint8_t *primes, int exponent_limit, const char *merged_path)
+{
+	prune->record = record;
+	prune->primes = primes;
+	prune->exponent_limit = exponent_limit;
+	prune->merged_path = merged_path;
+	prune->merged = NULL;
+	prune->loaded = 0;
+	prune->small_count = 0;
+	prune->tested = 0;
+	prune->pruned = 0;
+	prune->factored = 0;
+
+	for(int p = 3; p < MP_PRUNE_BOUND && p < exponent_limit; p += 2)
+	{
+		if( !(primes[p/8] & 1 << p%8) )
+			prune->small[prune->small_count++] = (uint32_t)p;
+	}
+
+	if( merged_path )
+	{
+		prune->merged = calloc(record->size ? record->size : 1, 1);
+
+		if( NULL == prune->merged )
+		{
+			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", record->size);
+			return -1;
+		}
+
+		return mp_prune_reload(prune);
+	}
+
+	return 0;
+}
+
+void mp_prune_free(struct mp_prune *prune)
+{
+	free(prune->merged);
+
+	prune->merged = NULL;
+}
+
+int mp_prune_due(const struct mp_prune *prune)
+{
+	return prune->merged_path && time(NULL) - prune->loaded >= MP_PRUNE_INTERVAL;
+}
+
+// add the bits of the merged record to the copy, they are never cleared
+int mp_prune_reload(struct mp_prune *prune)
+{
+	prune->loaded = time(NULL);
+
+	if( NULL == prune->merged_path || access(prune->merged_path, R_OK) )
+		return 0;
+
+	int exponent_limit = prune->exponent_limit;
+
+	struct mp_record merged;
+	if( mp_record_open(&merged, prune->merged_path, &exponent_limit, MP_RECORD_RDONLY) )
+	{
+		return -1;
+	}
+
+	mp_bitmap_or(prune->merged, merged.bits, prune->record->size);
+
+	mp_record_close(&merged);
+
+	return 0;
+}
+
+// the prime exponent n is not eliminated yet
+int mp_prune_is_clean(const struct mp_prune *prune, int n)
+{
+	if( n < 2 || n >= prune->exponent_limit )
+		return 0;
+
+	uint8_t mask = (uint8_t)(1 << n%8);
+
+	if( prune->primes[n/8] & mask )
+		return 0;
+
+	if( __atomic_load_n(&prune->record->bits[n/8], __ATOMIC_RELAXED) & mask )
+		return 0;
+
+	return !(prune->merged && prune->merged[n/8] & mask);
+}
+
+// 2^p = 1 (mod q) for the clean prime p, the order is then p
+static
+int clean_order(struct mp_prune *prune, uint64_t q, uint64_t p, int *powered)
+{
+	if( p >= (uint64_t)prune->exponent_limit || !mp_prune_is_clean(prune, (int)p) )
+		return 0;
+
+	*powered = 1;
+
+	return 1 == mp_uint64_pow2_mod(q, p);
+}
+
+// the clean prime order dividing the odd c, none of the primes of c is below the bound
+static
+int cofactor_order(struct mp_prune *prune, uint64_t q, uint64_t c, uint64_t bound, int *powered)
+{
+	if( c == 1 )
+		return 0;
+
+	// a prime
+	if( c / bound < bound )
+		return clean_order(prune, q, c, powered) ? (int)c : 0;
+
+	// all the primes are above the exponent limit
+	if( bound >= (uint64_t)prune->exponent_limit )
+		return 0;
+
+	*powered = 1;
+
+	if( 1 != mp_uint64_pow2_mod(q, c) )
+		return 0;
+
+	prune->factored++;
+
+	uint128_t factors[MP_FACTOR_MAX];
+	int exponents[MP_FACTOR_MAX];
+	uint128_t cofactor;
+
+	int count = mp_uint128_factor(c, factors, exponents, &cofactor, 0);
+
+	for(int i = 0; i < count && factors[i] < (uint128_t)prune->exponent_limit; i++)
+	{
+		if( clean_order(prune, q, (uint64_t)factors[i], powered) )
+			return (int)factors[i];
+	}
+
+	return 0;
+}
+
+// skip M itself and the factors other than +-1 (mod 8)
+static
+int prefilter(int64_t factor)
+{
+	if( INT64_0 == (factor & (factor+INT64_1)) )
+		return 0;
+
+	return INT64_C(1) == (factor&INT64_C(7)) || INT64_C(7) == (factor&INT64_C(7));
+}
+
+// not a prime factor, skip them
+static
+int finish(struct mp_prune *prune, int64_t factor, int n, int powered)
+{
+	if( !powered )
+	{
+		prune->pruned++;
+	}
+
+	if( n && !mp_int64_is_prime_wheel6(factor) )
+	{
+		return 0;
+	}
+
+	return n;
+}
+
+// the clean prime exponent n such that factor | M(n), or 0; the same as mp_int64_exponent_prtest for the clean exponents
+int mp_prune_int64_prtest(struct mp_prune *prune, int64_t factor)
+{
+	prune->tested++;
+
+	if( !prefilter(factor) )
+	{
+		prune->pruned++;
+		return 0;
+	}
+
+	uint64_t q = (uint64_t)factor;
+	uint64_t c = (q - 1) >> __builtin_ctzll(q - 1);
+	int powered = 0;
+	int n = 0;
+
+	// the small primes of q-1
+	for(size_t i = 0; i < prune->small_count && c > 1; i++)
+	{
+		uint64_t p = prune->small[i];
+
+		if( c % p )
+			continue;
+
+		do {
+			c /= p;
+		} while( 0 == c % p );
+
+		if( !n && clean_order(prune, q, p, &powered) )
+			n = (int)p;
+	}
+
+	if( !n )
+		n = cofactor_order(prune, q, c, MP_PRUNE_BOUND, &powered);
+
+	return finish(prune, factor, n, powered);
+}
+
+int mp_prune_block_init(struct mp_prune_block *block, const struct mp_prune *prune, int64_t sign)
+{
+	block->sign = sign;
+	block->base = INT64_MIN; // no segment yet
+	block->bound = prune->exponent_limit < MP_PRUNE_SIEVE ? (uint32_t)prune->exponent_limit : MP_PRUNE_SIEVE;
+	block->count = 0;
+	block->links = 0;
+	block->capacity = 4 * MP_PRUNE_SEGMENT;
+
+	block->primes = malloc(((size_t)block->bound / 2 + 1) * sizeof(uint32_t));
+	block->next = malloc(((size_t)block->bound / 2 + 1) * sizeof(uint32_t));
+	block->link_prime = malloc(block->capacity * sizeof(uint32_t));
+	block->link_next = malloc(block->capacity * sizeof(uint32_t));
+
+	if( NULL == block->primes || NULL == block->next || NULL == block->link_prime || NULL == block->link_next )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	for(uint32_t p = 3; p < block->bound; p += 2)
+	{
+		if( !(prune->primes[p/8] & 1 << p%8) )
+			block->primes[block->count++] = p;
+	}
+
+	return 0;
+}
+
+void mp_prune_block_free(struct mp_prune_block *block)
+{
+	free(block->primes);
+	free(block->next);
+	free(block->link_prime);
+	free(block->link_next);
+
+	block->primes = NULL;
+	block->next = NULL;
+	block->link_prime = NULL;
+	block->link_next = NULL;
+}
+
+static
+int block_link(struct mp_prune_block *block, uint32_t i, uint32_t p)
+{
+	if( block->links == block->capacity )
+	{
+		size_t capacity = 2 * block->capacity;
+
+		uint32_t *link_prime = realloc(block->link_prime, capacity * sizeof(uint32_t));
+		uint32_t *link_next = realloc(block->link_next, capacity * sizeof(uint32_t));
+
+		if( link_prime )
+			block->link_prime = link_prime;
+		if( link_next )
+			block->link_next = link_next;
+
+		if( NULL == link_prime || NULL == link_next )
+		{
+			message(ERR "Unable to allocate memory :(\n");
+			return -1;
+		}
+
+		block->capacity = capacity;
+	}
+
+	block->link_prime[block->links] = p;
+	block->link_next[block->links] = block->head[i];
+	block->head[i] = (uint32_t)++block->links;
+
+	return 0;
+}
+
+// list the primes of q-1 for the states [base; base + MP_PRUNE_SEGMENT)
+int mp_prune_block_segment(struct mp_prune_block *block, int64_t base)
+{
+	// the offsets carry over to the following segment only
+	if( base != block->base + MP_PRUNE_SEGMENT )
+	{
+		for(size_t j = 0; j < block->count; j++)
+		{
+			uint64_t p = block->primes[j];
+
+			// 1/8 = ((p+1)/2)^3 (mod p), the root is (1 - sign)/8
+			uint64_t half = (p + 1) / 2;
+			uint64_t inv8 = half * half % p * half % p;
+			uint64_t root = (uint64_t)((1 - block->sign) % (int64_t)p + (int64_t)p) % p * inv8 % p;
+
+			block->next[j] = (uint32_t)((root + p - (uint64_t)base % p) % p);
+		}
+	}
+
+	block->base = base;
+	block->links = 0;
+
+	memset(block->head, 0, sizeof(block->head));
+
+	for(size_t j = 0; j < block->count; j++)
+	{
+		uint32_t p = block->primes[j];
+		uint32_t i = block->next[j];
+
+		for(; i < MP_PRUNE_SEGMENT; i += p)
+		{
+			if( block_link(block, i, p) )
+				return -1;
+		}
+
+		block->next[j] = i - MP_PRUNE_SEGMENT;
+	}
+
+	return 0;
+}
+
+// the same as mp_prune_int64_prtest for the factor 8 state + sign of the segment
+int mp_prune_int64_prtest_block(struct mp_prune *prune, const struct mp_prune_block *block, int64_t state)
+{
+	int64_t factor = state * INT64_C(8) + block->sign;
+
+	assert( state >= block->base && state - block->base < MP_PRUNE_SEGMENT );
+
+	prune->tested++;
+
+	if( !prefilter(factor) )
+	{
+		prune->pruned++;
+		return 0;
+	}
+
+	uint64_t q = (uint64_t)factor;
+	uint64_t c = (q - 1) >> __builtin_ctzll(q - 1);
+	int powered = 0;
+	int n = 0;
+
+	for(uint32_t l = block->head[state - block->base]; l; l = block->link_next[l-1])
+	{
+		uint64_t p = block->link_prime[l-1];
+
+		do {
+			c /= p;
+		} while( 0 == c % p );
+
+		if( !n && clean_order(prune, q, p, &powered) )
+			n = (int)p;
+	}
+
+	if( !n )
+		n = cofactor_order(prune, q, c, block->bound, &powered);
+
+	return finish(prune, factor, n, powered);
+}
+
+void mp_prune_dump(const struct mp_prune *prune)
+{
+	message("%" PRIu64 " factors tested, %" PRIu64 " (%.1f %%) skipped without powering, %" PRIu64 " cofactors factored.\n",
+		prune->tested, prune->pruned, prune->tested ? 100. * (double)prune->pruned / (double)prune->tested : 0., prune->factored);
+}
@@ -0,0 +1,95 @@
+/** @file prune.h
+ * Skipping the factors that cannot eliminate a clean exponent
+ */
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "record.h"
+
+/** @defgroup prune prune
+ * @{
+ */
+
+// the small primes tried on (q-1)/2 are below this bound
+#define MP_PRUNE_BOUND 1024
+
+// reload the merged record every ten minutes
+#define MP_PRUNE_INTERVAL 600
+
+// the primes of the block sieve are below this bound (or the exponent limit)
+#define MP_PRUNE_SIEVE (1 << 24)
+
+// states per segment of the block sieve
+#define MP_PRUNE_SEGMENT (1 << 16)
+
+/**
+ * A prime q eliminates M(n) iff the order of 2 modulo q is the prime n, and
+ * the order divides q-1. The small primes are stripped off q-1 first; only
+ * those of them that are still clean get their 2^n (mod q) computed. The
+ * rest of q-1 (the cofactor c) is skipped if it cannot hold a clean prime
+ * below the exponent limit, e.g. it is a prime itself. Otherwise it can hold
+ * the order only if 2^c = 1 (mod q), and only then c is factored and its
+ * clean primes are powered. The clean exponents are the prime ones that are
+ * set neither in the own record nor in the merged record, a copy of which is
+ * reloaded periodically.
+ */
+struct mp_prune {
+	const struct mp_record *record;
+	const uint8_t *primes;
+	int exponent_limit;
+	const char *merged_path; // NULL for none
+	uint8_t *merged;
+	time_t loaded;
+	uint32_t small[MP_PRUNE_BOUND]; // odd primes below the bound
+	size_t small_count;
+	uint64_t tested; // factors
+	uint64_t pruned; // skipped without any powering
+	uint64_t factored; // the cofactors factored
+};
+
+/**
+ * Block sieve over the factors q = 8s + sign of consecutive states s. The odd
+ * primes below the bound dividing q-1 are listed for each state of the
+ * segment, so the factors are tested without any trial division, and with
+ * the bound at the exponent limit the cofactor is never powered. A prime p
+ * divides q-1 iff s = (1 - sign)/8 (mod p).
+ */
+struct mp_prune_block {
+	int64_t sign;
+	int64_t base; // the first state of the segment
+	uint32_t bound;
+	uint32_t *primes; // odd primes below the bound
+	uint32_t *next; // the next state with p | q-1, relative to the base
+	size_t count;
+	uint32_t head[MP_PRUNE_SEGMENT]; // the first link of the state + 1, 0 for none
+	uint32_t *link_prime;
+	uint32_t *link_next; // the next link + 1, 0 for none
+	size_t links;
+	size_t capacity;
+};
+
+int mp_prune_init(struct mp_prune *prune, const struct mp_record *record, const uint8_t *primes, int exponent_limit, const char *merged_path);
+void mp_prune_free(struct mp_prune *prune);
+
+int mp_prune_due(const struct mp_prune *prune);
+int mp_prune_reload(struct mp_prune *prune);
+
+int mp_prune_is_clean(const struct mp_prune *prune, int n);
+
+int mp_prune_int64_prtest(struct mp_prune *prune, int64_t factor);
+
+int mp_prune_block_init(struct mp_prune_block *block, const struct mp_prune *prune, int64_t sign);
+void mp_prune_block_free(struct mp_prune_block *block);
+
+int mp_prune_block_segment(struct mp_prune_block *block, int64_t base);
+
+int mp_prune_int64_prtest_block(struct mp_prune *prune, const struct mp_prune_block *block, int64_t state);
+
+void mp_prune_dump(const struct mp_prune *prune);
+
+/** @} */
+
+#endif
@@ -0,0 +1,381 @@
+#include "record.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+static
+size_t page_ceil(size_t size)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) / page * page;
+}
+
+// lengthen the file to at least size bytes, the file is never shortened
+static
+int record_extend(struct mp_record *record, size_t size)
+{
+	struct stat st;
+
+	if( -1 == fstat(record->fd, &st) )
+		return -1;
+
+	if( (off_t)size <= st.st_size )
+		return 0;
+
+	return ftruncate(record->fd, (off_t)size);
+}
+
+// map the file read-write, the file has to be at least record->size bytes long
+static
+int record_map_shared(struct mp_record *record)
+{
+	void *addr = mmap(NULL, record->map_size, PROT_READ|PROT_WRITE, MAP_SHARED, record->fd, 0);
+
+	if( MAP_FAILED == addr )
+	{
+		int errsv = errno;
+		message(ERR "Unable to map the record '%s' :( Error: %s\n", record->path, strerror(errsv));
+		return -1;
+	}
+
+	record->bits = addr;
+
+	// track the chunks changed since the last checkpoint
+	size_t chunks = (record->size + MP_RECORD_CHUNK - 1) / MP_RECORD_CHUNK;
+
+	uint8_t *dirty = realloc(record->dirty, (chunks+7)/8);
+
+	if( NULL == dirty )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (chunks+7)/8);
+		munmap(record->bits, record->map_size);
+		return -1;
+	}
+
+	if( (chunks+7)/8 > (record->chunks+7)/8 )
+		memset(dirty + (record->chunks+7)/8, 0, (chunks+7)/8 - (record->chunks+7)/8);
+
+	record->dirty = dirty;
+	record->chunks = chunks;
+
+	return 0;
+}
+
+// map zeros, then map the first file_size bytes of the file over them
+static
+int record_map_private(struct mp_record *record, size_t file_size)
+{
+	void *addr = mmap(NULL, record->map_size, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+
+	if( MAP_FAILED == addr )
+	{
+		int errsv = errno;
+		message(ERR "Unable to map %zu bytes :( Error: %s\n", record->map_size, strerror(errsv));
+		return -1;
+	}
+
+	if( file_size > record->size )
+		file_size = record->size;
+
+	if( file_size > 0 && MAP_FAILED == mmap(addr, page_ceil(file_size), PROT_READ, MAP_PRIVATE|MAP_FIXED, record->fd, 0) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to map the record '%s' :( Error: %s\n", record->path, strerror(errsv));
+		munmap(addr, record->map_size);
+		return -1;
+	}
+
+	record->bits = addr;
+
+	return 0;
+}
+
+// open (or create) the record
+int mp_record_open(struct mp_record *record, const char *record_path, int *p_exponent_limit, int mode)
+{
+	message("Loading the record from '%s'...\n", record_path);
+
+	record->bits = NULL;
+	record->dirty = NULL;
+	record->chunks = 0;
+	record->fresh = NULL;
+	record->path = record_path;
+	record->mode = mode;
+	record->fd = open(record_path, MP_RECORD_RDWR == mode ? O_RDWR|O_CREAT : O_RDONLY, 0644);
+
+	struct stat st;
+
+	if( -1 == record->fd || -1 == fstat(record->fd, &st) || 0 == st.st_size )
+	{
+		if( MP_RECORD_RDWR == mode && -1 == record->fd )
+		{
+			int errsv = errno;
+			message(ERR "Unable to create the record '%s' :( Error: %s\n", record_path, strerror(errsv));
+			return -1;
+		}
+
+		// exponent_limit is unset, use default
+		if( -1 == *p_exponent_limit )
+		{
+			*p_exponent_limit = 256*1024*1024; // up to 268M
+		}
+
+		record->exponent_limit = *p_exponent_limit;
+		record->size = (size_t)(*p_exponent_limit+7)/8;
+		record->map_size = page_ceil(record->size);
+
+		// no record file, start a new test
+		if( MP_RECORD_RDWR == mode )
+		{
+			if( -1 == ftruncate(record->fd, (off_t)record->size) )
+			{
+				int errsv = errno;
+				message(ERR "Unable to extend the record '%s' :( Error: %s\n", record_path, strerror(errsv));
+				close(record->fd);
+				return -1;
+			}
+
+			if( record_map_shared(record) )
+			{
+				close(record->fd);
+				return -1;
+			}
+		}
+		else
+		{
+			if( record_map_private(record, (size_t)0) )
+			{
+				if( -1 != record->fd )
+					close(record->fd);
+				return -1;
+			}
+		}
+
+		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
+			(*p_exponent_limit),
+			(*p_exponent_limit + (1<<23) - 1)>>23,
+			(*p_exponent_limit + (1<<23) - 1)>>23
+		);
+
+		return 0;
+	}
+
+	// detect the highest exponent from the existing record using fstat
+	long detected_exponent_limit = (long)st.st_size * 8;
+
+	// exponent_limit is unset, use fstat
+	if( -1 == *p_exponent_limit )
+	{
+		message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
+		*p_exponent_limit = (int)detected_exponent_limit;
+	}
+
+	// if exponent_limit <> fstat, print a warning
+	if( *p_exponent_limit < detected_exponent_limit )
+	{
+		message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The exponents above it are kept in the file, but not used.\n",
+			*p_exponent_limit, detected_exponent_limit
+		);
+	}
+	if( *p_exponent_limit > detected_exponent_limit )
+	{
+		message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
+			*p_exponent_limit, detected_exponent_limit
+		);
+	}
+
+	record->exponent_limit = *p_exponent_limit;
+	record->size = (size_t)(*p_exponent_limit+7)/8;
+	record->map_size = page_ceil(record->size);
+
+	if( MP_RECORD_RDWR == mode )
+	{
+		// a longer file is mapped only in part, the eliminations above the limit stay in it
+		if( -1 == record_extend(record, record->size) )
+		{
+			int errsv = errno;
+			message(ERR "Unable to extend the record '%s' :( Error: %s\n", record_path, strerror(errsv));
+			close(record->fd);
+			return -1;
+		}
+
+		if( record_map_shared(record) )
+		{
+			close(record->fd);
+			return -1;
+		}
+	}
+	else
+	{
+		if( record_map_private(record, (size_t)st.st_size) )
+		{
+			close(record->fd);
+			return -1;
+		}
+	}
+
+	message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
+		(*p_exponent_limit),
+		(*p_exponent_limit + (1<<23) - 1)>>23,
+		(*p_exponent_limit + (1<<23) - 1)>>23
+	);
+
+	return 0;
+}
+
+void mp_record_close(struct mp_record *record)
+{
+	if( record->bits )
+		munmap(record->bits, record->map_size);
+
+	if( -1 != record->fd )
+		close(record->fd);
+
+	free(record->dirty);
+	free(record->fresh);
+
+	record->bits = NULL;
+	record->dirty = NULL;
+	record->fresh = NULL;
+	record->fd = -1;
+}
+
+// extend the record up to the new exponent_limit, the record->bits may move
+int mp_record_grow(struct mp_record *record, int exponent_limit)
+{
+	if( exponent_limit <= record->exponent_limit )
+		return 0;
+
+	if( MP_RECORD_RDWR != record->mode )
+	{
+		message(ERR "Unable to grow the read-only record '%s'!\n", record->path);
+		return -1;
+	}
+
+	size_t size = (size_t)(exponent_limit+7)/8;
+
+	if( -1 == record_extend(record, size) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to extend the record '%s' :( Error: %s\n", record->path, strerror(errsv));
+		return -1;
+	}
+
+	if( record->fresh )
+	{
+		uint8_t *fresh = realloc(record->fresh, size);
+
+		if( NULL == fresh )
+		{
+			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", size);
+			return -1;
+		}
+
+		memset(fresh + record->size, 0, size - record->size);
+
+		record->fresh = fresh;
+	}
+
+	munmap(record->bits, record->map_size);
+
+	record->exponent_limit = exponent_limit;
+	record->size = size;
+	record->map_size = page_ceil(size);
+
+	if( record_map_shared(record) )
+	{
+		record->bits = NULL;
+		return -1;
+	}
+
+	message("The record was extended to %i exponents.\n", exponent_limit);
+
+	return 0;
+}
+
+// write the dirty pages back to the file
+int mp_record_sync(struct mp_record *record)
+{
+	if( MP_RECORD_RDWR != record->mode )
+		return 0;
+
+	message("Saving the record to '%s'...\n", record->path);
+
+	if( -1 == msync(record->bits, record->map_size, MS_SYNC) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to save the record :( Error: %s\n", strerror(errsv));
+		return -1;
+	}
+
+	message("The record was saved successfully.\n");
+
+	return 0;
+}
+
+// returns the previous value of the bit
+int mp_record_set_bit(struct mp_record *record, int n)
+{
+	uint8_t mask = (uint8_t)( 1 << n%8 );
+
+	int old = __atomic_fetch_or(&record->bits[n/8], mask, __ATOMIC_RELAXED) & mask;
+
+	if( !old && record->dirty )
+	{
+		size_t c = (size_t)n/8/MP_RECORD_CHUNK;
+
+		__atomic_fetch_or(&record->dirty[c/8], (uint8_t)( 1 << c%8 ), __ATOMIC_RELAXED);
+	}
+
+	if( !old && record->fresh )
+	{
+		__atomic_fetch_or(&record->fresh[n/8], mask, __ATOMIC_RELAXED);
+	}
+
+	return old;
+}
+
+int mp_record_get_bit(const struct mp_record *record, int n)
+{
+	return record->bits[n/8] & 1 << n%8;
+}
+
+// mark the bytes [offset; offset+len) as changed by a bulk write
+void mp_record_set_dirty(struct mp_record *record, size_t offset, size_t len)
+{
+	if( NULL == record->dirty || 0 == len )
+		return;
+
+	for(size_t c = offset/MP_RECORD_CHUNK; c <= (offset+len-1)/MP_RECORD_CHUNK && c < record->chunks; c++)
+	{
+		__atomic_fetch_or(&record->dirty[c/8], (uint8_t)( 1 << c%8 ), __ATOMIC_RELAXED);
+	}
+}
+
+// collect the bits set from now on, e.g. for a delta
+int mp_record_track(struct mp_record *record)
+{
+	if( record->fresh )
+		return 0;
+
+	// the zero pages are not touched until a bit is set in them
+	record->fresh = calloc(record->size ? record->size : 1, (size_t)1);
+
+	if( NULL == record->fresh )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", record->size);
+		return -1;
+	}
+
+	return 0;
+}
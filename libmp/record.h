@@ -0,0 +1,58 @@
+/** @file record.h
+ * Memory-mapped record of eliminated Mersenne exponents
+ */
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @defgroup record record
+ * @{
+ */
+
+#define MP_RECORD_RDONLY 0
+#define MP_RECORD_RDWR 1
+
+// granularity of the dirty tracking (in bytes)
+#define MP_RECORD_CHUNK 4096
+
+/**
+ * The bit n of the record is set if M(n) has a known factor. Writers map the
+ * file with MAP_SHARED, so the file is updated in place and a checkpoint only
+ * has to flush the dirty pages. Readers map the file read-only; the part beyond
+ * the end of the file (if any) reads as zeros. Writers also keep one bit per
+ * MP_RECORD_CHUNK bytes of the record that changed since the last checkpoint.
+ * The file is never shortened: a writer with a smaller exponent limit maps
+ * only the beginning of it. After mp_record_track, the bits set from then on
+ * are also collected in a separate bitmap of the same size.
+ */
+struct mp_record {
+	uint8_t *bits;
+	int exponent_limit;
+	size_t size; // (exponent_limit+7)/8 bytes
+	size_t map_size; // size rounded up to whole pages
+	int fd; // -1 for a record without any file
+	int mode;
+	const char *path;
+	uint8_t *dirty; // NULL for readers
+	size_t chunks;
+	uint8_t *fresh; // bits set since mp_record_track, NULL if not tracked
+};
+
+int mp_record_open(struct mp_record *record, const char *record_path, int *p_exponent_limit, int mode);
+void mp_record_close(struct mp_record *record);
+
+int mp_record_grow(struct mp_record *record, int exponent_limit);
+int mp_record_sync(struct mp_record *record);
+
+int mp_record_set_bit(struct mp_record *record, int n);
+int mp_record_get_bit(const struct mp_record *record, int n);
+
+void mp_record_set_dirty(struct mp_record *record, size_t offset, size_t len);
+
+int mp_record_track(struct mp_record *record);
+
+/** @} */
+
+#endif
@@ -0,0 +1,278 @@
+#include "status.h"
+#include "bitmap.h"
+#include "libmp.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define STATUS_MAGIC "MPSTAT02"
+
+// the bounds were rounded down to their bit lengths
+#define STATUS_MAGIC_OLD "MPSTAT01"
+
+struct status_header {
+	char magic[8];
+	uint32_t exponent_limit;
+	uint32_t count; // prime exponents
+};
+
+// the index of the prime exponent n in the columns, -1 for the others
+static
+long status_index(const struct mp_status *status, int n)
+{
+	if( n < 2 || n >= status->exponent_limit || status->primes[n/8] & 1 << n%8 )
+		return -1;
+
+	size_t block = (size_t)n / MP_STATUS_BLOCK;
+	size_t begin = block * MP_STATUS_BLOCK;
+
+	return (long)status->rank[block] + (long)mp_bitmap_popcount_nor(status->primes, NULL, begin < 2 ? 2 : begin, (size_t)n);
+}
+
+static
+int status_rank(struct mp_status *status)
+{
+	size_t limit = (size_t)status->exponent_limit;
+	size_t blocks = (limit + MP_STATUS_BLOCK - 1) / MP_STATUS_BLOCK;
+
+	status->rank = malloc((blocks + 1) * sizeof(uint32_t));
+
+	if( NULL == status->rank )
+	{
+		message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (blocks + 1) * sizeof(uint32_t));
+		return -1;
+	}
+
+	size_t count = 0;
+
+	for(size_t b = 0; b < blocks; b++)
+	{
+		size_t begin = b * MP_STATUS_BLOCK;
+		size_t end = begin + MP_STATUS_BLOCK < limit ? begin + MP_STATUS_BLOCK : limit;
+
+		status->rank[b] = (uint32_t)count;
+
+		// 0 and 1 are not marked in the table
+		count += mp_bitmap_popcount_nor(status->primes, NULL, begin < 2 ? 2 : begin, end);
+	}
+
+	status->rank[blocks] = (uint32_t)count;
+	status->count = count;
+
+	return 0;
+}
+
+// open (or create) the status file for the given exponent limit
+int mp_status_open(struct mp_status *status, const char *path, int exponent_limit, const uint8_t *primes, int mode)
+{
+	status->path = path;
+	status->map = NULL;
+	status->mode = mode;
+	status->exponent_limit = exponent_limit;
+	status->primes = primes;
+	status->rank = NULL;
+
+	if( status_rank(status) )
+		return -1;
+
+	struct status_header header;
+
+	status->map_size = sizeof(header) + (2 * sizeof(uint64_t) + 1) * status->count;
+	status->fd = open(path, MP_STATUS_RDWR == mode ? O_RDWR|O_CREAT : O_RDONLY, 0644);
+
+	struct stat st;
+
+	if( -1 == status->fd || -1 == fstat(status->fd, &st) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to open the status '%s' :( Error: %s\n", path, strerror(errsv));
+		mp_status_close(status);
+		return -1;
+	}
+
+	int fresh = 0 == st.st_size;
+
+	if( fresh && MP_STATUS_RDWR == mode )
+	{
+		if( -1 == ftruncate(status->fd, (off_t)status->map_size) )
+		{
+			int errsv = errno;
+			message(ERR "Unable to extend the status '%s' :( Error: %s\n", path, strerror(errsv));
+			mp_status_close(status);
+			return -1;
+		}
+	}
+	else if( (size_t)st.st_size != status->map_size )
+	{
+		message(ERR "The status '%s' does not match the exponent limit %i!\n", path, exponent_limit);
+		mp_status_close(status);
+		return -1;
+	}
+
+	void *addr = mmap(NULL, status->map_size, MP_STATUS_RDWR == mode ? PROT_READ|PROT_WRITE : PROT_READ,
+		MP_STATUS_RDWR == mode ? MAP_SHARED : MAP_PRIVATE, status->fd, 0);
+
+	if( MAP_FAILED == addr )
+	{
+		int errsv = errno;
+		message(ERR "Unable to map the status '%s' :( Error: %s\n", path, strerror(errsv));
+		mp_status_close(status);
+		return -1;
+	}
+
+	status->map = addr;
+
+	if( fresh )
+	{
+		memcpy(header.magic, STATUS_MAGIC, sizeof(header.magic));
+		header.exponent_limit = (uint32_t)exponent_limit;
+		header.count = (uint32_t)status->count;
+
+		memcpy(status->map, &header, sizeof(header));
+	}
+
+	memcpy(&header, status->map, sizeof(header));
+
+	if( 0 == memcmp(header.magic, STATUS_MAGIC_OLD, sizeof(header.magic)) )
+	{
+		message(ERR "The status '%s' has the old format, rebuild it!\n", path);
+		mp_status_close(status);
+		return -1;
+	}
+
+	if( memcmp(header.magic, STATUS_MAGIC, sizeof(header.magic)) || header.exponent_limit != (uint32_t)exponent_limit || header.count != status->count )
+	{
+		message(ERR "The status '%s' is damaged!\n", path);
+		mp_status_close(status);
+		return -1;
+	}
+
+	// the header keeps the bounds aligned
+	status->b1 = (uint64_t *)(void *)(status->map + sizeof(header));
+	status->b2 = status->b1 + status->count;
+	status->tf = (uint8_t *)(status->b2 + status->count);
+
+	message("Loaded the status of %zu prime exponents from '%s'.\n", status->count, path);
+
+	return 0;
+}
+
+void mp_status_close(struct mp_status *status)
+{
+	if( status->map )
+		munmap(status->map, status->map_size);
+
+	if( -1 != status->fd )
+		close(status->fd);
+
+	free(status->rank);
+
+	status->map = NULL;
+	status->rank = NULL;
+	status->fd = -1;
+}
+
+int mp_status_sync(struct mp_status *status)
+{
+	if( MP_STATUS_RDWR != status->mode )
+		return 0;
+
+	if( -1 == msync(status->map, status->map_size, MS_SYNC) )
+	{
+		int errsv = errno;
+		message(ERR "Unable to save the status '%s' :( Error: %s\n", status->path, strerror(errsv));
+		return -1;
+	}
+
+	return 0;
+}
+
+// raise the byte to the value, returns 1 if it changed
+static
+int raise(uint8_t *ptr, uint8_t value)
+{
+	uint8_t old = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+	while( old < value )
+	{
+		if( __atomic_compare_exchange_n(ptr, &old, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+			return 1;
+	}
+
+	return 0;
+}
+
+// raise the bound to the value, returns 1 if it changed
+static
+int raise64(uint64_t *ptr, uint64_t value)
+{
+	uint64_t old = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+	while( old < value )
+	{
+		if( __atomic_compare_exchange_n(ptr, &old, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+			return 1;
+	}
+
+	return 0;
+}
+
+// all factors below 2^bits were tried, 0 if unknown
+int mp_status_get_tf(const struct mp_status *status, int n)
+{
+	long i = status_index(status, n);
+
+	return i < 0 ? 0 : status->tf[i];
+}
+
+int mp_status_set_tf(struct mp_status *status, int n, int bits)
+{
+	long i = status_index(status, n);
+
+	if( i < 0 || bits < 0 || bits > 255 )
+		return 0;
+
+	return raise(&status->tf[i], (uint8_t)bits);
+}
+
+// the P-1 bounds, returns 0 if unknown
+int mp_status_get_pm1(const struct mp_status *status, int n, uint64_t *B1, uint64_t *B2)
+{
+	long i = status_index(status, n);
+
+	if( i < 0 || 0 == __atomic_load_n(&status->b1[i], __ATOMIC_RELAXED) )
+		return 0;
+
+	*B1 = __atomic_load_n(&status->b1[i], __ATOMIC_RELAXED);
+	*B2 = __atomic_load_n(&status->b2[i], __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+// the P-1 to the bounds B1 and B2 (or higher) is done
+int mp_status_has_pm1(const struct mp_status *status, int n, uint64_t B1, uint64_t B2)
+{
+	uint64_t b1, b2;
+
+	return mp_status_get_pm1(status, n, &b1, &b2) && b1 >= B1 && b2 >= B2;
+}
+
+int mp_status_set_pm1(struct mp_status *status, int n, uint64_t B1, uint64_t B2)
+{
+	long i = status_index(status, n);
+
+	if( i < 0 )
+		return 0;
+
+	int changed = raise64(&status->b1[i], B1);
+
+	return raise64(&status->b2[i], B2) | changed;
+}
@@ -0,0 +1,55 @@
+/** @file status.h
+ * Columns of the known GIMPS work per prime exponent
+ */
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @defgroup status status
+ * @{
+ */
+
+#define MP_STATUS_RDONLY 0
+#define MP_STATUS_RDWR 1
+
+// granularity of the rank table (in exponents)
+#define MP_STATUS_BLOCK 4096
+
+/**
+ * The status file holds a header and three columns per prime exponent below
+ * the exponent limit: the P-1 bounds B1 and B2 (eight bytes each, exact), and
+ * the trial factoring depth (one byte, all factors below 2^tf were tried).
+ * Zero stands for no work known. Writers map the file with MAP_SHARED and
+ * only ever raise the values.
+ */
+struct mp_status {
+	const char *path;
+	uint8_t *map;
+	size_t map_size;
+	int fd;
+	int mode;
+	int exponent_limit;
+	size_t count; // prime exponents
+	uint64_t *b1;
+	uint64_t *b2;
+	uint8_t *tf;
+	const uint8_t *primes;
+	uint32_t *rank; // prime exponents below each block
+};
+
+int mp_status_open(struct mp_status *status, const char *path, int exponent_limit, const uint8_t *primes, int mode);
+void mp_status_close(struct mp_status *status);
+int mp_status_sync(struct mp_status *status);
+
+int mp_status_get_tf(const struct mp_status *status, int n);
+int mp_status_set_tf(struct mp_status *status, int n, int bits);
+
+int mp_status_get_pm1(const struct mp_status *status, int n, uint64_t *B1, uint64_t *B2);
+int mp_status_has_pm1(const struct mp_status *status, int n, uint64_t B1, uint64_t B2);
+int mp_status_set_pm1(struct mp_status *status, int n, uint64_t B1, uint64_t B2);
+
+/** @} */
+
+#endif
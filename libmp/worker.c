@@ -0,0 +1,117 @@
+#include "worker.h"
+#include "libmp.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+static
+void *worker_main(void *ptr)
+{
+	struct mp_worker *worker = ptr;
+
+	pthread_mutex_lock(&worker->mutex);
+
+	while(1)
+	{
+		while( !worker->quit && NULL == worker->job )
+			pthread_cond_wait(&worker->cond, &worker->mutex);
+
+		if( NULL == worker->job )
+			break;
+
+		void (*job)(void *) = worker->job;
+		void *arg = worker->arg;
+
+		pthread_mutex_unlock(&worker->mutex);
+
+		job(arg);
+
+		pthread_mutex_lock(&worker->mutex);
+
+		worker->job = NULL;
+		__atomic_store_n(&worker->busy, 0, __ATOMIC_RELEASE);
+
+		pthread_cond_broadcast(&worker->cond);
+	}
+
+	pthread_mutex_unlock(&worker->mutex);
+
+	return NULL;
+}
+
+int mp_worker_start(struct mp_worker *worker)
+{
+	worker->job = NULL;
+	worker->arg = NULL;
+	worker->busy = 0;
+	worker->quit = 0;
+
+	pthread_mutex_init(&worker->mutex, NULL);
+	pthread_cond_init(&worker->cond, NULL);
+
+	// the signals are handled by the main thread, the worker inherits the mask
+	sigset_t set, old;
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+
+	int ret = pthread_create(&worker->thread, NULL, worker_main, worker);
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if( ret )
+	{
+		message(ERR "Unable to start a background thread :( Error: %s\n", strerror(ret));
+		return -1;
+	}
+
+	return 0;
+}
+
+// finish the current job (if any) and join the thread
+void mp_worker_stop(struct mp_worker *worker)
+{
+	pthread_mutex_lock(&worker->mutex);
+	worker->quit = 1;
+	pthread_cond_broadcast(&worker->cond);
+	pthread_mutex_unlock(&worker->mutex);
+
+	pthread_join(worker->thread, NULL);
+
+	pthread_cond_destroy(&worker->cond);
+	pthread_mutex_destroy(&worker->mutex);
+}
+
+// never blocks, returns -1 if the worker is still busy with a previous job
+int mp_worker_submit(struct mp_worker *worker, void (*job)(void *arg), void *arg)
+{
+	if( mp_worker_busy(worker) )
+		return -1;
+
+	pthread_mutex_lock(&worker->mutex);
+
+	worker->job = job;
+	worker->arg = arg;
+	__atomic_store_n(&worker->busy, 1, __ATOMIC_RELEASE);
+
+	pthread_cond_broadcast(&worker->cond);
+	pthread_mutex_unlock(&worker->mutex);
+
+	return 0;
+}
+
+// cheap enough to be polled from a sieve loop
+int mp_worker_busy(struct mp_worker *worker)
+{
+	return __atomic_load_n(&worker->busy, __ATOMIC_ACQUIRE);
+}
+
+void mp_worker_wait(struct mp_worker *worker)
+{
+	pthread_mutex_lock(&worker->mutex);
+
+	while( worker->busy )
+		pthread_cond_wait(&worker->cond, &worker->mutex);
+
+	pthread_mutex_unlock(&worker->mutex);
+}
@@ -0,0 +1,32 @@
+/** @file worker.h
+ * Background thread running one job at a time
+ */
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <pthread.h>
+
+/** @defgroup worker worker
+ * @{
+ */
+
+struct mp_worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	void (*job)(void *arg);
+	void *arg;
+	int busy; // a job is queued or running
+	int quit;
+};
+
+int mp_worker_start(struct mp_worker *worker);
+void mp_worker_stop(struct mp_worker *worker);
+
+int mp_worker_submit(struct mp_worker *worker, void (*job)(void *arg), void *arg);
+int mp_worker_busy(struct mp_worker *worker);
+void mp_worker_wait(struct mp_worker *worker);
+
+/** @} */
+
+#endif
@@ -0,0 +1,586 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <libmp.h>
+#include <record.h>
+#include <checkpoint.h>
+#include <list.h>
+#include <mersenne.h>
+
+int g_term = 0;
+int g_info = 0;
+int g_save = 0;
+
+void sighandler_int(int signum)
+{
+	(void)signum;
+	exit(0);
+}
+
+void sighandler_alrm(int signum)
+{
+	(void)signum;
+	g_term = 1;
+}
+
+void sighandler_term(int signum)
+{
+	(void)signum;
+	g_term = 1;
+
+	// set the signal handler again
+	signal(SIGTERM, sighandler_term);
+}
+
+void sighandler_usr1(int signum)
+{
+	(void)signum;
+	g_info = 1;
+
+	// set the signal handler again
+	signal(SIGUSR1, sighandler_usr1);
+}
+
+void sighandler_usr2(int signum)
+{
+	(void)signum;
+	g_save = 1;
+
+	// set the signal handler again
+	signal(SIGUSR2, sighandler_usr2);
+}
+
+// iterations between the checks of the flags
+#define POLL 1024
+
+// "MLL1"
+#define STATE_MAGIC UINT32_C(0x314c4c4d)
+
+/**
+ * The Lucas-Lehmer test of the candidates of a list: s = 4, s = s^2 - 2
+ * (mod M(p)) p - 2 times, M(p) is prime iff s = 0. The arithmetic of
+ * libmp/mersenne is exact, so there are no round-off checks. The exponents
+ * are handed out to the threads one at a time, each thread checkpoints the
+ * residue of its exponent into ll-<p>.state (written aside and renamed) so
+ * that an interrupted test resumes from there. A finished test appends the
+ * result with the low 64 bits of the residue (Res64) to the results file
+ * and sets the bit of the exponent in the LL-tested record, the same
+ * record download-gimps/reader fills from the GIMPS LL results.
+ */
+struct ll {
+	const uint32_t *exponents;
+	size_t count;
+	size_t next; // the next exponent handed out
+	const uint8_t *primes;
+	int exponent_limit;
+	const struct mp_record *record; // eliminated exponents, skipped
+	struct mp_record *lltested;
+	FILE *results;
+	pthread_mutex_t mutex; // of the exponents handed out and of the results
+	int interval; // checkpoint interval in seconds
+	int stop;
+	int running;
+	int save; // bumped by SIGUSR2
+	size_t tested;
+	size_t skipped;
+	size_t found; // primes
+};
+
+struct llthread {
+	struct ll *ll;
+	pthread_t thread;
+	uint32_t p; // in progress, 0 if none
+	uint64_t iteration;
+};
+
+struct state_header {
+	uint32_t magic;
+	uint32_t p;
+	uint64_t iteration;
+};
+
+static
+void state_path(char *path, size_t size, uint32_t p)
+{
+	snprintf(path, size, "ll-%" PRIu32 ".state", p);
+}
+
+// the header, the residue, the CRC-32 of both
+static
+int state_save(const struct mp_mersenne *ctx, uint64_t iteration, const uint64_t *s)
+{
+	struct state_header header = { STATE_MAGIC, ctx->p, iteration };
+	size_t len = sizeof(header) + ctx->words * sizeof(uint64_t);
+	uint8_t *buf = malloc(len + sizeof(uint32_t));
+	char path[64];
+
+	if( NULL == buf )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	memcpy(buf, &header, sizeof(header));
+	memcpy(buf + sizeof(header), s, ctx->words * sizeof(uint64_t));
+
+	uint32_t crc = mp_crc32(0, buf, len);
+
+	memcpy(buf + len, &crc, sizeof(crc));
+
+	state_path(path, sizeof(path), ctx->p);
+
+	int ret = mp_write_file_atomic(path, buf, len + sizeof(crc));
+
+	free(buf);
+
+	return ret;
+}
+
+// returns 0 if a valid state has been loaded
+static
+int state_load(const struct mp_mersenne *ctx, uint64_t *iteration, uint64_t *s)
+{
+	struct state_header header;
+	size_t len = sizeof(header) + ctx->words * sizeof(uint64_t);
+	uint8_t *buf = malloc(len + sizeof(uint32_t) + 1);
+	char path[64];
+	int ret = -1;
+
+	state_path(path, sizeof(path), ctx->p);
+
+	FILE *file = fopen(path, "rb");
+
+	if( NULL == file || NULL == buf )
+		goto end;
+
+	// exactly the expected size
+	if( fread(buf, 1, len + sizeof(uint32_t) + 1, file) != len + sizeof(uint32_t) )
+		goto end;
+
+	uint32_t crc;
+
+	memcpy(&header, buf, sizeof(header));
+	memcpy(&crc, buf + len, sizeof(crc));
+
+	if( STATE_MAGIC != header.magic || ctx->p != header.p || header.iteration > ctx->p - 2 || crc != mp_crc32(0, buf, len) )
+	{
+		message(WARN "The state '%s' is corrupted, starting over!\n", path);
+		goto end;
+	}
+
+	memcpy(s, buf + sizeof(header), ctx->words * sizeof(uint64_t));
+	*iteration = header.iteration;
+
+	ret = 0;
+
+end:
+	if( file )
+		fclose(file);
+
+	free(buf);
+
+	return ret;
+}
+
+// returns 1 if the test has been finished, 0 if interrupted, -1 on failure
+static
+int ll_test(struct llthread *th, uint32_t p)
+{
+	struct ll *ll = th->ll;
+	struct mp_mersenne ctx;
+	uint64_t iteration = 0;
+	int ret = -1;
+
+	if( mp_mersenne_init(&ctx, p) )
+		return -1;
+
+	uint64_t *s = mp_mersenne_alloc(&ctx);
+
+	if( NULL == s )
+		goto end;
+
+	if( 0 == state_load(&ctx, &iteration, s) )
+	{
+		message("Resuming M(%" PRIu32 ") from the iteration %" PRIu64 "...\n", p, iteration);
+	}
+	else
+	{
+		iteration = 0;
+		mp_mersenne_set_ui(&ctx, s, 4);
+	}
+
+	time_t last = time(NULL);
+	int save = __atomic_load_n(&ll->save, __ATOMIC_RELAXED);
+
+	for(; iteration < p - 2; iteration++)
+	{
+		if( 0 == iteration % POLL )
+		{
+			__atomic_store_n(&th->iteration, iteration, __ATOMIC_RELAXED);
+
+			if( __atomic_load_n(&ll->stop, __ATOMIC_RELAXED) )
+			{
+				ret = state_save(&ctx, iteration, s) ? -1 : 0;
+				goto end;
+			}
+
+			int now_save = __atomic_load_n(&ll->save, __ATOMIC_RELAXED);
+
+			if( now_save != save || (ll->interval && time(NULL) - last >= ll->interval) )
+			{
+				state_save(&ctx, iteration, s);
+
+				save = now_save;
+				last = time(NULL);
+			}
+		}
+
+		mp_mersenne_sqr(&ctx, s, s);
+		mp_mersenne_sub_ui(&ctx, s, s, 2);
+	}
+
+	int prime = mp_mersenne_is_ui(&ctx, s, 0);
+
+	pthread_mutex_lock(&ll->mutex);
+
+	if( prime )
+	{
+		message(INFO "M(%" PRIu32 ") is prime!\n", p);
+
+		fprintf(ll->results, "M%" PRIu32 " is prime!\n", p);
+		ll->found++;
+	}
+	else
+	{
+		fprintf(ll->results, "M%" PRIu32 " is not prime. Res64: %016" PRIX64 "\n", p, s[0]);
+	}
+
+	// the result is durable before the state is removed
+	if( fflush(ll->results) || fsync(fileno(ll->results)) )
+	{
+		message(ERR "Unable to write the result of M(%" PRIu32 ") :(\n", p);
+	}
+	else
+	{
+		char path[64];
+
+		state_path(path, sizeof(path), p);
+		unlink(path);
+	}
+
+	mp_record_set_bit(ll->lltested, (int)p);
+	ll->tested++;
+
+	pthread_mutex_unlock(&ll->mutex);
+
+	ret = 1;
+
+end:
+	free(s);
+
+	mp_mersenne_free(&ctx);
+
+	return ret;
+}
+
+static
+int get_bit(const uint8_t *ptr, int i)
+{
+	return ptr[i/8] >> i%8 & 1;
+}
+
+static
+void *llthread_main(void *arg)
+{
+	struct llthread *th = arg;
+	struct ll *ll = th->ll;
+
+	for(;;)
+	{
+		uint32_t p = 0;
+
+		pthread_mutex_lock(&ll->mutex);
+		while( !ll->stop && ll->next < ll->count )
+		{
+			uint32_t n = ll->exponents[ll->next++];
+
+			// prime exponents, neither eliminated nor tested
+			if( n < 3 || n >= (uint32_t)ll->exponent_limit || get_bit(ll->primes, (int)n) || mp_record_get_bit(ll->record, (int)n) || mp_record_get_bit(ll->lltested, (int)n) )
+			{
+				ll->skipped++;
+				continue;
+			}
+
+			p = n;
+			break;
+		}
+		th->p = p;
+		th->iteration = 0;
+		pthread_mutex_unlock(&ll->mutex);
+
+		if( 0 == p )
+			break;
+
+		if( ll_test(th, p) < 0 )
+		{
+			// leave the rest of the list for the next run
+			__atomic_store_n(&ll->stop, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&ll->mutex);
+	th->p = 0;
+	pthread_mutex_unlock(&ll->mutex);
+
+	__atomic_fetch_sub(&ll->running, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+void info_dump(struct ll *ll, const struct llthread *ths, int threads)
+{
+	pthread_mutex_lock(&ll->mutex);
+
+	for(int t = 0; t < threads; t++)
+	{
+		if( ths[t].p )
+		{
+			uint64_t iteration = __atomic_load_n(&ths[t].iteration, __ATOMIC_RELAXED);
+
+			message("M(%" PRIu32 "), iteration %" PRIu64 " (%.2f %% done).\n", ths[t].p, iteration, 100. * (double)iteration / (double)(ths[t].p - 2));
+		}
+	}
+
+	message("%zu of %zu exponents tested (%zu primes), %zu skipped.\n", ll->tested, ll->count, ll->found, ll->skipped);
+
+	pthread_mutex_unlock(&ll->mutex);
+}
+
+void run(struct ll *ll, int threads)
+{
+	struct llthread *ths = malloc((size_t)threads * sizeof(struct llthread));
+
+	if( NULL == ths )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return;
+	}
+
+	int started = 0;
+
+	ll->running = threads;
+
+	for(int t = 0; t < threads; t++)
+	{
+		ths[t].ll = ll;
+		ths[t].p = 0;
+		ths[t].iteration = 0;
+
+		if( pthread_create(&ths[t].thread, NULL, llthread_main, &ths[t]) )
+		{
+			message(ERR "Unable to start a thread :(\n");
+			__atomic_store_n(&ll->stop, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_sub(&ll->running, threads - t, __ATOMIC_RELEASE);
+			break;
+		}
+
+		started++;
+	}
+
+	while( __atomic_load_n(&ll->running, __ATOMIC_ACQUIRE) > 0 )
+	{
+		struct timespec ts = { 0, 100000000 };
+
+		nanosleep(&ts, NULL);
+
+		if( g_term )
+		{
+			// the threads checkpoint their residues and exit
+			__atomic_store_n(&ll->stop, 1, __ATOMIC_RELAXED);
+		}
+
+		if( g_save )
+		{
+			__atomic_fetch_add(&ll->save, 1, __ATOMIC_RELAXED);
+
+			g_save = 0;
+		}
+
+		if( g_info )
+		{
+			info_dump(ll, ths, started);
+
+			g_info = 0;
+		}
+	}
+
+	for(int t = 0; t < started; t++)
+	{
+		pthread_join(ths[t].thread, NULL);
+	}
+
+	info_dump(ll, ths, started);
+
+	free(ths);
+}
+
+int main(int argc, char *argv[])
+{
+	message("%s: Lucas-Lehmer test of Mersenne numbers\n", argv[0]);
+
+	// default options
+	unsigned int timeout = 0; // no limit
+	int interval = 600; // checkpoint every ten minutes
+	int exponent_limit = -1;
+	const char *list_path = "candidates.txt";
+	const char *record_path = "record.bits";
+	const char *lltested_path = "lltested.bits";
+	const char *results_path = "results.txt";
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	// parse command-line options
+	for(int opt; (opt = getopt(argc, argv, "t:c:h:L:r:l:o:j:")) != -1;)
+	{
+		switch(opt)
+		{
+			// -t SECS : terminate test after given time limit (in seconds)
+			case 't':
+				timeout = (unsigned int)atoi(optarg);
+				break;
+			// -c SECS : checkpoint interval of the residues (in seconds), 0 disables the autosave
+			case 'c':
+				interval = atoi(optarg);
+				break;
+			// -h EXP : highest exponent in the records
+			case 'h':
+				exponent_limit = atoi(optarg);
+				break;
+			// -L FILE : the exponents to test (text, one per line, or the binary list of tools/decode)
+			case 'L':
+				list_path = optarg;
+				break;
+			// -r FILE : record of the eliminated exponents, they are skipped
+			case 'r':
+				record_path = optarg;
+				break;
+			// -l FILE : record of the LL-tested exponents (see download-gimps/reader)
+			case 'l':
+				lltested_path = optarg;
+				break;
+			// -o FILE : the results are appended here
+			case 'o':
+				results_path = optarg;
+				break;
+			// -j THREADS : number of threads
+			case 'j':
+				threads = atoi(optarg);
+				if( threads < 1 )
+				{
+					message(WARN "Invalid number of threads, using one!\n");
+					threads = 1;
+				}
+				break;
+			default :
+				message(WARN "Unknown option :( Read the source code!\n");
+		}
+	}
+
+	size_t count;
+	uint32_t *exponents = mp_list_load(list_path, &count);
+	if( NULL == exponents )
+	{
+		return 1;
+	}
+
+	struct mp_record record, lltested;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDONLY) )
+	{
+		return 1;
+	}
+
+	if( mp_record_open(&lltested, lltested_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		return 1;
+	}
+
+	FILE *results = fopen(results_path, "a");
+	if( NULL == results )
+	{
+		message(ERR "Unable to open '%s' :(\n", results_path);
+		return 1;
+	}
+
+	// create prime table
+	uint8_t *primes = load_prime_table(exponent_limit);
+	if( NULL == primes )
+	{
+		primes = gen_prime_table(exponent_limit);
+		save_prime_table(primes, exponent_limit);
+	}
+
+	signal(SIGINT,  sighandler_int); // exit immediately
+	signal(SIGALRM, sighandler_alrm); // checkpoint, exit
+	signal(SIGTERM, sighandler_term); // checkpoint, exit
+	signal(SIGUSR1, sighandler_usr1); // print the progress
+	signal(SIGUSR2, sighandler_usr2); // checkpoint the residues
+
+	// set the alarm
+	if( timeout )
+	{
+		message("Setting an alarm to be delivered in %u seconds...\n", timeout);
+		alarm(timeout);
+	}
+
+	struct ll ll;
+
+	ll.exponents = exponents;
+	ll.count = count;
+	ll.next = 0;
+	ll.primes = primes;
+	ll.exponent_limit = exponent_limit;
+	ll.record = &record;
+	ll.lltested = &lltested;
+	ll.results = results;
+	ll.interval = interval;
+	ll.stop = 0;
+	ll.running = 0;
+	ll.save = 0;
+	ll.tested = 0;
+	ll.skipped = 0;
+	ll.found = 0;
+
+	pthread_mutex_init(&ll.mutex, NULL);
+
+	message("testing %zu exponents on %i threads...\n", count, threads);
+
+	run(&ll, threads);
+
+	pthread_mutex_destroy(&ll.mutex);
+
+	fclose(results);
+
+	mp_record_sync(&lltested);
+	mp_record_close(&lltested);
+	mp_record_close(&record);
+
+	free(primes);
+	free(exponents);
+
+	if( ll.tested + ll.skipped < count )
+	{
+		message("The program has been interrupted.\n");
+
+		return 2;
+	}
+
+	message("The program has finished successfully.\n");
+
+	return 0;
+}
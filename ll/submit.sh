@@ -0,0 +1,19 @@
+#!/bin/bash
+#
+#$ -N ll
+#$ -o factor/ll/logs/$JOB_NAME.$JOB_ID.out
+#$ -e factor/ll/logs/$JOB_NAME.$JOB_ID.err
+
+# log a node name
+uname -n
+
+# change working directory to store the record to the right place
+cd $HOME/factor/ll/
+
+# limit job to one hour, the residues are checkpointed
+./ll -t 3600 "$@"
+
+# submit again while the list is not done
+if [ $? -eq 2 ]; then
+	qsub -q all.q@@stable -l ram_free=512M $HOME/factor/ll/submit.sh "$@"
+fi
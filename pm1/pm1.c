@@ -0,0 +1,615 @@
+#include <libmp.h>
+#include <mersenne.h>
+#include <record.h>
+#include <journal.h>
+#include <status.h>
+#include <list.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+
+int g_term = 0;
+int g_info = 0;
+
+void sighandler_int(int signum)
+{
+	(void)signum;
+	exit(0);
+}
+
+void sighandler_alrm(int signum)
+{
+	(void)signum;
+	g_term = 1;
+}
+
+void sighandler_term(int signum)
+{
+	(void)signum;
+	g_term = 1;
+
+	// set the signal handler again
+	signal(SIGTERM, sighandler_term);
+}
+
+void sighandler_usr1(int signum)
+{
+	(void)signum;
+	g_info = 1;
+
+	// set the signal handler again
+	signal(SIGUSR1, sighandler_usr1);
+}
+
+// the modulus of the stage 2 giant steps
+#define D 2310
+
+static
+int is_composite(const uint8_t *primes, uint64_t n)
+{
+	return primes[n/8] & 1 << n%8;
+}
+
+/**
+ * P-1 factoring of M(p). Stage 1 raises 3 to E = 2p * (the prime powers up
+ * to B1), so a factor q is found by gcd(3^E - 1, M(p)) once q - 1 divides
+ * E. Stage 2 catches the q - 1 with a single prime Q in (B1; B2] above the
+ * B1-smooth part: with x = 3^E and Q = mD +- j (j coprime to D, j < D/2),
+ * x^((mD)^2) - x^(j^2) is divisible by q, and one product covers both mD - j
+ * and mD + j (the prime pairing). The giant steps x^((mD)^2) go by the
+ * ratios x^((2m+1)D^2), which go by x^(2D^2). All the differences are
+ * multiplied together, and a single gcd ends the stage.
+ */
+struct pm1 {
+	struct mp_mersenne ctx;
+	uint32_t p;
+	uint64_t B1;
+	uint64_t B2;
+	const uint8_t *primes;
+	uint64_t *x; // 3^E
+	uint64_t *g; // the gcd
+};
+
+// E = 2p * q^floor(log_q(B1)) for all q <= B1, returns the number of words
+static
+size_t pm1_exponent(const struct pm1 *pm1, uint64_t **e)
+{
+	// log2(lcm(1..B1)) < 1.04 B1 / ln(2)
+	size_t capacity = (size_t)(pm1->B1 * 3 / 2 / 64) + 4;
+	size_t len = 1;
+	uint64_t m = 1;
+
+	*e = malloc(capacity * sizeof(uint64_t));
+
+	if( NULL == *e )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return 0;
+	}
+
+	(*e)[0] = 2 * (uint64_t)pm1->p;
+
+	for(uint64_t q = 2; q <= pm1->B1 + 1; q++)
+	{
+		// flush the last product
+		int last = q == pm1->B1 + 1;
+		uint64_t qe = 1;
+
+		if( !last )
+		{
+			if( is_composite(pm1->primes, q) )
+				continue;
+
+			for(qe = q; qe <= pm1->B1 / q; qe *= q)
+				;
+		}
+
+		if( m > UINT64_MAX / qe || last )
+		{
+			uint64_t carry = 0;
+
+			for(size_t i = 0; i < len; i++)
+			{
+				uint128_t t = (uint128_t)(*e)[i] * m + carry;
+
+				(*e)[i] = (uint64_t)t;
+				carry = (uint64_t)(t >> 64);
+			}
+
+			if( carry )
+				(*e)[len++] = carry;
+
+			m = 1;
+		}
+
+		m *= qe;
+	}
+
+	return len;
+}
+
+// 1 if g is neither 1 nor M(p)
+static
+int pm1_proper(struct pm1 *pm1)
+{
+	const struct mp_mersenne *ctx = &pm1->ctx;
+	int one = 1, all = 1;
+
+	for(size_t i = 0; i < ctx->words; i++)
+	{
+		uint64_t top = i == ctx->words - 1 && ctx->p % 64 ? (UINT64_C(1) << ctx->p % 64) - 1 : UINT64_MAX;
+
+		one = one && pm1->g[i] == (i == 0);
+		all = all && pm1->g[i] == top;
+	}
+
+	if( all )
+	{
+		message(WARN "the gcd is M(%" PRIu32 ") itself!\n", pm1->p);
+	}
+
+	return !one && !all;
+}
+
+// returns 1 if a factor is in pm1->g, 0 if none, -1 on failure or interruption
+static
+int pm1_stage1(struct pm1 *pm1)
+{
+	struct mp_mersenne *ctx = &pm1->ctx;
+	uint64_t *e;
+	size_t len = pm1_exponent(pm1, &e);
+
+	if( 0 == len )
+		return -1;
+
+	size_t bits = len * 64 - (size_t)__builtin_clzll(e[len - 1]);
+
+	message(INFO "stage 1, B1 = %" PRIu64 ", %zu bits of the exponent\n", pm1->B1, bits);
+
+	mp_mersenne_set_ui(ctx, pm1->x, 3);
+
+	// left-to-right, multiplying by 3 is cheap
+	for(size_t i = bits - 1; i-- > 0;)
+	{
+		mp_mersenne_sqr(ctx, pm1->x, pm1->x);
+
+		if( e[i / 64] >> (i % 64) & 1 )
+			mp_mersenne_mul_ui(ctx, pm1->x, pm1->x, 3);
+
+		if( g_term )
+		{
+			free(e);
+			return -1;
+		}
+
+		if( g_info )
+		{
+			message("stage 1 of M(%" PRIu32 "), %.2f %% done\n", pm1->p, 100. * (double)(bits - i) / (double)bits);
+
+			g_info = 0;
+		}
+	}
+
+	free(e);
+
+	uint64_t *t = mp_mersenne_alloc(ctx);
+
+	if( NULL == t )
+		return -1;
+
+	mp_mersenne_sub_ui(ctx, t, pm1->x, 1);
+
+	int ret = mp_mersenne_gcd(ctx, pm1->g, t);
+
+	free(t);
+
+	if( ret )
+		return -1;
+
+	return pm1_proper(pm1);
+}
+
+// x^e, e < 2^64
+static
+void pow64(struct mp_mersenne *ctx, uint64_t *r, const uint64_t *x, uint64_t e)
+{
+	mp_mersenne_pow(ctx, r, x, &e, 64);
+}
+
+static
+int pm1_stage2(struct pm1 *pm1)
+{
+	struct mp_mersenne *ctx = &pm1->ctx;
+	uint64_t B1 = pm1->B1, B2 = pm1->B2;
+
+	// the baby steps x^(j^2), j coprime to D
+	uint64_t *baby[D/2];
+	size_t count = 0;
+
+	uint64_t *cur = mp_mersenne_alloc(ctx), *step = mp_mersenne_alloc(ctx), *x8 = mp_mersenne_alloc(ctx);
+	uint64_t *giant = mp_mersenne_alloc(ctx), *ratio = mp_mersenne_alloc(ctx), *x2d2 = mp_mersenne_alloc(ctx);
+	uint64_t *acc = mp_mersenne_alloc(ctx), *t = mp_mersenne_alloc(ctx);
+	uint32_t js[D/2];
+	int ret = -1;
+
+	if( !cur || !step || !x8 || !giant || !ratio || !x2d2 || !acc || !t )
+		goto end;
+
+	message(INFO "stage 2, B2 = %" PRIu64 "\n", B2);
+
+	// (j+2)^2 - j^2 = 4j + 4
+	mp_mersenne_copy(ctx, cur, pm1->x);
+	pow64(ctx, x8, pm1->x, 8);
+	mp_mersenne_copy(ctx, step, x8);
+
+	for(uint32_t j = 1; j < D/2; j += 2)
+	{
+		if( j % 3 && j % 5 && j % 7 && j % 11 )
+		{
+			baby[count] = mp_mersenne_alloc(ctx);
+
+			if( NULL == baby[count] )
+				goto end;
+
+			mp_mersenne_copy(ctx, baby[count], cur);
+			js[count++] = j;
+		}
+
+		mp_mersenne_mul(ctx, cur, cur, step);
+		mp_mersenne_mul(ctx, step, step, x8);
+	}
+
+	// x^((mD)^2), x^((2m+1)D^2), x^(2D^2)
+	uint64_t m0 = B1 / D;
+
+	pow64(ctx, giant, pm1->x, m0 * D * m0 * D);
+	pow64(ctx, ratio, pm1->x, (2 * m0 + 1) * D * D);
+	pow64(ctx, x2d2, pm1->x, 2 * (uint64_t)D * D);
+
+	mp_mersenne_set_ui(ctx, acc, 1);
+
+	uint64_t pairs = 0, products = 0;
+
+	for(uint64_t m = m0; m * D < B2 + D/2; m++)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			uint64_t a = m * D - js[i], b = m * D + js[i];
+			int use_a = m * D > js[i] && a > B1 && a <= B2 && !is_composite(pm1->primes, a);
+			int use_b = b > B1 && b <= B2 && !is_composite(pm1->primes, b);
+
+			if( use_a || use_b )
+			{
+				mp_mersenne_sub(ctx, t, giant, baby[i]);
+				mp_mersenne_mul(ctx, acc, acc, t);
+
+				products++;
+				pairs += use_a && use_b;
+			}
+		}
+
+		mp_mersenne_mul(ctx, giant, giant, ratio);
+		mp_mersenne_mul(ctx, ratio, ratio, x2d2);
+
+		if( g_term )
+			goto end;
+
+		if( g_info )
+		{
+			message("stage 2 of M(%" PRIu32 "), %.2f %% done\n", pm1->p, 100. * (double)(m * D - B1) / (double)(B2 - B1));
+
+			g_info = 0;
+		}
+	}
+
+	message(INFO "stage 2, %" PRIu64 " products, %" PRIu64 " of them paired\n", products, pairs);
+
+	if( mp_mersenne_gcd(ctx, pm1->g, acc) )
+		goto end;
+
+	ret = pm1_proper(pm1);
+
+end:
+	for(size_t i = 0; i < count; i++)
+		free(baby[i]);
+
+	free(cur);
+	free(step);
+	free(x8);
+	free(giant);
+	free(ratio);
+	free(x2d2);
+	free(acc);
+	free(t);
+
+	return ret;
+}
+
+// the decimal digits of a factor up to 128 bits, the hexadecimal ones above
+static
+char *factor_to_str(char *buf, size_t size, const uint64_t *g, size_t words)
+{
+	size_t top = words;
+
+	while( top > 1 && 0 == g[top - 1] )
+		top--;
+
+	if( top <= 2 )
+	{
+		char tmp[40];
+
+		snprintf(buf, size, "%s", mp_uint128_to_str(tmp, (uint128_t)(top > 1 ? g[1] : 0) << 64 | g[0]));
+
+		return buf;
+	}
+
+	size_t pos = (size_t)snprintf(buf, size, "0x%" PRIx64, g[top - 1]);
+
+	for(size_t i = top - 1; i-- > 0 && pos < size;)
+		pos += (size_t)snprintf(buf + pos, size - pos, "%016" PRIx64, g[i]);
+
+	return buf;
+}
+
+// returns 1 if M(p) has been eliminated, 0 if not, -1 on failure or interruption
+static
+int pm1_run(uint32_t p, uint64_t B1, uint64_t B2, const uint8_t *primes, struct mp_record *record, struct mp_journal *journal)
+{
+	struct pm1 pm1;
+
+	pm1.p = p;
+	pm1.B1 = B1;
+	pm1.B2 = B2;
+	pm1.primes = primes;
+
+	message(INFO "P-1 of M(%" PRIu32 ")...\n", p);
+
+	if( mp_mersenne_init(&pm1.ctx, p) )
+		return -1;
+
+	pm1.x = mp_mersenne_alloc(&pm1.ctx);
+	pm1.g = mp_mersenne_alloc(&pm1.ctx);
+
+	int ret = -1;
+
+	if( pm1.x && pm1.g )
+	{
+		ret = pm1_stage1(&pm1);
+
+		if( 0 == ret && B2 > B1 )
+			ret = pm1_stage2(&pm1);
+	}
+
+	if( 1 == ret )
+	{
+		char buf[4096];
+
+		message(INFO "success, %s | M(%" PRIu32 ")\n", factor_to_str(buf, sizeof(buf), pm1.g, pm1.ctx.words), p);
+
+		mp_record_set_bit(record, (int)p);
+
+		// the journal holds the factors up to 128 bits
+		size_t top = pm1.ctx.words;
+
+		while( top > 2 && 0 == pm1.g[top - 1] )
+			top--;
+
+		if( top <= 2 )
+			mp_journal_add(journal, (int)p, (uint128_t)(top > 1 ? pm1.g[1] : 0) << 64 | pm1.g[0]);
+	}
+
+	free(pm1.x);
+	free(pm1.g);
+
+	mp_mersenne_free(&pm1.ctx);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	message("%s: Mersenne number factorization, P-1 method\n", argv[0]);
+
+	int exponent_limit = 256*1024*1024; // 2^8 * 2^10 * 2^10
+	const char *status_path = "status.bin";
+	const char *record_path = "record.bits";
+	const char *list_path = NULL; // a single exponent
+	uint32_t p = 0;
+	int64_t B1 = 100000;
+	int64_t B2 = -1; // 20 B1
+	unsigned int timeout = 0; // no limit
+
+	// parse command-line options
+	for(int opt; (opt = getopt(argc, argv, "h:s:r:L:b:B:t:")) != -1;)
+	{
+		switch(opt)
+		{
+			// -h EXP : highest exponent in the prime table (and the record)
+			case 'h':
+				exponent_limit = atoi(optarg);
+				if( exponent_limit < 2 )
+				{
+					message(WARN "Invalid exponent, keeping the default one!\n");
+					exponent_limit = 256*1024*1024;
+				}
+				break;
+			// -s FILE : status of the work per prime exponent, the P-1 bounds done are skipped and raised
+			case 's':
+				status_path = optarg;
+				break;
+			// -r FILE : record of the eliminated exponents
+			case 'r':
+				record_path = optarg;
+				break;
+			// -L FILE : the exponents of the list (text, one per line, or see tools/decode)
+			case 'L':
+				list_path = optarg;
+				break;
+			// -b B1 : the bound of the stage 1
+			case 'b':
+				B1 = atoll(optarg);
+				break;
+			// -B B2 : the bound of the stage 2 (below the exponent limit), B1 skips the stage 2
+			case 'B':
+				B2 = atoll(optarg);
+				break;
+			// -t SECS : terminate after given time limit (in seconds)
+			case 't':
+				timeout = (unsigned int)atoi(optarg);
+				break;
+			default :
+				message(WARN "Unknown option :( Read the source code!\n");
+		}
+	}
+	// argument after options
+	if(optind < argc)
+	{
+		// pm1 [OPTIONS] [EXPONENT]
+		p = (uint32_t)atol(argv[optind++]);
+
+		if(optind < argc)
+		{
+			message(WARN "Too much options :( Read the source code!\n");
+		}
+	}
+
+	if( B1 < 11 || B1 >= exponent_limit )
+	{
+		message(ERR "invalid B1 = %" PRId64 "!\n", B1);
+		return 1;
+	}
+
+	if( B2 < 0 )
+	{
+		B2 = 20 * B1;
+	}
+
+	if( B2 >= exponent_limit )
+	{
+		B2 = exponent_limit - 1;
+		message(WARN "B2 is limited by the prime table, using %" PRId64 "!\n", B2);
+	}
+
+	// create prime table
+	uint8_t *primes = load_prime_table(exponent_limit);
+	if( NULL == primes )
+	{
+		primes = gen_prime_table(exponent_limit);
+		save_prime_table(primes, exponent_limit);
+	}
+
+	uint32_t *exponents;
+	size_t count = 1;
+
+	if( list_path )
+	{
+		exponents = mp_list_load(list_path, &count);
+	}
+	else
+	{
+		exponents = malloc(sizeof(uint32_t));
+
+		if( exponents )
+			exponents[0] = p;
+	}
+
+	if( NULL == exponents )
+	{
+		return 1;
+	}
+
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		return 1;
+	}
+
+	struct mp_journal journal;
+	if( mp_journal_open_record(&journal, record_path) )
+	{
+		return 1;
+	}
+
+	struct mp_status status;
+	int has_status = 0 == mp_status_open(&status, status_path, exponent_limit, primes, MP_STATUS_RDWR);
+
+	signal(SIGINT,  sighandler_int); // exit immediately
+	signal(SIGALRM, sighandler_alrm); // stop, exit
+	signal(SIGTERM, sighandler_term); // stop, exit
+	signal(SIGUSR1, sighandler_usr1); // print the progress
+
+	// set the alarm
+	if( timeout )
+	{
+		message("Setting an alarm to be delivered in %u seconds...\n", timeout);
+		alarm(timeout);
+	}
+
+	size_t done = 0, eliminated = 0, skipped = 0;
+
+	for(size_t i = 0; i < count && !g_term; i++)
+	{
+		uint32_t n = exponents[i];
+
+		if( n < 3 || n >= (uint32_t)exponent_limit || is_composite(primes, n) )
+		{
+			message(WARN "%" PRIu32 " is not a prime exponent below the limit, skipping!\n", n);
+			skipped++;
+			continue;
+		}
+
+		// eliminated, or the bounds are done
+		if( mp_record_get_bit(&record, (int)n) || (has_status && mp_status_has_pm1(&status, (int)n, (uint64_t)B1, (uint64_t)B2)) )
+		{
+			skipped++;
+			continue;
+		}
+
+		int ret = pm1_run(n, (uint64_t)B1, (uint64_t)B2, primes, &record, &journal);
+
+		if( ret < 0 )
+			break;
+
+		eliminated += (size_t)ret;
+		done++;
+
+		if( has_status )
+		{
+			mp_status_set_pm1(&status, (int)n, (uint64_t)B1, (uint64_t)B2);
+		}
+
+		mp_journal_flush(&journal);
+	}
+
+	message("%zu of %zu exponents done, %zu eliminated, %zu skipped.\n", done, count, eliminated, skipped);
+
+	mp_journal_sync(&journal);
+	mp_journal_close(&journal);
+
+	if( has_status )
+	{
+		mp_status_sync(&status);
+		mp_status_close(&status);
+	}
+
+	mp_record_sync(&record);
+	mp_record_close(&record);
+
+	free(exponents);
+	free(primes);
+
+	if( done + skipped < count )
+	{
+		message("The program has been interrupted.\n");
+
+		return 2;
+	}
+
+	message("The program has finished successfully.\n");
+
+	return 0;
+}
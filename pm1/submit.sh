@@ -0,0 +1,19 @@
+#!/bin/bash
+#
+#$ -N pm1
+#$ -o factor/pm1/logs/$JOB_NAME.$JOB_ID.out
+#$ -e factor/pm1/logs/$JOB_NAME.$JOB_ID.err
+
+# log a node name
+uname -n
+
+# change working directory to store the record to the right place
+cd $HOME/factor/pm1/
+
+# limit job to one hour, the exponents done are kept in the status
+./pm1 -t 3600 "$@"
+
+# submit again while the list is not done
+if [ $? -eq 2 ]; then
+	qsub -q all.q@@stable -l ram_free=512M $HOME/factor/pm1/submit.sh "$@"
+fi
@@ -10,6 +10,11 @@
 #include <stdarg.h>
 #include <string.h>
 #include <libmp.h>
+#include <record.h>
+#include <checkpoint.h>
+#include <worker.h>
+#include <journal.h>
+#include <delta.h>
 
 int g_term = 0;
 int g_info = 0;
@@ -92,6 +97,13 @@ int get_bit(const char *ptr, int i)
 	return ptr[i/8] & 1 << i%8;
 }
 
+// the record is read while the sieve sets bits in it
+static
+int get_bit_relaxed(const char *ptr, int i)
+{
+	return __atomic_load_n(&ptr[i/8], __ATOMIC_RELAXED) & 1 << i%8;
+}
+
 static
 int is_prime(int p, const char *primes)
 {
@@ -171,7 +183,7 @@ void summary(const char *record, int exponent_limit, const char *primes)
 			prime_total++;
 
 			// if dirty
-			if( get_bit(record, n) )
+			if( get_bit_relaxed(record, n) )
 			{
 				prime_eliminated++;
 
@@ -192,7 +204,7 @@ void summary(const char *record, int exponent_limit, const char *primes)
 			composite_total++;
 
 			// if dirty
-			if( get_bit(record, n) )
+			if( get_bit_relaxed(record, n) )
 			{
 				composite_dirty++;
 			}
@@ -204,36 +216,18 @@ void summary(const char *record, int exponent_limit, const char *primes)
 	);
 }
 
-// save the record
-void record_save(char *record, int exponent_limit, const char *record_path)
-{
-	message("Saving the record to '%s'...\n", record_path);
-
-	// remove backup copy
-	char backup_path[4096];
-	sprintf(backup_path, "%s.bak", record_path);
-	unlink(backup_path);
-
-	// rename a previous record
-	rename(record_path, backup_path);
-
-	// create new record
-	FILE *record_file = fopen(record_path, "w");
-	if( NULL == record_file )
-	{
-		message(ERR "Unable to save the record :(\n");
-		return;
-	}
-
-	// loop over the record
-	if( (size_t)(exponent_limit+7)/8 != fwrite(record, (size_t)1, (size_t)(exponent_limit+7)/8, record_file) )
-	{
-		message(ERR "Unable to write into the record :( The file is incomplete!\n");
-	}
+struct summary_args {
+	const char *record;
+	int exponent_limit;
+	const char *primes;
+};
 
-	fclose(record_file);
+// gather the progress overview on the worker thread, approximate as the bits set during the pass may or may not be counted
+void summary_job(void *ptr)
+{
+	const struct summary_args *args = ptr;
 
-	message("The record was saved successfully.\n");
+	summary(args->record, args->exponent_limit, args->primes);
 }
 
 struct timespec g_tp0;
@@ -348,8 +342,10 @@ int128_t int128_random_prime_fast(int n, FILE *random_file)
 	return s;
 }
 
-void sieve(char *record, int exponent_limit, const char *record_path, const char *primes, FILE *random_file)
+void sieve(struct mp_record *record, struct mp_checkpoint *cp, struct mp_worker *worker, int exponent_limit, const char *primes, FILE *random_file)
 {
+	struct summary_args args = { (const char *)record->bits, exponent_limit, primes };
+
 	clock_gettime(CLOCK_REALTIME, &g_tp0);
 
 	message("sieving...\n");
@@ -367,7 +363,15 @@ void sieve(char *record, int exponent_limit, const char *record_path, const char
 			INT128_H64(factor), INT128_L64(factor)
 		);
 
-		mp_int128_test_prtest((uint8_t *)record, factor, exponent_limit, (const uint8_t *)primes);
+		int exponent = mp_int128_exponent_prtest(factor, exponent_limit, (const uint8_t *)primes);
+
+		if( exponent )
+		{
+			// mark the M(exponent) as dirty
+			mp_record_set_bit(record, exponent);
+
+			mp_journal_add128(cp->journal, exponent, (uint128_t)factor);
+		}
 
 		if( g_term )
 		{
@@ -375,20 +379,19 @@ void sieve(char *record, int exponent_limit, const char *record_path, const char
 			break;
 		}
 
-		if( g_save )
+		if( g_save || mp_checkpoint_due(cp) )
 		{
-			// save the record and state...
-			record_save(record, exponent_limit, record_path);
-
-			g_save = 0;
+			// snapshot the record and state, the worker writes them out (retried while it is busy)
+			if( 0 == mp_checkpoint_commit_async(cp, worker, INT64_0) )
+				g_save = 0;
 		}
 
-		if( g_info )
+		if( g_info && !mp_worker_busy(worker) )
 		{
 			message("%" PRId64 " random states tested so far.\n", INT128_L64(states));
 
-			// gather and print a progress overview
-			summary(record, exponent_limit, primes);
+			// gather and print a progress overview in the background
+			mp_worker_submit(worker, summary_job, &args);
 
 			clock_dump(states);
 
@@ -396,99 +399,15 @@ void sieve(char *record, int exponent_limit, const char *record_path, const char
 		}
 	}
 
+	// wait for a snapshot in progress
+	mp_worker_wait(worker);
+
 	// save the record and state
-	record_save(record, exponent_limit, record_path);
+	mp_checkpoint_fold(cp, INT64_0);
 	clock_dump(states);
 
 	// gather and print a progress overview
-	summary(record, exponent_limit, primes);
-}
-
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
-{
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
-	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
-		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
-		}
-
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
-
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
-	}
-	else
-	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
-
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
-		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
-		}
-
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-		if( *p_exponent_limit > detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
-
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
-		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
-		}
-
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
-
-		fclose(record_file);
-	}
-
-	return record;
+	summary((const char *)record->bits, exponent_limit, primes);
 }
 
 int main(int argc, char *argv[])
@@ -497,11 +416,12 @@ int main(int argc, char *argv[])
 
 	// default options
 	unsigned int timeout = 0; // no limit
+	int interval = 60; // checkpoint every minute
 	int exponent_limit = -1;
 	const char *record_path = "record.bits";
 
 	// parse command-line options
-	for(int opt; (opt = getopt(argc, argv, "t:h:")) != -1;)
+	for(int opt; (opt = getopt(argc, argv, "t:c:h:")) != -1;)
 	{
 		switch(opt)
 		{
@@ -509,6 +429,10 @@ int main(int argc, char *argv[])
 			case 't':
 				timeout = atoi(optarg);
 				break;
+			// -c SECS : checkpoint interval (in seconds), 0 disables the autosave
+			case 'c':
+				interval = atoi(optarg);
+				break;
 			// -h EXP : highest exponent in the record
 			case 'h':
 				exponent_limit = atoi(optarg);
@@ -536,7 +460,40 @@ int main(int argc, char *argv[])
 	}
 
 	// load the record
-	char *record = record_load(&exponent_limit, record_path);
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		exit(0);
+	}
+
+	// checkpoints of the record
+	struct mp_checkpoint cp;
+	if( mp_checkpoint_init(&cp, &record, NULL, interval) )
+	{
+		exit(0);
+	}
+
+	// certificates of the eliminations
+	struct mp_journal journal;
+	if( mp_journal_open_record(&journal, record_path) )
+	{
+		exit(0);
+	}
+	cp.journal = &journal;
+
+	// bits set from now on are exchanged as a delta, appended to the one not shipped yet
+	struct mp_delta delta;
+	if( mp_delta_init(&delta, &record) )
+	{
+		exit(0);
+	}
+	cp.delta = &delta;
+
+	// replay an interrupted checkpoint, the replayed bits go into the delta too
+	if( mp_checkpoint_recover(&cp) < 0 )
+	{
+		exit(0);
+	}
 
 	// create prime table
 	char *primes = (char *)load_prime_table(exponent_limit);
@@ -567,12 +524,23 @@ int main(int argc, char *argv[])
 		alarm(timeout);
 	}
 
+	// start the background thread for snapshots
+	struct mp_worker worker;
+	if( mp_worker_start(&worker) )
+	{
+		exit(0);
+	}
+
 	// start a loop
-	sieve(record, exponent_limit, record_path, primes, random_file);
+	sieve(&record, &cp, &worker, exponent_limit, primes, random_file);
 
 	fclose(random_file);
 
-	free(record);
+	mp_worker_stop(&worker);
+	mp_checkpoint_free(&cp);
+	mp_journal_close(&journal);
+	mp_delta_free(&delta);
+	mp_record_close(&record);
 	free(primes);
 
 	message("The program has finished successfully.\n");
@@ -10,6 +10,12 @@
 #include <stdarg.h>
 #include <string.h>
 #include <libmp.h>
+#include <record.h>
+#include <checkpoint.h>
+#include <worker.h>
+#include <journal.h>
+#include <delta.h>
+#include <prune.h>
 
 int g_term = 0;
 int g_info = 0;
@@ -90,15 +96,16 @@ int64_t int64_ceil_sqrt(int64_t n)
 }
 
 static
-void set_bit(char *ptr, int i)
+int get_bit(const char *ptr, int i)
 {
-	ptr[i/8] |= 1 << i%8;
+	return ptr[i/8] & 1 << i%8;
 }
 
+// the record is read while the sieve sets bits in it
 static
-int get_bit(const char *ptr, int i)
+int get_bit_relaxed(const char *ptr, int i)
 {
-	return ptr[i/8] & 1 << i%8;
+	return __atomic_load_n(&ptr[i/8], __ATOMIC_RELAXED) & 1 << i%8;
 }
 
 static
@@ -130,28 +137,17 @@ int is_prime(int p, const char *primes)
 #endif
 }
 
-void test(char *record, int64_t factor, int exponent_limit, const char *primes)
+void test(struct mp_record *record, struct mp_journal *journal, struct mp_prune *prune, const struct mp_prune_block *block, int64_t state)
 {
-	if( INT64_0 == (factor & (factor+INT64_1)) )
-	{
-		// skip M itself
-		return;
-	}
-
-	if( !mp_int64_is_prime_wheel6(factor) )
-	{
-		// not a prime factor, skip them
-		return;
-	}
+	// find M(n), only the clean ones
+	int n = mp_prune_int64_prtest_block(prune, block, state);
 
-	// find M(n)
-	int n = (int)mp_int64_dlog2_bg_lim(factor, exponent_limit);
-
-	// check if the exponent is prime
-	if( is_prime(n, primes) )
+	if( n )
 	{
 		// mark the M(n) as dirty
-		set_bit(record, n);
+		mp_record_set_bit(record, n);
+
+		mp_journal_add64(journal, n, (uint64_t)(state * INT64_C(8) + block->sign));
 	}
 }
 
@@ -172,7 +168,7 @@ void summary(const char *record, int exponent_limit, const char *primes)
 			prime_total++;
 
 			// if dirty
-			if( get_bit(record, n) )
+			if( get_bit_relaxed(record, n) )
 			{
 				prime_eliminated++;
 
@@ -193,7 +189,7 @@ void summary(const char *record, int exponent_limit, const char *primes)
 			composite_total++;
 
 			// if dirty
-			if( get_bit(record, n) )
+			if( get_bit_relaxed(record, n) )
 			{
 				composite_dirty++;
 			}
@@ -205,87 +201,158 @@ void summary(const char *record, int exponent_limit, const char *primes)
 	);
 }
 
-// save the record
-void record_save(char *record, int exponent_limit, const char *record_path)
+struct summary_args {
+	const char *record;
+	int exponent_limit;
+	const char *primes;
+};
+
+// gather the progress overview on the worker thread, approximate as the bits set during the pass may or may not be counted
+void summary_job(void *ptr)
 {
-	message("Saving the record to '%s'...\n", record_path);
+	const struct summary_args *args = ptr;
 
-	// remove backup copy
-	char backup_path[4096];
-	sprintf(backup_path, "%s.bak", record_path);
-	unlink(backup_path);
+	summary(args->record, args->exponent_limit, args->primes);
+}
 
-	// rename a previous record
-	rename(record_path, backup_path);
+struct timespec g_tp0;
 
-	// create new record
-	FILE *record_file = fopen(record_path, "w");
-	if( NULL == record_file )
-	{
-		message(ERR "Unable to save the record :(\n");
-		return;
-	}
+void clock_dump(int64_t init_state, int64_t state)
+{
+	struct timespec tp1;
 
-	// loop over the record
-	if( (size_t)(exponent_limit+7)/8 != fwrite(record, (size_t)1, (size_t)(exponent_limit+7)/8, record_file) )
-	{
-		message(ERR "Unable to write into the record :( The file is incomplete!\n");
-	}
+	clock_gettime(CLOCK_REALTIME, &tp1);
 
-	fclose(record_file);
+	int64_t secs_elapsed = (int64_t)tp1.tv_sec - (int64_t)g_tp0.tv_sec;
+
+	float secs_per_state = secs_elapsed/(float)(state - init_state);
+	if( state - init_state <= INT64_0 )
+		secs_per_state = 0.f;
 
-	message("The record was saved successfully.\n");
+	message("%" PRId64 " seconds elapsed (%f secs per each state).\n",
+		secs_elapsed,
+		secs_per_state
+	);
 }
 
-void state_save(int64_t state)
+// states per segment of the k-sieve
+#define SEGMENT (1 << 16)
+
+/**
+ * Segmented sieve over the states. A bit is set if 8s+1 (or 8s-1) has an
+ * odd prime factor below the bound (other than itself), such a factor is
+ * skipped without any arithmetic.
+ */
+struct ksieve {
+	uint32_t *primes; // odd primes below the bound
+	uint32_t *roots1; // s (mod p) of the p | 8s+1
+	uint32_t *roots7; // s (mod p) of the p | 8s-1
+	size_t count;
+	int64_t base; // the first state of the segment
+	uint64_t bits1[SEGMENT/64];
+	uint64_t bits7[SEGMENT/64];
+	int64_t candidates;
+	int64_t survivors;
+};
+
+void ksieve_init(struct ksieve *ks, int bound)
 {
-	FILE *state_file = fopen("sieve.state", "wb");
-	if( NULL == state_file )
+	uint8_t *composite = calloc((size_t)bound, 1);
+
+	ks->primes = malloc((size_t)bound/2 * sizeof(uint32_t));
+	ks->roots1 = malloc((size_t)bound/2 * sizeof(uint32_t));
+	ks->roots7 = malloc((size_t)bound/2 * sizeof(uint32_t));
+	ks->count = 0;
+	ks->candidates = 0;
+	ks->survivors = 0;
+
+	if( NULL == composite || NULL == ks->primes || NULL == ks->roots1 || NULL == ks->roots7 )
 	{
-		message(ERR "Unable to save the state :(\n");
-		return;
+		message(ERR "Unable to allocate memory :(\n");
+		exit(0);
 	}
 
-	if( fprintf(state_file, "%" PRId64, state) < 0 )
+	for(int p = 3; p < bound; p += 2)
 	{
-		message(ERR "Unable to write the state :(\n");
+		if( composite[p] )
+			continue;
+
+		for(int64_t m = (int64_t)p * p; m < bound; m += 2 * p)
+			composite[m] = 1;
+
+		// 1/8 = ((p+1)/2)^3 (mod p)
+		uint64_t half = (uint64_t)(p + 1) / 2;
+		uint64_t inv8 = half * half % (uint64_t)p * half % (uint64_t)p;
+
+		ks->primes[ks->count] = (uint32_t)p;
+		ks->roots1[ks->count] = (uint32_t)(((uint64_t)p - inv8) % (uint64_t)p);
+		ks->roots7[ks->count] = (uint32_t)inv8;
+		ks->count++;
 	}
 
-	fclose(state_file);
+	free(composite);
 
-	message("The state (%" PRId64 ") was saved successfully.\n", state);
+	message("The k-sieve uses %zu primes below %i.\n", ks->count, bound);
 }
 
-struct timespec g_tp0;
+void ksieve_free(struct ksieve *ks)
+{
+	free(ks->primes);
+	free(ks->roots1);
+	free(ks->roots7);
+}
 
-void clock_dump(int64_t init_state, int64_t state)
+static
+void ksieve_mark(uint64_t *bits, int64_t base, uint32_t p, uint32_t root, int64_t sign)
 {
-	struct timespec tp1;
+	int64_t i = ((int64_t)root - base % p + p) % p;
 
-	clock_gettime(CLOCK_REALTIME, &tp1);
+	// keep the prime itself
+	if( base + i > INT64_0 && (base + i) * INT64_C(8) + sign == (int64_t)p )
+		i += p;
 
-	int64_t secs_elapsed = (int64_t)tp1.tv_sec - (int64_t)g_tp0.tv_sec;
+	for(; i < SEGMENT; i += p)
+		bits[i/64] |= UINT64_C(1) << i%64;
+}
 
-	float secs_per_state = secs_elapsed/(float)(state - init_state);
-	if( state - init_state <= INT64_0 )
-		secs_per_state = 0.f;
+// sieve the segment starting at the state base
+void ksieve_segment(struct ksieve *ks, int64_t base)
+{
+	ks->base = base;
 
-	message("%" PRId64 " seconds elapsed (%f secs per each state).\n",
-		secs_elapsed,
-		secs_per_state
-	);
+	memset(ks->bits1, 0, sizeof(ks->bits1));
+	memset(ks->bits7, 0, sizeof(ks->bits7));
+
+	for(size_t j = 0; j < ks->count; j++)
+	{
+		ksieve_mark(ks->bits1, base, ks->primes[j], ks->roots1[j], +INT64_1);
+		ksieve_mark(ks->bits7, base, ks->primes[j], ks->roots7[j], -INT64_1);
+	}
 }
 
-void sieve(char *record, int64_t init_state, int exponent_limit, const char *record_path, const char *primes)
+void ksieve_dump(const struct ksieve *ks)
+{
+	message("%" PRId64 " candidates, %" PRId64 " (%.1f %%) survived the k-sieve.\n",
+		ks->candidates, ks->survivors, ks->candidates ? 100. * (double)ks->survivors / (double)ks->candidates : 0.);
+}
+
+static
+int ksieve_get(const uint64_t *bits, int64_t i)
+{
+	return (int)(bits[i/64] >> i%64) & 1;
+}
+
+void sieve(struct mp_record *record, struct mp_checkpoint *cp, struct mp_worker *worker, struct mp_prune *prune, struct mp_prune_block *block1, struct mp_prune_block *block7, struct ksieve *ks, int64_t init_state, int exponent_limit, const char *primes)
 {
 	// for 64 bits: 1 + 60 + 3
 	int64_t max_state = (INT64_1<<60) - INT64_1;
 
+	struct summary_args args = { (const char *)record->bits, exponent_limit, primes };
+
 	clock_gettime(CLOCK_REALTIME, &g_tp0);
 
 	for(int64_t state = init_state; state <= max_state; state++)
 	{
-		int64_t factor1 = state*INT64_C(8) + INT64_1;
 		int64_t factor7 = state*INT64_C(8) - INT64_1;
 
 		if( INT64_0 == (factor7 & (factor7 + INT64_1)) )
@@ -293,8 +360,31 @@ void sieve(char *record, int64_t init_state, int exponent_limit, const char *rec
 			message("Entering bit level %i...\n", __builtin_popcountll(factor7));
 		}
 
-		test(record, factor1, exponent_limit, primes);
-		test(record, factor7, exponent_limit, primes);
+		if( state == init_state || state - ks->base == SEGMENT )
+		{
+			ksieve_segment(ks, state);
+		}
+
+		if( state == init_state || state - block1->base == MP_PRUNE_SEGMENT )
+		{
+			if( mp_prune_block_segment(block1, state) || mp_prune_block_segment(block7, state) )
+			{
+				max_state = state - INT64_1;
+				break;
+			}
+		}
+
+		int composite1 = ksieve_get(ks->bits1, state - ks->base);
+		int composite7 = ksieve_get(ks->bits7, state - ks->base);
+
+		// only the survivors of the k-sieve
+		if( !composite1 )
+			test(record, cp->journal, prune, block1, state);
+		if( !composite7 )
+			test(record, cp->journal, prune, block7, state);
+
+		ks->candidates += 2;
+		ks->survivors += 2 - composite1 - composite7;
 
 		if( g_term )
 		{
@@ -304,123 +394,46 @@ void sieve(char *record, int64_t init_state, int exponent_limit, const char *rec
 			break;
 		}
 
-		if( g_save )
+		if( g_save || mp_checkpoint_due(cp) )
 		{
-			// save the record and state...
-			record_save(record, exponent_limit, record_path);
-			state_save(state+INT64_1);
+			// snapshot the record and state, the worker writes them out (retried while it is busy)
+			if( 0 == mp_checkpoint_commit_async(cp, worker, state+INT64_1) )
+				g_save = 0;
+		}
 
-			g_save = 0;
+		if( mp_prune_due(prune) )
+		{
+			// pick up the exponents eliminated elsewhere
+			mp_prune_reload(prune);
 		}
 
-		if( g_info )
+		if( g_info && !mp_worker_busy(worker) )
 		{
 			message("Current state is %" PRId64 ".\n", state);
 
-			// gather and print a progress overview
-			summary(record, exponent_limit, primes);
+			// gather and print a progress overview in the background
+			mp_worker_submit(worker, summary_job, &args);
 
 			clock_dump(init_state, state);
+			ksieve_dump(ks);
+			mp_prune_dump(prune);
 
 			g_info = 0;
 		}
 	}
 
+	// wait for a snapshot in progress
+	mp_worker_wait(worker);
+
 	// save the record and state
-	record_save(record, exponent_limit, record_path);
-	state_save(max_state+INT64_1);
+	mp_checkpoint_fold(cp, max_state+INT64_1);
 
 	// gather and print a progress overview
-	summary(record, exponent_limit, primes);
+	summary((const char *)record->bits, exponent_limit, primes);
 
 	clock_dump(init_state, max_state);
-}
-
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
-{
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
-	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
-		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
-		}
-
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
-
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
-	}
-	else
-	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
-
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
-		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
-		}
-
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-		if( *p_exponent_limit > detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
-
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
-		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
-		}
-
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
-
-		fclose(record_file);
-	}
-
-	return record;
+	ksieve_dump(ks);
+	mp_prune_dump(prune);
 }
 
 // load the state
@@ -466,11 +479,14 @@ int main(int argc, char *argv[])
 	// default options
 	int64_t init_state = INT64_0;
 	unsigned int timeout = 0; // no limit
+	int interval = 60; // checkpoint every minute
 	int exponent_limit = -1;
 	const char *record_path = "record.bits";
+	const char *merged_path = NULL;
+	int ksieve_bound = 1 << 20;
 
 	// parse command-line options
-	for(int opt; (opt = getopt(argc, argv, "s:t:h:")) != -1;)
+	for(int opt; (opt = getopt(argc, argv, "s:t:c:h:m:b:")) != -1;)
 	{
 		switch(opt)
 		{
@@ -487,6 +503,10 @@ int main(int argc, char *argv[])
 			case 't':
 				timeout = atoi(optarg);
 				break;
+			// -c SECS : checkpoint interval (in seconds), 0 disables the autosave
+			case 'c':
+				interval = atoi(optarg);
+				break;
 			// -h EXP : highest exponent in the record
 			case 'h':
 				exponent_limit = atoi(optarg);
@@ -496,6 +516,16 @@ int main(int argc, char *argv[])
 					exponent_limit = -1;
 				}
 				break;
+			// -m FILE : merged record of all runs, its eliminations are not tested again
+			case 'm':
+				merged_path = optarg;
+				break;
+			// -b BOUND : the k-sieve removes the candidates with a prime factor below BOUND
+			case 'b':
+				ksieve_bound = atoi(optarg);
+				if( ksieve_bound < 3 )
+					ksieve_bound = 3;
+				break;
 			default :
 				message(WARN "Unknown option :( Read the source code!\n");
 		}
@@ -514,7 +544,40 @@ int main(int argc, char *argv[])
 	}
 
 	// load the record
-	char *record = record_load(&exponent_limit, record_path);
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		exit(0);
+	}
+
+	// checkpoints of the record
+	struct mp_checkpoint cp;
+	if( mp_checkpoint_init(&cp, &record, "sieve.state", interval) )
+	{
+		exit(0);
+	}
+
+	// certificates of the eliminations
+	struct mp_journal journal;
+	if( mp_journal_open_record(&journal, record_path) )
+	{
+		exit(0);
+	}
+	cp.journal = &journal;
+
+	// bits set from now on are exchanged as a delta, appended to the one not shipped yet
+	struct mp_delta delta;
+	if( mp_delta_init(&delta, &record) )
+	{
+		exit(0);
+	}
+	cp.delta = &delta;
+
+	// replay an interrupted checkpoint, the replayed bits go into the delta too
+	if( mp_checkpoint_recover(&cp) < 0 )
+	{
+		exit(0);
+	}
 
 	// create prime table
 	char *primes = (char *)load_prime_table(exponent_limit);
@@ -524,9 +587,27 @@ int main(int argc, char *argv[])
 		save_prime_table((uint8_t *)primes, exponent_limit);
 	}
 
+	// skip the factors of the eliminated exponents
+	struct mp_prune prune;
+	if( mp_prune_init(&prune, &record, (const uint8_t *)primes, exponent_limit, merged_path) )
+	{
+		exit(0);
+	}
+
 	// load the state
 	state_load(&init_state);
 
+	// candidates with small factors are removed in segments
+	struct ksieve ks;
+	ksieve_init(&ks, ksieve_bound);
+
+	// the primes of q-1 are listed in segments too
+	struct mp_prune_block block1, block7;
+	if( mp_prune_block_init(&block1, &prune, +INT64_1) || mp_prune_block_init(&block7, &prune, -INT64_1) )
+	{
+		exit(0);
+	}
+
 	// set SIGINT, SIGALRM, SIGUSR1, SIGUSR2, and SIGTERM signal handlers
 	signal(SIGINT,  sighandler_int); // exit immediately
 	signal(SIGALRM, sighandler_alrm); // save the record and state, exit
@@ -541,10 +622,25 @@ int main(int argc, char *argv[])
 		alarm(timeout);
 	}
 
-	// start a loop
-	sieve(record, init_state, exponent_limit, record_path, primes);
+	// start the background thread for snapshots
+	struct mp_worker worker;
+	if( mp_worker_start(&worker) )
+	{
+		exit(0);
+	}
 
-	free(record);
+	// start a loop
+	sieve(&record, &cp, &worker, &prune, &block1, &block7, &ks, init_state, exponent_limit, primes);
+
+	mp_worker_stop(&worker);
+	mp_checkpoint_free(&cp);
+	mp_journal_close(&journal);
+	mp_delta_free(&delta);
+	mp_prune_block_free(&block1);
+	mp_prune_block_free(&block7);
+	mp_prune_free(&prune);
+	ksieve_free(&ks);
+	mp_record_close(&record);
 	free(primes);
 
 	message("The program has finished successfully.\n");
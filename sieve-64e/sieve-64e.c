@@ -10,6 +10,13 @@
 #include <stdarg.h>
 #include <string.h>
 #include <libmp.h>
+#include <record.h>
+#include <checkpoint.h>
+#include <worker.h>
+#include <journal.h>
+#include <delta.h>
+#include <prune.h>
+#include <prefilter.h>
 
 int g_term = 0;
 int g_info = 0;
@@ -96,6 +103,13 @@ int get_bit(const char *ptr, int i)
 	return ptr[i/8] & 1 << i%8;
 }
 
+// the record is read while the sieve sets bits in it
+static
+int get_bit_relaxed(const char *ptr, int i)
+{
+	return __atomic_load_n(&ptr[i/8], __ATOMIC_RELAXED) & 1 << i%8;
+}
+
 static
 int is_prime(int p, const char *primes)
 {
@@ -142,7 +156,7 @@ void summary(const char *record, int exponent_limit, const char *primes)
 			prime_total++;
 
 			// if dirty
-			if( get_bit(record, n) )
+			if( get_bit_relaxed(record, n) )
 			{
 				prime_eliminated++;
 
@@ -163,7 +177,7 @@ void summary(const char *record, int exponent_limit, const char *primes)
 			composite_total++;
 
 			// if dirty
-			if( get_bit(record, n) )
+			if( get_bit_relaxed(record, n) )
 			{
 				composite_dirty++;
 			}
@@ -175,36 +189,18 @@ void summary(const char *record, int exponent_limit, const char *primes)
 	);
 }
 
-// save the record
-void record_save(char *record, int exponent_limit, const char *record_path)
-{
-	message("Saving the record to '%s'...\n", record_path);
-
-	// remove backup copy
-	char backup_path[4096];
-	sprintf(backup_path, "%s.bak", record_path);
-	unlink(backup_path);
+struct summary_args {
+	const char *record;
+	int exponent_limit;
+	const char *primes;
+};
 
-	// rename a previous record
-	rename(record_path, backup_path);
-
-	// create new record
-	FILE *record_file = fopen(record_path, "w");
-	if( NULL == record_file )
-	{
-		message(ERR "Unable to save the record :(\n");
-		return;
-	}
-
-	// loop over the record
-	if( (size_t)(exponent_limit+7)/8 != fwrite(record, (size_t)1, (size_t)(exponent_limit+7)/8, record_file) )
-	{
-		message(ERR "Unable to write into the record :( The file is incomplete!\n");
-	}
-
-	fclose(record_file);
+// gather the progress overview on the worker thread, approximate as the bits set during the pass may or may not be counted
+void summary_job(void *ptr)
+{
+	const struct summary_args *args = ptr;
 
-	message("The record was saved successfully.\n");
+	summary(args->record, args->exponent_limit, args->primes);
 }
 
 struct timespec g_tp0;
@@ -274,142 +270,95 @@ int64_t int64_random_factor(int n, FILE *random_file)
 	return r*8 + ( (r&1)?(+1):(-1) );
 }
 
-void sieve(char *record, int exponent_limit, const char *record_path, const char *primes, FILE *random_file)
+// candidates drawn at once
+#define BATCH 64
+
+void sieve(struct mp_record *record, struct mp_checkpoint *cp, struct mp_worker *worker, struct mp_prune *prune, int exponent_limit, const char *primes, FILE *random_file)
 {
+	struct summary_args args = { (const char *)record->bits, exponent_limit, primes };
+
 	clock_gettime(CLOCK_REALTIME, &g_tp0);
 
+	struct mp_prefilter prefilter;
+	mp_prefilter_init(&prefilter);
+
 	message("sieving...\n");
 
 	int64_t states = INT64_0;
-	for(;; states++)
+	for(;; states += BATCH)
 	{
-		// random difficulty level
-		int n = random_difficulty(random_file);
-
-		int64_t factor = int64_random_factor(n, random_file);
-
-		mp_int64_test_prtest((uint8_t *)record, factor, exponent_limit, (const uint8_t *)primes);
-
-		if( g_term )
-		{
-			// exit the program
-			break;
-		}
+		int64_t factors[BATCH];
 
-		if( g_save )
+		for(int i = 0; i < BATCH; i++)
 		{
-			// save the record and state...
-			record_save(record, exponent_limit, record_path);
+			// random difficulty level
+			int n = random_difficulty(random_file);
 
-			g_save = 0;
+			factors[i] = int64_random_factor(n, random_file);
 		}
 
-		if( g_info )
-		{
-			message("%" PRId64 " random states tested so far.\n", states);
+		// throw away the candidates with a small prime factor
+		size_t count = mp_prefilter_int64(&prefilter, factors, BATCH, factors);
 
-			// gather and print a progress overview
-			summary(record, exponent_limit, primes);
+		for(size_t i = 0; i < count; i++)
+		{
+			// only the clean exponents
+			int exponent = mp_prune_int64_prtest(prune, factors[i]);
 
-			clock_dump(states);
+			if( exponent )
+			{
+				// mark the M(exponent) as dirty
+				mp_record_set_bit(record, exponent);
 
-			g_info = 0;
+				mp_journal_add64(cp->journal, exponent, (uint64_t)factors[i]);
+			}
 		}
-	}
 
-	// save the record and state
-	record_save(record, exponent_limit, record_path);
-	clock_dump(states);
-
-	// gather and print a progress overview
-	summary(record, exponent_limit, primes);
-}
-
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
-{
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
-	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
+		if( g_term )
 		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
+			// exit the program
+			break;
 		}
 
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
+		if( g_save || mp_checkpoint_due(cp) )
 		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
+			// snapshot the record and state, the worker writes them out (retried while it is busy)
+			if( 0 == mp_checkpoint_commit_async(cp, worker, INT64_0) )
+				g_save = 0;
 		}
 
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
-	}
-	else
-	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
-
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
+		if( mp_prune_due(prune) )
 		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
+			// pick up the exponents eliminated elsewhere
+			mp_prune_reload(prune);
 		}
 
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-		if( *p_exponent_limit > detected_exponent_limit )
+		if( g_info && !mp_worker_busy(worker) )
 		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
+			message("%" PRId64 " random states tested so far.\n", states);
 
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
+			// gather and print a progress overview in the background
+			mp_worker_submit(worker, summary_job, &args);
 
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+			clock_dump(states);
+			mp_prefilter_dump(&prefilter);
+			mp_prune_dump(prune);
 
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
-		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
+			g_info = 0;
 		}
+	}
 
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+	// wait for a snapshot in progress
+	mp_worker_wait(worker);
 
-		fclose(record_file);
-	}
+	// save the record and state
+	mp_checkpoint_fold(cp, INT64_0);
+	clock_dump(states);
+	mp_prefilter_dump(&prefilter);
+	mp_prune_dump(prune);
 
-	return record;
+	// gather and print a progress overview
+	summary((const char *)record->bits, exponent_limit, primes);
 }
 
 int main(int argc, char *argv[])
@@ -418,11 +367,13 @@ int main(int argc, char *argv[])
 
 	// default options
 	unsigned int timeout = 0; // no limit
+	int interval = 60; // checkpoint every minute
 	int exponent_limit = -1;
 	const char *record_path = "record.bits";
+	const char *merged_path = NULL;
 
 	// parse command-line options
-	for(int opt; (opt = getopt(argc, argv, "t:h:")) != -1;)
+	for(int opt; (opt = getopt(argc, argv, "t:c:h:m:")) != -1;)
 	{
 		switch(opt)
 		{
@@ -430,6 +381,10 @@ int main(int argc, char *argv[])
 			case 't':
 				timeout = atoi(optarg);
 				break;
+			// -c SECS : checkpoint interval (in seconds), 0 disables the autosave
+			case 'c':
+				interval = atoi(optarg);
+				break;
 			// -h EXP : highest exponent in the record
 			case 'h':
 				exponent_limit = atoi(optarg);
@@ -439,6 +394,10 @@ int main(int argc, char *argv[])
 					exponent_limit = -1;
 				}
 				break;
+			// -m FILE : merged record of all runs, its eliminations are not tested again
+			case 'm':
+				merged_path = optarg;
+				break;
 			default :
 				message(WARN "Unknown option :( Read the source code!\n");
 		}
@@ -457,7 +416,40 @@ int main(int argc, char *argv[])
 	}
 
 	// load the record
-	char *record = record_load(&exponent_limit, record_path);
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		exit(0);
+	}
+
+	// checkpoints of the record
+	struct mp_checkpoint cp;
+	if( mp_checkpoint_init(&cp, &record, NULL, interval) )
+	{
+		exit(0);
+	}
+
+	// certificates of the eliminations
+	struct mp_journal journal;
+	if( mp_journal_open_record(&journal, record_path) )
+	{
+		exit(0);
+	}
+	cp.journal = &journal;
+
+	// bits set from now on are exchanged as a delta, appended to the one not shipped yet
+	struct mp_delta delta;
+	if( mp_delta_init(&delta, &record) )
+	{
+		exit(0);
+	}
+	cp.delta = &delta;
+
+	// replay an interrupted checkpoint, the replayed bits go into the delta too
+	if( mp_checkpoint_recover(&cp) < 0 )
+	{
+		exit(0);
+	}
 
 	// create prime table
 	char *primes = (char *)load_prime_table(exponent_limit);
@@ -467,6 +459,13 @@ int main(int argc, char *argv[])
 		save_prime_table((uint8_t *)primes, exponent_limit);
 	}
 
+	// skip the factors of the eliminated exponents
+	struct mp_prune prune;
+	if( mp_prune_init(&prune, &record, (const uint8_t *)primes, exponent_limit, merged_path) )
+	{
+		exit(0);
+	}
+
 	FILE *random_file = fopen("/dev/urandom", "r");
 	if( NULL == random_file )
 	{
@@ -488,12 +487,24 @@ int main(int argc, char *argv[])
 		alarm(timeout);
 	}
 
+	// start the background thread for snapshots
+	struct mp_worker worker;
+	if( mp_worker_start(&worker) )
+	{
+		exit(0);
+	}
+
 	// start a loop
-	sieve(record, exponent_limit, record_path, primes, random_file);
+	sieve(&record, &cp, &worker, &prune, exponent_limit, primes, random_file);
 
 	fclose(random_file);
 
-	free(record);
+	mp_worker_stop(&worker);
+	mp_checkpoint_free(&cp);
+	mp_journal_close(&journal);
+	mp_delta_free(&delta);
+	mp_prune_free(&prune);
+	mp_record_close(&record);
 	free(primes);
 
 	message("The program has finished successfully.\n");
@@ -0,0 +1,698 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <assert.h>
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <libmp.h>
+#include <record.h>
+#include <checkpoint.h>
+#include <worker.h>
+#include <journal.h>
+#include <delta.h>
+#include <mont.h>
+
+int g_term = 0;
+int g_info = 0;
+int g_save = 0;
+
+void sighandler_int(int signum)
+{
+	(void)signum;
+	exit(0);
+}
+
+void sighandler_alrm(int signum)
+{
+	(void)signum;
+	g_term = 1;
+}
+
+void sighandler_term(int signum)
+{
+	(void)signum;
+	g_term = 1;
+
+	// set the signal handler again
+	signal(SIGTERM, sighandler_term);
+}
+
+void sighandler_usr1(int signum)
+{
+	(void)signum;
+	g_info = 1;
+
+	// set the signal handler again
+	signal(SIGUSR1, sighandler_usr1);
+}
+
+void sighandler_usr2(int signum)
+{
+	(void)signum;
+	g_save = 1;
+
+	// set the signal handler again
+	signal(SIGUSR2, sighandler_usr2);
+}
+
+// exponents per segment, a multiple of 64
+#define SEGMENT (1 << 18)
+
+// candidates powered at once
+#define BATCH 1024
+
+/**
+ * A pass fixes k and goes over all the exponents n below the limit at once:
+ * q = 2kn+1 has the prime factor r iff n == -1/(2k) (mod r), so the small
+ * factors of q are sieved out along arithmetic progressions of n. Only the
+ * prime n still clean in the record and with q == +-1 (mod 8) are left, and
+ * 2^n (mod q) of those is computed in batches, a lane per exponent. If it is
+ * one, q divides M(n). A composite q is not missed this way: its prime
+ * factors divide M(n) as well, and they have been found by the passes of
+ * the smaller k. There is no discrete logarithm at all. The passes are run
+ * in parallel, a thread per k; the state is the lowest k whose pass has not
+ * been finished.
+ */
+struct ksieve {
+	struct mp_record *record;
+	struct mp_journal *journal;
+	pthread_mutex_t mutex; // of the journal and of the k handed out
+	const uint8_t *primes;
+	int exponent_limit;
+	uint32_t *sieve_primes; // 3 and above
+	size_t count;
+	int64_t next; // the next k
+	int64_t k_max;
+	int stop;
+	int running;
+	uint64_t passes;
+	uint64_t tested;
+	uint64_t eliminated;
+};
+
+struct kthread {
+	struct ksieve *ks;
+	pthread_t thread;
+	int64_t k; // in progress, INT64_MAX if none
+	uint32_t *offsets; // the next exponent marked by each prime
+	uint64_t bits[SEGMENT/64];
+	size_t len;
+	uint64_t n[BATCH];
+	uint64_t q[BATCH];
+	uint64_t r[BATCH];
+};
+
+static
+int get_bit(const uint8_t *ptr, int i)
+{
+	return ptr[i/8] & 1 << i%8;
+}
+
+// the word w of a bitmap of the given size in bytes, zeros beyond
+static
+uint64_t load_word(const uint8_t *ptr, size_t w, size_t size)
+{
+	uint64_t x = 0;
+	size_t offset = w * 8;
+
+	if( offset < size )
+		memcpy(&x, ptr + offset, size - offset < 8 ? size - offset : 8);
+
+	return x;
+}
+
+// 1/a (mod r), a and r coprime
+static
+uint32_t uint32_inv_mod(uint32_t a, uint32_t r)
+{
+	int64_t t = 0, new_t = 1;
+	int64_t s = r, new_s = a;
+
+	while( new_s )
+	{
+		int64_t quotient = s / new_s, tmp;
+
+		tmp = t - quotient * new_t; t = new_t; new_t = tmp;
+		tmp = s - quotient * new_s; s = new_s; new_s = tmp;
+	}
+
+	return (uint32_t)(t < 0 ? t + r : t);
+}
+
+// there is no q == +-1 (mod 8) for k == 2 (mod 4)
+static
+int64_t next_k(int64_t k)
+{
+	return k % 4 == 1 ? k + 2 : k + 1;
+}
+
+static
+int64_t valid_k(int64_t k)
+{
+	return k % 4 == 2 ? k + 1 : k;
+}
+
+static
+int ksieve_init(struct ksieve *ks, struct mp_record *record, struct mp_journal *journal, const uint8_t *primes, int exponent_limit, int64_t init_k, int64_t k_max, uint32_t bound)
+{
+	ks->record = record;
+	ks->journal = journal;
+	ks->primes = primes;
+	ks->exponent_limit = exponent_limit;
+	ks->next = valid_k(init_k);
+	ks->k_max = k_max;
+	ks->stop = 0;
+	ks->running = 0;
+	ks->passes = 0;
+	ks->tested = 0;
+	ks->eliminated = 0;
+	ks->count = 0;
+	ks->sieve_primes = malloc((bound / 2 + 1) * sizeof(uint32_t));
+
+	if( NULL == ks->sieve_primes )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return -1;
+	}
+
+	for(uint32_t r = 3; r < bound && r < (uint32_t)exponent_limit; r += 2)
+	{
+		if( !get_bit(primes, (int)r) )
+			ks->sieve_primes[ks->count++] = r;
+	}
+
+	pthread_mutex_init(&ks->mutex, NULL);
+
+	return 0;
+}
+
+static
+void ksieve_free(struct ksieve *ks)
+{
+	pthread_mutex_destroy(&ks->mutex);
+
+	free(ks->sieve_primes);
+}
+
+// power the batch, set the bits of the eliminated exponents
+static
+void kthread_flush(struct kthread *th)
+{
+	struct ksieve *ks = th->ks;
+
+	mp_uint64_pow2_mod_batch(th->len, th->q, th->n, th->r);
+
+	for(size_t i = 0; i < th->len; i++)
+	{
+		if( 1 == th->r[i] && 0 == mp_record_set_bit(ks->record, (int)th->n[i]) )
+		{
+			__atomic_fetch_add(&ks->eliminated, 1, __ATOMIC_RELAXED);
+
+			pthread_mutex_lock(&ks->mutex);
+			mp_journal_add64(ks->journal, (int)th->n[i], th->q[i]);
+			pthread_mutex_unlock(&ks->mutex);
+		}
+	}
+
+	__atomic_fetch_add(&ks->tested, th->len, __ATOMIC_RELAXED);
+
+	th->len = 0;
+}
+
+// all the exponents for the given k, returns 0 if it was interrupted
+static
+int kthread_pass(struct kthread *th, int64_t k)
+{
+	struct ksieve *ks = th->ks;
+	uint64_t k2 = 2 * (uint64_t)k;
+	size_t size = ks->record->size;
+
+	// n == -1/(2k) (mod r), the prime q == r itself is kept
+	for(size_t m = 0; m < ks->count; m++)
+	{
+		uint32_t r = ks->sieve_primes[m];
+		uint32_t a = (uint32_t)(k2 % r);
+
+		if( 0 == a )
+		{
+			th->offsets[m] = UINT32_MAX;
+			continue;
+		}
+
+		uint32_t root = r - uint32_inv_mod(a, r);
+
+		if( k2 * root + 1 == r )
+			root += r;
+
+		th->offsets[m] = root;
+	}
+
+	// q == +-1 (mod 8): any odd n for k == 0 (mod 4), otherwise kn == 3 (mod 4)
+	uint64_t pattern = k % 4 == 0 ? UINT64_C(0xaaaaaaaaaaaaaaaa) : (k % 4 == 1 ? UINT64_C(0x8888888888888888) : UINT64_C(0x2222222222222222));
+
+	for(uint32_t base = 0; base < (uint32_t)ks->exponent_limit; base += SEGMENT)
+	{
+		uint32_t len = (uint32_t)ks->exponent_limit - base < SEGMENT ? (uint32_t)ks->exponent_limit - base : SEGMENT;
+
+		memset(th->bits, 0, (len + 63) / 64 * sizeof(uint64_t));
+
+		for(size_t m = 0; m < ks->count; m++)
+		{
+			uint32_t r = ks->sieve_primes[m];
+			uint32_t i = th->offsets[m];
+
+			if( UINT32_MAX == i )
+				continue;
+
+			for(; i < len; i += r)
+				th->bits[i/64] |= UINT64_C(1) << i%64;
+
+			th->offsets[m] = i - len;
+		}
+
+		// the clean prime exponents left
+		for(uint32_t w = 0; w < (len + 63) / 64; w++)
+		{
+			size_t word = base / 64 + w;
+			uint64_t x = ~th->bits[w] & pattern & ~load_word(ks->primes, word, size) & ~load_word(ks->record->bits, word, size);
+
+			if( w == len / 64 )
+				x &= (UINT64_C(1) << len%64) - 1;
+
+			for(; x; x &= x - 1)
+			{
+				uint64_t n = base + w * 64 + (uint32_t)__builtin_ctzll(x);
+				uint64_t q = k2 * n + 1;
+
+				// M(n) itself
+				if( n < 3 || (n < 64 && q == (UINT64_C(1) << n) - 1) )
+					continue;
+
+				th->n[th->len] = n;
+				th->q[th->len] = q;
+
+				if( ++th->len == BATCH )
+					kthread_flush(th);
+			}
+		}
+
+		if( __atomic_load_n(&ks->stop, __ATOMIC_RELAXED) )
+		{
+			th->len = 0;
+			return 0;
+		}
+	}
+
+	kthread_flush(th);
+
+	return 1;
+}
+
+static
+void *kthread_main(void *arg)
+{
+	struct kthread *th = arg;
+	struct ksieve *ks = th->ks;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&ks->mutex);
+		int64_t k = ks->next <= ks->k_max && !ks->stop ? ks->next : INT64_MAX;
+		if( INT64_MAX != k )
+			ks->next = next_k(k);
+		th->k = k;
+		pthread_mutex_unlock(&ks->mutex);
+
+		if( INT64_MAX == k || !kthread_pass(th, k) )
+			break;
+
+		__atomic_fetch_add(&ks->passes, 1, __ATOMIC_RELAXED);
+
+		pthread_mutex_lock(&ks->mutex);
+		th->k = INT64_MAX;
+		pthread_mutex_unlock(&ks->mutex);
+	}
+
+	__atomic_fetch_sub(&ks->running, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+// the lowest k whose pass has not been finished, the mutex is held
+static
+int64_t ksieve_state(struct ksieve *ks, const struct kthread *ths, int threads)
+{
+	int64_t state = ks->next;
+
+	for(int t = 0; t < threads; t++)
+	{
+		if( ths[t].k < state )
+			state = ths[t].k;
+	}
+
+	return state;
+}
+
+struct timespec g_tp0;
+
+void clock_dump(const struct ksieve *ks, int64_t init_state, int64_t state)
+{
+	struct timespec tp1;
+
+	clock_gettime(CLOCK_REALTIME, &tp1);
+
+	int64_t secs_elapsed = (int64_t)tp1.tv_sec - (int64_t)g_tp0.tv_sec;
+
+	float secs_per_state = state > init_state ? secs_elapsed/(float)(state - init_state) : 0.f;
+
+	message("%" PRId64 " seconds elapsed (%f secs per each state).\n",
+		secs_elapsed,
+		secs_per_state
+	);
+
+	message("%" PRIu64 " passes, %" PRIu64 " candidates powered, %" PRIu64 " exponents eliminated.\n",
+		__atomic_load_n(&ks->passes, __ATOMIC_RELAXED),
+		__atomic_load_n(&ks->tested, __ATOMIC_RELAXED),
+		__atomic_load_n(&ks->eliminated, __ATOMIC_RELAXED)
+	);
+}
+
+void sieve(struct ksieve *ks, struct mp_checkpoint *cp, struct mp_worker *worker, int threads)
+{
+	int64_t init_state = ks->next;
+	int64_t state = init_state;
+
+	clock_gettime(CLOCK_REALTIME, &g_tp0);
+
+	message("sieving %zu primes below the exponent limit %i...\n", ks->count, ks->exponent_limit);
+
+	struct kthread *ths = malloc((size_t)threads * sizeof(struct kthread));
+
+	if( NULL == ths )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		return;
+	}
+
+	int started = 0;
+
+	ks->running = threads;
+
+	for(int t = 0; t < threads; t++)
+	{
+		ths[t].ks = ks;
+		ths[t].k = INT64_MAX;
+		ths[t].len = 0;
+		ths[t].offsets = malloc(ks->count * sizeof(uint32_t) + 1);
+
+		if( NULL == ths[t].offsets || pthread_create(&ths[t].thread, NULL, kthread_main, &ths[t]) )
+		{
+			message(ERR "Unable to start a thread :(\n");
+			__atomic_store_n(&ks->stop, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_sub(&ks->running, threads - t, __ATOMIC_RELEASE);
+			free(ths[t].offsets);
+			break;
+		}
+
+		started++;
+	}
+
+	while( __atomic_load_n(&ks->running, __ATOMIC_ACQUIRE) > 0 )
+	{
+		struct timespec ts = { 0, 100000000 };
+
+		nanosleep(&ts, NULL);
+
+		if( g_term )
+		{
+			// exit the program
+			__atomic_store_n(&ks->stop, 1, __ATOMIC_RELAXED);
+		}
+
+		if( g_save || mp_checkpoint_due(cp) )
+		{
+			pthread_mutex_lock(&ks->mutex);
+
+			state = ksieve_state(ks, ths, started);
+
+			// snapshot the record and state, the worker writes them out (retried while it is busy)
+			if( 0 == mp_checkpoint_commit_async(cp, worker, state) )
+				g_save = 0;
+
+			pthread_mutex_unlock(&ks->mutex);
+		}
+
+		if( g_info )
+		{
+			pthread_mutex_lock(&ks->mutex);
+			state = ksieve_state(ks, ths, started);
+			pthread_mutex_unlock(&ks->mutex);
+
+			message("Current state is %" PRId64 ".\n", state);
+
+			clock_dump(ks, init_state, state);
+
+			g_info = 0;
+		}
+	}
+
+	for(int t = 0; t < started; t++)
+	{
+		pthread_join(ths[t].thread, NULL);
+	}
+
+	state = ksieve_state(ks, ths, started);
+
+	for(int t = 0; t < started; t++)
+	{
+		free(ths[t].offsets);
+	}
+
+	free(ths);
+
+	// wait for a snapshot in progress
+	mp_worker_wait(worker);
+
+	// save the record and state
+	mp_checkpoint_fold(cp, state);
+
+	message("Current state is %" PRId64 ".\n", state);
+
+	clock_dump(ks, init_state, state);
+}
+
+// load the state
+void state_load(int64_t *p_init_state)
+{
+	FILE *state_file = fopen("sieve.state", "rb");
+	if( NULL == state_file )
+	{
+		// init_state is unset, use default
+		if( INT64_0 == *p_init_state )
+		{
+			*p_init_state = INT64_1;
+		}
+
+		message("There is no state to restore, starting from %" PRId64 "...\n", *p_init_state);
+	}
+	else
+	{
+		if( INT64_0 != *p_init_state )
+		{
+			message(WARN "Overwriting the saved state, now starting from %" PRId64 "...\n", *p_init_state);
+		}
+		else
+		{
+			// load sieve.state (or fallback to default)
+			if( fscanf(state_file, "%" PRId64, p_init_state) < 0 )
+			{
+				message(ERR "Unable to read the state :( Falling back to the default one.\n");
+				*p_init_state = INT64_1;
+			}
+
+			message("Starting from the previous state %" PRId64 "...\n", *p_init_state);
+		}
+
+		fclose(state_file);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	message("%s: Sieve of Mersenne exponents, k-major test\n", argv[0]);
+
+	// default options
+	int64_t init_state = INT64_0;
+	int64_t k_max = INT64_0; // as far as q fits
+	unsigned int timeout = 0; // no limit
+	int interval = 60; // checkpoint every minute
+	int exponent_limit = -1;
+	const char *record_path = "record.bits";
+	int bound = 1 << 16;
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	// parse command-line options
+	for(int opt; (opt = getopt(argc, argv, "s:k:t:c:h:b:j:")) != -1;)
+	{
+		switch(opt)
+		{
+			// -s STATE : start test at the exact k
+			case 's':
+				init_state = atoll(optarg);
+				if( init_state < INT64_1 )
+				{
+					message(WARN "Invalid state, keeping the default one!\n");
+					init_state = INT64_0;
+				}
+				break;
+			// -k K : stop after the pass of the given k
+			case 'k':
+				k_max = atoll(optarg);
+				break;
+			// -t SECS : terminate test after given time limit (in seconds)
+			case 't':
+				timeout = atoi(optarg);
+				break;
+			// -c SECS : checkpoint interval (in seconds), 0 disables the autosave
+			case 'c':
+				interval = atoi(optarg);
+				break;
+			// -h EXP : highest exponent in the record
+			case 'h':
+				exponent_limit = atoi(optarg);
+				if( exponent_limit < 2 )
+				{
+					message(WARN "Invalid exponent, keeping the default one!\n");
+					exponent_limit = -1;
+				}
+				break;
+			// -b BOUND : remove the candidates with a prime factor below BOUND
+			case 'b':
+				bound = atoi(optarg);
+				if( bound < 3 )
+					bound = 3;
+				break;
+			// -j THREADS : number of threads
+			case 'j':
+				threads = atoi(optarg);
+				if( threads < 1 )
+					threads = 1;
+				break;
+			default :
+				message(WARN "Unknown option :( Read the source code!\n");
+		}
+	}
+
+	// argument after options
+	if(optind < argc)
+	{
+		// sieve-k [OPTIONS] [record.bits]
+		record_path = argv[optind++];
+
+		if(optind < argc)
+		{
+			message(WARN "Too much options :( Read the source code!\n");
+		}
+	}
+
+	// load the record
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		exit(0);
+	}
+
+	// checkpoints of the record
+	struct mp_checkpoint cp;
+	if( mp_checkpoint_init(&cp, &record, "sieve.state", interval) )
+	{
+		exit(0);
+	}
+
+	// certificates of the eliminations
+	struct mp_journal journal;
+	if( mp_journal_open_record(&journal, record_path) )
+	{
+		exit(0);
+	}
+	cp.journal = &journal;
+
+	// bits set from now on are exchanged as a delta, appended to the one not shipped yet
+	struct mp_delta delta;
+	if( mp_delta_init(&delta, &record) )
+	{
+		exit(0);
+	}
+	cp.delta = &delta;
+
+	// replay an interrupted checkpoint, the replayed bits go into the delta too
+	if( mp_checkpoint_recover(&cp) < 0 )
+	{
+		exit(0);
+	}
+
+	// create prime table
+	uint8_t *primes = load_prime_table(exponent_limit);
+	if( NULL == primes )
+	{
+		primes = gen_prime_table(exponent_limit);
+		save_prime_table(primes, exponent_limit);
+	}
+
+	// load the state
+	state_load(&init_state);
+
+	// q = 2kn+1 below 2^63
+	int64_t k_limit = (INT64_MAX / 2) / exponent_limit - 1;
+
+	if( INT64_0 == k_max || k_max > k_limit )
+	{
+		k_max = k_limit;
+	}
+
+	struct ksieve ks;
+	if( ksieve_init(&ks, &record, &journal, primes, exponent_limit, init_state, k_max, (uint32_t)bound) )
+	{
+		exit(0);
+	}
+
+	// set SIGINT, SIGALRM, SIGUSR1, SIGUSR2, and SIGTERM signal handlers
+	signal(SIGINT,  sighandler_int); // exit immediately
+	signal(SIGALRM, sighandler_alrm); // save the record and state, exit
+	signal(SIGTERM, sighandler_term); // save the record and state, exit
+	signal(SIGUSR1, sighandler_usr1); // print progress overview
+	signal(SIGUSR2, sighandler_usr2); // save the record and state
+
+	// set the alarm
+	if( timeout > 0 )
+	{
+		message("Setting an alarm to be delivered in %i seconds...\n", timeout);
+		alarm(timeout);
+	}
+
+	// start the background thread for snapshots
+	struct mp_worker worker;
+	if( mp_worker_start(&worker) )
+	{
+		exit(0);
+	}
+
+	// start the passes
+	sieve(&ks, &cp, &worker, threads);
+
+	mp_worker_stop(&worker);
+	mp_checkpoint_free(&cp);
+	mp_journal_close(&journal);
+	mp_delta_free(&delta);
+	ksieve_free(&ks);
+	mp_record_close(&record);
+	free(primes);
+
+	message("The program has finished successfully.\n");
+
+	return 0;
+}
@@ -0,0 +1,17 @@
+#!/bin/bash
+#
+#$ -N sieve-k
+#$ -o sieve/sieve-k/logs/$JOB_NAME.$JOB_ID.out
+#$ -e sieve/sieve-k/logs/$JOB_NAME.$JOB_ID.err
+
+# log a node name
+uname -n
+
+# change working directory to store a state/record to the right place
+cd $HOME/sieve/sieve-k/
+
+# limit job to one hour
+./sieve-k -t 3600
+
+# submit again
+qsub -q all.q@@stable -l ram_free=512M $HOME/sieve/sieve-k/submit.sh
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <bitmap.h>
+
+static
+int get_bit(const uint8_t *ptr, size_t i)
+{
+	return ptr[i/8] & 1 << i%8;
+}
+
+int main()
+{
+	enum { SIZE = 4099 };
+
+	uint8_t *a = malloc(SIZE), *b = malloc(SIZE), *m = malloc(SIZE), *t = malloc(SIZE);
+	uint32_t out[64];
+
+	assert( a && b && m && t );
+
+	srand(1);
+
+	for(size_t i = 0; i < SIZE; i++)
+	{
+		a[i] = (uint8_t)rand();
+		b[i] = (uint8_t)rand();
+		m[i] = (uint8_t)(rand() & rand());
+	}
+
+	// ranges of all kinds of alignment
+	for(size_t begin = 0; begin < 200; begin += 7)
+	{
+		for(size_t end = begin; end <= 8*SIZE; end += end < 1200 ? 13 : 997)
+		{
+			size_t c = 0, c_andn = 0, c_mask = 0, c_nor = 0, last = end;
+
+			for(size_t i = begin; i < end; i++)
+			{
+				c += !!get_bit(a, i);
+				c_andn += get_bit(a, i) && !get_bit(b, i);
+				c_mask += get_bit(a, i) && !get_bit(b, i) && !get_bit(m, i);
+				c_nor += !get_bit(a, i) && !get_bit(m, i);
+
+				if( get_bit(a, i) && !get_bit(b, i) && !get_bit(m, i) )
+					last = i;
+			}
+
+			assert( c == mp_bitmap_popcount(a, begin, end) );
+			assert( c_andn == mp_bitmap_popcount_andn(a, b, NULL, begin, end) );
+			assert( c_mask == mp_bitmap_popcount_andn(a, b, m, begin, end) );
+			assert( c_nor == mp_bitmap_popcount_nor(a, m, begin, end) );
+			assert( last == mp_bitmap_last_andn(a, b, m, begin, end) );
+
+			// extract in small pieces
+			size_t pos = begin, prev = begin, total = 0;
+
+			for(size_t n; (n = mp_bitmap_extract_nor(a, m, &pos, end, out, 64)) > 0; total += n)
+			{
+				for(size_t j = 0; j < n; j++)
+				{
+					for(; prev < out[j]; prev++)
+						assert( !(!get_bit(a, prev) && !get_bit(m, prev)) );
+
+					assert( !get_bit(a, out[j]) && !get_bit(m, out[j]) );
+					prev = out[j] + 1;
+				}
+			}
+
+			assert( total == c_nor && pos == end );
+		}
+	}
+
+	// in-place operations against the byte loops
+	for(size_t size = 0; size < 300; size++)
+	{
+		memcpy(t, a, SIZE);
+		mp_bitmap_or(t, b, size);
+		for(size_t i = 0; i < SIZE; i++)
+			assert( t[i] == (i < size ? (a[i] | b[i]) : a[i]) );
+
+		memcpy(t, a, SIZE);
+		mp_bitmap_xor(t, b, size);
+		for(size_t i = 0; i < SIZE; i++)
+			assert( t[i] == (i < size ? (a[i] ^ b[i]) : a[i]) );
+
+		memcpy(t, a, SIZE);
+		mp_bitmap_andn(t, b, size);
+		for(size_t i = 0; i < SIZE; i++)
+			assert( t[i] == (i < size ? (a[i] & (uint8_t)~b[i]) : a[i]) );
+	}
+
+	free(a);
+	free(b);
+	free(m);
+	free(t);
+
+	printf("OK\n");
+
+	return 0;
+}
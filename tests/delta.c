@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <libmp.h>
+#include <record.h>
+#include <checkpoint.h>
+#include <delta.h>
+
+// read the delta back, returns the number of exponents
+static
+int read_delta(const char *path, int *list, int max, uint32_t *base_crc)
+{
+	struct mp_delta_reader reader;
+	int count = 0;
+	int n;
+
+	assert( 0 == mp_delta_reader_open(&reader, path) );
+
+	while( mp_delta_next(&reader, &n) > 0 )
+	{
+		assert( count < max );
+		list[count++] = n;
+	}
+
+	*base_crc = reader.base_crc;
+
+	mp_delta_reader_close(&reader);
+
+	return count;
+}
+
+static
+int contains(const int *list, int count, int n)
+{
+	for(int i = 0; i < count; i++)
+		if( list[i] == n )
+			return 1;
+
+	return 0;
+}
+
+int main()
+{
+	const char *path = "delta-test.bits";
+	const char *delta_path = "delta-test.bits.delta";
+	const char *wal_path = "delta-test.bits.wal";
+	int exponent_limit = 100000;
+	int list[100000];
+	uint32_t base_crc;
+
+	unlink(path);
+	unlink(delta_path);
+	unlink(wal_path);
+
+	struct mp_record record;
+	struct mp_checkpoint cp;
+	struct mp_delta delta;
+
+	// the base has 3 and 5
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDWR) );
+	mp_record_set_bit(&record, 3);
+	mp_record_set_bit(&record, 5);
+
+	uint32_t crc = mp_crc32(0, record.bits, record.size);
+
+	assert( 0 == mp_checkpoint_init(&cp, &record, NULL, 0) );
+	assert( 0 == mp_delta_init(&delta, &record) );
+	cp.delta = &delta;
+
+	mp_record_set_bit(&record, 7);
+	mp_record_set_bit(&record, 50000);
+
+	// the write-ahead file is left behind as by a killed run
+	assert( 0 == mp_checkpoint_commit(&cp, 1) );
+	assert( 2 == read_delta(delta_path, list, 100000, &base_crc) );
+	assert( 7 == list[0] && 50000 == list[1] );
+	assert( crc == base_crc );
+
+	mp_delta_free(&delta);
+	mp_checkpoint_free(&cp);
+	mp_record_close(&record);
+
+	// the next run appends to the delta and keeps its base, the replayed chunks go into it too
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDWR) );
+	assert( 0 == mp_checkpoint_init(&cp, &record, NULL, 0) );
+	assert( 0 == mp_delta_init(&delta, &record) );
+	cp.delta = &delta;
+
+	mp_record_set_bit(&record, 99991);
+
+	assert( 1 == mp_checkpoint_recover(&cp) );
+	assert( 0 != access(wal_path, F_OK) );
+
+	int count = read_delta(delta_path, list, 100000, &base_crc);
+
+	assert( crc == base_crc );
+	assert( contains(list, count, 7) && contains(list, count, 50000) && contains(list, count, 99991) );
+
+	for(int i = 1; i < count; i++)
+		assert( list[i-1] < list[i] );
+
+	mp_delta_free(&delta);
+	mp_checkpoint_free(&cp);
+	mp_record_close(&record);
+
+	// a run with a smaller limit keeps the exponents above it
+	exponent_limit = 40000;
+
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDWR) );
+	assert( 0 == mp_checkpoint_init(&cp, &record, NULL, 0) );
+	assert( 0 == mp_delta_init(&delta, &record) );
+	cp.delta = &delta;
+
+	mp_record_set_bit(&record, 11);
+
+	assert( 0 == mp_checkpoint_fold(&cp, 2) );
+
+	int count2 = read_delta(delta_path, list, 100000, &base_crc);
+
+	assert( count + 1 == count2 );
+	assert( crc == base_crc );
+	assert( contains(list, count2, 11) && contains(list, count2, 50000) && contains(list, count2, 99991) );
+
+	for(int i = 1; i < count2; i++)
+		assert( list[i-1] < list[i] );
+
+	mp_delta_free(&delta);
+	mp_checkpoint_free(&cp);
+	mp_record_close(&record);
+
+	// once shipped and removed, a new delta starts against the record as it is
+	unlink(delta_path);
+	exponent_limit = 100000;
+
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDWR) );
+	assert( 0 == mp_checkpoint_init(&cp, &record, NULL, 0) );
+	assert( 0 == mp_delta_init(&delta, &record) );
+	cp.delta = &delta;
+
+	crc = mp_crc32(0, record.bits, record.size);
+
+	assert( 0 == mp_checkpoint_fold(&cp, 3) );
+	assert( 0 == read_delta(delta_path, list, 100000, &base_crc) );
+	assert( crc == base_crc );
+
+	mp_delta_free(&delta);
+	mp_checkpoint_free(&cp);
+	mp_record_close(&record);
+
+	unlink(path);
+	unlink(delta_path);
+
+	printf("OK\n");
+
+	return 0;
+}
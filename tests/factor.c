@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+#include <libmp.h>
+#include <factor.h>
+
+static
+uint128_t uint128(uint64_t hi, uint64_t lo)
+{
+	return (uint128_t)hi << 64 | lo;
+}
+
+int main()
+{
+	// BPSW against the trial division
+	for(int128_t n = 0; n < 200000; n++)
+	{
+		assert( mp_uint128_is_prime((uint128_t)n) == (n > 1 && mp_int128_is_prime(n)) );
+	}
+
+	// the pseudoprimes to the base 2
+	assert( !mp_uint128_is_prime(2047) );
+	assert( !mp_uint128_is_prime(3215031751) );
+	assert( !mp_uint128_is_prime(UINT64_C(3825123056546413051)) );
+	assert( !mp_uint128_is_prime((uint128_t)UINT64_C(4294967291) * UINT64_C(4294967279)) );
+
+	// M(61), M(89), M(107), M(127)
+	assert( mp_uint128_is_prime(((uint128_t)1 << 61) - 1) );
+	assert( mp_uint128_is_prime(((uint128_t)1 << 89) - 1) );
+	assert( mp_uint128_is_prime(((uint128_t)1 << 107) - 1) );
+	assert( mp_uint128_is_prime(((uint128_t)1 << 127) - 1) );
+	assert( !mp_uint128_is_prime(((uint128_t)1 << 67) - 1) );
+	assert( !mp_uint128_is_prime(((uint128_t)1 << 101) - 1) );
+
+	// M(67) = 193707721 * 761838257287
+	{
+		uint128_t factors[MP_FACTOR_MAX];
+		int exponents[MP_FACTOR_MAX];
+		uint128_t cofactor;
+
+		int count = mp_uint128_factor(((uint128_t)1 << 67) - 1, factors, exponents, &cofactor, 0);
+
+		assert( 2 == count );
+		assert( 193707721 == factors[0] && 1 == exponents[0] );
+		assert( UINT64_C(761838257287) == factors[1] && 1 == exponents[1] );
+		assert( 1 == cofactor );
+	}
+
+	// 2^100 + 276 = 2^2 * 52203989 * 6070659658921032842417
+	{
+		uint128_t factors[MP_FACTOR_MAX];
+		int exponents[MP_FACTOR_MAX];
+		uint128_t cofactor;
+
+		int count = mp_uint128_factor(((uint128_t)1 << 100) + 276, factors, exponents, &cofactor, 0);
+
+		assert( 3 == count );
+		assert( 2 == factors[0] && 2 == exponents[0] );
+		assert( 52203989 == factors[1] && 1 == exponents[1] );
+		assert( uint128(329, UINT64_C(1680858670590360753)) == factors[2] && 1 == exponents[2] );
+		assert( 1 == cofactor );
+
+		// the cofactor is left unsplit or not
+		count = mp_uint128_factor(((uint128_t)1 << 100) + 276, factors, exponents, &cofactor, 1000);
+
+		uint128_t n = cofactor;
+
+		for(int i = 0; i < count; i++)
+			for(int e = 0; e < exponents[i]; e++)
+				n *= factors[i];
+
+		assert( ((uint128_t)1 << 100) + 276 == n );
+	}
+
+	// the order of 2 against the brute force
+	for(int64_t p = 3; p < 20000; p += 2)
+	{
+		if( !mp_int64_is_prime(p) )
+			continue;
+
+		int128_t t = 1;
+
+		for(int64_t a = 2; a != 1; a = 2 * a % p)
+			t++;
+
+		assert( mp_int128_element2_order(p) == t );
+	}
+
+	// the order of 2 modulo 2^100 + 277 is q-1, modulo 2^126 - 137 it is (q-1)/2
+	assert( mp_int128_element2_order((int128_t)((uint128_t)1 << 100) + 277) == (int128_t)((uint128_t)1 << 100) + 276 );
+	assert( mp_int128_element2_order((int128_t)((uint128_t)1 << 126) - 137) == (int128_t)((uint128_t)1 << 125) - 69 );
+
+	// the factors of M(109), M(137), M(149)
+	assert( 109 == mp_int128_element2_order((int128_t)uint128(47164, UINT64_C(13748606283694915849))) );
+	assert( 109 == mp_int128_element2_order_lim((int128_t)uint128(47164, UINT64_C(13748606283694915849)), 1000) );
+	assert( 137 == mp_int128_element2_order_lim((int128_t)uint128(294, UINT64_C(15699425929596115055)), 1000) );
+	assert( 149 == mp_int128_element2_order_lim((int128_t)uint128(446426, UINT64_C(3166840986434261745)), 1000) );
+	assert( 0 == mp_int128_element2_order_lim((int128_t)uint128(446426, UINT64_C(3166840986434261745)), 149) );
+	assert( 0 == mp_int128_element2_order_lim((int128_t)((uint128_t)1 << 100) + 277, 1 << 30) );
+
+	printf("OK\n");
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <libmp.h>
+#include <journal.h>
+
+// q = 2kn+1 for some pseudo-random k, up to 120 bits
+static
+uint128_t factor(int n, int i)
+{
+	uint128_t k = (uint128_t)(i + 1) * UINT64_C(0x9e3779b97f4a7c15);
+
+	k = k << (i % 24) | (uint128_t)i;
+
+	return 2 * k * (uint128_t)n + 1;
+}
+
+static
+int exponent(int i)
+{
+	return 3 + (i * 7919) % 100000;
+}
+
+int main()
+{
+	const char *path = "journal-test.journal";
+
+	unlink(path);
+
+	struct mp_journal journal;
+
+	// more entries than fit into the buffer, then two more blocks
+	assert( 0 == mp_journal_open(&journal, path) );
+
+	for(int i = 0; i < 20000; i++)
+	{
+		assert( 0 == mp_journal_add(&journal, exponent(i), factor(exponent(i), i)) );
+	}
+
+	assert( 0 == mp_journal_sync(&journal) );
+	assert( 0 == mp_journal_add64(&journal, 11, UINT64_C(23)) );
+	assert( 0 == mp_journal_sync(&journal) );
+
+	mp_journal_close(&journal);
+
+	// a torn block at the end is cut off
+	FILE *file = fopen(path, "ab");
+	assert( NULL != file );
+	fputs("MPJ1 torn", file);
+	fclose(file);
+
+	assert( 0 == mp_journal_open(&journal, path) );
+	assert( 0 == mp_journal_add128(&journal, 1021, factor(1021, 12345)) );
+	mp_journal_close(&journal);
+
+	// read it back
+	struct mp_journal_reader reader;
+	assert( 0 == mp_journal_reader_open(&reader, path) );
+
+	int n;
+	uint128_t q;
+
+	for(int i = 0; i < 20000; i++)
+	{
+		assert( 1 == mp_journal_next(&reader, &n, &q) );
+		assert( exponent(i) == n );
+		assert( factor(n, i) == q );
+	}
+
+	assert( 1 == mp_journal_next(&reader, &n, &q) );
+	assert( 11 == n && 23 == q );
+
+	assert( 1 == mp_journal_next(&reader, &n, &q) );
+	assert( 1021 == n && factor(1021, 12345) == q );
+
+	assert( 0 == mp_journal_next(&reader, &n, &q) );
+
+	mp_journal_reader_close(&reader);
+
+	unlink(path);
+
+	printf("OK\n");
+
+	return 0;
+}
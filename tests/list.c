@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <list.h>
+
+int main()
+{
+	const char *path = "list-test.bin";
+
+	enum { COUNT = 100000 };
+	static uint32_t exponents[COUNT], deltas[COUNT], out[777];
+
+	uint32_t n = 0;
+
+	for(size_t i = 0; i < COUNT; i++)
+	{
+		n += 1 + (uint32_t)(i * 7919) % 1000;
+		exponents[i] = n;
+	}
+
+	// encode in two pieces
+	FILE *file = fopen(path, "w");
+	assert( file );
+	assert( 0 == mp_list_write_header(file, 0, n + 1) );
+
+	uint32_t last = 0;
+	assert( 1000 == mp_list_encode(deltas, exponents, 1000, &last) );
+	assert( 1000 == fwrite(deltas, sizeof(uint32_t), 1000, file) );
+	assert( COUNT - 1000 == mp_list_encode(deltas, exponents + 1000, COUNT - 1000, &last) );
+	assert( COUNT - 1000 == fwrite(deltas, sizeof(uint32_t), COUNT - 1000, file) );
+	assert( last == n );
+
+	assert( 0 == mp_list_write_header(file, COUNT, n + 1) );
+	assert( 0 == fclose(file) );
+
+	// decode in small pieces
+	struct mp_list list;
+	assert( 0 == mp_list_open(&list, path) );
+	assert( COUNT == list.count && n + 1 == list.exponent_limit );
+
+	size_t pos = 0, total = 0;
+	last = 0;
+
+	for(size_t k; (k = mp_list_decode(&list, &pos, &last, out, 777)) > 0; total += k)
+	{
+		for(size_t j = 0; j < k; j++)
+			assert( out[j] == exponents[total + j] );
+	}
+
+	assert( COUNT == total && COUNT == pos );
+
+	mp_list_close(&list);
+
+	unlink(path);
+
+	printf("OK\n");
+
+	return 0;
+}
@@ -0,0 +1,215 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <libmp.h>
+#include <mersenne.h>
+
+static uint64_t g_seed = 1;
+
+static
+uint64_t rand64()
+{
+	// xorshift64*
+	g_seed ^= g_seed >> 12;
+	g_seed ^= g_seed << 25;
+	g_seed ^= g_seed >> 27;
+
+	return g_seed * UINT64_C(2685821657736338717);
+}
+
+static
+void random_residue(struct mp_mersenne *ctx, uint64_t *x)
+{
+	for(size_t i = 0; i < ctx->words; i++)
+		ctx->t[i] = rand64();
+
+	// reduce a random number of words + 1 words
+	ctx->t[ctx->words] = 0;
+	mp_mersenne_mul_ui(ctx, x, ctx->t, 1);
+}
+
+int main()
+{
+	// against the 128-bit arithmetic
+	for(uint32_t p = 2; p < 64; p++)
+	{
+		struct mp_mersenne ctx;
+		uint64_t x, y, r;
+		uint64_t n = (UINT64_C(1) << p) - 1;
+
+		assert( 0 == mp_mersenne_init(&ctx, p) );
+
+		for(int i = 0; i < 1000; i++)
+		{
+			uint64_t a = rand64() % n, b = rand64() % n;
+			uint32_t c = (uint32_t)rand64();
+
+			x = a;
+			y = b;
+
+			mp_mersenne_mul(&ctx, &r, &x, &y);
+			assert( r == (uint64_t)((uint128_t)a * b % n) );
+
+			mp_mersenne_sqr(&ctx, &r, &x);
+			assert( r == (uint64_t)((uint128_t)a * a % n) );
+
+			mp_mersenne_add(&ctx, &r, &x, &y);
+			assert( r == (uint64_t)(((uint128_t)a + b) % n) );
+
+			mp_mersenne_sub(&ctx, &r, &x, &y);
+			assert( r == (uint64_t)(((uint128_t)a + n - b) % n) );
+
+			mp_mersenne_mul_ui(&ctx, &r, &x, c);
+			assert( r == (uint64_t)((uint128_t)a * c % n) );
+
+			mp_mersenne_set_ui(&ctx, &r, c);
+			assert( r == c % n && mp_mersenne_is_ui(&ctx, &r, c) );
+
+			// 2^p == 1
+			uint64_t e = p;
+			mp_mersenne_set_ui(&ctx, &x, 2);
+			mp_mersenne_pow(&ctx, &r, &x, &e, 64);
+			assert( 1 == r );
+		}
+
+		mp_mersenne_free(&ctx);
+	}
+
+	// Fermat's test of the Mersenne primes, of the word boundaries and of a composite one, the transform above
+	const uint32_t exponents[] = { 61, 89, 107, 127, 128, 191, 192, 521, 607, 1279, 2203, 2281, 44497, 110503 };
+
+	for(size_t k = 0; k < sizeof(exponents) / sizeof(*exponents); k++)
+	{
+		struct mp_mersenne ctx;
+		uint32_t p = exponents[k];
+
+		assert( 0 == mp_mersenne_init(&ctx, p) );
+
+		uint64_t *x = mp_mersenne_alloc(&ctx), *y = mp_mersenne_alloc(&ctx), *z = mp_mersenne_alloc(&ctx);
+		uint64_t *r = mp_mersenne_alloc(&ctx), *s = mp_mersenne_alloc(&ctx);
+		uint64_t *e = mp_mersenne_alloc(&ctx);
+
+		assert( x && y && z && r && s && e );
+
+		// 3^(2^p - 2)
+		if( p < 10000 )
+		{
+			memset(e, 0xff, ctx.words * sizeof(uint64_t));
+			e[0] ^= 1;
+			if( p % 64 )
+				e[ctx.words - 1] &= (UINT64_C(1) << p % 64) - 1;
+
+			mp_mersenne_set_ui(&ctx, x, 3);
+			mp_mersenne_pow(&ctx, r, x, e, p);
+			assert( mp_mersenne_is_ui(&ctx, r, 1) == (128 != p && 191 != p && 192 != p) );
+		}
+
+		// 2^a 2^b = 2^(a + b mod p)
+		for(int i = 0; i < 10; i++)
+		{
+			uint64_t a = rand64() % p, b = rand64() % p;
+
+			memset(x, 0, ctx.words * sizeof(uint64_t));
+			memset(y, 0, ctx.words * sizeof(uint64_t));
+			memset(s, 0, ctx.words * sizeof(uint64_t));
+			x[a / 64] = UINT64_C(1) << a % 64;
+			y[b / 64] = UINT64_C(1) << b % 64;
+			s[(a + b) % p / 64] = UINT64_C(1) << (a + b) % p % 64;
+
+			mp_mersenne_mul(&ctx, r, x, y);
+			assert( 0 == memcmp(r, s, ctx.words * sizeof(uint64_t)) );
+		}
+
+		// the ring identities
+		for(int i = 0; i < 10; i++)
+		{
+			random_residue(&ctx, x);
+			random_residue(&ctx, y);
+			random_residue(&ctx, z);
+
+			// (xy)z = x(yz)
+			mp_mersenne_mul(&ctx, r, x, y);
+			mp_mersenne_mul(&ctx, r, r, z);
+			mp_mersenne_mul(&ctx, s, y, z);
+			mp_mersenne_mul(&ctx, s, x, s);
+			assert( 0 == memcmp(r, s, ctx.words * sizeof(uint64_t)) );
+
+			// (x + y)^2 = x^2 + 2xy + y^2
+			mp_mersenne_add(&ctx, r, x, y);
+			mp_mersenne_sqr(&ctx, r, r);
+			mp_mersenne_mul(&ctx, s, x, y);
+			mp_mersenne_mul_ui(&ctx, s, s, 2);
+			mp_mersenne_sqr(&ctx, z, x);
+			mp_mersenne_add(&ctx, s, s, z);
+			mp_mersenne_sqr(&ctx, z, y);
+			mp_mersenne_add(&ctx, s, s, z);
+			assert( 0 == memcmp(r, s, ctx.words * sizeof(uint64_t)) );
+
+			// x c by the multiplication and by mul_ui
+			uint32_t c = (uint32_t)rand64();
+			mp_mersenne_set_ui(&ctx, z, c);
+			mp_mersenne_mul(&ctx, r, x, z);
+			mp_mersenne_mul_ui(&ctx, s, x, c);
+			assert( 0 == memcmp(r, s, ctx.words * sizeof(uint64_t)) );
+
+			// (x - y) + y = x
+			mp_mersenne_sub(&ctx, r, x, y);
+			mp_mersenne_add(&ctx, r, r, y);
+			assert( 0 == memcmp(r, x, ctx.words * sizeof(uint64_t)) );
+		}
+
+		free(x);
+		free(y);
+		free(z);
+		free(r);
+		free(s);
+		free(e);
+
+		mp_mersenne_free(&ctx);
+	}
+
+	// the gcd with 2^p - 1
+	const uint64_t factors[][2] = { { 11, 23 }, { 67, 193707721 }, { 1013, 6079 }, { 1019, 2039 }, { 2011, 2171881 } };
+
+	for(size_t k = 0; k < sizeof(factors) / sizeof(*factors); k++)
+	{
+		struct mp_mersenne ctx;
+		uint32_t p = (uint32_t)factors[k][0];
+
+		assert( 0 == mp_mersenne_init(&ctx, p) );
+
+		uint64_t *x = mp_mersenne_alloc(&ctx), *y = mp_mersenne_alloc(&ctx), *g = mp_mersenne_alloc(&ctx);
+
+		assert( x && y && g );
+
+		// q times a random residue
+		random_residue(&ctx, y);
+		mp_mersenne_set_ui(&ctx, x, factors[k][1]);
+		mp_mersenne_mul(&ctx, x, x, y);
+
+		assert( 0 == mp_mersenne_gcd(&ctx, g, x) );
+		assert( 0 == g[0] % factors[k][1] );
+		for(size_t i = 1; i < ctx.words; i++)
+			assert( 0 == g[i] );
+
+		mp_mersenne_set_ui(&ctx, x, 1);
+		assert( 0 == mp_mersenne_gcd(&ctx, g, x) && mp_mersenne_is_ui(&ctx, g, 1) );
+
+		// 2^p - 1 itself
+		mp_mersenne_set_ui(&ctx, x, 0);
+		assert( 0 == mp_mersenne_gcd(&ctx, g, x) );
+		assert( g[0] == (p < 64 ? (UINT64_C(1) << p) - 1 : UINT64_MAX) );
+
+		free(x);
+		free(y);
+		free(g);
+
+		mp_mersenne_free(&ctx);
+	}
+
+	printf("OK\n");
+
+	return 0;
+}
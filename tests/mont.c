@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+#include <libmp.h>
+#include <mont.h>
+
+static uint64_t g_seed = 1;
+
+static
+uint64_t rand64()
+{
+	// xorshift64*
+	g_seed ^= g_seed >> 12;
+	g_seed ^= g_seed << 25;
+	g_seed ^= g_seed >> 27;
+
+	return g_seed * UINT64_C(2685821657736338717);
+}
+
+int main()
+{
+	enum { COUNT = 1000 };
+
+	uint64_t q64[COUNT], e64[COUNT], r64[COUNT];
+	uint128_t q128[COUNT], e128[COUNT], r128[COUNT];
+
+	for(int i = 0; i < COUNT; i++)
+	{
+		// odd moduli of various sizes
+		q64[i] = (rand64() >> (1 + i % 62)) | 1;
+		e64[i] = rand64() >> (i % 64);
+
+		q128[i] = (((uint128_t)rand64() << 64 | rand64()) >> (1 + i % 126)) | 1;
+		e128[i] = ((uint128_t)rand64() << 64 | rand64()) >> (i % 128);
+	}
+
+	mp_uint64_pow2_mod_batch(COUNT, q64, e64, r64);
+	mp_uint128_pow2_mod_batch(COUNT, q128, e128, r128);
+
+	for(int i = 0; i < COUNT; i++)
+	{
+		uint64_t r = mp_int64_dpow2_pl_log((int64_t)q64[i], (int64_t)(e64[i] >> 1)) % q64[i];
+
+		assert( r64[i] == mp_uint64_pow2_mod(q64[i], e64[i]) );
+		assert( r64[i] == (uint64_t)(((uint128_t)r * r << (e64[i] & 1)) % q64[i]) );
+
+		assert( r128[i] == mp_uint128_pow2_mod(q128[i], e128[i]) );
+
+		if( q128[i] < (UINT128_1 << 62) )
+		{
+			assert( r128[i] == (uint128_t)mp_int128_dpow2_pl_log((int128_t)q128[i], (int128_t)e128[i]) % q128[i] );
+		}
+
+		// Montgomery round trip and product against the plain one
+		struct mp_mont128 ctx;
+		mp_mont128_init(&ctx, q128[i]);
+
+		uint128_t a = ((uint128_t)rand64() << 64 | rand64()) % q128[i];
+
+		assert( a == mp_mont128_from(&ctx, mp_mont128_to(&ctx, a)) );
+
+		if( q128[i] < (UINT128_1 << 64) )
+		{
+			uint128_t b = rand64() % q128[i];
+
+			assert( a * b % q128[i] == mp_mont128_from(&ctx, mp_mont128_mul(&ctx, mp_mont128_to(&ctx, a), mp_mont128_to(&ctx, b))) );
+		}
+	}
+
+	// the shared exponent against the per-modulus one
+	for(int i = 0; i < COUNT; i++)
+	{
+		e64[i] = e64[COUNT/3];
+		e128[i] = e128[COUNT/3];
+	}
+
+	mp_uint64_pow2_mod_shared(COUNT, q64, e64[0], r64);
+	mp_uint128_pow2_mod_shared(COUNT, q128, e128[0], r128);
+
+	for(int i = 0; i < COUNT; i++)
+	{
+		assert( r64[i] == mp_uint64_pow2_mod(q64[i], e64[i]) );
+		assert( r128[i] == mp_uint128_pow2_mod(q128[i], e128[i]) );
+	}
+
+	// the plans of a few exponents, the evaluators against each other
+	for(int i = 0; i < 64; i++)
+	{
+		struct mp_plan plan;
+		uint128_t e = i < 32 ? (uint128_t)i : (uint128_t)rand64() >> (i % 64);
+
+		mp_plan_init(&plan, e);
+		mp_plan_pow2_mod64(&plan, COUNT, q64, r64);
+		mp_plan_pow2_mod128(&plan, COUNT, q128, r128);
+
+		for(int j = 0; j < COUNT; j++)
+		{
+			assert( r64[j] == mp_uint64_pow2_mod(q64[j], (uint64_t)e) );
+			assert( r128[j] == mp_uint128_pow2_mod(q128[j], e) );
+		}
+	}
+
+	// the dual form, one modulus and many exponents
+	for(int i = 0; i < COUNT; i++)
+	{
+		struct mp_mont64_squares squares;
+		struct mp_plan plans[MP_MONT_LANES + 3];
+		uint64_t r[MP_MONT_LANES + 3];
+
+		mp_mont64_squares_init(&squares, q64[i], 64);
+
+		for(int j = 0; j < MP_MONT_LANES + 3; j++)
+		{
+			mp_plan_init(&plans[j], (uint128_t)(rand64() >> (rand64() % 64)));
+		}
+
+		mp_plan_pow2_mod64_dual(&squares, MP_MONT_LANES + 3, plans, r);
+
+		for(int j = 0; j < MP_MONT_LANES + 3; j++)
+		{
+			assert( r[j] == mp_uint64_pow2_mod(q64[i], (uint64_t)plans[j].e) );
+		}
+	}
+
+	// the small cases
+	assert( 1 == mp_uint128_pow2_mod(23, 11) );
+	assert( 1 == mp_uint64_pow2_mod(47, 23) );
+	assert( 0 == mp_uint64_pow2_mod(1, 5) );
+
+	printf("OK\n");
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <prefilter.h>
+
+static
+int has_small_factor(int64_t n, uint64_t max)
+{
+	if( (uint64_t)n <= max )
+		return 0;
+
+	for(int64_t p = 3; (uint64_t)p <= max; p += 2)
+	{
+		int prime = 1;
+
+		for(int64_t d = 3; d * d <= p && prime; d += 2)
+			prime = 0 != p % d;
+
+		if( prime && 0 == n % p )
+			return 1;
+	}
+
+	return 0;
+}
+
+int main()
+{
+	enum { COUNT = 10003 };
+
+	static int64_t in[COUNT], out[COUNT];
+
+	struct mp_prefilter pf;
+	mp_prefilter_init(&pf);
+
+	assert( MP_PREFILTER_PRIMES == pf.count );
+
+	srand(1);
+
+	for(size_t i = 0; i < COUNT; i++)
+	{
+		switch( i % 4 )
+		{
+			case 0: in[i] = (int64_t)i; break;
+			case 1: in[i] = ((int64_t)rand() << 31 | rand()) | 1; break;
+			case 2: in[i] = (int64_t)(rand() % 1000) * 1613 * 1621 + 1; break;
+			case 3: in[i] = INT64_MAX - (int64_t)i; break;
+		}
+	}
+
+	size_t n = mp_prefilter_int64(&pf, in, COUNT, out);
+
+	// the survivors in order
+	size_t j = 0;
+
+	for(size_t i = 0; i < COUNT; i++)
+	{
+		if( !has_small_factor(in[i], pf.max) )
+		{
+			assert( j < n && out[j] == in[i] );
+			j++;
+		}
+	}
+
+	assert( j == n );
+
+	// in place
+	assert( n == mp_prefilter_int64(&pf, in, COUNT, in) );
+
+	for(size_t i = 0; i < n; i++)
+		assert( in[i] == out[i] );
+
+	printf("OK\n");
+
+	return 0;
+}
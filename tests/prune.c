@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <libmp.h>
+#include <record.h>
+#include <prune.h>
+
+int main()
+{
+	int exponent_limit = 1 << 20;
+
+	uint8_t *primes = gen_prime_table(exponent_limit);
+	assert( primes );
+
+	struct mp_record record;
+	record.exponent_limit = exponent_limit;
+	record.size = (size_t)(exponent_limit + 7) / 8;
+	record.bits = calloc(record.size, 1);
+	record.dirty = NULL;
+	record.fresh = NULL;
+	assert( record.bits );
+
+	struct mp_prune prune;
+	assert( 0 == mp_prune_init(&prune, &record, primes, exponent_limit, NULL) );
+
+	srand(1);
+
+	int hits = 0;
+
+	for(int i = 0; i < 20000; i++)
+	{
+		int64_t factor;
+
+		if( i % 2 )
+		{
+			// q = 2kn+1, often a factor of M(n)
+			int n;
+			do {
+				n = 3 + rand() % (exponent_limit - 3);
+			} while( !mp_int_is_prime_cached(n, primes) );
+			factor = 2 * (int64_t)(1 + rand() % 10) * n + 1;
+		}
+		else
+		{
+			factor = (int64_t)(rand() % (1 << 30)) | 1;
+		}
+
+		int n = mp_int64_exponent_prtest(factor, exponent_limit, primes);
+
+		// eliminate every third one found
+		if( n && 0 == i % 3 )
+		{
+			mp_record_set_bit(&record, n);
+		}
+
+		int clean = n && !mp_record_get_bit(&record, n);
+
+		assert( mp_prune_int64_prtest(&prune, factor) == (clean ? n : 0) );
+
+		hits += clean;
+	}
+
+	assert( hits > 100 );
+	assert( prune.pruned > 0 && prune.factored < prune.tested / 10 );
+
+	// the block sieve, two consecutive segments and a jump
+	for(int64_t sign = -1; sign <= 1; sign += 2)
+	{
+		struct mp_prune_block block;
+		assert( 0 == mp_prune_block_init(&block, &prune, sign) );
+
+		int64_t bases[] = { 0, MP_PRUNE_SEGMENT, 12345678, INT64_C(1) << 36 };
+
+		for(size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); b++)
+		{
+			assert( 0 == mp_prune_block_segment(&block, bases[b]) );
+
+			for(int64_t state = bases[b]; state < bases[b] + MP_PRUNE_SEGMENT; state += 31)
+			{
+				int64_t factor = 8 * state + sign;
+
+				if( factor < 3 )
+					continue;
+
+				int n = mp_int64_exponent_prtest(factor, exponent_limit, primes);
+				int clean = n && mp_prune_is_clean(&prune, n);
+
+				assert( mp_prune_int64_prtest_block(&prune, &block, state) == (clean ? n : 0) );
+				assert( mp_prune_int64_prtest(&prune, factor) == (clean ? n : 0) );
+			}
+		}
+
+		mp_prune_block_free(&block);
+	}
+
+	mp_prune_free(&prune);
+	free(record.bits);
+	free(primes);
+
+	printf("OK\n");
+
+	return 0;
+}
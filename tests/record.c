@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <libmp.h>
+#include <record.h>
+
+int main()
+{
+	const char *path = "record-test.bits";
+
+	unlink(path);
+
+	struct mp_record record;
+	int exponent_limit = 1000;
+
+	// create a new record and mark every 7th exponent
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDWR) );
+	assert( 1000 == exponent_limit );
+
+	for(int n = 0; n < exponent_limit; n += 7)
+	{
+		assert( 0 == mp_record_set_bit(&record, n) );
+		assert( 0 != mp_record_set_bit(&record, n) );
+	}
+
+	assert( 0 == mp_record_sync(&record) );
+	mp_record_close(&record);
+
+	// detect the size and read it back
+	exponent_limit = -1;
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDONLY) );
+	assert( 1000 == exponent_limit );
+
+	for(int n = 0; n < exponent_limit; n++)
+	{
+		assert( !mp_record_get_bit(&record, n) == !!(n % 7) );
+	}
+
+	mp_record_close(&record);
+
+	// read it as a larger record, the tail reads as zeros
+	exponent_limit = 100000;
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDONLY) );
+
+	for(int n = 0; n < exponent_limit; n++)
+	{
+		assert( !mp_record_get_bit(&record, n) == ( n >= 1000 || n % 7 ) );
+	}
+
+	mp_record_close(&record);
+
+	// grow the record
+	exponent_limit = -1;
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDWR) );
+	assert( 0 == mp_record_grow(&record, 100000) );
+	assert( 0 == mp_record_set_bit(&record, 99991) );
+	mp_record_close(&record);
+
+	exponent_limit = -1;
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDONLY) );
+	assert( 100000 == exponent_limit );
+	assert( mp_record_get_bit(&record, 99991) );
+	assert( mp_record_get_bit(&record, 994) );
+	assert( !mp_record_get_bit(&record, 995) );
+	mp_record_close(&record);
+
+	// a writer with a smaller limit keeps the exponents above it in the file
+	exponent_limit = 1000;
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDWR) );
+	assert( 0 == mp_record_set_bit(&record, 995) );
+	assert( 0 == mp_record_grow(&record, 50000) );
+	mp_record_close(&record);
+
+	exponent_limit = -1;
+	assert( 0 == mp_record_open(&record, path, &exponent_limit, MP_RECORD_RDONLY) );
+	assert( 100000 == exponent_limit );
+	assert( mp_record_get_bit(&record, 99991) );
+	assert( mp_record_get_bit(&record, 995) );
+	mp_record_close(&record);
+
+	unlink(path);
+
+	printf("OK\n");
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <libmp.h>
+#include <status.h>
+
+int main()
+{
+	const char *path = "status-test.bin";
+	int exponent_limit = 100000;
+
+	unlink(path);
+
+	uint8_t *primes = gen_prime_table(exponent_limit);
+	assert( primes );
+
+	struct mp_status status;
+
+	assert( 0 == mp_status_open(&status, path, exponent_limit, primes, MP_STATUS_RDWR) );
+	assert( 9592 == status.count );
+
+	for(int n = 2; n < exponent_limit; n++)
+	{
+		int prime = mp_int64_is_prime(n);
+
+		assert( prime == mp_status_set_tf(&status, n, 50 + n % 30) );
+		assert( 0 == mp_status_set_tf(&status, n, 40) );
+		assert( prime == mp_status_set_pm1(&status, n, (uint64_t)n << 10, (uint64_t)n << 20) );
+	}
+
+	assert( 0 == mp_status_sync(&status) );
+	mp_status_close(&status);
+
+	// read back
+	assert( 0 == mp_status_open(&status, path, exponent_limit, primes, MP_STATUS_RDONLY) );
+
+	for(int n = 0; n < exponent_limit; n++)
+	{
+		int prime = n >= 2 && mp_int64_is_prime(n);
+		uint64_t B1 = 0, B2 = 0;
+
+		assert( (prime ? 50 + n % 30 : 0) == mp_status_get_tf(&status, n) );
+		assert( prime == mp_status_get_pm1(&status, n, &B1, &B2) );
+
+		if( prime )
+		{
+			assert( (uint64_t)n << 10 == B1 );
+			assert( (uint64_t)n << 20 == B2 );
+		}
+	}
+
+	mp_status_close(&status);
+
+	// pm1 runs M(89) twice to the same bounds, the second run skips it
+	assert( 0 == mp_status_open(&status, path, exponent_limit, primes, MP_STATUS_RDWR) );
+
+	assert( 1 == mp_status_has_pm1(&status, 89, 89 << 10, 89 << 20) );
+	assert( 0 == mp_status_has_pm1(&status, 89, 1000000, 100000000) );
+	mp_status_set_pm1(&status, 89, 1000000, 100000000);
+	assert( 1 == mp_status_has_pm1(&status, 89, 1000000, 100000000) );
+	assert( 1 == mp_status_has_pm1(&status, 89, 1000000, 0) );
+	assert( 0 == mp_status_has_pm1(&status, 89, 2000000, 100000000) );
+	assert( 0 == mp_status_has_pm1(&status, 89, 1000001, 100000000) );
+
+	// lower bounds do not cover the higher ones of the same bit length
+	mp_status_set_pm1(&status, 97, 600000, 600000000);
+	assert( 1 == mp_status_has_pm1(&status, 97, 600000, 600000000) );
+	assert( 0 == mp_status_has_pm1(&status, 97, 1000000, 600000000) );
+	assert( 0 == mp_status_has_pm1(&status, 97, 600000, 1000000000) );
+	assert( 0 == mp_status_has_pm1(&status, 4, 1, 1) );
+
+	mp_status_close(&status);
+
+	// the exponent limit has to match
+	assert( 0 != mp_status_open(&status, path, exponent_limit / 2, primes, MP_STATUS_RDONLY) );
+
+	unlink(path);
+	free(primes);
+
+	printf("OK\n");
+
+	return 0;
+}
@@ -4,12 +4,8 @@
 #include <assert.h>
 #include <strings.h>
 #include <libmp.h>
-
-static
-int get_bit(const char *ptr, int i)
-{
-	return ptr[i/8] & 1 << i%8;
-}
+#include <record.h>
+#include <bitmap.h>
 
 int ceil_sqrt(int n)
 {
@@ -27,101 +23,6 @@ int ceil_sqrt(int n)
 	return x;
 }
 
-static
-int is_prime(int p, const char *primes)
-{
-	assert( p >= 0 );
-
-	return !get_bit(primes, p);
-}
-
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
-{
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
-	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
-		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
-		}
-
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
-
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
-	}
-	else
-	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
-
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
-		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
-		}
-
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-		if( *p_exponent_limit > detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
-
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
-		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
-		}
-
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
-
-		fclose(record_file);
-	}
-
-	return record;
-}
-
 // compare [OPTIONS] [record.bits] [record.bits]
 int main(int argc, char *argv[])
 {
@@ -174,8 +75,15 @@ int main(int argc, char *argv[])
 	}
 
 	// open the records
-	char *record0 = record_load(&exponent_limit, record0_path);
-	char *record1 = record_load(&exponent_limit, record1_path);
+	struct mp_record record0, record1;
+	if( mp_record_open(&record0, record0_path, &exponent_limit, MP_RECORD_RDONLY) )
+	{
+		exit(0);
+	}
+	if( mp_record_open(&record1, record1_path, &exponent_limit, MP_RECORD_RDONLY) )
+	{
+		exit(0);
+	}
 
 	// create prime table
 	char *primes = (char *)load_prime_table(exponent_limit);
@@ -185,37 +93,43 @@ int main(int argc, char *argv[])
 		save_prime_table((uint8_t *)primes, exponent_limit);
 	}
 
-	int less = 1, equal = 1, greater = 1;
-	int rec0_cnt = 0, rec1_cnt = 0;
+	const uint8_t *r0 = record0.bits;
+	const uint8_t *r1 = record1.bits;
+	const uint8_t *p = (const uint8_t *)primes;
+	size_t end = (size_t)exponent_limit;
 
-	for(int n = 1; n < exponent_limit; n++)
+	// differences on prime exponents only, 1-0 and 0-1
+	int rec0_cnt = (int)mp_bitmap_popcount_andn(r0, r1, p, 1, end);
+	int rec1_cnt = (int)mp_bitmap_popcount_andn(r1, r0, p, 1, end);
+
+	int less = !rec0_cnt, greater = !rec1_cnt, equal = less && greater;
+
+	if(verbose)
 	{
-		// for each prime
-		if( is_prime(n, primes) )
-		{
-			int b0 = get_bit(record0, n);
-			int b1 = get_bit(record1, n);
+		// both lists are sorted, print them merged
+		uint32_t buf0[4096], buf1[4096];
+		size_t pos0 = 1, pos1 = 1, n0 = 0, n1 = 0, i0 = 0, i1 = 0;
 
-			if( b0 < b1 ) // 0-1
+		while(1)
+		{
+			if( i0 == n0 )
 			{
-				equal = 0;
-				greater = 0;
-				rec1_cnt++;
-
-				if(verbose)
-					message("<\tM(%i)\n", n);
+				n0 = mp_bitmap_extract_andn(r0, r1, p, &pos0, end, buf0, 4096);
+				i0 = 0;
 			}
-			else if( b0 > b1 ) // 1-0
+			if( i1 == n1 )
 			{
-				equal = 0;
-				less = 0;
-				rec0_cnt++;
-
-				if(verbose)
-					message(">\tM(%i)\n", n);
+				n1 = mp_bitmap_extract_andn(r1, r0, p, &pos1, end, buf1, 4096);
+				i1 = 0;
 			}
-			else // 0-0 or 1-1
-			{}
+
+			if( i0 == n0 && i1 == n1 )
+				break;
+
+			if( i1 == n1 || (i0 < n0 && buf0[i0] < buf1[i1]) )
+				message(">\tM(%i)\n", (int)buf0[i0++]);
+			else
+				message("<\tM(%i)\n", (int)buf1[i1++]);
 		}
 	}
 
@@ -228,8 +142,8 @@ int main(int argc, char *argv[])
 	else
 		message("'%s' (+%i) != '%s' (+%i) (the records are completely different)\n", record0_path, rec0_cnt, record1_path, rec1_cnt);
 
-	free(record0);
-	free(record1);
+	mp_record_close(&record0);
+	mp_record_close(&record1);
 	free(primes);
 
 	message("The program has finished.\n");
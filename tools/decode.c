@@ -1,16 +1,16 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <strings.h>
+#include <pthread.h>
 #include <libmp.h>
-
-static
-int get_bit(const char *ptr, int i)
-{
-	return ptr[i/8] & 1 << i%8;
-}
+#include <record.h>
+#include <bitmap.h>
+#include <list.h>
 
 int ceil_sqrt(int n)
 {
@@ -28,99 +28,212 @@ int ceil_sqrt(int n)
 	return x;
 }
 
+// exponents per chunk
+#define CHUNK (1 << 22)
+
+// a chunk of the list, formatted by one thread
+struct chunk {
+	const uint8_t *record;
+	const uint8_t *primes;
+	int factored; // dirty prime exponents, otherwise the clean ones
+	int binary;
+	size_t begin, end;
+	char *buf;
+	size_t len;
+	size_t count;
+	uint32_t last; // the highest exponent in the chunk
+	pthread_t thread;
+};
+
 static
-int is_prime(int p, const char *primes)
+char *put_uint(char *ptr, uint32_t n)
 {
-	assert( p >= 0 );
+	static const char digits[] =
+		"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+	char tmp[10];
+	char *end = tmp + sizeof(tmp);
+	char *p = end;
+
+	for(; n >= 100; n /= 100)
+	{
+		p -= 2;
+		memcpy(p, digits + 2 * (n % 100), 2);
+	}
+
+	if( n >= 10 )
+	{
+		p -= 2;
+		memcpy(p, digits + 2 * n, 2);
+	}
+	else
+	{
+		*--p = (char)('0' + n);
+	}
+
+	memcpy(ptr, p, (size_t)(end - p));
+	ptr += end - p;
+	*ptr++ = '\n';
 
-	return !get_bit(primes, p);
+	return ptr;
 }
 
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
+void *chunk_job(void *ptr)
 {
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
+	struct chunk *chunk = ptr;
+	const uint8_t *r = chunk->record;
+	const uint8_t *p = chunk->primes;
+
+	// the size of the output is known in advance
+	size_t count = chunk->factored
+		? mp_bitmap_popcount_andn(r, NULL, p, chunk->begin, chunk->end)
+		: mp_bitmap_popcount_nor(r, p, chunk->begin, chunk->end);
+
+	chunk->buf = malloc(count * (chunk->binary ? sizeof(uint32_t) : 11) + 1);
+	chunk->len = 0;
+	chunk->count = 0;
+	chunk->last = 0;
+
+	if( NULL == chunk->buf )
+	{
+		return NULL;
+	}
+
+	uint32_t exponents[4096];
+	char *out = chunk->buf;
+
+	for(size_t pos = chunk->begin, n; (n = chunk->factored
+		? mp_bitmap_extract_andn(r, NULL, p, &pos, chunk->end, exponents, 4096)
+		: mp_bitmap_extract_nor(r, p, &pos, chunk->end, exponents, 4096)) > 0;)
 	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
+		if( chunk->binary )
 		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
+			// the first difference is fixed up when the chunks are concatenated
+			uint32_t deltas[4096];
+			mp_list_encode(deltas, exponents, n, &chunk->last);
+			memcpy(out, deltas, n * sizeof(uint32_t));
+			out += n * sizeof(uint32_t);
 		}
-
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
+		else
 		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
+			for(size_t i = 0; i < n; i++)
+			{
+				out = put_uint(out, exponents[i]);
+			}
+
+			chunk->last = exponents[n - 1];
 		}
 
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+		chunk->count += n;
+	}
+
+	chunk->len = (size_t)(out - chunk->buf);
 
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+	return NULL;
+}
+
+// write the dirty or the clean prime exponents, the chunks are formatted in parallel and written in order
+void decode(const char *path, int factored, int binary, int threads, const uint8_t *record, const uint8_t *primes, int exponent_limit)
+{
+	FILE *file = fopen(path, "w");
+	if( NULL == file )
+	{
+		message(ERR "Unable to open file '%s'.\n", path);
+		exit(0);
 	}
-	else
+
+	if( binary && mp_list_write_header(file, 0, (uint64_t)exponent_limit) )
 	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
+		exit(0);
+	}
 
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
-		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
-		}
+	struct chunk *chunks = malloc((size_t)threads * sizeof(struct chunk));
+	if( NULL == chunks )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		exit(0);
+	}
 
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-		if( *p_exponent_limit > detected_exponent_limit )
+	size_t limit = (size_t)exponent_limit;
+	uint64_t count = 0;
+	uint32_t last = 0;
+
+	for(size_t begin = 1; begin < limit;)
+	{
+		int used = 0;
+
+		for(; used < threads && begin < limit; used++, begin = begin - begin % CHUNK + CHUNK)
 		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
+			struct chunk *chunk = &chunks[used];
+
+			chunk->record = record;
+			chunk->primes = primes;
+			chunk->factored = factored;
+			chunk->binary = binary;
+			chunk->begin = begin;
+			chunk->end = begin - begin % CHUNK + CHUNK < limit ? begin - begin % CHUNK + CHUNK : limit;
+
+			if( pthread_create(&chunk->thread, NULL, chunk_job, chunk) )
+			{
+				message(ERR "Unable to start a thread :(\n");
+				exit(0);
+			}
 		}
 
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
+		for(int t = 0; t < used; t++)
 		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
+			struct chunk *chunk = &chunks[t];
 
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+			pthread_join(chunk->thread, NULL);
 
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
-		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
+			if( NULL == chunk->buf )
+			{
+				message(ERR "Unable to allocate memory :(\n");
+				exit(0);
+			}
+
+			if( 0 == chunk->count )
+			{
+				free(chunk->buf);
+				continue;
+			}
+
+			if( binary )
+			{
+				uint32_t first;
+				memcpy(&first, chunk->buf, sizeof(first));
+				first -= last;
+				memcpy(chunk->buf, &first, sizeof(first));
+			}
+
+			if( chunk->len != fwrite(chunk->buf, 1, chunk->len, file) )
+			{
+				message(ERR "Unable to write into file '%s'.\n", path);
+				exit(0);
+			}
+
+			count += chunk->count;
+			last = chunk->last;
+
+			free(chunk->buf);
 		}
+	}
 
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+	free(chunks);
 
-		fclose(record_file);
+	if( binary && mp_list_write_header(file, count, (uint64_t)exponent_limit) )
+	{
+		exit(0);
 	}
 
-	return record;
+	if( fclose(file) )
+	{
+		message(ERR "Unable to write into file '%s'.\n", path);
+		exit(0);
+	}
+
+	message("%" PRIu64 " exponents written into '%s'.\n", count, path);
 }
 
 // decode [OPTIONS] [record.bits]
@@ -130,11 +243,13 @@ int main(int argc, char *argv[])
 
 	int exponent_limit = -1;
 	const char *record_path = "merged.bits";
-	const char *candidates_path = "candidates.txt";
-	const char *factored_path = "factored.txt";
+	const char *candidates_path = NULL;
+	const char *factored_path = NULL;
+	int binary = 0;
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
 
 	// parse command-line options
-	for(int opt; (opt = getopt(argc, argv, "f:p:h:")) != -1;)
+	for(int opt; (opt = getopt(argc, argv, "f:p:h:bt:")) != -1;)
 	{
 		switch(opt)
 		{
@@ -155,11 +270,34 @@ int main(int argc, char *argv[])
 					exponent_limit = -1;
 				}
 				break;
+			// -b : binary lists (see list.h) instead of the text ones
+			case 'b':
+				binary = 1;
+				break;
+			// -t THREADS : number of threads
+			case 't':
+				threads = atoi(optarg);
+				break;
 			default :
 				message(WARN "Unknown option :( Read the source code!\n");
 		}
 	}
 
+	if( threads < 1 )
+	{
+		threads = 1;
+	}
+
+	if( NULL == candidates_path )
+	{
+		candidates_path = binary ? "candidates.bin" : "candidates.txt";
+	}
+
+	if( NULL == factored_path )
+	{
+		factored_path = binary ? "factored.bin" : "factored.txt";
+	}
+
 	// argument after options
 	if(optind < argc)
 	{
@@ -173,7 +311,11 @@ int main(int argc, char *argv[])
 	}
 
 	// load the record
-	char *record = record_load(&exponent_limit, record_path);
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDONLY) )
+	{
+		exit(0);
+	}
 
 	// create prime table
 	char *primes = (char *)load_prime_table(exponent_limit);
@@ -183,49 +325,13 @@ int main(int argc, char *argv[])
 		save_prime_table((uint8_t *)primes, exponent_limit);
 	}
 
-	// open candidates_path, factored_path
-	FILE *candidates_file = fopen(candidates_path, "w");
-	if( NULL == candidates_file )
-	{
-		message(ERR "Unable to open file '%s'.\n", candidates_path);
-		exit(0);
-	}
-	FILE *factored_file = fopen(factored_path, "w");
-	if( NULL == factored_file )
-	{
-		message(ERR "Unable to open file '%s'.\n", factored_path);
-		exit(0);
-	}
-
-	for(int n = 1; n < exponent_limit; n++)
-	{
-		// for each prime
-		if( is_prime(n, primes) )
-		{
-			// if marked as dirty
-			if( get_bit(record, n) )
-			{
-				// write exponent into factored file
-				if( fprintf(factored_file, "%i\n", n) < 0 )
-				{
-					message(ERR "Unable to write into file '%s'.\n", factored_path);
-				}
-			}
-			else
-			{
-				// write it into candidates
-				if( fprintf(candidates_file, "%i\n", n) < 0 )
-				{
-					message(ERR "Unable to write into file '%s'.\n", candidates_path);
-				}
-			}
-		}
-	}
+	// prime exponents marked as dirty into factored file
+	decode(factored_path, 1, binary, threads, record.bits, (const uint8_t *)primes, exponent_limit);
 
-	fclose(candidates_file);
-	fclose(factored_file);
+	// the clean ones into candidates
+	decode(candidates_path, 0, binary, threads, record.bits, (const uint8_t *)primes, exponent_limit);
 
-	free(record);
+	mp_record_close(&record);
 	free(primes);
 
 	message("The program has finished.\n");
@@ -1,15 +1,13 @@
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <strings.h>
 #include <libmp.h>
-
-static
-int get_bit(const char *ptr, int i)
-{
-	return ptr[i/8] & 1 << i%8;
-}
+#include <record.h>
+#include <bitmap.h>
 
 int ceil_sqrt(int n)
 {
@@ -27,57 +25,31 @@ int ceil_sqrt(int n)
 	return x;
 }
 
-static
-int is_prime(int p, const char *primes)
-{
-	assert( p >= 0 );
-
-	return !get_bit(primes, p);
-}
-
 void summary(const char *record, int exponent_limit, const char *primes)
 {
-	int prime_total = 0; // prime exponents in total, Mersenne numbers
-	int prime_eliminated = 0; // dirty exponents, factor found
-	int prime_candidates = 0; // clean exponents, possible Mersenne primes
-	int composite_total = 0; // composite exponents
-	int composite_dirty = 0; // dirty composite exponents, should be zero
+	const uint8_t *r = (const uint8_t *)record;
+	const uint8_t *p = (const uint8_t *)primes;
+
+	// the prime table has the composites set
+	int prime_total = (int)mp_bitmap_popcount_nor(p, NULL, 1, (size_t)exponent_limit); // prime exponents in total, Mersenne numbers
+	int prime_eliminated = (int)mp_bitmap_popcount_andn(r, NULL, p, 1, (size_t)exponent_limit); // dirty exponents, factor found
+	int prime_candidates = prime_total - prime_eliminated; // clean exponents, possible Mersenne primes
+	int composite_total = exponent_limit - 1 - prime_total; // composite exponents
+	int composite_dirty = (int)mp_bitmap_popcount(r, 1, (size_t)exponent_limit) - prime_eliminated; // dirty composite exponents, should be zero
 	int first_candidate = 0;
 	int biggest_eliminated = 0;
 
-	for(int n = 1; n < exponent_limit; n++)
+	size_t pos = 1;
+	uint32_t first;
+	if( mp_bitmap_extract_nor(r, p, &pos, (size_t)exponent_limit, &first, 1) )
 	{
-		if( is_prime(n, primes) )
-		{
-			prime_total++;
-
-			// if dirty
-			if( get_bit(record, n) )
-			{
-				prime_eliminated++;
-
-				biggest_eliminated = n;
-			}
-			else
-			{
-				prime_candidates++;
-
-				if(!first_candidate)
-				{
-					first_candidate = n;
-				}
-			}
-		}
-		else
-		{
-			composite_total++;
+		first_candidate = (int)first;
+	}
 
-			// if dirty
-			if( get_bit(record, n) )
-			{
-				composite_dirty++;
-			}
-		}
+	size_t last = mp_bitmap_last_andn(r, NULL, p, 1, (size_t)exponent_limit);
+	if( last != (size_t)exponent_limit )
+	{
+		biggest_eliminated = (int)last;
 	}
 
 	message("Summary: %i prime exponents (%i candidates + %i eliminated) and %i composite exponents (%i dirty) out of %i exponents in total. The first candidate is M(%i). The biggest eliminated is M(%i).\n",
@@ -85,94 +57,164 @@ void summary(const char *record, int exponent_limit, const char *primes)
 	);
 }
 
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
+struct bucket {
+	size_t begin, end;
+	size_t primes; // prime exponents
+	size_t eliminated[2]; // per record
+	size_t only[2]; // eliminated in this record only
+};
+
+struct histogram_job {
+	struct bucket *buckets;
+	size_t count;
+	size_t first; // every stride-th bucket from the first one
+	size_t stride;
+	const uint8_t *records[2]; // the second one may be NULL
+	const uint8_t *primes;
+	pthread_t thread;
+};
+
+void *histogram_job(void *ptr)
 {
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
+	const struct histogram_job *job = ptr;
+	const uint8_t *r0 = job->records[0];
+	const uint8_t *r1 = job->records[1];
+	const uint8_t *p = job->primes;
+
+	for(size_t i = job->first; i < job->count; i += job->stride)
 	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
+		struct bucket *b = &job->buckets[i];
+
+		b->primes = mp_bitmap_popcount_nor(p, NULL, b->begin, b->end);
+		b->eliminated[0] = mp_bitmap_popcount_andn(r0, NULL, p, b->begin, b->end);
+
+		if( r1 )
 		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
+			b->eliminated[1] = mp_bitmap_popcount_andn(r1, NULL, p, b->begin, b->end);
+			b->only[0] = mp_bitmap_popcount_andn(r0, r1, p, b->begin, b->end);
+			b->only[1] = mp_bitmap_popcount_andn(r1, r0, p, b->begin, b->end);
 		}
+	}
 
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
+	return NULL;
+}
+
+static
+double ratio(size_t a, size_t b)
+{
+	return b ? (double)a / (double)b : 0.;
+}
+
+// per-bucket statistics of one record, or of two records side by side
+void histogram(const char *output_path, int json, size_t bucket_size, int threads,
+	const char *paths[2], const uint8_t *records[2], int exponent_limit, const char *primes)
+{
+	size_t limit = (size_t)exponent_limit;
+	size_t count = (limit + bucket_size - 1) / bucket_size;
+
+	struct bucket *buckets = calloc(count, sizeof(struct bucket));
+	struct histogram_job *jobs = malloc((size_t)threads * sizeof(struct histogram_job));
+
+	if( NULL == buckets || NULL == jobs )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		exit(0);
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		buckets[i].begin = i * bucket_size;
+		buckets[i].end = (i + 1) * bucket_size < limit ? (i + 1) * bucket_size : limit;
+	}
+
+	for(int t = 0; t < threads; t++)
+	{
+		jobs[t].buckets = buckets;
+		jobs[t].count = count;
+		jobs[t].first = (size_t)t;
+		jobs[t].stride = (size_t)threads;
+		jobs[t].records[0] = records[0];
+		jobs[t].records[1] = records[1];
+		jobs[t].primes = (const uint8_t *)primes;
+
+		if( pthread_create(&jobs[t].thread, NULL, histogram_job, &jobs[t]) )
 		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
+			message(ERR "Unable to start a thread :(\n");
 			exit(0);
 		}
+	}
+
+	for(int t = 0; t < threads; t++)
+	{
+		pthread_join(jobs[t].thread, NULL);
+	}
+
+	FILE *file = fopen(output_path, "w");
+	if( NULL == file )
+	{
+		message(ERR "Unable to open file '%s'.\n", output_path);
+		exit(0);
+	}
 
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+	int diff = NULL != records[1];
 
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+	if( json )
+	{
+		fprintf(file, "{\n\t\"record\": \"%s\",\n", paths[0]);
+		if( diff )
+			fprintf(file, "\t\"other\": \"%s\",\n", paths[1]);
+		fprintf(file, "\t\"exponent_limit\": %i,\n\t\"bucket\": %zu,\n\t\"buckets\": [\n", exponent_limit, bucket_size);
 	}
 	else
 	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
-
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
-		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
-		}
+		fprintf(file, "begin,end,primes,eliminated,remaining,prime_density,eliminated_ratio");
+		if( diff )
+			fprintf(file, ",eliminated_other,remaining_other,eliminated_ratio_other,only_record,only_other");
+		fprintf(file, "\n");
+	}
 
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-		if( *p_exponent_limit > detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
+	for(size_t i = 0; i < count; i++)
+	{
+		const struct bucket *b = &buckets[i];
+		double prime_density = ratio(b->primes, b->end - b->begin);
 
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
+		if( json )
 		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
+			fprintf(file, "\t\t{ \"begin\": %zu, \"end\": %zu, \"primes\": %zu, \"eliminated\": %zu, \"remaining\": %zu, \"prime_density\": %f, \"eliminated_ratio\": %f",
+				b->begin, b->end, b->primes, b->eliminated[0], b->primes - b->eliminated[0], prime_density, ratio(b->eliminated[0], b->primes));
+			if( diff )
+				fprintf(file, ", \"eliminated_other\": %zu, \"remaining_other\": %zu, \"eliminated_ratio_other\": %f, \"only_record\": %zu, \"only_other\": %zu",
+					b->eliminated[1], b->primes - b->eliminated[1], ratio(b->eliminated[1], b->primes), b->only[0], b->only[1]);
+			fprintf(file, " }%s\n", i + 1 < count ? "," : "");
 		}
-
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
-
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
+		else
 		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
+			fprintf(file, "%zu,%zu,%zu,%zu,%zu,%f,%f",
+				b->begin, b->end, b->primes, b->eliminated[0], b->primes - b->eliminated[0], prime_density, ratio(b->eliminated[0], b->primes));
+			if( diff )
+				fprintf(file, ",%zu,%zu,%f,%zu,%zu",
+					b->eliminated[1], b->primes - b->eliminated[1], ratio(b->eliminated[1], b->primes), b->only[0], b->only[1]);
+			fprintf(file, "\n");
 		}
+	}
 
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+	if( json )
+	{
+		fprintf(file, "\t]\n}\n");
+	}
 
-		fclose(record_file);
+	if( fclose(file) )
+	{
+		message(ERR "Unable to write into file '%s'.\n", output_path);
 	}
 
-	return record;
+	message("%zu buckets of %zu exponents written into '%s'.\n", count, bucket_size, output_path);
+
+	free(jobs);
+	free(buckets);
 }
 
-// info [record.bits]
+// info [OPTIONS] [record.bits] [other.bits]
 int main(int argc, char *argv[])
 {
 	message("%s: Sieve of Mersenne exponents, print summary\n", argv[0]);
@@ -180,9 +222,14 @@ int main(int argc, char *argv[])
 	// default options
 	int exponent_limit = -1;
 	const char *record_path = "merged.bits";
+	const char *other_path = NULL;
+	size_t bucket_size = 0; // no histogram
+	int json = 0;
+	const char *output_path = NULL;
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
 
 	// parse command-line options
-	for(int opt; (opt = getopt(argc, argv, "h:")) != -1;)
+	for(int opt; (opt = getopt(argc, argv, "h:b:f:o:t:")) != -1;)
 	{
 		switch(opt)
 		{
@@ -195,25 +242,56 @@ int main(int argc, char *argv[])
 					exponent_limit = -1;
 				}
 				break;
+			// -b EXPS : write the statistics per bucket of EXPS exponents (e.g. 1000000)
+			case 'b':
+				bucket_size = (size_t)atol(optarg);
+				break;
+			// -f csv|json : format of the statistics
+			case 'f':
+				json = 0 == strcmp(optarg, "json");
+				break;
+			// -o FILE : output file of the statistics
+			case 'o':
+				output_path = optarg;
+				break;
+			// -t THREADS : number of threads
+			case 't':
+				threads = atoi(optarg);
+				break;
 			default :
 				message(WARN "Unknown option :( Read the source code!\n");
 		}
 	}
 
-	// argument after options
+	if( threads < 1 )
+	{
+		threads = 1;
+	}
+
+	// arguments after options
 	if(optind < argc)
 	{
 		// info [OPTIONS] [record.bits]
 		record_path = argv[optind++];
 	}
 
+	if(optind < argc)
+	{
+		// info [OPTIONS] [record.bits] [other.bits]
+		other_path = argv[optind++];
+	}
+
 	if(optind < argc)
 	{
 		message(WARN "Too much options :( Read the source code!\n");
 	}
 
 	// load the record
-	char *record = record_load(&exponent_limit, record_path);
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDONLY) )
+	{
+		exit(0);
+	}
 
 	// create prime table
 	char *primes = (char *)load_prime_table(exponent_limit);
@@ -224,9 +302,38 @@ int main(int argc, char *argv[])
 	}
 
 	// print the summary
-	summary(record, exponent_limit, primes);
+	summary((const char *)record.bits, exponent_limit, primes);
+
+	struct mp_record other;
+	if( other_path )
+	{
+		if( mp_record_open(&other, other_path, &exponent_limit, MP_RECORD_RDONLY) )
+		{
+			exit(0);
+		}
+
+		summary((const char *)other.bits, exponent_limit, primes);
+	}
+
+	if( bucket_size > 0 )
+	{
+		const char *paths[2] = { record_path, other_path };
+		const uint8_t *records[2] = { record.bits, other_path ? other.bits : NULL };
+
+		if( NULL == output_path )
+		{
+			output_path = json ? "info.json" : "info.csv";
+		}
+
+		histogram(output_path, json, bucket_size, threads, paths, records, exponent_limit, primes);
+	}
+
+	if( other_path )
+	{
+		mp_record_close(&other);
+	}
 
-	free(record);
+	mp_record_close(&record);
 	free(primes);
 
 	message("The program has finished.\n");
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <libmp.h>
+#include <journal.h>
+
+struct entry {
+	int n;
+	uint128_t q;
+};
+
+static
+int entry_cmp(const void *p1, const void *p2)
+{
+	const struct entry *e1 = p1;
+	const struct entry *e2 = p2;
+
+	if( e1->n != e2->n )
+		return e1->n < e2->n ? -1 : +1;
+
+	if( e1->q != e2->q )
+		return e1->q < e2->q ? -1 : +1;
+
+	return 0;
+}
+
+// append all entries of the journal to the array
+int journal_load(const char *path, struct entry **entries, size_t *count, size_t *capacity)
+{
+	struct mp_journal_reader reader;
+
+	if( mp_journal_reader_open(&reader, path) )
+	{
+		return -1;
+	}
+
+	size_t loaded = 0;
+
+	for(struct entry e; mp_journal_next(&reader, &e.n, &e.q) > 0; loaded++)
+	{
+		if( *count == *capacity )
+		{
+			*capacity = *capacity ? 2 * *capacity : 4096;
+			*entries = realloc(*entries, *capacity * sizeof(struct entry));
+
+			if( NULL == *entries )
+			{
+				message(ERR "Unable to allocate memory :(\n");
+				exit(0);
+			}
+		}
+
+		(*entries)[(*count)++] = e;
+	}
+
+	mp_journal_reader_close(&reader);
+
+	message("Loaded %zu eliminations from '%s'.\n", loaded, path);
+
+	return 0;
+}
+
+// journal [-n EXP] [-l] [-o OUTPUT] [-r RECORD] [JOURNAL...]
+int main(int argc, char *argv[])
+{
+	message("%s: Sieve of Mersenne exponents, index the journals by exponent\n", argv[0]);
+
+	// default options
+	int exponent = 0; // all of them
+	int list = 0;
+	const char *output_path = NULL;
+	const char *record_path = NULL;
+
+	// parse command-line options
+	for(int opt; (opt = getopt(argc, argv, "n:lo:r:")) != -1;)
+	{
+		switch(opt)
+		{
+			// -n EXP : print the factors of M(EXP)
+			case 'n':
+				exponent = atoi(optarg);
+				list = 1;
+				break;
+			// -l : print all the factors
+			case 'l':
+				list = 1;
+				break;
+			// -o FILE : write the sorted and deduplicated journal
+			case 'o':
+				output_path = optarg;
+				break;
+			// -r FILE : the journal of the record FILE (FILE.journal)
+			case 'r':
+				record_path = optarg;
+				break;
+			default :
+				message(WARN "Unknown option :( Read the source code!\n");
+		}
+	}
+
+	struct entry *entries = NULL;
+	size_t count = 0;
+	size_t capacity = 0;
+
+	// the journal of the default record if nothing else is given
+	if( NULL == record_path && optind == argc )
+	{
+		record_path = "record.bits";
+	}
+
+	if( record_path )
+	{
+		char path[4096];
+
+		if( (size_t)snprintf(path, sizeof(path), "%s.journal", record_path) >= sizeof(path) )
+		{
+			message(ERR "The record path is too long!\n");
+			exit(0);
+		}
+
+		journal_load(path, &entries, &count, &capacity);
+	}
+
+	for(; optind < argc; optind++)
+	{
+		journal_load(argv[optind], &entries, &count, &capacity);
+	}
+
+	qsort(entries, count, sizeof(struct entry), entry_cmp);
+
+	// drop the duplicates, e.g. found by several nodes
+	size_t unique = 0;
+	size_t exponents = 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if( unique > 0 && 0 == entry_cmp(&entries[unique-1], &entries[i]) )
+			continue;
+
+		if( 0 == unique || entries[unique-1].n != entries[i].n )
+			exponents++;
+
+		entries[unique++] = entries[i];
+	}
+
+	message("%zu eliminations (%zu unique factors) of %zu exponents in total.\n", count, unique, exponents);
+
+	if( list )
+	{
+		char buf[40];
+
+		for(size_t i = 0; i < unique; i++)
+		{
+			if( exponent && entries[i].n != exponent )
+				continue;
+
+			printf("%i %s\n", entries[i].n, mp_uint128_to_str(buf, entries[i].q));
+		}
+	}
+
+	if( output_path )
+	{
+		struct mp_journal journal;
+
+		if( 0 == access(output_path, F_OK) && -1 == unlink(output_path) )
+		{
+			message(ERR "Unable to replace '%s' :(\n", output_path);
+			exit(0);
+		}
+
+		if( mp_journal_open(&journal, output_path) )
+		{
+			exit(0);
+		}
+
+		for(size_t i = 0; i < unique; i++)
+		{
+			mp_journal_add(&journal, entries[i].n, entries[i].q);
+		}
+
+		mp_journal_close(&journal);
+
+		message("Written %" PRIu64 " eliminations (%" PRIu64 " bytes) into '%s'.\n", journal.entries, journal.bytes, output_path);
+	}
+
+	free(entries);
+
+	message("The program has finished.\n");
+
+	return 0;
+}
@@ -1,141 +1,133 @@
+#include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <strings.h>
 #include <libmp.h>
+#include <record.h>
+#include <delta.h>
+#include <bitmap.h>
 
 // merge records
-void record_merge(char *output_record, const char *input_record, int exponent_limit)
+void record_merge(uint8_t *output_record, const uint8_t *input_record, int exponent_limit)
 {
-	size_t size = (size_t)(exponent_limit+7)/8;
-
-	for(size_t i = 0; i < size; i++)
-	{
-		output_record[i] |= input_record[i];
-	}
+	mp_bitmap_or(output_record, input_record, (size_t)(exponent_limit+7)/8);
 }
 
-// load the record
-char *record_load(int *p_exponent_limit, const char *record_path)
+// a record the deltas may have been taken against
+struct base {
+	uint32_t crc;
+	uint64_t size;
+};
+
+struct head {
+	int n; // the smallest exponent not merged yet
+	struct mp_delta_reader *reader;
+};
+
+static
+void heap_down(struct head *heap, size_t size, size_t i)
 {
-	char *record;
-	message("Loading the record from '%s'...\n", record_path);
-	FILE *record_file = fopen(record_path, "rb");
-	if( NULL == record_file )
+	while( 2*i+1 < size )
 	{
-		// exponent_limit is unset, use default
-		if( -1 == *p_exponent_limit )
-		{
-			*p_exponent_limit = 256*1024*1024; // up to 268M
-		}
+		size_t c = 2*i+1;
 
-		// no record file, start a new test
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
-		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
-			exit(0);
-		}
+		if( c+1 < size && heap[c+1].n < heap[c].n )
+			c++;
 
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+		if( heap[i].n <= heap[c].n )
+			break;
 
-		message("There is no record. Created a new record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+		struct head t = heap[i];
+		heap[i] = heap[c];
+		heap[c] = t;
+
+		i = c;
 	}
-	else
-	{
-		// detect the highest exponent from the existing record using fstat
-		fseek(record_file, 0L, SEEK_END);
-		long detected_exponent_limit = ftell(record_file) * 8;
-		rewind(record_file);
+}
 
-		// exponent_limit is unset, use fstat
-		if( -1 == *p_exponent_limit )
-		{
-			message("The highest exponent in the record is %li (detected).\n", detected_exponent_limit);
-			*p_exponent_limit = detected_exponent_limit;
-		}
+// merge the sorted deltas in one pass, in ascending order of exponents
+void delta_merge(struct mp_record *output_record, const char **paths, size_t count, const struct base *bases, size_t base_count)
+{
+	struct mp_delta_reader *readers = malloc(count * sizeof(struct mp_delta_reader));
+	struct head *heap = malloc(count * sizeof(struct head));
 
-		// if exponent_limit <> fstat, print a warning
-		if( *p_exponent_limit < detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is less than the detected one (%li)! The record will be truncated.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
-		if( *p_exponent_limit > detected_exponent_limit )
-		{
-			message(WARN "Forced exponent limit (%i) is is greater than the detected one (%li)! The record will be extended.\n",
-				*p_exponent_limit, detected_exponent_limit
-			);
-		}
+	if( NULL == readers || NULL == heap )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		exit(0);
+	}
 
-		// read the record content
-		record = malloc( (size_t)(*p_exponent_limit+7)/8 );
-		if( NULL == record )
+	size_t size = 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if( mp_delta_reader_open(&readers[i], paths[i]) )
 		{
-			message(ERR "Unable to allocate memory :( %zu bytes requested.\n", (size_t)(*p_exponent_limit+7)/8);
 			exit(0);
 		}
 
-		// all zeros implicitly
-		bzero(record, (size_t)(*p_exponent_limit+7)/8);
+		size_t b = 0;
 
-		// loop over the record
-		if( (size_t)(*p_exponent_limit+7)/8 != fread(record, (size_t)1, (size_t)(*p_exponent_limit+7)/8, record_file) )
+		// the output contains the original output and all the input records
+		while( b < base_count && (readers[i].base_crc != bases[b].crc || readers[i].base_size != bases[b].size) )
+			b++;
+
+		if( b == base_count )
 		{
-			message(ERR "Unable to read from the record :( The file may be corrupted!\n");
+			message(WARN "The delta '%s' was taken against a different base record, merging anyway.\n", paths[i]);
 		}
 
-		message("Loaded an existing record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
-			(*p_exponent_limit),
-			(*p_exponent_limit + (1<<23) - 1)>>23,
-			(*p_exponent_limit + (1<<23) - 1)>>23
-		);
+		heap[size].reader = &readers[i];
 
-		fclose(record_file);
+		if( mp_delta_next(&readers[i], &heap[size].n) > 0 )
+			size++;
 	}
 
-	return record;
-}
+	for(size_t i = size/2; i-- > 0;)
+	{
+		heap_down(heap, size, i);
+	}
 
-// save the record
-void record_save(char *record, int exponent_limit, const char *record_path)
-{
-	message("Saving the record to '%s'...\n", record_path);
+	size_t total = 0;
+	size_t fresh = 0;
+	size_t dropped = 0;
 
-	// remove backup copy
-	char backup_path[4096];
-	sprintf(backup_path, "%s.bak", record_path);
-	unlink(backup_path);
+	while( size > 0 )
+	{
+		int n = heap[0].n;
 
-	// rename a previous record
-	rename(record_path, backup_path);
+		total++;
 
-	// create new record
-	FILE *record_file = fopen(record_path, "w");
-	if( NULL == record_file )
-	{
-		message(ERR "Unable to save the record :(\n");
-		return;
+		if( n >= output_record->exponent_limit )
+			dropped++;
+		else if( !mp_record_set_bit(output_record, n) )
+			fresh++;
+
+		if( mp_delta_next(heap[0].reader, &heap[0].n) <= 0 )
+			heap[0] = heap[--size];
+
+		heap_down(heap, size, 0);
 	}
 
-	// loop over the record
-	if( (size_t)(exponent_limit+7)/8 != fwrite(record, (size_t)1, (size_t)(exponent_limit+7)/8, record_file) )
+	for(size_t i = 0; i < count; i++)
 	{
-		message(ERR "Unable to write into the record :( The file is incomplete!\n");
+		mp_delta_reader_close(&readers[i]);
 	}
 
-	fclose(record_file);
+	message("%zu deltas have been merged: %zu exponents, %zu of them newly eliminated.\n", count, total, fresh);
 
-	message("The record was saved successfully.\n");
+	if( dropped > 0 )
+	{
+		message(WARN "%zu exponents are above the exponent limit (%i) and were dropped! Increase the limit (-h).\n", dropped, output_record->exponent_limit);
+	}
+
+	free(heap);
+	free(readers);
 }
 
-// merge [-o output] [input1] [... inputN]
+// merge [-o output] [input1] [... inputN], an input is a record or a delta
 int main(int argc, char *argv[])
 {
 	message("%s: Sieve of Mersenne exponents, record merger\n", argv[0]);
@@ -172,11 +164,15 @@ int main(int argc, char *argv[])
 	}
 
 	// open output record
-	char *output_record = record_load(&exponent_limit, output_path);
+	struct mp_record output_record;
+	if( mp_record_open(&output_record, output_path, &exponent_limit, MP_RECORD_RDWR) )
+	{
+		exit(0);
+	}
 
 	if(reset)
 	{
-		bzero(output_record, (size_t)(exponent_limit+7)/8);
+		bzero(output_record.bits, output_record.size);
 		message("Resetting the record... Created empty record of %i exponents in size (%i MiB in memory, %i MiB in file)!\n",
 			(exponent_limit),
 			(exponent_limit + (1<<23) - 1)>>23,
@@ -184,24 +180,63 @@ int main(int argc, char *argv[])
 		);
 	}
 
+	const char **delta_paths = malloc((size_t)argc * sizeof(const char *));
+	size_t deltas = 0;
+	struct base *bases = malloc((size_t)argc * sizeof(struct base));
+	size_t base_count = 0;
+
+	if( NULL == delta_paths || NULL == bases )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		exit(0);
+	}
+
+	// before any input is merged into it
+	bases[base_count].crc = mp_crc32(0, output_record.bits, output_record.size);
+	bases[base_count].size = (uint64_t)output_record.size;
+	base_count++;
+
 	// for each input record
 	while(optind < argc)
 	{
 		const char *input_path = argv[optind++];
 
-		char *input_record = record_load(&exponent_limit, input_path);
+		// the deltas are merged at once at the end
+		if( mp_delta_probe(input_path) )
+		{
+			delta_paths[deltas++] = input_path;
+			continue;
+		}
+
+		struct mp_record input_record;
+		if( mp_record_open(&input_record, input_path, &exponent_limit, MP_RECORD_RDONLY) )
+		{
+			exit(0);
+		}
+
+		bases[base_count].crc = mp_crc32(0, input_record.bits, input_record.size);
+		bases[base_count].size = (uint64_t)input_record.size;
+		base_count++;
 
-		record_merge(output_record, input_record, exponent_limit);
+		record_merge(output_record.bits, input_record.bits, exponent_limit);
 
 		message("'%s' has been merged.\n", input_path);
 
-		free(input_record);
+		mp_record_close(&input_record);
 	}
 
+	if( deltas > 0 )
+	{
+		delta_merge(&output_record, delta_paths, deltas, bases, base_count);
+	}
+
+	free(delta_paths);
+	free(bases);
+
 	// save the record
-	record_save(output_record, exponent_limit, output_path);
+	mp_record_sync(&output_record);
 
-	free(output_record);
+	mp_record_close(&output_record);
 
 	message("The program has finished.\n");
 
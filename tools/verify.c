@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <libmp.h>
+#include <record.h>
+#include <journal.h>
+#include <mont.h>
+
+// entries verified in parallel at once
+#define BATCH (1<<20)
+
+// moduli passed to the kernels at once
+#define CHUNK 4096
+
+struct entry {
+	int n;
+	uint128_t q;
+};
+
+// a journal or a text list of "n q" lines
+struct source {
+	const char *path;
+	struct mp_journal_reader reader;
+	FILE *file;
+};
+
+struct context {
+	const struct entry *entries;
+	size_t count;
+	int exponent_limit;
+	const char *primes;
+	uint8_t *supported; // bits of exponents with a valid certificate
+	size_t invalid;
+	size_t beyond; // valid, but out of the record
+};
+
+struct job {
+	struct context *ctx;
+	size_t begin, end;
+	size_t invalid;
+	size_t beyond;
+	pthread_t thread;
+};
+
+static
+int get_bit(const char *ptr, int i)
+{
+	return ptr[i/8] & 1 << i%8;
+}
+
+static
+int is_prime(int p, const char *primes)
+{
+	return !get_bit(primes, p);
+}
+
+int source_open(struct source *source, const char *path)
+{
+	source->path = path;
+	source->file = fopen(path, "rb");
+
+	if( NULL == source->file )
+	{
+		message(ERR "Unable to open '%s' :(\n", path);
+		return -1;
+	}
+
+	char magic[4];
+
+	if( sizeof(magic) == fread(magic, 1, sizeof(magic), source->file) && 0 == memcmp(magic, "MPJ1", sizeof(magic)) )
+	{
+		fclose(source->file);
+		source->file = NULL;
+
+		return mp_journal_reader_open(&source->reader, path);
+	}
+
+	rewind(source->file);
+
+	return 0;
+}
+
+void source_close(struct source *source)
+{
+	if( source->file )
+		fclose(source->file);
+	else
+		mp_journal_reader_close(&source->reader);
+}
+
+// 1 for an entry, 0 at the end
+int source_next(struct source *source, int *n, uint128_t *q)
+{
+	if( NULL == source->file )
+		return mp_journal_next(&source->reader, n, q) > 0;
+
+	char line[256];
+
+	while( fgets(line, sizeof(line), source->file) )
+	{
+		char *ptr = line;
+
+		// skip comments and log lines
+		if( *ptr < '0' || *ptr > '9' )
+			continue;
+
+		*n = (int)strtol(ptr, &ptr, 10);
+
+		while( ' ' == *ptr || '\t' == *ptr )
+			ptr++;
+
+		if( *ptr < '0' || *ptr > '9' )
+			continue;
+
+		*q = 0;
+
+		for(; *ptr >= '0' && *ptr <= '9'; ptr++)
+			*q = *q * 10 + (uint128_t)(*ptr - '0');
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static
+void report_invalid(int n, uint128_t q, const char *reason)
+{
+	char buf[40];
+
+	message(WARN "Invalid certificate: %s does not eliminate M(%i), %s!\n", mp_uint128_to_str(buf, q), n, reason);
+}
+
+// check the entries [begin; end)
+void *verify_job(void *ptr)
+{
+	struct job *job = ptr;
+	const struct context *ctx = job->ctx;
+
+	uint64_t q64[CHUNK], e64[CHUNK], r64[CHUNK];
+	uint128_t q128[CHUNK], e128[CHUNK], r128[CHUNK];
+	size_t i64[CHUNK], i128[CHUNK];
+
+	for(size_t begin = job->begin; begin < job->end; begin += CHUNK)
+	{
+		size_t end = job->end - begin < CHUNK ? job->end : begin + CHUNK;
+		size_t c64 = 0, c128 = 0;
+
+		// sort the entries out by the size of the factor
+		for(size_t i = begin; i < end; i++)
+		{
+			const struct entry *e = &ctx->entries[i];
+
+			if( e->n < 2 || !(e->q & 1) || e->q < 3 || e->q >> 127 )
+			{
+				report_invalid(e->n, e->q, "malformed");
+				job->invalid++;
+				continue;
+			}
+
+			if( e->n < ctx->exponent_limit && !is_prime(e->n, ctx->primes) )
+			{
+				report_invalid(e->n, e->q, "the exponent is not a prime");
+				job->invalid++;
+				continue;
+			}
+
+			// M(n) itself
+			if( e->n < 128 && e->q == (UINT128_1 << e->n) - 1 )
+			{
+				report_invalid(e->n, e->q, "it is the Mersenne number itself");
+				job->invalid++;
+				continue;
+			}
+
+			if( e->q >> 63 )
+			{
+				q128[c128] = e->q;
+				e128[c128] = (uint128_t)e->n;
+				i128[c128++] = i;
+			}
+			else
+			{
+				q64[c64] = (uint64_t)e->q;
+				e64[c64] = (uint64_t)e->n;
+				i64[c64++] = i;
+			}
+		}
+
+		mp_uint64_pow2_mod_batch(c64, q64, e64, r64);
+		mp_uint128_pow2_mod_batch(c128, q128, e128, r128);
+
+		for(size_t j = 0; j < c64 + c128; j++)
+		{
+			int valid = j < c64 ? 1 == r64[j] : 1 == r128[j - c64];
+			const struct entry *e = &ctx->entries[j < c64 ? i64[j] : i128[j - c64]];
+
+			if( !valid )
+			{
+				report_invalid(e->n, e->q, "2^n != 1 (mod q)");
+				job->invalid++;
+			}
+			else if( e->n >= ctx->exponent_limit )
+			{
+				job->beyond++;
+			}
+			else
+			{
+				__atomic_fetch_or(&ctx->supported[e->n/8], (uint8_t)(1 << e->n%8), __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+// verify the batch on all threads
+void verify(struct context *ctx, int threads)
+{
+	struct job jobs[threads];
+
+	for(int t = 0; t < threads; t++)
+	{
+		jobs[t].ctx = ctx;
+		jobs[t].begin = ctx->count * (size_t)t / (size_t)threads;
+		jobs[t].end = ctx->count * (size_t)(t+1) / (size_t)threads;
+		jobs[t].invalid = 0;
+		jobs[t].beyond = 0;
+
+		if( pthread_create(&jobs[t].thread, NULL, verify_job, &jobs[t]) )
+		{
+			message(ERR "Unable to start a thread :(\n");
+			exit(0);
+		}
+	}
+
+	for(int t = 0; t < threads; t++)
+	{
+		pthread_join(jobs[t].thread, NULL);
+
+		ctx->invalid += jobs[t].invalid;
+		ctx->beyond += jobs[t].beyond;
+	}
+}
+
+// verify [-h EXP] [-t THREADS] [-r RECORD] [-l] FILE...
+int main(int argc, char *argv[])
+{
+	message("%s: Sieve of Mersenne exponents, verify the certificates\n", argv[0]);
+
+	// default options
+	int exponent_limit = -1;
+	const char *record_path = "merged.bits";
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int list = 0;
+
+	// parse command-line options
+	for(int opt; (opt = getopt(argc, argv, "h:t:r:l")) != -1;)
+	{
+		switch(opt)
+		{
+			// -h EXP : highest exponent in the record
+			case 'h':
+				exponent_limit = atoi(optarg);
+				if( exponent_limit < 2 )
+				{
+					message(WARN "Invalid exponent, keeping the default one!\n");
+					exponent_limit = -1;
+				}
+				break;
+			// -t THREADS : number of threads
+			case 't':
+				threads = atoi(optarg);
+				break;
+			// -r FILE : the record to audit
+			case 'r':
+				record_path = optarg;
+				break;
+			// -l : list all unsupported exponents
+			case 'l':
+				list = 1;
+				break;
+			default :
+				message(WARN "Unknown option :( Read the source code!\n");
+		}
+	}
+
+	if( threads < 1 )
+	{
+		threads = 1;
+	}
+
+	if( optind == argc )
+	{
+		message(ERR "No journal or factor list given :( Read the source code!\n");
+		exit(0);
+	}
+
+	// load the record
+	struct mp_record record;
+	if( mp_record_open(&record, record_path, &exponent_limit, MP_RECORD_RDONLY) )
+	{
+		exit(0);
+	}
+
+	// create prime table
+	char *primes = (char *)load_prime_table(exponent_limit);
+	if( NULL == primes )
+	{
+		primes = (char *)gen_prime_table(exponent_limit);
+		save_prime_table((uint8_t *)primes, exponent_limit);
+	}
+
+	struct context ctx;
+
+	ctx.exponent_limit = exponent_limit;
+	ctx.primes = primes;
+	ctx.supported = calloc((size_t)(exponent_limit+7)/8, 1);
+	ctx.invalid = 0;
+	ctx.beyond = 0;
+
+	struct entry *entries = malloc(BATCH * sizeof(struct entry));
+
+	if( NULL == ctx.supported || NULL == entries )
+	{
+		message(ERR "Unable to allocate memory :(\n");
+		exit(0);
+	}
+
+	ctx.entries = entries;
+
+	message("Verifying on %i threads...\n", threads);
+
+	struct timespec tp0, tp1;
+	clock_gettime(CLOCK_MONOTONIC, &tp0);
+
+	size_t total = 0;
+
+	for(; optind < argc; optind++)
+	{
+		struct source source;
+
+		if( source_open(&source, argv[optind]) )
+		{
+			continue;
+		}
+
+		size_t loaded = 0;
+
+		do {
+			ctx.count = 0;
+
+			while( ctx.count < BATCH && source_next(&source, &entries[ctx.count].n, &entries[ctx.count].q) )
+				ctx.count++;
+
+			verify(&ctx, threads);
+
+			loaded += ctx.count;
+		} while( BATCH == ctx.count );
+
+		source_close(&source);
+
+		message("Verified %zu certificates from '%s'.\n", loaded, argv[optind]);
+
+		total += loaded;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tp1);
+
+	double secs = (double)(tp1.tv_sec - tp0.tv_sec) + (double)(tp1.tv_nsec - tp0.tv_nsec) * 1e-9;
+
+	message("%zu certificates verified in %f seconds (%f millions per second): %zu invalid, %zu beyond the record.\n",
+		total, secs, secs > 0. ? (double)total / secs * 1e-6 : 0., ctx.invalid, ctx.beyond);
+
+	// bits without a certificate
+	size_t unsupported = 0;
+	size_t missing = 0;
+
+	for(int n = 0; n < exponent_limit; n++)
+	{
+		int set = mp_record_get_bit(&record, n) != 0;
+		int proven = get_bit((const char *)ctx.supported, n) != 0;
+
+		if( set && !proven )
+		{
+			if( list || unsupported < 10 )
+				message(WARN "M(%i) is eliminated in the record, but has no certificate.\n", n);
+
+			unsupported++;
+		}
+
+		if( !set && proven )
+		{
+			missing++;
+		}
+	}
+
+	message("%zu eliminated exponents without a certificate, %zu certified exponents missing in the record.\n", unsupported, missing);
+
+	free(entries);
+	free(ctx.supported);
+	mp_record_close(&record);
+	free(primes);
+
+	message("The program has finished.\n");
+
+	return 0;
+}